@@ -0,0 +1,180 @@
+#include "compiler.h"
+#include "package.h"
+#include "cache.h"
+#include "scanner/scanner.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+// Startup benchmark. Tokenizes a generated script and an identifier heavy text, then
+// compiles the script on one thread, on every core, through a cold and a warm
+// compilation cache, lazily, and again after editing one function. Every function of the
+// script calls the same generic function.
+// usage: bench [functions] [runs]
+
+static const char* cache_dir = "bench_cache";
+
+static double now_ms() {
+    struct timespec ts;
+    timespec_get(&ts, TIME_UTC);
+    return ts.tv_sec * 1000.0 + ts.tv_nsec / 1000000.0;
+}
+
+static char* generate(size_t functions) {
+    const char* generic =
+        "fn twice(Any n) -> Int {\n"
+        "    return n + n;\n"
+        "}\n";
+    const char* function =
+        "fn f%zu(Int n) -> Int {\n"
+        "    Int sum := 0;\n"
+        "    [Int] values := [1, 2, 3, 4];\n"
+        "    for v in values: sum := sum + v * n;\n"
+        "    for i in 0..n: {\n"
+        "        if i < n / 2: sum := sum + i;\n"
+        "        else sum := sum - 1;\n"
+        "    }\n"
+        "    fn inner() -> Int { return sum + %zu; }\n"
+        "    return inner() + twice(n);\n"
+        "}\n";
+
+    size_t capacity = (strlen(function) + 64) * functions + strlen(generic) + 64;
+    char* source = malloc(capacity);
+    char* c = source + sprintf(source, "%s", generic);
+    for (size_t i = 0; i < functions; ++i) {
+        c += sprintf(c, function, i, i);
+    }
+    sprintf(c, "fn main() { f0(10); }\n");
+    return source;
+}
+
+// keywords mixed with identifiers that share their length and first characters
+static char* generate_identifiers(size_t size) {
+    static const char* words[] = {
+        "return", "result", "while", "whilst", "for", "format", "Int", "Integer", "if", "index",
+        "match", "matcher", "String", "Strings", "else", "elsewhere", "true", "truth", "fn", "fun"
+    };
+    const size_t count = sizeof(words) / sizeof(words[0]);
+
+    char* text = malloc(size + 16);
+    size_t length = 0;
+    for (size_t i = 0; length < size; ++i) {
+        length += sprintf(text + length, "%s ", words[(i * 7) % count]);
+    }
+    return text;
+}
+
+static void clear_cache(const char* source, const struct mtr_compile_options* options) {
+    char* path = mtr_cache_path(cache_dir, mtr_cache_key(source, mtr_compile_flags(options)));
+    remove(path);
+    free(path);
+}
+
+static double measure(const char* source, const struct mtr_compile_options* options, bool cold) {
+    if (cold) {
+        clear_cache(source, options);
+    }
+
+    struct mtr_package package;
+    mtr_init_package(&package);
+
+    double start = now_ms();
+    enum mtr_exit_code ec = mtr_compile_with_options(source, &package, options);
+    double end = now_ms();
+
+    mtr_delete_package(&package);
+    if (ec != MTR_OK) {
+        fprintf(stderr, "Compilation failed (%d)\n", ec);
+        exit(1);
+    }
+    return end - start;
+}
+
+// compiles source, then times compiling edited with what is left of that
+static double measure_edit(const char* source, const char* edited) {
+    struct mtr_incremental incremental;
+    mtr_init_incremental(&incremental);
+    const struct mtr_compile_options options = { .cache = NULL, .incremental = &incremental };
+    measure(source, &options, false);
+    double time = measure(edited, &options, false);
+    mtr_delete_incremental(&incremental);
+    return time;
+}
+
+static double measure_scan(const char* source) {
+    double start = now_ms();
+    struct mtr_scanner scanner;
+    mtr_scanner_init(&scanner, source);
+    while (mtr_next_token(&scanner).type != MTR_TOKEN_EOF);
+    return now_ms() - start;
+}
+
+static double report(const char* name, double* samples, size_t runs) {
+    double best = samples[0];
+    double total = 0.0;
+    for (size_t i = 0; i < runs; ++i) {
+        best = samples[i] < best ? samples[i] : best;
+        total += samples[i];
+    }
+    printf("%-10s best %9.3f ms   mean %9.3f ms\n", name, best, total / runs);
+    return best;
+}
+
+static void report_scan(const char* name, const char* text, double* samples, size_t runs) {
+    for (size_t i = 0; i < runs; ++i) samples[i] = measure_scan(text);
+    double best = report(name, samples, runs);
+    printf("%-10s %9.1f MB/s\n", "", strlen(text) / (best * 1000.0));
+}
+
+int main(int argc, char** argv) {
+    size_t functions = argc > 1 ? strtoul(argv[1], NULL, 10) : 2000;
+    size_t runs = argc > 2 ? strtoul(argv[2], NULL, 10) : 5;
+    runs = runs == 0 ? 1 : runs;
+
+    char* source = generate(functions);
+    printf("%zu functions, %zu bytes of source, %zu runs\n", functions, strlen(source), runs);
+
+    const struct mtr_compile_options serial = { .cache = NULL, .threads = 1 };
+    const struct mtr_compile_options parallel = { .cache = NULL };
+    const struct mtr_compile_options with_cache = { .cache = cache_dir };
+    const struct mtr_compile_options lazy = { .cache = NULL, .lazy = true };
+
+    double* samples = malloc(sizeof(double) * runs);
+
+    report_scan("scan", source, samples, runs);
+
+    char* identifiers = generate_identifiers(strlen(source));
+    report_scan("keywords", identifiers, samples, runs);
+    free(identifiers);
+
+    for (size_t i = 0; i < runs; ++i) samples[i] = measure(source, &serial, false);
+    report("serial", samples, runs);
+
+    for (size_t i = 0; i < runs; ++i) samples[i] = measure(source, &parallel, false);
+    report("parallel", samples, runs);
+
+    for (size_t i = 0; i < runs; ++i) samples[i] = measure(source, &lazy, false);
+    report("lazy", samples, runs);
+
+    char* edited = malloc(strlen(source) + 1);
+    strcpy(edited, source);
+    strstr(edited, "Int sum := 0;")[11] = '1';
+    for (size_t i = 0; i < runs; ++i) samples[i] = measure_edit(source, edited);
+    report("edit", samples, runs);
+    free(edited);
+
+    for (size_t i = 0; i < runs; ++i) samples[i] = measure(source, &with_cache, true);
+    report("cold", samples, runs);
+
+    for (size_t i = 0; i < runs; ++i) samples[i] = measure(source, &with_cache, false);
+    report("warm", samples, runs);
+
+    clear_cache(source, &with_cache);
+    remove(cache_dir);
+
+    free(samples);
+    free(source);
+    return 0;
+}
@@ -2,6 +2,8 @@
 #define MTR_AST_H
 
 #include "typeList.h"
+#include "core/arena.h"
+#include "scanner/names.h"
 #include "scanner/token.h"
 #include "symbol.h"
 
@@ -16,7 +18,8 @@ enum mtr_expr_type {
     MTR_EXPR_CALL,
     MTR_EXPR_CAST,
     MTR_EXPR_SUBSCRIPT,
-    MTR_EXPR_ACCESS
+    MTR_EXPR_ACCESS,
+    MTR_EXPR_VARIANT
 };
 
 struct mtr_expr {
@@ -78,6 +81,7 @@ struct mtr_call {
     struct mtr_expr expr_;
     struct mtr_expr* callable;
     struct mtr_expr** argv;
+    const struct mtr_union_type* returns; // set by the validator when the call returns a union, natives don't tag their results
     u8 argc;
 };
 
@@ -87,6 +91,13 @@ struct mtr_access {
     struct mtr_expr* element;
 };
 
+// inserted by the validator when a member value is stored into a union
+struct mtr_variant {
+    struct mtr_expr expr_;
+    struct mtr_expr* value;
+    u16 tag;
+};
+
 enum mtr_stmt_type {
     MTR_STMT_ASSIGNMENT,
     MTR_STMT_STRUCT,
@@ -98,6 +109,8 @@ enum mtr_stmt_type {
     MTR_STMT_VAR,
     MTR_STMT_IF,
     MTR_STMT_WHILE,
+    MTR_STMT_FOR,
+    MTR_STMT_MATCH,
     MTR_STMT_BLOCK,
     MTR_STMT_SCOPE,
     MTR_STMT_CALL,
@@ -128,6 +141,44 @@ struct mtr_while {
     struct mtr_expr* condition;
 };
 
+enum mtr_for_kind {
+    MTR_FOR_RANGE,
+    MTR_FOR_ARRAY,
+    MTR_FOR_MAP
+};
+
+// for a in b..c: / for x in array: / for k, v in map:
+// The loop keeps its state in hidden slots starting at 'slot':
+// range: counter, end | array/map: object, index. The bound variables follow.
+struct mtr_for {
+    struct mtr_stmt stmt;
+    struct mtr_stmt* body;
+    struct mtr_expr* iterable;  // range start for range loops
+    struct mtr_expr* end;       // NULL unless this is a range loop
+    struct mtr_symbol first;
+    struct mtr_symbol second;   // the map value. token is invalid when missing
+    enum mtr_for_kind kind;
+    u16 slot;
+};
+
+struct mtr_match_case {
+    struct mtr_symbol symbol; // the member type and the name it is bound to
+    struct mtr_stmt* body;
+    u16 variant;
+};
+
+// match value: { Int i: ...; String s: ...; else: ...; }
+struct mtr_match {
+    struct mtr_stmt stmt;
+    struct mtr_token token;
+    struct mtr_expr* expr;
+    struct mtr_match_case* cases;
+    struct mtr_stmt* otherwise;
+    u16 count;
+    u16 capacity;
+    u16 variants; // members in the union, set by the validator
+};
+
 struct mtr_variable {
     struct mtr_stmt stmt;
     struct mtr_symbol symbol;
@@ -141,9 +192,12 @@ struct mtr_variable {
 struct mtr_function_decl {
     struct mtr_stmt stmt;
     struct mtr_stmt* body;
+    const char* deferred; // where the body starts when it is parsed later (see mtr_parse_body)
+    size_t deferred_length; // up to and including the closing '}'
     struct mtr_symbol symbol;
     struct mtr_variable* argv;
     u8 argc;
+    bool generic; // has 'Any' parameters. Only its specializations get compiled
 };
 
 struct mtr_closure_decl {
@@ -184,14 +238,23 @@ struct mtr_call_stmt {
     struct mtr_expr* call;
 };
 
+// Every node and every array hanging from a node lives in the arena, so the tree is
+// freed all at once and nodes dropped during validation don't have to be freed.
 struct mtr_ast {
     struct mtr_stmt* head;
     struct mtr_type_list type_list;
+    struct mtr_names names; // of every identifier in the source
+    struct mtr_arena arena;
     const char* source;
+    struct mtr_token* imports; // paths of the imported modules (see module.h)
+    size_t import_count;
+    size_t import_capacity;
 };
 
-void mtr_free_stmt(struct mtr_stmt* s);
-void mtr_free_expr(struct mtr_expr* node);
+struct mtr_stmt* mtr_copy_stmt(struct mtr_arena* arena, const struct mtr_stmt* s);
+struct mtr_expr* mtr_copy_expr(struct mtr_arena* arena, const struct mtr_expr* node);
+
+void mtr_block_append(struct mtr_arena* arena, struct mtr_block* block, struct mtr_stmt* s);
 
 void mtr_delete_ast(struct mtr_ast* ast);
 
@@ -10,7 +10,7 @@
 
 
 struct mtr_type mtr_get_data_type(struct mtr_token type) {
-    struct mtr_type t;
+    struct mtr_type t = { .type = MTR_DATA_INVALID, .id = MTR_NO_TYPE_ID, .exact = false };
     switch (type.type)
     {
     case MTR_TOKEN_INT_LITERAL:
@@ -55,47 +55,6 @@ bool mtr_is_compound_type(const struct mtr_type* type) {
     return type->type > MTR_DATA_STRING;
 }
 
-static void delete_object_type(struct mtr_type* obj) {
-    switch (obj->type) {
-    case MTR_DATA_ARRAY: {
-        struct mtr_array_type* a = (struct mtr_array_type*) obj;
-        return;
-    }
-    case MTR_DATA_MAP: {
-        struct mtr_map_type* m = (struct mtr_map_type*) obj;
-        return;
-    }
-    case MTR_DATA_FN: {
-        struct mtr_function_type* f = (struct mtr_function_type*) obj;
-        free(f->argv);
-        return;
-    }
-    case MTR_DATA_STRUCT: {
-        struct mtr_struct_type* s = (struct mtr_struct_type*) obj;
-        free(s->members);
-        return;
-    }
-    case MTR_DATA_UNION: {
-        struct mtr_union_type* u = (struct mtr_union_type*) obj;
-        free(u->types);
-        return;
-    }
-    case MTR_DATA_USER: {
-        struct mtr_user_type* u = (struct mtr_user_type*) obj;
-        return;
-    }
-    default:
-        break;
-    }
-    MTR_ASSERT(false, "Invalid type.");
-}
-
-void mtr_delete_type(struct mtr_type* type) {
-    if (mtr_is_compound_type(type)) {
-        delete_object_type(type);
-    }
-}
-
 static bool are_user_types(enum mtr_data_type lhs, enum mtr_data_type rhs) {
     return (lhs == MTR_DATA_USER && (rhs == MTR_DATA_STRUCT || rhs == MTR_DATA_UNION))
         || (rhs == MTR_DATA_USER && (lhs == MTR_DATA_STRUCT || lhs == MTR_DATA_UNION));
@@ -145,6 +104,9 @@ static bool object_type_match(const struct mtr_type* lhs, const struct mtr_type*
 
 bool mtr_type_match(const struct mtr_type* lhs, const struct mtr_type* rhs) {
     if (!lhs || !rhs) return false;
+    if (lhs->exact && rhs->exact) {
+        return lhs->id == rhs->id;
+    }
     bool invalid = lhs->type == MTR_DATA_INVALID || rhs->type == MTR_DATA_INVALID;
     bool any = lhs->type == MTR_DATA_ANY || rhs->type == MTR_DATA_ANY;
     bool match = (lhs->type == rhs->type)
@@ -156,6 +118,19 @@ bool mtr_type_match(const struct mtr_type* lhs, const struct mtr_type* rhs) {
     return !invalid && (any || match || user_match);
 }
 
+bool mtr_union_has_member(const struct mtr_union_type* u, const struct mtr_type* type) {
+    if (u->members && type && type->exact) {
+        u32 word = type->id / 64;
+        return word < u->words && (u->members[word] >> (type->id % 64)) & 1;
+    }
+
+    for (u16 i = 0; i < u->argc; ++i) {
+        if (mtr_type_match(u->types[i], type)) {
+            return true;
+        }
+    }
+    return false;
+}
 
 struct mtr_type* mtr_get_underlying_type(const struct mtr_type* type) {
     switch (type->type) {
@@ -25,11 +25,15 @@ enum mtr_data_type {
     MTR_DATA_STRUCT,
 };
 
+// Types are interned in a mtr_type_list, which hands every distinct type a dense id.
+// Exact types only ever match themselves, so comparing two of them is comparing ids.
 struct mtr_type {
     enum mtr_data_type type;
+    u32 id; // MTR_NO_TYPE_ID until interned
+    bool exact; // interned and free of Any and Invalid
 };
 
-void mtr_delete_type(struct mtr_type* type);
+#define MTR_NO_TYPE_ID 0
 
 struct mtr_type mtr_get_data_type(struct mtr_token token);
 bool mtr_is_compound_type(const struct mtr_type* type);
@@ -39,7 +43,7 @@ bool mtr_type_match(const struct mtr_type* lhs, const struct mtr_type* rhs);
 struct mtr_type* mtr_get_underlying_type(const struct mtr_type* type);
 
 // Compound types dont own what they are compounded with (Dont know if you say it like that?)
-// When we free them we only free allocations with in them
+// Everything lives in the arena of the type list
 
 struct mtr_array_type {
     struct mtr_type type;
@@ -67,9 +71,13 @@ struct mtr_user_type {
 struct mtr_union_type {
     struct mtr_user_type name;
     struct mtr_type** types;
+    const u64* members; // bitset over the ids of the exact members, NULL if any member isn't exact
+    u32 words;
     u16 argc;
 };
 
+bool mtr_union_has_member(const struct mtr_union_type* u, const struct mtr_type* type);
+
 struct mtr_struct_type {
     struct mtr_user_type name;
     struct mtr_symbol** members;
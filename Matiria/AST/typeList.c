@@ -10,26 +10,62 @@
 #include <string.h>
 
 // this should be const
-static struct mtr_type invalid_type = {.type = MTR_DATA_INVALID};
-static struct mtr_type any_type = { .type = MTR_DATA_ANY };
-static struct mtr_type void_type = {.type = MTR_DATA_VOID };
-static struct mtr_type bool_type = { .type = MTR_DATA_BOOL };
-static struct mtr_type int_type = { .type = MTR_DATA_INT };
-static struct mtr_type float_type = { .type = MTR_DATA_FLOAT };
-static struct mtr_type string_type = { .type = MTR_DATA_STRING };
+// Basic types are interned from the start, their id is their enum value + 1
+#define BASIC_TYPE(enume, is_exact) { .type = enume, .id = enume + 1, .exact = is_exact }
+static struct mtr_type invalid_type = BASIC_TYPE(MTR_DATA_INVALID, false);
+static struct mtr_type any_type = BASIC_TYPE(MTR_DATA_ANY, false);
+static struct mtr_type void_type = BASIC_TYPE(MTR_DATA_VOID, true);
+static struct mtr_type bool_type = BASIC_TYPE(MTR_DATA_BOOL, true);
+static struct mtr_type int_type = BASIC_TYPE(MTR_DATA_INT, true);
+static struct mtr_type float_type = BASIC_TYPE(MTR_DATA_FLOAT, true);
+static struct mtr_type string_type = BASIC_TYPE(MTR_DATA_STRING, true);
+#undef BASIC_TYPE
 
 struct type_entry {
     struct mtr_type* type;
     size_t hash;
 };
 
+struct type_table {
+    size_t capacity;
+    struct type_entry entries[];
+};
+
+// Function bodies are validated on several threads. Lookups don't lock: an entry is published
+// by its type pointer once everything else about it is written, and a table that fills up is
+// copied into a bigger one instead of being resized in place, so a lookup on the old one still
+// finds what it held. Only inserting goes through the critical section.
+// Without OpenMP the pragmas do nothing.
+
+static struct mtr_type* load_type(struct type_entry* entry) {
+    struct mtr_type* type;
+    #pragma omp atomic read seq_cst
+    type = entry->type;
+    return type;
+}
+
+static struct type_table* load_table(struct mtr_type_list* list) {
+    struct type_table* table;
+    #pragma omp atomic read seq_cst
+    table = list->table;
+    return table;
+}
+
+// tables live in the arena, a lookup may still be reading one that was outgrown
+static struct type_table* new_table(struct mtr_type_list* list, size_t capacity) {
+    struct type_table* table = mtr_arena_alloc(&list->arena, sizeof(struct type_table) + sizeof(struct type_entry) * capacity);
+    memset(table->entries, 0, sizeof(struct type_entry) * capacity);
+    table->capacity = capacity;
+    return table;
+}
+
 void mtr_type_list_init(struct mtr_type_list* list) {
-    list->types = calloc(16, sizeof(struct type_entry));
-    list->capacity = 16;
+    mtr_init_arena(&list->arena);
+    list->table = new_table(list, 16);
     list->count = 7;
 
 #define LOAD_TYPE(ptr, enume) \
-    list->types[enume] = (struct type_entry){ .type = ptr, .hash = enume }
+    list->table->entries[enume] = (struct type_entry){ .type = ptr, .hash = enume }
 
     LOAD_TYPE(&invalid_type, MTR_DATA_INVALID);
     LOAD_TYPE(&any_type, MTR_DATA_ANY);
@@ -43,20 +79,16 @@ void mtr_type_list_init(struct mtr_type_list* list) {
 }
 
 void mtr_type_list_delete(struct mtr_type_list* list) {
-    for (size_t i = 7; i < list->capacity; ++i) {
-        if (!list->types[i].type) {
-            continue;
-        }
-        mtr_delete_type(list->types[i].type);
-        free(list->types[i].type);
-    }
-
-    free(list->types);
-    list->capacity = 0;
+    mtr_delete_arena(&list->arena);
     list->count = 0;
-    list->types = NULL;
+    list->table = NULL;
+}
+
+static size_t type_id(const struct mtr_type* type) {
+    return type ? type->id : MTR_NO_TYPE_ID;
 }
 
+// Whatever a compound type is made of is already interned, so its hash only needs the ids
 static size_t hash_type(struct mtr_type* type) {
     if (type == NULL) {
         return 0;
@@ -75,19 +107,19 @@ static size_t hash_type(struct mtr_type* type) {
     case MTR_DATA_ARRAY: {
         struct mtr_array_type* a = (struct mtr_array_type*) type;
         return MTR_DATA_ARRAY
-                ^ (hash_type(a->element) << 1) * 21;
+                ^ (type_id(a->element) << 1) * 21;
     }
     case MTR_DATA_MAP: {
         struct mtr_map_type* m = (struct mtr_map_type*) type;
         return ((MTR_DATA_MAP
-                ^ (hash_type(m->key) << 5)) >> 8)
-                ^ (hash_type(m->value) << 13) * 21;
+                ^ (type_id(m->key) << 5)) >> 8)
+                ^ (type_id(m->value) << 13) * 21;
     }
     case MTR_DATA_FN: {
         struct mtr_function_type* f = (struct mtr_function_type*) type;
-        size_t h = MTR_DATA_FN ^ (hash_type(f->return_) << 7);
+        size_t h = MTR_DATA_FN ^ (type_id(f->return_) << 7);
         for (u8 i = 0; i < f->argc; ++i) {
-            h ^= (hash_type(f->argv[i]) << i * 17);
+            h ^= (type_id(f->argv[i]) << (i % 32));
             h = h * 21;
         }
         h += h << 11;
@@ -96,180 +128,235 @@ static size_t hash_type(struct mtr_type* type) {
     case MTR_DATA_USER:
     case MTR_DATA_UNION:
     case MTR_DATA_STRUCT: {
+        // looked up by name in get_user_type
         struct mtr_user_type* u = (struct mtr_user_type*) type;
         return hash(u->name.start, u->name.length);
     }
     }
 }
 
+static bool is_exact(const struct mtr_type* type) {
+    return type && type->exact;
+}
+
+static bool compute_exact(const struct mtr_type* type) {
+    switch (type->type) {
+    case MTR_DATA_ARRAY: {
+        const struct mtr_array_type* a = (const struct mtr_array_type*) type;
+        return is_exact(a->element);
+    }
+    case MTR_DATA_MAP: {
+        const struct mtr_map_type* m = (const struct mtr_map_type*) type;
+        return is_exact(m->key) && is_exact(m->value);
+    }
+    case MTR_DATA_FN: {
+        const struct mtr_function_type* f = (const struct mtr_function_type*) type;
+        for (u8 i = 0; i < f->argc; ++i) {
+            if (!is_exact(f->argv[i])) {
+                return false;
+            }
+        }
+        return is_exact(f->return_);
+    }
+    case MTR_DATA_UNION:
+    case MTR_DATA_STRUCT:
+        // one type per name
+        return true;
+    default:
+        return false;
+    }
+}
+
 // this is basically hashing
-static struct type_entry* find_entry(struct mtr_type* type, struct type_entry* entries, size_t capacity) {
+static struct type_entry* find_entry(struct mtr_type* type, struct type_table* table) {
     size_t t = (size_t) type->type;
     if (!mtr_is_compound_type(type)) {
-        return entries + t; // there is always room for basic types in here so this will always fit
+        return table->entries + t; // there is always room for basic types in here so this will always fit
     }
 
-    u8 basic_types_count = 7;
-
+    const size_t capacity = table->capacity;
     size_t h = hash_type(type);
     size_t i = h & (capacity - 1);
 
-#ifndef NDEBUG
-    size_t iters = 0;
-#endif
-
-    struct type_entry e = entries[i];
-    while (e.type != NULL) {
-        if (h == e.hash && mtr_type_match(type, e.type)) {
-            return entries + i;
+    struct mtr_type* e = load_type(table->entries + i);
+    while (e != NULL) {
+        if (h == table->entries[i].hash && mtr_type_match(type, e)) {
+            return table->entries + i;
         }
-#ifndef NDEBUG
-        iters++;
-#endif
         i = (i + 1) & (capacity - 1);
-        e = entries[i];
+        e = load_type(table->entries + i);
     }
 
-// #ifndef NDEBUG
-//     MTR_LOG_WARN("%zu collisions with size %zu", iters, capacity);
-// #endif
     MTR_ASSERT(i >= 7, "Whaaaaaaaaaaaat");
-    return entries + i;
+    return table->entries + i;
 }
 
-static struct mtr_type* insert(struct mtr_type_list* list, void* type, size_t size_type);
-#define INSERT(type) insert(list, type, sizeof(*type))
+static struct mtr_type* lookup(struct mtr_type_list* list, struct mtr_type* type) {
+    struct type_entry* entry = find_entry(type, load_table(list));
+    struct mtr_type* found = load_type(entry);
+    return found && mtr_type_match(type, found) ? found : NULL;
+}
 
 #define LOAD_FACTOR 0.75
 
-static struct type_entry* resize(struct type_entry* entries, size_t old_cap) {
-    size_t new_cap = old_cap * 2;
-    struct type_entry* temp = calloc(new_cap, sizeof(struct type_entry));
+static void grow(struct mtr_type_list* list) {
+    struct type_table* old = list->table;
+    struct type_table* table = new_table(list, old->capacity * 2);
 
-    for (size_t i = 0; i < old_cap; ++i) {
-        struct type_entry old = entries[i];
-        if (!old.type)
+    for (size_t i = 0; i < old->capacity; ++i) {
+        struct type_entry e = old->entries[i];
+        if (!e.type)
             continue;
-        struct type_entry* entry = find_entry(old.type, temp, new_cap);
-        entry->type = old.type;
-        entry->hash = old.hash;
+        *find_entry(e.type, table) = e;
+    }
+
+    #pragma omp atomic write seq_cst
+    list->table = table;
+}
+
+static void* copy_array(struct mtr_type_list* list, void* array, size_t size) {
+    if (size == 0) {
+        return NULL;
+    }
+    void* copy = mtr_arena_alloc(&list->arena, size);
+    memcpy(copy, array, size);
+    return copy;
+}
+
+// Checking whether a type belongs to the union is then a single bit test
+static void index_members(struct mtr_type_list* list, struct mtr_union_type* u) {
+    u32 max = 0;
+    for (u16 i = 0; i < u->argc; ++i) {
+        if (!is_exact(u->types[i])) {
+            return;
+        }
+        max = u->types[i]->id > max ? u->types[i]->id : max;
     }
-    free(entries);
-    return temp;
 
+    u32 words = max / 64 + 1;
+    u64* members = mtr_arena_alloc(&list->arena, sizeof(u64) * words);
+    memset(members, 0, sizeof(u64) * words);
+    for (u16 i = 0; i < u->argc; ++i) {
+        u32 id = u->types[i]->id;
+        members[id / 64] |= (u64) 1 << (id % 64);
+    }
+    u->members = members;
+    u->words = words;
 }
 
-static struct mtr_type* insert(struct mtr_type_list* list, void* type, size_t size_type) {
-    struct mtr_type* actual_type = type;
-    MTR_ASSERT(list->count < list->capacity, "Wrong size!");
-    struct type_entry* entry = find_entry(actual_type, list->types, list->capacity);
+// the arrays of the type being registered belong to the caller, the interned one gets its own
+static void own_parts(struct mtr_type_list* list, struct mtr_type* type) {
+    switch (type->type) {
+    case MTR_DATA_FN: {
+        struct mtr_function_type* f = (struct mtr_function_type*) type;
+        f->argv = copy_array(list, f->argv, sizeof(struct mtr_type*) * f->argc);
+        break;
+    }
+    case MTR_DATA_STRUCT: {
+        struct mtr_struct_type* s = (struct mtr_struct_type*) type;
+        s->members = copy_array(list, s->members, sizeof(struct mtr_symbol*) * s->argc);
+        break;
+    }
+    case MTR_DATA_UNION: {
+        struct mtr_union_type* u = (struct mtr_union_type*) type;
+        u->types = copy_array(list, u->types, sizeof(struct mtr_type*) * u->argc);
+        if (u->types) {
+            index_members(list, u);
+        }
+        break;
+    }
+    default:
+        break;
+    }
+}
 
-    if (entry->type && mtr_type_match(actual_type, entry->type)) {
+// has to hold the critical section
+static struct mtr_type* insert(struct mtr_type_list* list, struct mtr_type* type, size_t size_type) {
+    struct type_entry* entry = find_entry(type, list->table);
+    if (entry->type && mtr_type_match(type, entry->type)) {
         return entry->type;
     }
 
-    entry->type = malloc(size_type);
-    memcpy(entry->type, type, size_type);
-    entry->hash = hash_type(type);
+    struct mtr_type* inserted = mtr_arena_alloc(&list->arena, size_type);
+    memcpy(inserted, type, size_type);
+    own_parts(list, inserted);
     list->count++;
+    inserted->id = (u32) list->count;
+    inserted->exact = compute_exact(inserted);
+
+    entry->hash = hash_type(inserted);
+    #pragma omp atomic write seq_cst
+    entry->type = inserted;
+
+    if (list->count >= list->table->capacity * LOAD_FACTOR) {
+        grow(list);
+    }
+    return inserted;
+}
 
-    if (list->count >= list->capacity * LOAD_FACTOR) {
-        list->types = resize(list->types, list->capacity);
-        list->capacity *= 2;
+// most types asked for already exist, so they are found without locking
+static struct mtr_type* intern(struct mtr_type_list* list, struct mtr_type* type, size_t size_type) {
+    struct mtr_type* r = lookup(list, type);
+    if (r) {
+        return r;
     }
-    return entry->type;
+
+    #pragma omp critical (mtr_type_list)
+    r = insert(list, type, size_type);
+    return r;
 }
 
+#define INTERN(type) intern(list, (struct mtr_type*) type, sizeof(*type))
+
 struct mtr_type* mtr_type_list_register_from_token(struct mtr_type_list* list, struct mtr_token token) {
     struct mtr_type type = mtr_get_data_type(token);
-    return INSERT(&type);
+    return INTERN(&type);
 }
 
-
 struct mtr_type* mtr_type_list_register_array(struct mtr_type_list* list, struct mtr_type* element) {
-    struct mtr_array_type a;
+    struct mtr_array_type a = { 0 };
     a.type.type = MTR_DATA_ARRAY;
     a.element = element;
-
-    return INSERT(&a);
+    return INTERN(&a);
 }
 
 struct mtr_type* mtr_type_list_register_map(struct mtr_type_list* list, struct mtr_type* key, struct mtr_type* value) {
-    struct mtr_map_type m;
+    struct mtr_map_type m = { 0 };
     m.type.type = MTR_DATA_MAP;
     m.key = key;
     m.value = value;
-
-    return INSERT(&m);
+    return INTERN(&m);
 }
 
 struct mtr_type* mtr_type_list_register_function(struct mtr_type_list* list, struct mtr_type* ret, struct mtr_type** argv, u8 argc) {
-    struct mtr_function_type f;
+    struct mtr_function_type f = { 0 };
     f.type.type = MTR_DATA_FN;
     f.argc = argc;
     f.argv = argv;
     f.return_ = ret;
-
-    struct mtr_function_type* r = (void*) INSERT(&f);
-
-    if (r->argv == argv) {
-        if (argc == 0) {
-            r->argv = NULL;
-            return (void*)r;
-        }
-        void* temp = malloc(sizeof(struct mtr_type*) * argc);
-        memcpy(temp, argv, sizeof(struct mtr_type*) * argc);
-        r->argv = temp;
-    }
-
-
-    return (void*)r;
+    return INTERN(&f);
 }
 
 struct mtr_type* mtr_type_list_register_struct_type(struct mtr_type_list* list, struct mtr_token name, struct mtr_symbol** members, u16 count) {
-    struct mtr_struct_type s;
+    struct mtr_struct_type s = { 0 };
     s.name.type.type = MTR_DATA_STRUCT;
     s.name.name = name;
     s.members = members;
     s.argc = count;
-
-    struct mtr_struct_type* r = (void*) INSERT(&s);
-
-    if (r->members == members) {
-        if (count == 0) {
-            r->members = NULL;
-            return (void*) r;
-        }
-        void* temp = malloc(sizeof(struct mtr_symbol*) * count);
-        memcpy(temp, members, sizeof(struct mtr_symbol*) * count);
-        r->members = temp;
-    }
-    return (void*)r;
+    return INTERN(&s);
 }
 
 struct mtr_type* mtr_type_list_register_union_type(struct mtr_type_list* list, struct mtr_token name, struct mtr_type** types, u16 count) {
-    struct mtr_union_type u;
+    struct mtr_union_type u = { 0 };
     u.name.type.type = MTR_DATA_UNION;
     u.name.name = name;
     u.types = types;
     u.argc = count;
-
-    struct mtr_union_type* r = (void*) INSERT(&u);
-
-    if (r->types == types) {
-        if (count == 0) {
-            r->types = NULL;
-            return (void*) r;
-        }
-        void* temp = malloc(sizeof(struct mtr_type*) * count);
-        memcpy(temp, types, sizeof(struct mtr_type*) * count);
-        r->types = temp;
-    }
-    return (void*)r;
+    return INTERN(&u);
 }
 
 struct mtr_type* mtr_type_list_get(struct mtr_type_list* list, size_t index) {
-    return list->types[index].type;
+    return load_type(load_table(list)->entries + index);
 }
 
 static bool is_user(struct mtr_type* type) {
@@ -277,31 +364,29 @@ static bool is_user(struct mtr_type* type) {
 }
 
 struct mtr_type* mtr_type_list_get_user_type(struct mtr_type_list* list, struct mtr_token token) {
+    struct type_table* table = load_table(list);
     size_t h = hash(token.start, token.length);
-    size_t i = h & (list->capacity - 1);
+    size_t i = h & (table->capacity - 1);
 
-    struct type_entry e = list->types[i];
-    while (e.type != NULL) {
-        struct mtr_user_type* u = (struct mtr_user_type*) e.type;
-        if (h == e.hash && is_user(e.type) && mtr_token_compare(u->name, token)) {
-            return e.type;
+    struct mtr_type* e = load_type(table->entries + i);
+    while (e != NULL) {
+        struct mtr_user_type* u = (struct mtr_user_type*) e;
+        if (h == table->entries[i].hash && is_user(e) && mtr_token_compare(u->name, token)) {
+            return e;
         }
 
-        i = (i + 1) & (list->capacity - 1);
-        e = list->types[i];
+        i = (i + 1) & (table->capacity - 1);
+        e = load_type(table->entries + i);
     }
 
-    return e.type;
+    return NULL;
 }
 
 struct mtr_type* mtr_type_list_get_void_type(struct mtr_type_list* list) {
-    return list->types[MTR_DATA_VOID].type;
+    // basic types never move
+    return &void_type;
 }
 
 struct mtr_type* mtr_type_list_exists(struct mtr_type_list* list, struct mtr_type type) {
-    struct type_entry* entry = find_entry(&type, list->types, list->capacity);
-    if (entry->type && mtr_type_match(&type, entry->type)) {
-        return entry->type;
-    }
-    return NULL;
+    return lookup(list, &type);
 }
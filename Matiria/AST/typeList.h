@@ -3,10 +3,14 @@
 
 #include "type.h"
 
+#include "core/arena.h"
+
+struct type_table;
+
 struct mtr_type_list {
-    struct type_entry* types;
+    struct type_table* table; // looked up without locking, see typeList.c
     size_t count;
-    size_t capacity;
+    struct mtr_arena arena; // the types themselves and the tables they outgrew
 };
 
 void mtr_type_list_init(struct mtr_type_list* list);
@@ -3,12 +3,16 @@
 #include "core/log.h"
 
 #include <stdlib.h>
+#include <string.h>
 
 struct mtr_chunk mtr_new_chunk(void) {
     struct mtr_chunk chunk = {
         .bytecode = NULL,
         .capacity = 0,
-        .size = 0
+        .size = 0,
+        .lines = NULL,
+        .lines_size = 0,
+        .lines_offset = 0
     };
 
     void* temp = malloc(sizeof(u8) * 8);
@@ -22,9 +26,17 @@ struct mtr_chunk mtr_new_chunk(void) {
     return chunk;
 }
 void mtr_delete_chunk(struct mtr_chunk* chunk) {
-    free(chunk->bytecode);
+    // chunks without capacity borrow their bytecode and lines (from an image or an enclosing chunk)
+    if (chunk->capacity > 0) {
+        free(chunk->bytecode);
+        free(chunk->lines);
+    }
+    chunk->bytecode = NULL;
     chunk->capacity = 0;
     chunk->size = 0;
+    chunk->lines = NULL;
+    chunk->lines_size = 0;
+    chunk->lines_offset = 0;
 }
 
 void mtr_write_chunk(struct mtr_chunk* chunk, u8 bytecode) {
@@ -39,3 +51,153 @@ void mtr_write_chunk(struct mtr_chunk* chunk, u8 bytecode) {
     }
     chunk->bytecode[chunk->size++] = bytecode;
 }
+
+static u32 read_u32(const u8* at) {
+    u32 value;
+    memcpy(&value, at, sizeof(value));
+    return value;
+}
+
+static u16 read_u16(const u8* at) {
+    u16 value;
+    memcpy(&value, at, sizeof(value));
+    return value;
+}
+
+const u8* mtr_next_instruction(const u8* instruction) {
+    const u8* operands = instruction + 1;
+    switch ((enum mtr_op_code) *instruction) {
+    case MTR_OP_INT:
+    case MTR_OP_FLOAT:
+        return operands + sizeof(u64);
+
+    case MTR_OP_STRING_LITERAL:
+        return operands + sizeof(u32) + read_u32(operands);
+
+    case MTR_OP_ARRAY_LITERAL:
+    case MTR_OP_MAP_LITERAL:
+    case MTR_OP_CONSTRUCTOR:
+    case MTR_OP_CALL:
+        return operands + sizeof(u8);
+
+    case MTR_OP_CLOSURE: {
+        const u16 count = read_u16(operands);
+        const u8* size = operands + sizeof(u16) + count * (sizeof(u16) + sizeof(u8));
+        return size + sizeof(u32) + read_u32(size);
+    }
+
+    case MTR_OP_OR:
+    case MTR_OP_AND:
+    case MTR_OP_JMP:
+    case MTR_OP_JMP_Z:
+        return operands + sizeof(i16);
+
+    case MTR_OP_OR_LONG:
+    case MTR_OP_AND_LONG:
+    case MTR_OP_JMP_LONG:
+    case MTR_OP_JMP_Z_LONG:
+        return operands + sizeof(i32);
+
+    case MTR_OP_GET:
+    case MTR_OP_SET:
+    case MTR_OP_GLOBAL_GET:
+    case MTR_OP_UPVALUE_GET:
+    case MTR_OP_UPVALUE_SET:
+    case MTR_OP_STRUCT_GET:
+    case MTR_OP_STRUCT_SET:
+    case MTR_OP_VARIANT:
+    case MTR_OP_POP_V:
+        return operands + sizeof(u16);
+
+    case MTR_OP_FOR_RANGE:
+    case MTR_OP_FOR_ARRAY:
+    case MTR_OP_FOR_MAP:
+        return operands + sizeof(i32) + sizeof(u16);
+
+    case MTR_OP_TAG:
+        return operands + sizeof(u16) + read_u16(operands) * sizeof(u8);
+
+    case MTR_OP_MATCH:
+        return operands + sizeof(u16) + read_u16(operands) * sizeof(i32);
+
+    default:
+        return operands;
+    }
+}
+
+// LEB128, 7 bits at a time with the high bit set on every byte but the last
+static size_t write_varint(u8* at, u64 value) {
+    size_t size = 0;
+    do {
+        u8 byte = value & 0x7F;
+        value >>= 7;
+        at[size++] = byte | (value != 0 ? 0x80 : 0);
+    } while (value != 0);
+    return size;
+}
+
+static const u8* read_varint(const u8* at, u64* value) {
+    *value = 0;
+    for (u32 shift = 0; ; shift += 7) {
+        const u8 byte = *at++;
+        *value |= (u64) (byte & 0x7F) << shift;
+        if ((byte & 0x80) == 0) {
+            return at;
+        }
+    }
+}
+
+// lines can go back, zigzag keeps small negative differences small
+static u64 zigzag(i64 value) {
+    return ((u64) value << 1) ^ (u64) (value >> 63);
+}
+
+static i64 unzigzag(u64 value) {
+    return (i64) (value >> 1) ^ -(i64) (value & 1);
+}
+
+void mtr_write_lines(struct mtr_chunk* chunk, const struct mtr_line* lines, size_t count) {
+    free(chunk->lines);
+    chunk->lines = NULL;
+    chunk->lines_size = 0;
+    if (count == 0) {
+        return;
+    }
+
+    // a u32 takes up to 5 bytes
+    u8* table = malloc(count * 10);
+    size_t size = 0;
+    struct mtr_line previous = { 0, 0 };
+    for (size_t i = 0; i < count; ++i) {
+        MTR_ASSERT(lines[i].offset >= previous.offset, "Lines are out of order.");
+        size += write_varint(table + size, lines[i].offset - previous.offset);
+        size += write_varint(table + size, zigzag((i64) lines[i].line - (i64) previous.line));
+        previous = lines[i];
+    }
+
+    chunk->lines = realloc(table, size);
+    chunk->lines_size = size;
+}
+
+u32 mtr_chunk_line(const struct mtr_chunk* chunk, size_t offset) {
+    if (chunk->lines == NULL) {
+        return 0;
+    }
+
+    offset += chunk->lines_offset;
+    const u8* at = chunk->lines;
+    const u8* end = chunk->lines + chunk->lines_size;
+    size_t current = 0;
+    i64 line = 0;
+    while (at < end) {
+        u64 delta;
+        at = read_varint(at, &delta);
+        if (current + delta > offset) {
+            break;
+        }
+        current += delta;
+        at = read_varint(at, &delta);
+        line += unzigzag(delta);
+    }
+    return (u32) line;
+}
@@ -24,6 +24,8 @@ enum mtr_op_code {
 
     MTR_OP_OR,
     MTR_OP_AND,
+    MTR_OP_OR_LONG,
+    MTR_OP_AND_LONG,
 
     MTR_OP_NOT,
 
@@ -48,6 +50,15 @@ enum mtr_op_code {
     MTR_OP_GREATER_F,
     MTR_OP_EQUAL_F,
 
+    // the comparison followed by NOT, in one instruction
+    MTR_OP_LESS_EQUAL_I,
+    MTR_OP_GREATER_EQUAL_I,
+    MTR_OP_NOT_EQUAL_I,
+
+    MTR_OP_LESS_EQUAL_F,
+    MTR_OP_GREATER_EQUAL_F,
+    MTR_OP_NOT_EQUAL_F,
+
     MTR_OP_GET,
     MTR_OP_SET,
 
@@ -64,6 +75,16 @@ enum mtr_op_code {
 
     MTR_OP_JMP,
     MTR_OP_JMP_Z,
+    MTR_OP_JMP_LONG,
+    MTR_OP_JMP_Z_LONG,
+
+    MTR_OP_FOR_RANGE,
+    MTR_OP_FOR_ARRAY,
+    MTR_OP_FOR_MAP,
+
+    MTR_OP_VARIANT,
+    MTR_OP_TAG,
+    MTR_OP_MATCH,
 
     MTR_OP_POP,
     MTR_OP_POP_V,
@@ -76,10 +97,25 @@ enum mtr_op_code {
     MTR_OP_RETURN
 };
 
+// TAG is followed by the member count of the union and one of these per member
+enum mtr_tag_kind {
+    MTR_TAG_ANY,
+    MTR_TAG_INT,
+    MTR_TAG_FLOAT,
+    MTR_TAG_STRING,
+    MTR_TAG_ARRAY,
+    MTR_TAG_MAP,
+    MTR_TAG_STRUCT,
+    MTR_TAG_FN
+};
+
 struct mtr_chunk {
     u8* bytecode;
     size_t size;
     size_t capacity;
+    u8* lines; // source lines of the instructions (see mtr_chunk_line). NULL unless compiled for debugging
+    size_t lines_size;
+    size_t lines_offset; // where the bytecode starts in the code the lines are for, closures borrow the lines of their function
 };
 
 struct mtr_chunk mtr_new_chunk(void);
@@ -87,4 +123,20 @@ void mtr_delete_chunk(struct mtr_chunk* chunk);
 
 void mtr_write_chunk(struct mtr_chunk* chunk, u8 bytecode);
 
+// where the instruction after the one at instruction starts. The code of a closure is part of its CLOSURE
+const u8* mtr_next_instruction(const u8* instruction);
+
+// where the instructions of a line start, in order of offset
+struct mtr_line {
+    u32 offset;
+    u32 line;
+};
+
+// Stores the lines with the chunk, each one as the difference to the one before.
+// Looking one up walks the table so it is for error messages and tools, not for running code
+void mtr_write_lines(struct mtr_chunk* chunk, const struct mtr_line* lines, size_t count);
+
+// line of the instruction at offset in the bytecode of the chunk. 0 if the chunk has no lines
+u32 mtr_chunk_line(const struct mtr_chunk* chunk, size_t offset);
+
 #endif
@@ -0,0 +1,161 @@
+#ifndef _WIN32
+#   define _POSIX_C_SOURCE 200809L
+#endif
+
+#include "cache.h"
+
+#include "image.h"
+#include "core/log.h"
+#include "core/utils.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#ifndef _WIN32
+#   include <dirent.h>
+#   include <errno.h>
+#   include <sys/stat.h>
+#   include <utime.h>
+#else
+#   include <direct.h>
+#endif
+
+static const char extension[] = ".mtrc";
+
+u64 mtr_cache_key(const char* source, u64 flags) {
+    const u32 version = MTR_IMAGE_VERSION;
+    const size_t length = strlen(source);
+    u64 key = MTR_HASH64_SEED;
+    key = hash64(&version, sizeof(version), key);
+    key = hash64(&flags, sizeof(flags), key);
+    key = hash64(&length, sizeof(length), key);
+    return hash64(source, length, key);
+}
+
+char* mtr_cache_path(const char* dir, u64 key) {
+    size_t size = strlen(dir) + 1 + 16 + sizeof(extension);
+    char* path = malloc(size);
+    snprintf(path, size, "%s/%016llx%s", dir, (unsigned long long) key, extension);
+    return path;
+}
+
+bool mtr_cache_load(const char* dir, u64 key, struct mtr_package* package) {
+    char* path = mtr_cache_path(dir, key);
+
+    // a miss is not an error, only complain about entries that exist but can't be used
+    FILE* file = fopen(path, "rb");
+    bool hit = file != NULL;
+    if (file) {
+        fclose(file);
+        hit = mtr_load_image(package, path) == MTR_OK;
+        if (!hit) {
+            MTR_LOG_WARN("Discarding cache entry %s", path);
+            remove(path);
+        }
+    }
+
+#ifndef _WIN32
+    if (hit) {
+        utime(path, NULL); // recently used entries survive trimming
+    }
+#endif
+
+    free(path);
+    return hit;
+}
+
+#ifndef _WIN32
+
+bool mtr_cache_prepare(const char* dir) {
+    if (mkdir(dir, 0755) != 0 && errno != EEXIST) {
+        MTR_LOG_ERROR("Unable to create cache directory %s", dir);
+        return false;
+    }
+    return true;
+}
+
+struct entry {
+    char* path;
+    struct timespec used;
+};
+
+static int by_use(const void* lhs, const void* rhs) {
+    const struct entry* l = lhs;
+    const struct entry* r = rhs;
+    if (l->used.tv_sec != r->used.tv_sec) {
+        return (l->used.tv_sec > r->used.tv_sec) - (l->used.tv_sec < r->used.tv_sec);
+    }
+    return (l->used.tv_nsec > r->used.tv_nsec) - (l->used.tv_nsec < r->used.tv_nsec);
+}
+
+static bool is_entry(const char* name) {
+    size_t length = strlen(name);
+    size_t ext = sizeof(extension) - 1;
+    return length > ext && strcmp(name + length - ext, extension) == 0;
+}
+
+void mtr_cache_trim(const char* dir, size_t max_entries) {
+    if (max_entries == 0) {
+        return;
+    }
+
+    DIR* d = opendir(dir);
+    if (!d) {
+        return;
+    }
+
+    struct entry* entries = NULL;
+    size_t count = 0;
+    size_t capacity = 0;
+
+    const size_t dir_length = strlen(dir);
+    struct dirent* e;
+    while ((e = readdir(d)) != NULL) {
+        if (!is_entry(e->d_name)) {
+            continue;
+        }
+
+        size_t size = dir_length + 1 + strlen(e->d_name) + 1;
+        char* path = malloc(size);
+        snprintf(path, size, "%s/%s", dir, e->d_name);
+
+        struct stat st;
+        if (stat(path, &st) != 0) {
+            free(path);
+            continue;
+        }
+
+        if (count == capacity) {
+            capacity = capacity == 0 ? 16 : capacity * 2;
+            entries = realloc(entries, sizeof(struct entry) * capacity);
+        }
+        entries[count++] = (struct entry) { path, st.st_mtim };
+    }
+    closedir(d);
+
+    if (count > max_entries) {
+        qsort(entries, count, sizeof(struct entry), by_use);
+        for (size_t i = 0; i < count - max_entries; ++i) {
+            remove(entries[i].path);
+        }
+    }
+
+    for (size_t i = 0; i < count; ++i) {
+        free(entries[i].path);
+    }
+    free(entries);
+}
+
+#else
+
+bool mtr_cache_prepare(const char* dir) {
+    _mkdir(dir);
+    return true;
+}
+
+void mtr_cache_trim(const char* dir, size_t max_entries) {
+    // Not implemented on Windows, the cache grows unbounded.
+}
+
+#endif
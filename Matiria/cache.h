@@ -0,0 +1,26 @@
+#ifndef MTR_CACHE_H
+#define MTR_CACHE_H
+
+#include "package.h"
+
+#include "core/types.h"
+
+// On disk cache of compiled packages. Each entry is an image (see image.h) named after
+// a hash of the source, the image version and the compile flags, so an entry is never
+// reused for a different source or by an incompatible compiler.
+
+u64 mtr_cache_key(const char* source, u64 flags);
+
+// returns the path of the entry for key. Has to be freed
+char* mtr_cache_path(const char* dir, u64 key);
+
+// loads the entry into an empty package. False if there is no usable entry
+bool mtr_cache_load(const char* dir, u64 key, struct mtr_package* package);
+
+// creates the cache directory if it doesn't exist
+bool mtr_cache_prepare(const char* dir);
+
+// evicts the least recently used entries until at most max_entries remain
+void mtr_cache_trim(const char* dir, size_t max_entries);
+
+#endif
@@ -2,6 +2,10 @@
 
 #include "AST/symbol.h"
 #include "bytecode.h"
+#include "cache.h"
+#include "image.h"
+#include "incremental.h"
+#include "module.h"
 #include "package.h"
 
 #include "scanner/scanner.h"
@@ -10,10 +14,13 @@
 
 #include "validator/validator.h"
 
+#include "runtime/engine.h"
 #include "runtime/object.h"
 
+#include "core/lines.h"
 #include "core/log.h"
 #include "core/macros.h"
+#include "core/report.h"
 
 #include "debug/disassemble.h"
 #include "debug/dump.h"
@@ -21,6 +28,10 @@
 #include <stdlib.h>
 #include <string.h>
 
+#ifdef _OPENMP
+#   include <omp.h>
+#endif
+
 static u64 evaluate_int(struct mtr_token token) {
     u64 s = 0;
     for (u32 i = 0; i < token.length; ++i) {
@@ -51,93 +62,415 @@ static f64 evaluate_float(struct mtr_token token) {
     return s;
 }
 
-static void write_u64(struct mtr_chunk* chunk, u64 value) {
+#define JUMP_PENDING ((size_t) -1)
+#define NOWHERE ((size_t) -1)
+
+// Jumps are emitted in their short form (i16 operand) and only widened to the
+// long form (i32 operand) when the distance doesn't fit. Every jump of the
+// chunk is recorded so that widening one of them (which inserts bytes in the
+// middle of the chunk) can fix up the positions and offsets of the others.
+struct jump {
+    size_t operand; // where the offset is stored in the chunk
+    size_t target;  // JUMP_PENDING until the jump is patched
+    bool wide;
+};
+
+// what folding needs to know about the code of a global (see fold_calls)
+struct code_info {
+    struct mtr_dependencies dependencies;
+    bool impure; // calls something that isn't a global or creates closures
+    bool constant_calls; // calls a global with constant arguments
+};
+
+// Calls of pure functions with constant arguments are run while compiling and replaced by their result.
+// Pure functions only call other pure functions and don't create closures, so they can't reach natives
+// or captured state. A call that fails or takes too long is left alone, it fails the same way when it runs
+struct fold {
+    struct mtr_package* package;
+    const bool* pure; // per global
+    struct mtr_engine* engine;
+};
+
+// jumps and calls a single folded call can take
+#define FOLD_BUDGET (1 << 16)
+// bytes of bytecode the result of a folded call can take
+#define FOLD_MAX_SIZE 4096
+
+// Hot calls (see profile.h) of functions that only return an expression are replaced by the expression,
+// with the arguments in place of the parameters. Only arguments that can be evaluated more than once
+// without changing anything are taken, so the parameters can be used any number of times.
+// The same profile lays out hot branches and matches (see write_if and write_match)
+struct inlining {
+    const struct mtr_profile* profile;
+    const struct mtr_block* globals;
+};
+
+// nodes of the expression of an inlined function
+#define INLINE_MAX_SIZE 24
+
+struct compiler {
+    struct mtr_chunk chunk;
+    struct jump* jumps;
+    size_t jump_count;
+    size_t jump_capacity;
+    struct mtr_dependencies* dependencies; // globals the code uses, NULL if nobody asks
+    struct code_info* info; // NULL if nobody asks
+    struct fold* fold; // NULL if calls aren't folded
+    const struct inlining* inlining; // NULL if calls aren't inlined
+    struct mtr_expr** arguments; // in place of the parameters while an inlined expression is written
+    u32 global; // index of the code, calls, branches and matches are counted by it and their position
+    u32 calls;
+    u32 branches;
+    u32 matches;
+
+    // Debug code gets a line table and is written as is. Otherwise the peephole pass merges and drops
+    // instructions, and comparisons followed by NOT are written as one instruction
+    const struct mtr_line_index* lines; // NULL unless compiling for debugging
+    struct mtr_line* marks;
+    size_t mark_count;
+    size_t mark_capacity;
+
+    // the peephole pass never merges across the place a jump lands on
+    size_t label; // where the last jump that was patched lands
+    size_t popped; // where the last POP_V ends
+    size_t returned; // where the last RETURN ends
+};
+
+static void init_compiler(struct compiler* compiler, struct mtr_dependencies* dependencies) {
+    compiler->chunk = mtr_new_chunk();
+    compiler->jumps = NULL;
+    compiler->jump_count = 0;
+    compiler->jump_capacity = 0;
+    compiler->dependencies = dependencies;
+    compiler->info = NULL;
+    compiler->fold = NULL;
+    compiler->inlining = NULL;
+    compiler->arguments = NULL;
+    compiler->global = 0;
+    compiler->calls = 0;
+    compiler->branches = 0;
+    compiler->matches = 0;
+    compiler->lines = NULL;
+    compiler->marks = NULL;
+    compiler->mark_count = 0;
+    compiler->mark_capacity = 0;
+    compiler->label = NOWHERE;
+    compiler->popped = NOWHERE;
+    compiler->returned = NOWHERE;
+}
+
+// returns the finished chunk, the compiler can't be used after this
+static struct mtr_chunk end_compiler(struct compiler* compiler) {
+    free(compiler->jumps);
+    compiler->jumps = NULL;
+    compiler->jump_count = 0;
+    compiler->jump_capacity = 0;
+
+    if (compiler->lines) {
+        mtr_write_lines(&compiler->chunk, compiler->marks, compiler->mark_count);
+    }
+    free(compiler->marks);
+    compiler->marks = NULL;
+    compiler->mark_count = 0;
+    compiler->mark_capacity = 0;
+    return compiler->chunk;
+}
+
+static void add_mark(struct compiler* compiler, u32 offset, u32 line) {
+    if (compiler->mark_count > 0) {
+        struct mtr_line* last = compiler->marks + compiler->mark_count - 1;
+        if (last->line == line) {
+            return;
+        }
+        // nothing was written for the last one
+        if (last->offset == offset) {
+            last->line = line;
+            return;
+        }
+    }
+
+    if (compiler->mark_count == compiler->mark_capacity) {
+        size_t new_cap = compiler->mark_capacity == 0 ? 16 : compiler->mark_capacity * 2;
+        compiler->marks = realloc(compiler->marks, sizeof(struct mtr_line) * new_cap);
+        compiler->mark_capacity = new_cap;
+    }
+    compiler->marks[compiler->mark_count++] = (struct mtr_line) { offset, line };
+}
+
+// the code written from here on comes from the line of token
+static void mark_line(struct compiler* compiler, struct mtr_token token) {
+    if (!compiler->lines) {
+        return;
+    }
+
+    // inlined code and specializations can come from somewhere else
+    const u32 line = mtr_line_of(compiler->lines, token.start);
+    if (line > 0) {
+        add_mark(compiler, (u32) compiler->chunk.size, line);
+    }
+}
+
+static void write_u8(struct compiler* compiler, u8 value) {
+    mtr_write_chunk(&compiler->chunk, value);
+}
+
+static void write_u64(struct compiler* compiler, u64 value) {
     // this is definetly dangerous, but fun :). it probably breaks for big endian
-    mtr_write_chunk(chunk, (u8) (value >> 0));
-    mtr_write_chunk(chunk, (u8) (value >> 8));
-    mtr_write_chunk(chunk, (u8) (value >> 16));
-    mtr_write_chunk(chunk, (u8) (value >> 24));
-    mtr_write_chunk(chunk, (u8) (value >> 32));
-    mtr_write_chunk(chunk, (u8) (value >> 40));
-    mtr_write_chunk(chunk, (u8) (value >> 48));
-    mtr_write_chunk(chunk, (u8) (value >> 56));
+    write_u8(compiler, (u8) (value >> 0));
+    write_u8(compiler, (u8) (value >> 8));
+    write_u8(compiler, (u8) (value >> 16));
+    write_u8(compiler, (u8) (value >> 24));
+    write_u8(compiler, (u8) (value >> 32));
+    write_u8(compiler, (u8) (value >> 40));
+    write_u8(compiler, (u8) (value >> 48));
+    write_u8(compiler, (u8) (value >> 56));
+}
+
+static void write_u32(struct compiler* compiler, u32 value) {
+    write_u8(compiler, (u8) (value >> 0));
+    write_u8(compiler, (u8) (value >> 8));
+    write_u8(compiler, (u8) (value >> 16));
+    write_u8(compiler, (u8) (value >> 24));
+}
+
+static void write_u16(struct compiler* compiler, u16 value) {
+    write_u8(compiler, (u8) (value >> 0));
+    write_u8(compiler, (u8) (value >> 8));
+}
+
+static u8 long_jump(u8 instruction) {
+    switch (instruction) {
+    case MTR_OP_JMP:   return MTR_OP_JMP_LONG;
+    case MTR_OP_JMP_Z: return MTR_OP_JMP_Z_LONG;
+    case MTR_OP_OR:    return MTR_OP_OR_LONG;
+    case MTR_OP_AND:   return MTR_OP_AND_LONG;
+    default:
+        break;
+    }
+    MTR_ASSERT(false, "Instruction is not a jump.");
+    return instruction;
+}
+
+static size_t jump_size(const struct jump* jump) {
+    return jump->wide ? sizeof(i32) : sizeof(i16);
+}
+
+// offsets are relative to the end of the operand, which is where ip is after reading it
+static bool encode_jump(struct compiler* compiler, const struct jump* jump) {
+    i64 where = (i64) jump->target - (i64) (jump->operand + jump_size(jump));
+    u8* operand = compiler->chunk.bytecode + jump->operand;
+    if (jump->wide) {
+        *((i32*) operand) = (i32) where;
+        return true;
+    }
+
+    if (where < INT16_MIN || where > INT16_MAX) {
+        return false;
+    }
+    *((i16*) operand) = (i16) where;
+    return true;
+}
+
+static void move_place(size_t* place, size_t at) {
+    if (*place != NOWHERE && *place >= at) {
+        *place += 2;
+    }
+}
+
+// makes room for an i32 operand and moves everything after the jump two bytes forward.
+static void widen_jump(struct compiler* compiler, struct jump* jump) {
+    const size_t at = jump->operand + sizeof(i16);
+    const size_t moved = compiler->chunk.size - at;
+    write_u16(compiler, 0);
+    u8* bytecode = compiler->chunk.bytecode;
+    memmove(bytecode + at + 2, bytecode + at, moved);
+    bytecode[jump->operand - 1] = long_jump(bytecode[jump->operand - 1]);
+    jump->wide = true;
+
+    for (size_t i = 0; i < compiler->jump_count; ++i) {
+        struct jump* j = compiler->jumps + i;
+        if (j->operand >= at) {
+            j->operand += 2;
+        }
+        if (j->target != JUMP_PENDING && j->target >= at) {
+            j->target += 2;
+        }
+    }
+
+    for (size_t i = 0; i < compiler->mark_count; ++i) {
+        if (compiler->marks[i].offset >= at) {
+            compiler->marks[i].offset += 2;
+        }
+    }
+
+    move_place(&compiler->label, at);
+    move_place(&compiler->popped, at);
+    move_place(&compiler->returned, at);
 }
 
-static void write_u32(struct mtr_chunk* chunk, u32 value) {
-    mtr_write_chunk(chunk, (u8) (value >> 0));
-    mtr_write_chunk(chunk, (u8) (value >> 8));
-    mtr_write_chunk(chunk, (u8) (value >> 16));
-    mtr_write_chunk(chunk, (u8) (value >> 24));
+// Re-encodes every resolved jump, widening the ones that no longer fit.
+// Widening only makes distances grow, so this settles once nothing overflows.
+static void relax_jumps(struct compiler* compiler) {
+    bool changed = true;
+    while (changed) {
+        changed = false;
+        for (size_t i = 0; i < compiler->jump_count; ++i) {
+            struct jump* j = compiler->jumps + i;
+            if (j->target == JUMP_PENDING || encode_jump(compiler, j)) {
+                continue;
+            }
+            widen_jump(compiler, j);
+            changed = true;
+        }
+    }
 }
 
-static void write_u16(struct mtr_chunk* chunk, u16 value) {
-    mtr_write_chunk(chunk, (u8) (value >> 0));
-    mtr_write_chunk(chunk, (u8) (value >> 8));
+static size_t add_jump(struct compiler* compiler, size_t target, bool wide) {
+    if (compiler->jump_count == compiler->jump_capacity) {
+        size_t new_cap = compiler->jump_capacity == 0 ? 8 : compiler->jump_capacity * 2;
+        compiler->jumps = realloc(compiler->jumps, sizeof(struct jump) * new_cap);
+        compiler->jump_capacity = new_cap;
+    }
+
+    struct jump* j = compiler->jumps + compiler->jump_count;
+    j->operand = compiler->chunk.size;
+    j->target = target;
+    j->wide = wide;
+    if (wide) {
+        write_u32(compiler, (u32) 0xFFFFFFFFu);
+    } else {
+        write_u16(compiler, (u16) 0xFFFFu);
+    }
+    return compiler->jump_count++;
 }
 
-// returns the location of where to jump relative to the chunk
-static u16 write_jump(struct mtr_chunk* chunk, u8 instruction) {
-    mtr_write_chunk(chunk, instruction);
-    write_u16(chunk, (u16) 0xFFFFu);
-    return chunk->size - 2;
+// returns a handle to the jump, to be passed to patch_jump
+static size_t write_jump(struct compiler* compiler, u8 instruction) {
+    write_u8(compiler, instruction);
+    return add_jump(compiler, JUMP_PENDING, false);
 }
 
 // patch the jump address after a block of bytecode
-static void patch_jump(struct mtr_chunk* chunk, i16 offset) {
-    i16 where = chunk->size - offset - 2;
-    i16* to_patch = (i16*)(chunk->bytecode + offset);
-    *to_patch = where;
+static void patch_jump(struct compiler* compiler, size_t jump) {
+    struct jump* j = compiler->jumps + jump;
+    j->target = compiler->chunk.size;
+    compiler->label = compiler->chunk.size;
+    if (!encode_jump(compiler, j)) {
+        relax_jumps(compiler);
+    }
+}
+
+// returns where the instruction of a jump currently is. Widening can move it so don't hold on to it
+static size_t jump_location(struct compiler* compiler, size_t jump) {
+    return compiler->jumps[jump].operand - 1;
+}
+
+static void write_loop(struct compiler* compiler, size_t target) {
+    write_u8(compiler, MTR_OP_JMP);
+    size_t jump = add_jump(compiler, target, false);
+    if (!encode_jump(compiler, compiler->jumps + jump)) {
+        relax_jumps(compiler);
+    }
+}
+
+// Moves the code from 'from' to 'to' behind the code after it, along with the jumps in it and into it.
+// A jump to 'to' from the moved code goes to its end, from anywhere else to what came after it.
+// Debug code is never moved, the marks of the lines stay where they are
+static void move_behind(struct compiler* compiler, size_t from, size_t to) {
+    const size_t end = compiler->chunk.size;
+    const size_t moved = to - from;
+    const size_t rest = end - to;
+    u8* bytecode = compiler->chunk.bytecode;
+    u8* copy = malloc(moved + 1);
+    memcpy(copy, bytecode + from, moved);
+    memmove(bytecode + from, bytecode + to, rest);
+    memcpy(bytecode + from + rest, copy, moved);
+    free(copy);
+
+    for (size_t i = 0; i < compiler->jump_count; ++i) {
+        struct jump* j = compiler->jumps + i;
+        const bool inside = j->operand >= from && j->operand < to;
+        if (j->target != JUMP_PENDING && j->target >= from && j->target < end) {
+            const bool with = j->target < to || (j->target == to && inside);
+            j->target = with ? j->target + rest : j->target - moved;
+        }
+        if (j->operand >= from && j->operand < end) {
+            j->operand = inside ? j->operand + rest : j->operand - moved;
+        }
+    }
+
+    compiler->label = end;
+    compiler->popped = NOWHERE;
+    compiler->returned = NOWHERE;
+    relax_jumps(compiler);
 }
 
-static void write_loop(struct mtr_chunk* chunk, u16 offset) {
-    mtr_write_chunk(chunk, MTR_OP_JMP);
-    i16 where = offset - chunk->size - 3;
-    write_u16(chunk, mtr_reinterpret_cast(u16, where));
+// the profile to lay out branches and matches by, NULL if they are written as they are
+static const struct mtr_profile* layout_profile(const struct compiler* compiler) {
+    return compiler->inlining && !compiler->lines ? compiler->inlining->profile : NULL;
 }
 
-static void write_expr(struct mtr_chunk* chunk, struct mtr_expr* expr);
+static void write_expr(struct compiler* compiler, struct mtr_expr* expr);
+
+static void write_primary(struct compiler* compiler, struct mtr_primary* expr) {
+    if (compiler->arguments && !expr->symbol.is_global) {
+        // the argument belongs to the caller
+        struct mtr_expr** arguments = compiler->arguments;
+        compiler->arguments = NULL;
+        write_expr(compiler, arguments[expr->symbol.index]);
+        compiler->arguments = arguments;
+        return;
+    }
 
-static void write_primary(struct mtr_chunk* chunk, struct mtr_primary* expr) {
+    mark_line(compiler, expr->symbol.token);
     u8 op = expr->symbol.is_global ? MTR_OP_GLOBAL_GET
         : expr->symbol.upvalue ? MTR_OP_UPVALUE_GET
         : MTR_OP_GET;
-    mtr_write_chunk(chunk, op);
-    write_u16(chunk, (u16)expr->symbol.index);
+    write_u8(compiler, op);
+    write_u16(compiler, (u16)expr->symbol.index);
+
+    if (expr->symbol.is_global && compiler->dependencies) {
+        mtr_add_dependency(compiler->dependencies, (u32) expr->symbol.index);
+    }
 }
 
-static void write_literal(struct mtr_chunk* chunk, struct mtr_literal* expr) {
+static void write_literal(struct compiler* compiler, struct mtr_literal* expr) {
+    mark_line(compiler, expr->literal);
     switch (expr->literal.type)
     {
     case MTR_TOKEN_INT_LITERAL: {
-        mtr_write_chunk(chunk, MTR_OP_INT);
+        write_u8(compiler, MTR_OP_INT);
         u64 value = evaluate_int(expr->literal);
-        write_u64(chunk, value);
+        write_u64(compiler, value);
         break;
     }
 
     case MTR_TOKEN_FLOAT_LITERAL: {
-        mtr_write_chunk(chunk, MTR_OP_FLOAT);
+        write_u8(compiler, MTR_OP_FLOAT);
         f64 value = evaluate_float(expr->literal);
-        write_u64(chunk, mtr_reinterpret_cast(u64, value));
+        write_u64(compiler, mtr_reinterpret_cast(u64, value));
         break;
     }
 
     case MTR_TOKEN_STRING_LITERAL: {
-        // this is weird
-        mtr_write_chunk(chunk, MTR_OP_STRING_LITERAL);
+        // the characters are stored inline so chunks don't point into the source
+        write_u8(compiler, MTR_OP_STRING_LITERAL);
         const char* string_start = expr->literal.start+1; // skip opening "
-        write_u64(chunk, mtr_reinterpret_cast(u64, string_start));
-        write_u32(chunk, expr->literal.length - 2); // skip closing "
+        const u32 length = (u32) expr->literal.length - 2; // skip closing "
+        write_u32(compiler, length);
+        for (u32 i = 0; i < length; ++i) {
+            write_u8(compiler, (u8) string_start[i]);
+        }
         break;
     }
 
     case MTR_TOKEN_TRUE: {
-        mtr_write_chunk(chunk, MTR_OP_TRUE);
+        write_u8(compiler, MTR_OP_TRUE);
         break;
     }
 
     case MTR_TOKEN_FALSE: {
-        mtr_write_chunk(chunk, MTR_OP_FALSE);
+        write_u8(compiler, MTR_OP_FALSE);
         break;
     }
     default:
@@ -146,70 +479,82 @@ static void write_literal(struct mtr_chunk* chunk, struct mtr_literal* expr) {
     }
 }
 
-static void write_array_literal(struct mtr_chunk* chunk, struct mtr_array_literal* array) {
+static void write_array_literal(struct compiler* compiler, struct mtr_array_literal* array) {
     for (u8 i = 0; i < array->count; ++i) {
         // We need to write them from last to first to keep the array order
         // Doing the for loop that way results in unsigned int wrapping around\, so it doesnt work
         u8 actual_index = array->count - i - 1;
-        write_expr(chunk, array->expressions[actual_index]);
+        write_expr(compiler, array->expressions[actual_index]);
     }
 
-    mtr_write_chunk(chunk, MTR_OP_ARRAY_LITERAL);
-    mtr_write_chunk(chunk, array->count);
+    write_u8(compiler, MTR_OP_ARRAY_LITERAL);
+    write_u8(compiler, array->count);
 }
 
-static void write_map_literal(struct mtr_chunk* chunk, struct mtr_map_literal* map) {
+static void write_map_literal(struct compiler* compiler, struct mtr_map_literal* map) {
     for (u8 i = 0; i < map->count; ++i) {
         u8 actual_index = map->count - i - 1;
         struct mtr_map_entry e = map->entries[actual_index];
-        write_expr(chunk, e.key);
-        write_expr(chunk, e.value);
+        write_expr(compiler, e.key);
+        write_expr(compiler, e.value);
     }
 
-    mtr_write_chunk(chunk, MTR_OP_MAP_LITERAL);
-    mtr_write_chunk(chunk, map->count);
+    write_u8(compiler, MTR_OP_MAP_LITERAL);
+    write_u8(compiler, map->count);
 }
 
-static void write_and(struct mtr_chunk* chunk, struct mtr_binary* expr) {
-    write_expr(chunk, expr->left);
-    u16 offset = write_jump(chunk, MTR_OP_AND);
+static void write_and(struct compiler* compiler, struct mtr_binary* expr) {
+    write_expr(compiler, expr->left);
+    size_t offset = write_jump(compiler, MTR_OP_AND);
 
-    write_expr(chunk, expr->right);
-    patch_jump(chunk, offset);
+    write_expr(compiler, expr->right);
+    patch_jump(compiler, offset);
 }
 
-static void write_or(struct mtr_chunk* chunk, struct mtr_binary* expr) {
-    write_expr(chunk, expr->left);
-    u16 left_true = write_jump(chunk, MTR_OP_OR);
+static void write_or(struct compiler* compiler, struct mtr_binary* expr) {
+    write_expr(compiler, expr->left);
+    size_t left_true = write_jump(compiler, MTR_OP_OR);
 
-    write_expr(chunk, expr->right);
-    patch_jump(chunk, left_true);
+    write_expr(compiler, expr->right);
+    patch_jump(compiler, left_true);
 }
 
-static void write_binary(struct mtr_chunk* chunk, struct mtr_binary* expr) {
+static void write_binary(struct compiler* compiler, struct mtr_binary* expr) {
     // handle && and || as they are short circuited
     if (expr->operator.token.type == MTR_TOKEN_AND) {
-        write_and(chunk, expr);
+        write_and(compiler, expr);
         return;
     } else if (expr->operator.token.type == MTR_TOKEN_OR) {
-        write_or(chunk, expr);
+        write_or(compiler, expr);
         return;
     }
 
-    write_expr(chunk, expr->left);
-    write_expr(chunk, expr->right);
+    write_expr(compiler, expr->left);
+    write_expr(compiler, expr->right);
+    mark_line(compiler, expr->operator.token);
 
 #define BINARY_OP(op)                                             \
     do {                                                          \
         if (expr->operator.type->type == MTR_DATA_INT) {           \
-            mtr_write_chunk(chunk, MTR_OP_ ## op ## _I);          \
+            write_u8(compiler, MTR_OP_ ## op ## _I);          \
         } else if (expr->operator.type->type == MTR_DATA_FLOAT) {  \
-            mtr_write_chunk(chunk, MTR_OP_ ## op ## _F);          \
+            write_u8(compiler, MTR_OP_ ## op ## _F);          \
         } else {                                                  \
             MTR_LOG_WARN("Invalid data type.");                   \
         }                                                         \
     } while (false)
 
+// debug code keeps the NOT on its own
+#define NEGATED_OP(op, fused)                                     \
+    do {                                                          \
+        if (compiler->lines) {                                    \
+            BINARY_OP(op);                                        \
+            write_u8(compiler, MTR_OP_NOT);                       \
+        } else {                                                  \
+            BINARY_OP(fused);                                     \
+        }                                                         \
+    } while (false)
+
     switch (expr->operator.token.type)
     {
     case MTR_TOKEN_PLUS:
@@ -233,8 +578,7 @@ static void write_binary(struct mtr_chunk* chunk, struct mtr_binary* expr) {
         break;
 
     case MTR_TOKEN_LESS_EQUAL:
-        BINARY_OP(GREATER);
-        mtr_write_chunk(chunk, MTR_OP_NOT);
+        NEGATED_OP(GREATER, LESS_EQUAL);
         break;
 
     case MTR_TOKEN_GREATER:
@@ -242,8 +586,7 @@ static void write_binary(struct mtr_chunk* chunk, struct mtr_binary* expr) {
         break;
 
     case MTR_TOKEN_GREATER_EQUAL:
-        BINARY_OP(LESS);
-        mtr_write_chunk(chunk, MTR_OP_NOT);
+        NEGATED_OP(LESS, GREATER_EQUAL);
         break;
 
     case MTR_TOKEN_EQUAL:
@@ -251,8 +594,7 @@ static void write_binary(struct mtr_chunk* chunk, struct mtr_binary* expr) {
         break;
 
     case MTR_TOKEN_BANG_EQUAL:
-        BINARY_OP(EQUAL);
-        mtr_write_chunk(chunk, MTR_OP_NOT);
+        NEGATED_OP(EQUAL, NOT_EQUAL);
         break;
 
     default:
@@ -260,21 +602,23 @@ static void write_binary(struct mtr_chunk* chunk, struct mtr_binary* expr) {
     }
 
 #undef BINARY_OP
+#undef NEGATED_OP
 }
 
-static void write_unary(struct mtr_chunk* chunk, struct mtr_unary* unary) {
-    write_expr(chunk, unary->right);
+static void write_unary(struct compiler* compiler, struct mtr_unary* unary) {
+    write_expr(compiler, unary->right);
+    mark_line(compiler, unary->operator.token);
 
     switch (unary->operator.token.type)
     {
     case MTR_TOKEN_BANG:
-        mtr_write_chunk(chunk, MTR_OP_NOT);
+        write_u8(compiler, MTR_OP_NOT);
         break;
     case MTR_TOKEN_MINUS:
         if (unary->operator.type->type == MTR_DATA_INT) {
-            mtr_write_chunk(chunk, MTR_OP_NEGATE_I);
+            write_u8(compiler, MTR_OP_NEGATE_I);
         } else {
-            mtr_write_chunk(chunk, MTR_OP_NEGATE_F);
+            write_u8(compiler, MTR_OP_NEGATE_F);
         }
         break;
     default:
@@ -282,28 +626,357 @@ static void write_unary(struct mtr_chunk* chunk, struct mtr_unary* unary) {
     }
 }
 
-static void write_call(struct mtr_chunk* chunk, struct mtr_call* call) {
+static bool global_callee(const struct mtr_call* call) {
+    return call->callable->type == MTR_EXPR_PRIMARY && ((const struct mtr_primary*) call->callable)->symbol.is_global;
+}
+
+// literals and calls of pure functions with constant arguments. Without fold it only looks at the form
+static bool is_constant(const struct mtr_expr* expr, const struct fold* fold) {
+    switch (expr->type) {
+    case MTR_EXPR_LITERAL: return true;
+    case MTR_EXPR_GROUPING: return is_constant(((const struct mtr_grouping*) expr)->expression, fold);
+    case MTR_EXPR_UNARY: return is_constant(((const struct mtr_unary*) expr)->right, fold);
+    case MTR_EXPR_CAST: return is_constant(((const struct mtr_cast*) expr)->right, fold);
+    case MTR_EXPR_BINARY: {
+        const struct mtr_binary* b = (const struct mtr_binary*) expr;
+        return is_constant(b->left, fold) && is_constant(b->right, fold);
+    }
+    case MTR_EXPR_ARRAY_LITERAL: {
+        const struct mtr_array_literal* a = (const struct mtr_array_literal*) expr;
+        for (u8 i = 0; i < a->count; ++i) {
+            if (!is_constant(a->expressions[i], fold)) {
+                return false;
+            }
+        }
+        return true;
+    }
+    case MTR_EXPR_MAP_LITERAL: {
+        const struct mtr_map_literal* m = (const struct mtr_map_literal*) expr;
+        for (u8 i = 0; i < m->count; ++i) {
+            if (!is_constant(m->entries[i].key, fold) || !is_constant(m->entries[i].value, fold)) {
+                return false;
+            }
+        }
+        return true;
+    }
+    case MTR_EXPR_CALL: {
+        const struct mtr_call* call = (const struct mtr_call*) expr;
+        if (!global_callee(call) || (fold && !fold->pure[((const struct mtr_primary*) call->callable)->symbol.index])) {
+            return false;
+        }
+        for (u8 i = 0; i < call->argc; ++i) {
+            if (!is_constant(call->argv[i], fold)) {
+                return false;
+            }
+        }
+        return true;
+    }
+    default:
+        return false;
+    }
+}
+
+// types whose values can be written back as literals
+static bool has_literal(const struct mtr_type* type) {
+    switch (type->type) {
+    case MTR_DATA_BOOL:
+    case MTR_DATA_INT:
+    case MTR_DATA_FLOAT:
+    case MTR_DATA_STRING:
+        return true;
+    case MTR_DATA_ARRAY: return has_literal(((const struct mtr_array_type*) type)->element);
+    case MTR_DATA_MAP: {
+        const struct mtr_map_type* m = (const struct mtr_map_type*) type;
+        return has_literal(m->key) && has_literal(m->value);
+    }
+    default:
+        return false;
+    }
+}
+
+// writes value as the literal that creates it. False if it is too big for one
+static bool write_value(struct compiler* compiler, const struct mtr_type* type, mtr_value value) {
+    switch (type->type) {
+    case MTR_DATA_BOOL:
+        write_u8(compiler, MTR_AS_INT(value) ? MTR_OP_TRUE : MTR_OP_FALSE);
+        return true;
+    case MTR_DATA_INT:
+        write_u8(compiler, MTR_OP_INT);
+        write_u64(compiler, (u64) MTR_AS_INT(value));
+        return true;
+    case MTR_DATA_FLOAT:
+        write_u8(compiler, MTR_OP_FLOAT);
+        write_u64(compiler, mtr_reinterpret_cast(u64, MTR_AS_FLOAT(value)));
+        return true;
+    case MTR_DATA_STRING: {
+        const struct mtr_string* string = (const struct mtr_string*) MTR_AS_OBJ(value);
+        write_u8(compiler, MTR_OP_STRING_LITERAL);
+        write_u32(compiler, (u32) string->length);
+        for (size_t i = 0; i < string->length; ++i) {
+            write_u8(compiler, (u8) string->s[i]);
+        }
+        return true;
+    }
+    case MTR_DATA_ARRAY: {
+        const struct mtr_array* array = (const struct mtr_array*) MTR_AS_OBJ(value);
+        const struct mtr_type* element = ((const struct mtr_array_type*) type)->element;
+        if (array->size > UINT8_MAX) {
+            return false;
+        }
+        // from last to first, like write_array_literal
+        for (size_t i = array->size; i > 0; --i) {
+            if (!write_value(compiler, element, array->elements[i - 1])) {
+                return false;
+            }
+        }
+        write_u8(compiler, MTR_OP_ARRAY_LITERAL);
+        write_u8(compiler, (u8) array->size);
+        return true;
+    }
+    case MTR_DATA_MAP: {
+        struct mtr_map* map = (struct mtr_map*) MTR_AS_OBJ(value);
+        const struct mtr_map_type* m = (const struct mtr_map_type*) type;
+        if (map->size > UINT8_MAX) {
+            return false;
+        }
+        size_t index = 0;
+        for (struct mtr_map_element* e = mtr_map_next(map, &index); e; e = mtr_map_next(map, &index)) {
+            if (!write_value(compiler, m->key, e->key) || !write_value(compiler, m->value, e->value)) {
+                return false;
+            }
+        }
+        write_u8(compiler, MTR_OP_MAP_LITERAL);
+        write_u8(compiler, (u8) map->size);
+        return true;
+    }
+    default:
+        break;
+    }
+    return false;
+}
+
+static void write_call(struct compiler* compiler, struct mtr_call* call);
+
+// runs the call in the sandbox and writes its result instead of the call
+static bool fold_call(struct compiler* compiler, struct mtr_call* call) {
+    // struct constructors are called too
+    const struct mtr_primary* callee = (const struct mtr_primary*) call->callable;
+    if (callee->symbol.type->type != MTR_DATA_FN || !is_constant((const struct mtr_expr*) call, compiler->fold)) {
+        return false;
+    }
+
+    const struct mtr_type* result = ((const struct mtr_function_type*) callee->symbol.type)->return_;
+    if (!has_literal(result)) {
+        return false;
+    }
+
+    struct compiler evaluator;
+    init_compiler(&evaluator, NULL);
+    write_call(&evaluator, call);
+    write_u8(&evaluator, MTR_OP_RETURN);
+    struct mtr_chunk chunk = end_compiler(&evaluator);
+
+    // a result that can't be written leaves nothing behind. Values never add jumps
+    const size_t start = compiler->chunk.size;
+    mtr_value value;
+    struct mtr_engine* engine = compiler->fold->engine;
+    bool ok = mtr_evaluate(engine, compiler->fold->package, chunk, FOLD_BUDGET, &value)
+        && write_value(compiler, result, value)
+        && compiler->chunk.size - start <= FOLD_MAX_SIZE;
+    if (!ok) {
+        compiler->chunk.size = start;
+    }
+
+    mtr_engine_collect(engine);
+    mtr_delete_chunk(&chunk);
+    return ok;
+}
+
+static size_t expr_size(const struct mtr_expr* expr) {
+    switch (expr->type) {
+    case MTR_EXPR_PRIMARY:
+    case MTR_EXPR_LITERAL:
+        return 1;
+    case MTR_EXPR_GROUPING: return expr_size(((const struct mtr_grouping*) expr)->expression);
+    case MTR_EXPR_UNARY: return 1 + expr_size(((const struct mtr_unary*) expr)->right);
+    case MTR_EXPR_CAST: return 1 + expr_size(((const struct mtr_cast*) expr)->right);
+    case MTR_EXPR_VARIANT: return 1 + expr_size(((const struct mtr_variant*) expr)->value);
+    case MTR_EXPR_ACCESS: return 1 + expr_size(((const struct mtr_access*) expr)->object);
+    case MTR_EXPR_SUBSCRIPT: {
+        const struct mtr_access* a = (const struct mtr_access*) expr;
+        return 1 + expr_size(a->object) + expr_size(a->element);
+    }
+    case MTR_EXPR_BINARY: {
+        const struct mtr_binary* b = (const struct mtr_binary*) expr;
+        return 1 + expr_size(b->left) + expr_size(b->right);
+    }
+    case MTR_EXPR_ARRAY_LITERAL: {
+        const struct mtr_array_literal* a = (const struct mtr_array_literal*) expr;
+        size_t size = 1;
+        for (u8 i = 0; i < a->count; ++i) {
+            size += expr_size(a->expressions[i]);
+        }
+        return size;
+    }
+    case MTR_EXPR_MAP_LITERAL: {
+        const struct mtr_map_literal* m = (const struct mtr_map_literal*) expr;
+        size_t size = 1;
+        for (u8 i = 0; i < m->count; ++i) {
+            size += expr_size(m->entries[i].key) + expr_size(m->entries[i].value);
+        }
+        return size;
+    }
+    case MTR_EXPR_CALL: {
+        const struct mtr_call* c = (const struct mtr_call*) expr;
+        size_t size = 1 + expr_size(c->callable);
+        for (u8 i = 0; i < c->argc; ++i) {
+            size += expr_size(c->argv[i]);
+        }
+        return size;
+    }
+    }
+    return INLINE_MAX_SIZE + 1;
+}
+
+// values and variables, evaluating them again gives the same thing
+static bool is_simple(const struct mtr_expr* expr) {
+    switch (expr->type) {
+    case MTR_EXPR_PRIMARY:
+    case MTR_EXPR_LITERAL:
+        return true;
+    case MTR_EXPR_GROUPING: return is_simple(((const struct mtr_grouping*) expr)->expression);
+    case MTR_EXPR_VARIANT: return is_simple(((const struct mtr_variant*) expr)->value);
+    default:
+        return false;
+    }
+}
+
+// the expression a function does nothing but return, NULL if it does more
+static struct mtr_expr* inline_body(const struct mtr_stmt* stmt) {
+    const struct mtr_function_decl* fn = (const struct mtr_function_decl*) stmt;
+    if (stmt->type != MTR_STMT_FN || fn->generic || fn->body == NULL) {
+        return NULL;
+    }
+
+    const struct mtr_stmt* body = fn->body;
+    if (body->type == MTR_STMT_BLOCK || body->type == MTR_STMT_SCOPE) {
+        const struct mtr_block* block = (const struct mtr_block*) body;
+        if (block->size != 1) {
+            return NULL;
+        }
+        body = block->statements[0];
+    }
+
+    if (body->type != MTR_STMT_RETURN) {
+        return NULL;
+    }
+
+    struct mtr_expr* expr = ((const struct mtr_return*) body)->expr;
+    return expr != NULL && expr_size(expr) <= INLINE_MAX_SIZE ? expr : NULL;
+}
+
+static bool inline_call(struct compiler* compiler, struct mtr_call* call) {
+    const struct mtr_primary* callee = (const struct mtr_primary*) call->callable;
+    if (callee->symbol.index == compiler->global) {
+        return false;
+    }
+
+    for (u8 i = 0; i < call->argc; ++i) {
+        if (!is_simple(call->argv[i])) {
+            return false;
+        }
+    }
+
+    // with simple arguments no call is written before this one, so it is the next one
+    const u64 site = mtr_profile_site(compiler->global, compiler->calls);
+    if (mtr_profile_get(compiler->inlining->profile, site) < MTR_PROFILE_HOT) {
+        return false;
+    }
+
+    struct mtr_expr* expr = inline_body(compiler->inlining->globals->statements[callee->symbol.index]);
+    if (expr == NULL) {
+        return false;
+    }
+
+    compiler->arguments = call->argv;
+    write_expr(compiler, expr);
+    compiler->arguments = NULL;
+    return true;
+}
+
+static u8 tag_kind(const struct mtr_type* type) {
+    switch (type->type) {
+    case MTR_DATA_BOOL:
+    case MTR_DATA_INT: return MTR_TAG_INT;
+    case MTR_DATA_FLOAT: return MTR_TAG_FLOAT;
+    case MTR_DATA_STRING: return MTR_TAG_STRING;
+    case MTR_DATA_ARRAY: return MTR_TAG_ARRAY;
+    case MTR_DATA_MAP: return MTR_TAG_MAP;
+    case MTR_DATA_STRUCT: return MTR_TAG_STRUCT;
+    case MTR_DATA_FN: return MTR_TAG_FN;
+    default: return MTR_TAG_ANY;
+    }
+}
+
+static void write_tag(struct compiler* compiler, const struct mtr_union_type* u) {
+    write_u8(compiler, MTR_OP_TAG);
+    write_u16(compiler, u->argc);
+    for (u16 i = 0; i < u->argc; ++i) {
+        write_u8(compiler, tag_kind(u->types[i]));
+    }
+}
+
+static void write_call_value(struct compiler* compiler, struct mtr_call* call);
+
+static void write_call(struct compiler* compiler, struct mtr_call* call) {
+    write_call_value(compiler, call);
+    if (call->returns) {
+        write_tag(compiler, call->returns);
+    }
+}
+
+static void write_call_value(struct compiler* compiler, struct mtr_call* call) {
+    if (compiler->info) {
+        if (!global_callee(call)) {
+            compiler->info->impure = true;
+        } else if (is_constant((const struct mtr_expr*) call, NULL)) {
+            compiler->info->constant_calls = true;
+        }
+    }
+
+    if (compiler->fold && global_callee(call) && fold_call(compiler, call)) {
+        return;
+    }
+
+    // calls of inlined expressions don't count, the profile is of code without them
+    const bool counted = compiler->arguments == NULL;
+    if (compiler->inlining && counted && global_callee(call) && inline_call(compiler, call)) {
+        compiler->calls++;
+        return;
+    }
+
     for (u8 i = 0; i < call->argc; ++i) {
         struct mtr_expr* expr = call->argv[i];
-        write_expr(chunk, expr);
+        write_expr(compiler, expr);
     }
 
-    write_expr(chunk, call->callable);
-    mtr_write_chunk(chunk, MTR_OP_CALL);
-    mtr_write_chunk(chunk, call->argc);
+    write_expr(compiler, call->callable);
+    write_u8(compiler, MTR_OP_CALL);
+    write_u8(compiler, call->argc);
+    compiler->calls += counted;
 }
 
-static void write_cast(struct mtr_chunk* chunk, struct mtr_cast* cast) {
-    write_expr(chunk, cast->right);
+static void write_cast(struct compiler* compiler, struct mtr_cast* cast) {
+    write_expr(compiler, cast->right);
 
     switch (cast->to.type) {
     case MTR_DATA_FLOAT: {
-        mtr_write_chunk(chunk, MTR_OP_FLOAT_CAST);
+        write_u8(compiler, MTR_OP_FLOAT_CAST);
         break;
     }
 
     case MTR_DATA_INT: {
-        mtr_write_chunk(chunk, MTR_OP_INT_CAST);
+        write_u8(compiler, MTR_OP_INT_CAST);
         break;
     }
 
@@ -312,39 +985,46 @@ static void write_cast(struct mtr_chunk* chunk, struct mtr_cast* cast) {
     }
 }
 
-static void write_subscript(struct mtr_chunk* chunk, struct mtr_access* expr) {
-    write_expr(chunk, expr->object);
-    write_expr(chunk, expr->element);
-    mtr_write_chunk(chunk, MTR_OP_INDEX_GET);
+static void write_subscript(struct compiler* compiler, struct mtr_access* expr) {
+    write_expr(compiler, expr->object);
+    write_expr(compiler, expr->element);
+    write_u8(compiler, MTR_OP_INDEX_GET);
 }
 
-static void write_access(struct mtr_chunk* chunk, struct mtr_access* expr) {
-    write_expr(chunk, expr->object);
+static void write_access(struct compiler* compiler, struct mtr_access* expr) {
+    write_expr(compiler, expr->object);
     struct mtr_primary* p = (struct mtr_primary*) expr->element;
-    mtr_write_chunk(chunk, MTR_OP_STRUCT_GET);
-    write_u16(chunk, p->symbol.index);
+    write_u8(compiler, MTR_OP_STRUCT_GET);
+    write_u16(compiler, p->symbol.index);
 }
 
-static void write_expr(struct mtr_chunk* chunk, struct mtr_expr* expr) {
+static void write_variant(struct compiler* compiler, struct mtr_variant* expr) {
+    write_expr(compiler, expr->value);
+    write_u8(compiler, MTR_OP_VARIANT);
+    write_u16(compiler, expr->tag);
+}
+
+static void write_expr(struct compiler* compiler, struct mtr_expr* expr) {
     switch (expr->type)
     {
-    case MTR_EXPR_BINARY:  write_binary(chunk, (struct mtr_binary*) expr); return;
-    case MTR_EXPR_PRIMARY: write_primary(chunk, (struct mtr_primary*) expr); return;
-    case MTR_EXPR_LITERAL: write_literal(chunk, (struct mtr_literal*) expr); return;
-    case MTR_EXPR_ARRAY_LITERAL: write_array_literal(chunk, (struct mtr_array_literal*) expr); return;
-    case MTR_EXPR_MAP_LITERAL: write_map_literal(chunk, (struct mtr_map_literal*) expr); return;
-    case MTR_EXPR_UNARY:   write_unary(chunk, (struct mtr_unary*) expr); return;
-    case MTR_EXPR_GROUPING: write_expr(chunk, ((struct mtr_grouping*) expr)->expression); return;
-    case MTR_EXPR_CALL: write_call(chunk, (struct mtr_call*) expr); return;
-    case MTR_EXPR_CAST: write_cast(chunk, (struct mtr_cast*) expr); return;
-    case MTR_EXPR_ACCESS: write_access(chunk, (struct mtr_access*) expr); return;
-    case MTR_EXPR_SUBSCRIPT: write_subscript(chunk, (struct mtr_access*) expr); return;
+    case MTR_EXPR_BINARY:  write_binary(compiler, (struct mtr_binary*) expr); return;
+    case MTR_EXPR_PRIMARY: write_primary(compiler, (struct mtr_primary*) expr); return;
+    case MTR_EXPR_LITERAL: write_literal(compiler, (struct mtr_literal*) expr); return;
+    case MTR_EXPR_ARRAY_LITERAL: write_array_literal(compiler, (struct mtr_array_literal*) expr); return;
+    case MTR_EXPR_MAP_LITERAL: write_map_literal(compiler, (struct mtr_map_literal*) expr); return;
+    case MTR_EXPR_UNARY:   write_unary(compiler, (struct mtr_unary*) expr); return;
+    case MTR_EXPR_GROUPING: write_expr(compiler, ((struct mtr_grouping*) expr)->expression); return;
+    case MTR_EXPR_CALL: write_call(compiler, (struct mtr_call*) expr); return;
+    case MTR_EXPR_CAST: write_cast(compiler, (struct mtr_cast*) expr); return;
+    case MTR_EXPR_ACCESS: write_access(compiler, (struct mtr_access*) expr); return;
+    case MTR_EXPR_SUBSCRIPT: write_subscript(compiler, (struct mtr_access*) expr); return;
+    case MTR_EXPR_VARIANT: write_variant(compiler, (struct mtr_variant*) expr); return;
     }
 }
 
-static void write(struct mtr_chunk* chunk, struct mtr_stmt* stmt);
+static void write(struct compiler* compiler, struct mtr_stmt* stmt);
 
-static void write_variable(struct mtr_chunk* chunk, struct mtr_variable* var) {
+static void write_variable(struct compiler* compiler, struct mtr_variable* var) {
     u8 nil_op;
 
     switch (var->symbol.type->type) {
@@ -374,75 +1054,293 @@ static void write_variable(struct mtr_chunk* chunk, struct mtr_variable* var) {
     }
     }
 
+    mark_line(compiler, var->symbol.token);
     if (NULL == var->value) {
-        mtr_write_chunk(chunk, nil_op);
+        write_u8(compiler, nil_op);
     } else {
-        write_expr(chunk, var->value);
+        write_expr(compiler, var->value);
+    }
+}
+
+// Outside of debug code nothing is written when there is nothing to pop or the code before
+// returned, and it is added to a POP_V right before it. Unless a jump lands in between
+static void write_pop_v(struct compiler* compiler, u16 count) {
+    const size_t at = compiler->chunk.size;
+    if (!compiler->lines) {
+        const bool label = compiler->label == at;
+        if (count == 0 || (!label && compiler->returned == at)) {
+            return;
+        }
+
+        if (!label && compiler->popped == at) {
+            u8* operand = compiler->chunk.bytecode + at - sizeof(u16);
+            u16 popped;
+            memcpy(&popped, operand, sizeof(u16));
+            if (popped <= UINT16_MAX - count) {
+                popped += count;
+                memcpy(operand, &popped, sizeof(u16));
+                return;
+            }
+        }
     }
+
+    write_u8(compiler, MTR_OP_POP_V);
+    write_u16(compiler, count);
+    compiler->popped = compiler->chunk.size;
 }
 
-static void write_block(struct mtr_chunk* chunk, struct mtr_block* stmt) {
+static void write_block(struct compiler* compiler, struct mtr_block* stmt) {
     for (size_t i = 0; i < stmt->size; ++i) {
         struct mtr_stmt* s = stmt->statements[i];
-        write(chunk, s);
+        write(compiler, s);
     }
 
-    mtr_write_chunk(chunk, MTR_OP_POP_V);
-    write_u16(chunk, stmt->var_count);
+    write_pop_v(compiler, stmt->var_count);
 }
 
-static void write_if(struct mtr_chunk* chunk, struct mtr_if* stmt) {
-    write_expr(chunk, stmt->condition);
-    u16 offset = write_jump(chunk, MTR_OP_JMP_Z);
+// the comparison that is true when the one in token isn't, they all have an instruction of their own
+static enum mtr_token_type negated(enum mtr_token_type token) {
+    switch (token) {
+    case MTR_TOKEN_LESS:          return MTR_TOKEN_GREATER_EQUAL;
+    case MTR_TOKEN_LESS_EQUAL:    return MTR_TOKEN_GREATER;
+    case MTR_TOKEN_GREATER:       return MTR_TOKEN_LESS_EQUAL;
+    case MTR_TOKEN_GREATER_EQUAL: return MTR_TOKEN_LESS;
+    case MTR_TOKEN_EQUAL:         return MTR_TOKEN_BANG_EQUAL;
+    case MTR_TOKEN_BANG_EQUAL:    return MTR_TOKEN_EQUAL;
+    default:
+        return MTR_TOKEN_INVALID;
+    }
+}
+
+// Writes the opposite of the condition when that takes no more code than the condition, returns false if it doesn't
+static bool write_negated(struct compiler* compiler, struct mtr_expr* condition) {
+    switch (condition->type) {
+    case MTR_EXPR_GROUPING:
+        return write_negated(compiler, ((struct mtr_grouping*) condition)->expression);
+
+    case MTR_EXPR_UNARY: {
+        struct mtr_unary* unary = (struct mtr_unary*) condition;
+        if (unary->operator.token.type != MTR_TOKEN_BANG) {
+            return false;
+        }
+        write_expr(compiler, unary->right);
+        return true;
+    }
+
+    case MTR_EXPR_BINARY: {
+        struct mtr_binary opposite = *(struct mtr_binary*) condition;
+        const enum mtr_data_type type = opposite.operator.type ? opposite.operator.type->type : MTR_DATA_INVALID;
+        opposite.operator.token.type = negated(opposite.operator.token.type);
+        if (opposite.operator.token.type == MTR_TOKEN_INVALID || (type != MTR_DATA_INT && type != MTR_DATA_FLOAT)) {
+            return false;
+        }
+        write_binary(compiler, &opposite);
+        return true;
+    }
+
+    default:
+        return false;
+    }
+}
+
+// The arm that is jumped to runs one instruction less than the one that jumps over the other at its end.
+// When the profile says the condition is mostly true, the condition is negated and the arms swap places
+static void write_if(struct compiler* compiler, struct mtr_if* stmt) {
+    const u32 branch = compiler->branches++;
+    const struct mtr_profile* profile = layout_profile(compiler);
+    bool swapped = false;
+    if (profile && stmt->otherwise) {
+        const u64 taken = mtr_profile_get(profile, mtr_profile_branch(compiler->global, branch, true));
+        const u64 not_taken = mtr_profile_get(profile, mtr_profile_branch(compiler->global, branch, false));
+        swapped = taken + not_taken >= MTR_PROFILE_HOT && not_taken > taken && write_negated(compiler, stmt->condition);
+    }
+
+    if (swapped) {
+        // the arms are written in order, so the sites in them keep their positions.
+        // Nothing is merged into the end of the then arm, it moves away from the otherwise arm
+        size_t offset = write_jump(compiler, MTR_OP_JMP_Z);
+        const size_t then = compiler->chunk.size;
+        write(compiler, stmt->then);
+        const size_t otherwise = compiler->chunk.size;
+        compiler->label = otherwise;
+        write(compiler, stmt->otherwise);
+        size_t end = write_jump(compiler, MTR_OP_JMP);
+        move_behind(compiler, then, otherwise);
+
+        compiler->jumps[offset].target = compiler->chunk.size - (otherwise - then);
+        relax_jumps(compiler);
+        patch_jump(compiler, end);
+        return;
+    }
+
+    write_expr(compiler, stmt->condition);
+    size_t offset = write_jump(compiler, MTR_OP_JMP_Z);
 
-    write(chunk, stmt->then);
+    write(compiler, stmt->then);
 
     if (stmt->otherwise) {
-        u16 otherwise = write_jump(chunk, MTR_OP_JMP);
-        patch_jump(chunk, offset);
-        write(chunk, stmt->otherwise);
-        patch_jump(chunk, otherwise);
+        size_t otherwise = write_jump(compiler, MTR_OP_JMP);
+        patch_jump(compiler, offset);
+        write(compiler, stmt->otherwise);
+        patch_jump(compiler, otherwise);
+    } else {
+        patch_jump(compiler, offset);
+    }
+}
+
+static void write_while(struct compiler* compiler, struct mtr_while* stmt) {
+    compiler->branches++;
+    write_expr(compiler, stmt->condition);
+    size_t offset = write_jump(compiler, MTR_OP_JMP_Z);
+
+    write(compiler, stmt->body);
+
+    write_expr(compiler, stmt->condition); // we need to write the condition again because it was popped
+    write_loop(compiler, jump_location(compiler, offset));
+
+    patch_jump(compiler, offset);
+}
+
+// The condition lives at the bottom so each iteration runs a single FOR_* instruction.
+// Its backward jump is always an i32 so the operand layout is fixed: [op][i32][u16 slot]
+static void write_for(struct compiler* compiler, struct mtr_for* stmt) {
+    static const u8 ops[] = {
+        [MTR_FOR_RANGE] = MTR_OP_FOR_RANGE,
+        [MTR_FOR_ARRAY] = MTR_OP_FOR_ARRAY,
+        [MTR_FOR_MAP] = MTR_OP_FOR_MAP
+    };
+
+    write_expr(compiler, stmt->iterable);
+    if (stmt->kind == MTR_FOR_RANGE) {
+        write_expr(compiler, stmt->end);
     } else {
-        patch_jump(chunk, offset);
+        write_u8(compiler, MTR_OP_NIL); // NIL is an Int 0 so it doubles as the starting index
+    }
+
+    u16 vars = stmt->kind == MTR_FOR_MAP ? 2 : 1;
+    for (u16 i = 0; i < vars; ++i) {
+        write_u8(compiler, MTR_OP_NIL);
+    }
+
+    size_t entry = write_jump(compiler, MTR_OP_JMP);
+    write(compiler, stmt->body);
+    patch_jump(compiler, entry);
+
+    // the body starts right after the entry jump, which may have been widened by now
+    const struct jump* j = compiler->jumps + entry;
+    size_t body = j->operand + jump_size(j);
+
+    write_u8(compiler, ops[stmt->kind]);
+    size_t loop = add_jump(compiler, body, true);
+    write_u16(compiler, stmt->slot);
+    encode_jump(compiler, compiler->jumps + loop);
+
+    write_pop_v(compiler, 2 + vars);
+}
+
+// the case the profile saw most often, -1 if the match isn't hot
+static i32 hottest_case(const struct compiler* compiler, const struct mtr_match* stmt, u32 match) {
+    const struct mtr_profile* profile = layout_profile(compiler);
+    if (profile == NULL) {
+        return -1;
+    }
+
+    i32 hottest = -1;
+    u64 most = 0;
+    u64 total = 0;
+    for (u16 i = 0; i < stmt->count; ++i) {
+        const u64 seen = mtr_profile_get(profile, mtr_profile_variant(compiler->global, match, stmt->cases[i].variant));
+        total += seen;
+        if (seen > most) {
+            most = seen;
+            hottest = i;
+        }
     }
+    return total >= MTR_PROFILE_HOT ? hottest : -1;
 }
 
-static void write_while(struct mtr_chunk* chunk, struct mtr_while* stmt) {
-    write_expr(chunk, stmt->condition);
-    u16 offset = write_jump(chunk, MTR_OP_JMP_Z);
+// MATCH is followed by one i32 offset per union member and jumps through the entry of the value's tag.
+// The matched value stays in its slot until the end of the match. Without an else the last case
+// needs no jump to the end, so the one the profile saw most often is moved there.
+static void write_match(struct compiler* compiler, struct mtr_match* stmt) {
+    const u32 match = compiler->matches++;
+    const i32 last = stmt->otherwise ? -1 : stmt->count - 1;
+    const i32 hot = stmt->otherwise ? -1 : hottest_case(compiler, stmt, match);
+    const i32 falls = hot >= 0 ? hot : last;
+
+    write_expr(compiler, stmt->expr);
+    write_u8(compiler, MTR_OP_MATCH);
+    write_u16(compiler, stmt->variants);
+
+    const size_t table = compiler->jump_count;
+    for (u16 i = 0; i < stmt->variants; ++i) {
+        add_jump(compiler, JUMP_PENDING, true);
+    }
+
+    // the cases are written in order, so the sites in them keep their positions
+    size_t* exits = malloc(sizeof(size_t) * (stmt->count + 1));
+    size_t from = 0;
+    size_t to = 0;
+    for (u16 i = 0; i < stmt->count; ++i) {
+        const struct mtr_match_case* c = stmt->cases + i;
+        patch_jump(compiler, table + c->variant);
+        from = i == falls ? compiler->chunk.size : from;
+        write(compiler, c->body);
+        to = i == falls ? compiler->chunk.size : to;
+        if (i != falls) {
+            exits[i] = write_jump(compiler, MTR_OP_JMP);
+        }
+    }
+
+    if (falls >= 0 && falls != last) {
+        move_behind(compiler, from, to);
+        compiler->jumps[table + stmt->cases[falls].variant].target = compiler->chunk.size - (to - from);
+        relax_jumps(compiler);
+    }
 
-    write(chunk, stmt->body);
+    if (stmt->otherwise) {
+        for (u16 i = 0; i < stmt->variants; ++i) {
+            if (compiler->jumps[table + i].target == JUMP_PENDING) {
+                patch_jump(compiler, table + i);
+            }
+        }
+        write(compiler, stmt->otherwise);
+    }
 
-    write_expr(chunk, stmt->condition); // we need to write the condition again because it was popped
-    write_loop(chunk, offset);
+    for (u16 i = 0; i < stmt->count; ++i) {
+        if (i != falls) {
+            patch_jump(compiler, exits[i]);
+        }
+    }
+    free(exits);
 
-    patch_jump(chunk, offset);
+    write_pop_v(compiler, 1);
 }
 
-static void write_assignment(struct mtr_chunk* chunk, struct mtr_assignment* stmt) {
-    write_expr(chunk, stmt->expression);
+static void write_assignment(struct compiler* compiler, struct mtr_assignment* stmt) {
+    write_expr(compiler, stmt->expression);
 
     switch (stmt->right->type) {
     case MTR_EXPR_PRIMARY: {
         struct mtr_primary* p = (struct mtr_primary*) stmt->right;
         u8 op = p->symbol.upvalue ? MTR_OP_UPVALUE_SET : MTR_OP_SET;
-        mtr_write_chunk(chunk, op);
-        write_u16(chunk, p->symbol.index);
+        write_u8(compiler, op);
+        write_u16(compiler, p->symbol.index);
         return;
     }
     case MTR_EXPR_SUBSCRIPT: {
         struct mtr_access* s = (struct mtr_access*) stmt->right;
-        write_expr(chunk, s->object);
-        write_expr(chunk, s->element);
-        mtr_write_chunk(chunk, MTR_OP_INDEX_SET);
+        write_expr(compiler, s->object);
+        write_expr(compiler, s->element);
+        write_u8(compiler, MTR_OP_INDEX_SET);
         return;
     }
     case MTR_EXPR_ACCESS: {
         struct mtr_access* s = (struct mtr_access*) stmt->right;
-        write_expr(chunk, s->object);
+        write_expr(compiler, s->object);
         struct mtr_primary* p = (struct mtr_primary*) s->element;
-        mtr_write_chunk(chunk, MTR_OP_STRUCT_SET);
-        write_u16(chunk, p->symbol.index);
+        write_u8(compiler, MTR_OP_STRUCT_SET);
+        write_u16(compiler, p->symbol.index);
         return;
     }
 
@@ -452,58 +1350,85 @@ static void write_assignment(struct mtr_chunk* chunk, struct mtr_assignment* stm
     MTR_ASSERT(false, "Invalid expr type.");
 }
 
-static void write_return(struct mtr_chunk* chunk, struct mtr_return* stmt) {
+static void write_return(struct compiler* compiler, struct mtr_return* stmt) {
     if (stmt->expr) {
-        write_expr(chunk, stmt->expr);
+        write_expr(compiler, stmt->expr);
     } else {
-        mtr_write_chunk(chunk, MTR_OP_NIL);
+        write_u8(compiler, MTR_OP_NIL);
     }
 
-    mtr_write_chunk(chunk, MTR_OP_RETURN);
+    write_u8(compiler, MTR_OP_RETURN);
+    compiler->returned = compiler->chunk.size;
 }
 
-static void write_call_stmt(struct mtr_chunk* chunk, struct mtr_call_stmt* call) {
-    write_expr(chunk, call->call);
-    mtr_write_chunk(chunk, MTR_OP_POP);
+static void write_call_stmt(struct compiler* compiler, struct mtr_call_stmt* call) {
+    write_expr(compiler, call->call);
+    write_u8(compiler, MTR_OP_POP);
 }
 
-static void write_function(struct mtr_chunk* chunk, struct mtr_function_decl* fn) {
-    write(chunk, fn->body);
+static void write_function(struct compiler* compiler, struct mtr_function_decl* fn) {
+    write(compiler, fn->body);
 }
 
-static void write_closure(struct mtr_chunk* chunk, struct mtr_closure_decl* c) {
-    struct mtr_chunk closure_chunk = mtr_new_chunk();
-    write_function(&closure_chunk, c->function);
+static void write_closure(struct compiler* compiler, struct mtr_closure_decl* c) {
+    if (compiler->info) {
+        compiler->info->impure = true;
+    }
 
-    struct mtr_closure* closure = mtr_new_closure(closure_chunk, NULL, c->count);
+    struct compiler closure_compiler;
+    init_compiler(&closure_compiler, compiler->dependencies);
+    closure_compiler.lines = compiler->lines;
+    write_function(&closure_compiler, c->function);
 
-    mtr_write_chunk(chunk, MTR_OP_CLOSURE);
-    write_u64(chunk, mtr_reinterpret_cast(u64, closure));
+    write_u8(compiler, MTR_OP_CLOSURE);
+    write_u16(compiler, c->count);
 
     for (u16 i = 0; i < c->count; ++i) {
         struct mtr_upvalue_symbol s = c->upvalues[i];
-        write_u16(chunk, (u16)s.index);
-        mtr_write_chunk(chunk, s.local);
+        write_u16(compiler, (u16)s.index);
+        write_u8(compiler, s.local);
+    }
+
+    // the closure code is stored inline and every execution creates a closure that borrows it.
+    // Its lines go in the table of the enclosing function, which the closure borrows too
+    const u32 code = (u32) (compiler->chunk.size + sizeof(u32));
+    const u32 line = compiler->mark_count > 0 ? compiler->marks[compiler->mark_count - 1].line : 0;
+    for (size_t i = 0; i < closure_compiler.mark_count; ++i) {
+        add_mark(compiler, code + closure_compiler.marks[i].offset, closure_compiler.marks[i].line);
+    }
+    closure_compiler.lines = NULL;
+    struct mtr_chunk chunk = end_compiler(&closure_compiler);
+
+    write_u32(compiler, (u32) chunk.size);
+    for (size_t i = 0; i < chunk.size; ++i) {
+        write_u8(compiler, chunk.bytecode[i]);
+    }
+    mtr_delete_chunk(&chunk);
+
+    if (line > 0) {
+        add_mark(compiler, (u32) compiler->chunk.size, line);
     }
 }
 
-static void write(struct mtr_chunk* chunk, struct mtr_stmt* stmt) {
+static void write(struct compiler* compiler, struct mtr_stmt* stmt) {
     switch (stmt->type)
     {
-    case MTR_STMT_VAR:   write_variable(chunk, (struct mtr_variable*) stmt); return;
+    case MTR_STMT_VAR:   write_variable(compiler, (struct mtr_variable*) stmt); return;
 
-    case MTR_STMT_IF:    write_if(chunk, (struct mtr_if*) stmt); return;
-    case MTR_STMT_WHILE: write_while(chunk, (struct mtr_while*) stmt); return;
+    case MTR_STMT_IF:    write_if(compiler, (struct mtr_if*) stmt); return;
+    case MTR_STMT_WHILE: write_while(compiler, (struct mtr_while*) stmt); return;
+    case MTR_STMT_FOR: write_for(compiler, (struct mtr_for*) stmt); return;
+    case MTR_STMT_MATCH: write_match(compiler, (struct mtr_match*) stmt); return;
 
     // scopes are just for validation purposes
     case MTR_STMT_SCOPE:
     case MTR_STMT_BLOCK:
-        write_block(chunk, (struct mtr_block*) stmt); return;
+        write_block(compiler, (struct mtr_block*) stmt); return;
 
-    case MTR_STMT_ASSIGNMENT: write_assignment(chunk, (struct mtr_assignment*) stmt); return;
-    case MTR_STMT_RETURN: write_return(chunk, (struct mtr_return*) stmt); return;
-    case MTR_STMT_CALL: write_call_stmt(chunk, (struct mtr_call_stmt*) stmt); return;
-    case MTR_STMT_CLOSURE: write_closure(chunk, (struct mtr_closure_decl*) stmt); return;
+    case MTR_STMT_ASSIGNMENT: write_assignment(compiler, (struct mtr_assignment*) stmt); return;
+    case MTR_STMT_RETURN: write_return(compiler, (struct mtr_return*) stmt); return;
+    case MTR_STMT_CALL: write_call_stmt(compiler, (struct mtr_call_stmt*) stmt); return;
+    case MTR_STMT_CLOSURE: write_closure(compiler, (struct mtr_closure_decl*) stmt); return;
 
     case MTR_STMT_UNION:
     case MTR_STMT_STRUCT:
@@ -514,70 +1439,537 @@ static void write(struct mtr_chunk* chunk, struct mtr_stmt* stmt) {
     }
 }
 
-static void write_struct(struct mtr_chunk* chunk, struct mtr_struct_decl* s) {
+static void write_struct(struct compiler* compiler, struct mtr_struct_decl* s) {
     for (u8 i = 0; i < s->argc; ++i) {
         struct mtr_variable* v = s->members[i];
-        write_variable(chunk, v);
+        write_variable(compiler, v);
     }
-    mtr_write_chunk(chunk, MTR_OP_CONSTRUCTOR);
-    mtr_write_chunk(chunk, s->argc);
-    mtr_write_chunk(chunk, MTR_OP_RETURN);
+    write_u8(compiler, MTR_OP_CONSTRUCTOR);
+    write_u8(compiler, s->argc);
+    write_u8(compiler, MTR_OP_RETURN);
 }
 
-// as every function has its own chunk we could probably paralellize this pretty easily
-static void write_bytecode(struct mtr_stmt* stmt, struct mtr_package* package) {
+// returns NULL for globals without code
+static struct mtr_function* write_global(struct mtr_stmt* stmt, struct mtr_symbol* symbol, struct mtr_dependencies* dependencies, struct code_info* info, const struct inlining* inlining, const struct mtr_line_index* lines) {
     switch (stmt->type)
     {
     case MTR_STMT_FN: {
         struct mtr_function_decl* fn = (struct mtr_function_decl*) stmt;
-        struct mtr_chunk chunk = mtr_new_chunk();
-        write_function(&chunk, fn);
-        struct mtr_function* f = mtr_new_function(chunk);
-        mtr_package_insert_function(package, (struct mtr_object*) f, fn->symbol);
-        break;
+        if (fn->generic) {
+            break;
+        }
+        struct compiler compiler;
+        init_compiler(&compiler, dependencies);
+        compiler.info = info;
+        compiler.inlining = inlining;
+        compiler.global = (u32) fn->symbol.index;
+        compiler.lines = lines;
+        mark_line(&compiler, fn->symbol.token);
+        write_function(&compiler, fn);
+        *symbol = fn->symbol;
+        return mtr_new_function(end_compiler(&compiler));
     }
     case MTR_STMT_STRUCT: {
         struct mtr_struct_decl* sd = (struct mtr_struct_decl*) stmt;
-        struct mtr_chunk chunk = mtr_new_chunk();
-        write_struct(&chunk, sd);
-        struct mtr_function* constructor = mtr_new_function(chunk);
-        mtr_package_insert_function(package, (struct mtr_object*) constructor, sd->symbol);
-        break;
+        struct compiler compiler;
+        init_compiler(&compiler, dependencies);
+        compiler.lines = lines;
+        mark_line(&compiler, sd->symbol.token);
+        write_struct(&compiler, sd);
+        *symbol = sd->symbol;
+        return mtr_new_function(end_compiler(&compiler));
     }
     default:
         break;
     }
+    return NULL;
 }
 
-enum mtr_exit_code mtr_compile(const char* source, struct mtr_package* package) {
+static void write_bytecode(struct mtr_stmt* stmt, struct mtr_package* package, struct code_info* info, const struct inlining* inlining, const struct mtr_line_index* lines) {
+    struct mtr_symbol symbol;
+    struct mtr_function* f = write_global(stmt, &symbol, info ? &info->dependencies : NULL, info, inlining, lines);
+    if (f) {
+        mtr_package_insert_function(package, (struct mtr_object*) f, symbol);
+    }
+}
+
+// Every function body is parsed, checked, compiled and dropped before the next one,
+// so only the declarations and the generic functions stay around for the whole compile.
+// The package is only loaded at the end because specializing keeps adding globals.
+// With an incremental state the bodies that didn't change are not even parsed.
+static bool compile_stream(struct mtr_parser* parser, struct mtr_ast* ast, struct mtr_package* package, struct mtr_incremental* incremental, const struct mtr_line_index* lines) {
+    struct mtr_validator* validator = mtr_validate_begin(ast);
+    struct mtr_block* block = (struct mtr_block*) ast->head;
+    const size_t declared = mtr_validate_declared(validator);
+
+    // specializations copy the generic body, so it has to outlive every caller
+    for (size_t i = 0; i < declared; ++i) {
+        struct mtr_function_decl* fn = (struct mtr_function_decl*) block->statements[i];
+        if (fn->stmt.type == MTR_STMT_FN && fn->generic && fn->deferred) {
+            mtr_parse_body(parser, ast, fn, &ast->arena);
+        }
+    }
+
+    if (incremental) {
+        mtr_incremental_begin(incremental, ast, declared);
+    }
+
+    struct compiled {
+        struct mtr_function* function;
+        struct mtr_symbol symbol;
+    };
+    struct compiled* functions = calloc(declared, sizeof(struct compiled));
+
+    struct mtr_arena body;
+    mtr_init_arena(&body);
+
+    struct mtr_dependencies dependencies = { NULL, 0, 0 };
+
+    bool ok = !parser->had_error;
+    for (size_t i = 0; i < declared; ++i) {
+        struct mtr_function_decl* fn = (struct mtr_function_decl*) block->statements[i];
+        const bool deferred = fn->stmt.type == MTR_STMT_FN && !fn->generic && fn->deferred;
+
+        if (deferred && incremental) {
+            functions[i].function = mtr_incremental_reuse(incremental, fn);
+            functions[i].symbol = fn->symbol;
+            if (functions[i].function) {
+                continue;
+            }
+        }
+
+        if (deferred) {
+            mtr_parse_body(parser, ast, fn, &body);
+        }
+
+        // a body that didn't parse isn't checked, it would only add noise to the errors
+        if (!parser->had_error) {
+            ok = mtr_validate_global(validator, i, &body) && ok;
+        } else {
+            ok = false;
+        }
+
+        if (ok) {
+            dependencies.count = 0;
+            functions[i].function = write_global(block->statements[i], &functions[i].symbol, incremental ? &dependencies : NULL, NULL, NULL, lines);
+            if (deferred && incremental) {
+                mtr_incremental_record(incremental, fn, functions[i].function, &dependencies);
+            }
+        }
+
+        if (deferred) {
+            fn->body = NULL;
+            mtr_reset_arena(&body);
+        }
+    }
+
+    ok = mtr_validate_end(validator) && ok;
+    mtr_delete_arena(&body);
+    mtr_delete_dependencies(&dependencies);
+
+    if (incremental) {
+        mtr_incremental_end(incremental, ok);
+    }
+
+    if (ok) {
+        mtr_load_package(package, ast);
+        for (size_t i = 0; i < declared; ++i) {
+            if (functions[i].function) {
+                mtr_package_insert_function(package, (struct mtr_object*) functions[i].function, functions[i].symbol);
+            }
+        }
+        for (size_t i = declared; i < block->size; ++i) {
+            write_bytecode(block->statements[i], package, NULL, NULL, lines);
+        }
+    } else {
+        for (size_t i = 0; i < declared; ++i) {
+            if (functions[i].function) {
+                mtr_delete_object((struct mtr_object*) functions[i].function);
+            }
+        }
+    }
+
+    free(functions);
+    return ok;
+}
+
+struct mtr_lazy {
+    struct mtr_parser parser;
+    struct mtr_ast ast;
+    struct mtr_validator* validator;
+    struct mtr_stub* stubs; // per declared global, only the ones of lazy functions are used
+    struct mtr_line_index* lines; // NULL unless compiling for debugging
+};
+
+static bool is_lazy(const struct mtr_stmt* stmt) {
+    const struct mtr_function_decl* fn = (const struct mtr_function_decl*) stmt;
+    if (stmt->type != MTR_STMT_FN || fn->generic || !fn->deferred) {
+        return false;
+    }
+    // the engine starts from a function
+    const struct mtr_token name = fn->symbol.token;
+    return name.length != 4 || memcmp(name.start, "main", 4) != 0;
+}
+
+// A compile error in a body that is only checked now can't be handled any better than a runtime error
+static struct mtr_function* compile_stub(struct mtr_stub* stub) {
+    struct mtr_package* package = stub->package;
+    struct mtr_lazy* lazy = package->lazy;
+    struct mtr_block* block = (struct mtr_block*) lazy->ast.head;
+    struct mtr_function_decl* fn = (struct mtr_function_decl*) block->statements[stub->index];
+
+    mtr_parse_body(&lazy->parser, &lazy->ast, fn, &lazy->ast.arena);
+    bool ok = !lazy->parser.had_error && mtr_validate_global(lazy->validator, stub->index, &lazy->ast.arena);
+    if (!ok) {
+        MTR_LOG_ERROR("Unable to compile '%.*s'.", (int) fn->symbol.token.length, fn->symbol.token.start);
+        exit(-1);
+    }
+
+    // specializations of generic functions called from the body
+    if (block->size > package->count) {
+        package->objects = realloc(package->objects, sizeof(struct mtr_object*) * block->size);
+        for (size_t i = package->count; i < block->size; ++i) {
+            package->objects[i] = NULL;
+        }
+        const size_t first = package->count;
+        package->count = block->size;
+        for (size_t i = first; i < block->size; ++i) {
+            mtr_package_insert_global(package, ((struct mtr_function_decl*) block->statements[i])->symbol);
+            write_bytecode(block->statements[i], package, NULL, NULL, lazy->lines);
+        }
+    }
+
+    struct mtr_symbol symbol;
+    stub->function = write_global(block->statements[stub->index], &symbol, NULL, NULL, NULL, lazy->lines);
+    package->objects[stub->index] = (struct mtr_object*) stub->function;
+    return stub->function;
+}
+
+// Signatures, structs, main and one line functions are checked and compiled now, every other
+// body waits behind a stub. The parser, the ast and the validator move into the package for later.
+static enum mtr_exit_code compile_lazy(struct mtr_parser* parser, struct mtr_ast* ast, struct mtr_package* package, bool debug) {
+    struct mtr_lazy* lazy = malloc(sizeof(struct mtr_lazy));
+    lazy->parser = *parser;
+    lazy->ast = *ast;
+    lazy->validator = mtr_validate_begin(&lazy->ast);
+    lazy->lines = NULL;
+    if (debug) {
+        lazy->lines = malloc(sizeof(struct mtr_line_index));
+        mtr_init_line_index(lazy->lines, lazy->ast.source);
+    }
+
+    struct mtr_block* block = (struct mtr_block*) lazy->ast.head;
+    const size_t declared = mtr_validate_declared(lazy->validator);
+    lazy->stubs = calloc(declared, sizeof(struct mtr_stub));
+
+    // generic bodies first, checking main can already specialize them
+    for (size_t i = 0; i < declared; ++i) {
+        struct mtr_function_decl* fn = (struct mtr_function_decl*) block->statements[i];
+        if (fn->stmt.type == MTR_STMT_FN && fn->deferred && !is_lazy(block->statements[i])) {
+            mtr_parse_body(&lazy->parser, &lazy->ast, fn, &lazy->ast.arena);
+        }
+    }
+
+    // a body that didn't parse isn't checked, it would only add noise to the errors
+    const bool parsed = !lazy->parser.had_error;
+    bool ok = parsed;
+    for (size_t i = 0; parsed && i < declared; ++i) {
+        if (!is_lazy(block->statements[i])) {
+            ok = mtr_validate_global(lazy->validator, i, &lazy->ast.arena) && ok;
+        }
+    }
+
+    if (!ok) {
+        enum mtr_exit_code ec = parsed ? MTR_TYPE_ERROR : MTR_PARSER_ERROR;
+        mtr_delete_lazy(lazy);
+        return ec;
+    }
+
+    mtr_load_package(package, &lazy->ast);
+    package->lazy = lazy;
+    for (size_t i = 0; i < block->size; ++i) {
+        if (i < declared && is_lazy(block->statements[i])) {
+            struct mtr_stub* stub = lazy->stubs + i;
+            stub->obj.type = MTR_OBJ_STUB;
+            stub->compile = compile_stub;
+            stub->package = package;
+            stub->index = (u32) i;
+            package->objects[i] = (struct mtr_object*) stub;
+        } else {
+            write_bytecode(block->statements[i], package, NULL, NULL, lazy->lines);
+        }
+    }
+    return MTR_OK;
+}
+
+void mtr_delete_lazy(struct mtr_lazy* lazy) {
+    mtr_validate_end(lazy->validator);
+    mtr_report_end_source(lazy->ast.source);
+    mtr_delete_ast(&lazy->ast);
+    if (lazy->lines) {
+        mtr_delete_line_index(lazy->lines);
+        free(lazy->lines);
+    }
+    free(lazy->stubs);
+    free(lazy);
+}
+
+// A function is pure until it uses a global that is neither a pure function nor a struct
+static bool* find_pure(const struct mtr_block* block, const struct code_info* info) {
+    bool* pure = malloc(sizeof(bool) * block->size);
+    for (size_t i = 0; i < block->size; ++i) {
+        const struct mtr_function_decl* fn = (const struct mtr_function_decl*) block->statements[i];
+        pure[i] = fn->stmt.type == MTR_STMT_FN && !fn->generic && !info[i].impure;
+    }
+
+    bool changed = true;
+    while (changed) {
+        changed = false;
+        for (size_t i = 0; i < block->size; ++i) {
+            const struct mtr_dependencies* d = &info[i].dependencies;
+            for (size_t j = 0; pure[i] && j < d->count; ++j) {
+                const u32 used = d->indices[j];
+                if (!pure[used] && block->statements[used]->type != MTR_STMT_STRUCT) {
+                    pure[i] = false;
+                    changed = true;
+                }
+            }
+        }
+    }
+    return pure;
+}
+
+// Compiles the functions with calls that might fold again, now that every function they could call exists
+static void fold_calls(struct mtr_block* block, struct mtr_package* package, struct code_info* info, const struct inlining* inlining, const struct mtr_line_index* lines) {
+    bool any = false;
+    for (size_t i = 0; i < block->size; ++i) {
+        any = any || info[i].constant_calls;
+    }
+
+    if (any) {
+        struct fold fold;
+        fold.package = package;
+        fold.pure = find_pure(block, info);
+        fold.engine = malloc(sizeof(struct mtr_engine));
+
+        for (size_t i = 0; i < block->size; ++i) {
+            if (!info[i].constant_calls) {
+                continue;
+            }
+
+            struct mtr_function_decl* fn = (struct mtr_function_decl*) block->statements[i];
+            struct compiler compiler;
+            init_compiler(&compiler, NULL);
+            compiler.fold = &fold;
+            compiler.inlining = inlining;
+            compiler.global = (u32) i;
+            compiler.lines = lines;
+            mark_line(&compiler, fn->symbol.token);
+            write_function(&compiler, fn);
+
+            mtr_delete_object(package->objects[i]);
+            mtr_package_insert_function(package, (struct mtr_object*) mtr_new_function(end_compiler(&compiler)), fn->symbol);
+        }
+
+        free(fold.engine);
+        free((bool*) fold.pure);
+    }
+
+    for (size_t i = 0; i < block->size; ++i) {
+        mtr_delete_dependencies(&info[i].dependencies);
+    }
+}
+
+// generic functions and natives don't have code of their own
+static void codegen(struct mtr_timeline* timeline, struct mtr_stmt* stmt, u64 start) {
+    const struct mtr_token* name = NULL;
+    if (stmt->type == MTR_STMT_FN && !((struct mtr_function_decl*) stmt)->generic) {
+        name = &((struct mtr_function_decl*) stmt)->symbol.token;
+    } else if (stmt->type == MTR_STMT_STRUCT) {
+        name = &((struct mtr_struct_decl*) stmt)->symbol.token;
+    }
+
+    if (timeline && name) {
+        mtr_timeline_span(timeline, "codegen", name->start, name->length, start);
+    }
+}
+
+static enum mtr_exit_code compile(const char* source, struct mtr_package* package, const struct mtr_compile_options* options, const char* image) {
     enum mtr_exit_code ec = MTR_OK;
+    struct mtr_line_index index;
+    const struct mtr_line_index* lines = NULL;
+    struct mtr_timeline* timeline = options->timeline;
+    u64 start = mtr_timeline_now(timeline);
+
+    int threads = options->threads;
+#ifdef _OPENMP
+    threads = threads == 0 ? omp_get_max_threads() : threads;
+#endif
+
+    // errors of the whole compile find their lines through one index
+    mtr_report_begin_source(source);
 
     struct mtr_parser parser;
     mtr_parser_init(&parser, source);
+    const bool lazy = options->lazy && !image;
+    const bool stream = options->stream || options->incremental;
+    parser.defer_bodies = stream || lazy;
 
+    // the parser pulls the tokens from the scanner, scanning has no phase of its own
     struct mtr_ast ast = mtr_parse(&parser);
+    mtr_timeline_phase(timeline, "compile", "scan and parse", start);
 
     if (parser.had_error){
         ec = MTR_PARSER_ERROR;
         goto ret;
     }
 
-    bool all_ok = mtr_validate(&ast);
+    if (ast.import_count > 0) {
+        // the image would need the modules too
+        if (image && !options->cache) {
+            mtr_report_error(ast.imports[0], "A package that imports modules can't be saved.", source);
+            ec = MTR_FILE_ERROR;
+            goto ret;
+        }
+        image = NULL;
+
+        start = mtr_timeline_now(timeline);
+        ec = mtr_import_modules(&parser, &ast, package, options->cache ? options->cache : MTR_MODULE_CACHE);
+        mtr_timeline_phase(timeline, "compile", "import modules", start);
+        if (ec != MTR_OK) {
+            goto ret;
+        }
+    }
+
+    if (lazy) {
+        // the bodies aren't compiled yet, so there is nothing to stream or to reuse.
+        // The ast and the report session now belong to the package
+        start = mtr_timeline_now(timeline);
+        ec = compile_lazy(&parser, &ast, package, options->debug);
+        mtr_timeline_phase(timeline, "compile", "check signatures", start);
+        return ec;
+    }
+
+    if (options->debug) {
+        mtr_init_line_index(&index, source);
+        lines = &index;
+    }
+
+    if (stream) {
+        // reused code would keep the lines of where it was
+        struct mtr_incremental* incremental = options->debug ? NULL : options->incremental;
+        start = mtr_timeline_now(timeline);
+        const bool ok = compile_stream(&parser, &ast, package, incremental, lines);
+        mtr_timeline_phase(timeline, "compile", "stream", start);
+        if (!ok) {
+            ec = parser.had_error ? MTR_PARSER_ERROR : MTR_TYPE_ERROR;
+            goto ret;
+        }
+        goto save;
+    }
+
+    start = mtr_timeline_now(timeline);
+    bool all_ok = mtr_validate(&ast, threads);
+    mtr_timeline_phase(timeline, "compile", "validate", start);
 
     if (!all_ok) {
         ec = MTR_TYPE_ERROR; // need to handle type and scope errors separetly
         goto ret;
     }
 
+    start = mtr_timeline_now(timeline);
     mtr_load_package(package, &ast);
+    mtr_timeline_phase(timeline, "compile", "load package", start);
 
+    // every function has its own chunk and its own slot in the package, so they can be written
+    // in any order and the package still comes out the same
     struct mtr_block* block = (struct mtr_block*) ast.head;
+    struct code_info* info = calloc(block->size, sizeof(struct code_info));
+    const struct inlining inlining = { options->profile, block };
+    const struct inlining* inline_calls = options->profile ? &inlining : NULL;
+    #pragma omp parallel for schedule(dynamic, 8) num_threads(threads) if(threads > 1 && block->size > 32)
     for (size_t i = 0; i < block->size; ++i) {
         struct mtr_stmt* s = block->statements[i];
-        write_bytecode(s, package);
+        const u64 began = mtr_timeline_now(timeline);
+        write_bytecode(s, package, info + i, inline_calls, lines);
+        codegen(timeline, s, began);
+    }
+
+    start = mtr_timeline_now(timeline);
+    fold_calls(block, package, info, inline_calls, lines);
+    mtr_timeline_phase(timeline, "compile", "fold calls", start);
+    free(info);
+
+save:
+    // names and signatures come from the ast so the image has to be written before it is gone
+    start = mtr_timeline_now(timeline);
+    if (image && !mtr_write_image(package, &ast, image)) {
+        // the package is fine without its cache entry, the next run just compiles again
+        if (options->cache) {
+            MTR_LOG_WARN("Compiled package isn't cached.");
+        } else {
+            ec = MTR_FILE_ERROR;
+        }
+    }
+    if (image) {
+        mtr_timeline_phase(timeline, "compile", "save image", start);
     }
 
 ret:
+    if (lines) {
+        mtr_delete_line_index(&index);
+    }
     mtr_delete_ast(&ast);
+    mtr_report_end_source(source);
+    return ec;
+}
+
+enum mtr_exit_code mtr_compile(const char* source, struct mtr_package* package) {
+    const struct mtr_compile_options options = { .cache = NULL };
+    return compile(source, package, &options, NULL);
+}
+
+u64 mtr_compile_flags(const struct mtr_compile_options* options) {
+    u64 flags = 0;
+#ifdef NDEBUG
+    flags |= 1;
+#endif
+    if (options->debug) {
+        flags |= 2;
+    }
+    if (options->profile) {
+        flags ^= mtr_profile_hash(options->profile) << 2;
+    }
+    return flags;
+}
+
+enum mtr_exit_code mtr_compile_with_options(const char* source, struct mtr_package* package, const struct mtr_compile_options* options) {
+    // images don't keep the line tables
+    if (!options->cache || options->debug) {
+        return compile(source, package, options, NULL);
+    }
+
+    const u64 key = mtr_cache_key(source, mtr_compile_flags(options));
+    const u64 start = mtr_timeline_now(options->timeline);
+    const bool cached = mtr_cache_load(options->cache, key, package);
+    mtr_timeline_phase(options->timeline, "compile", "load cached image", start);
+    if (cached) {
+        return MTR_OK;
+    }
+
+    if (!mtr_cache_prepare(options->cache)) {
+        return compile(source, package, options, NULL);
+    }
+
+    char* path = mtr_cache_path(options->cache, key);
+    enum mtr_exit_code ec = compile(source, package, options, path);
+    free(path);
+
+    mtr_cache_trim(options->cache, options->cache_entries);
     return ec;
 }
+
+enum mtr_exit_code mtr_compile_and_save(const char* source, struct mtr_package* package, const char* path) {
+    const struct mtr_compile_options options = { .cache = NULL };
+    return compile(source, package, &options, path);
+}
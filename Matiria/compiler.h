@@ -1,10 +1,42 @@
 #ifndef MTR_COMPILER_H
 #define MTR_COMPILER_H
 
+#include "incremental.h"
 #include "package.h"
+#include "profile.h"
+#include "timeline.h"
 
 #include "core/exitCode.h"
 
+struct mtr_compile_options {
+    const char* cache; // directory of the compilation cache (see cache.h). NULL compiles without it
+    size_t cache_entries; // maximum number of images kept in the cache. 0 keeps all of them
+    int threads; // for code generation. 0 uses every core
+    bool stream; // parse, check and compile one function at a time, for huge sources. Ignores threads
+    struct mtr_incremental* incremental; // reuses what didn't change since the last compile with it (see incremental.h). Streams.
+                                         // Ignored by lazy compiles, which neither use nor update it
+    bool lazy; // only checks signatures, a function body is checked and compiled on its first call.
+               // The source has to outlive the package. Ignored when the package is saved as an image,
+               // otherwise it ignores stream and incremental
+    const struct mtr_profile* profile; // of an earlier run, hot calls of functions that just return an expression
+                                       // are compiled in place and the hot arm of a branch or match is laid out
+                                       // to fall through. Ignored by stream and lazy compiles
+    bool debug; // every function gets a table of the source lines of its code (see mtr_chunk_line) and the code is
+                // left as written. Skips the cache and doesn't use or update the incremental state
+    struct mtr_timeline* timeline; // gets the phases of the compile and the code generation of every function
+};
+
 enum mtr_exit_code mtr_compile(const char* source, struct mtr_package* package);
 
+// everything that changes the generated code. Part of the cache key
+u64 mtr_compile_flags(const struct mtr_compile_options* options);
+
+enum mtr_exit_code mtr_compile_with_options(const char* source, struct mtr_package* package, const struct mtr_compile_options* options);
+
+// also saves the compiled package as an image at path (see image.h)
+enum mtr_exit_code mtr_compile_and_save(const char* source, struct mtr_package* package, const char* path);
+
+// frees what a lazily compiled package kept around, done by mtr_delete_package
+void mtr_delete_lazy(struct mtr_lazy* lazy);
+
 #endif
@@ -0,0 +1,98 @@
+#include "arena.h"
+
+#include <stdalign.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define BLOCK_SIZE (64 * 1024)
+#define ALIGNMENT alignof(max_align_t)
+
+struct mtr_arena_block {
+    struct mtr_arena_block* previous;
+    size_t size;
+    alignas(max_align_t) u8 data[];
+};
+
+void mtr_init_arena(struct mtr_arena* arena) {
+    arena->current = NULL;
+    arena->top = NULL;
+    arena->end = NULL;
+}
+
+void mtr_delete_arena(struct mtr_arena* arena) {
+    struct mtr_arena_block* block = arena->current;
+    while (block) {
+        struct mtr_arena_block* previous = block->previous;
+        free(block);
+        block = previous;
+    }
+    mtr_init_arena(arena);
+}
+
+void mtr_reset_arena(struct mtr_arena* arena) {
+    struct mtr_arena_block* kept = arena->current;
+    if (!kept) {
+        return;
+    }
+
+    struct mtr_arena_block* block = kept->previous;
+    while (block) {
+        struct mtr_arena_block* previous = block->previous;
+        free(block);
+        block = previous;
+    }
+
+    kept->previous = NULL;
+    arena->top = kept->data;
+    arena->end = kept->data + kept->size;
+}
+
+static void* new_block(struct mtr_arena* arena, size_t size) {
+    // big allocations get a block of their own so the current one can keep being used
+    const bool big = size > BLOCK_SIZE / 4;
+    const size_t block_size = big ? size : BLOCK_SIZE;
+    struct mtr_arena_block* block = malloc(sizeof(struct mtr_arena_block) + block_size);
+    block->size = block_size;
+
+    if (big && arena->current) {
+        block->previous = arena->current->previous;
+        arena->current->previous = block;
+        return block->data;
+    }
+
+    block->previous = arena->current;
+    arena->current = block;
+    arena->top = block->data + size;
+    arena->end = block->data + block_size;
+    return block->data;
+}
+
+static size_t align(size_t size) {
+    return (size + ALIGNMENT - 1) & ~(ALIGNMENT - 1);
+}
+
+void* mtr_arena_alloc(struct mtr_arena* arena, size_t size) {
+    size = align(size);
+    if (arena->top == NULL || (size_t) (arena->end - arena->top) < size) {
+        return new_block(arena, size);
+    }
+
+    void* memory = arena->top;
+    arena->top += size;
+    return memory;
+}
+
+void* mtr_arena_grow(struct mtr_arena* arena, void* old, size_t old_size, size_t new_size) {
+    // the last allocation can grow in place
+    u8* old_end = (u8*) old + align(old_size);
+    if (old && old_end == arena->top && (size_t) (arena->end - (u8*) old) >= align(new_size)) {
+        arena->top = (u8*) old + align(new_size);
+        return old;
+    }
+
+    void* memory = mtr_arena_alloc(arena, new_size);
+    if (old) {
+        memcpy(memory, old, old_size < new_size ? old_size : new_size);
+    }
+    return memory;
+}
@@ -0,0 +1,29 @@
+#ifndef MTR_ARENA_H
+#define MTR_ARENA_H
+
+#include "types.h"
+
+// Bump allocator for things that live exactly as long as a compilation.
+// Nothing is freed on its own, deleting the arena frees everything at once.
+// Not thread safe, callers that share one between threads have to lock around it.
+
+struct mtr_arena_block;
+
+struct mtr_arena {
+    struct mtr_arena_block* current;
+    u8* top;
+    u8* end;
+};
+
+void mtr_init_arena(struct mtr_arena* arena);
+void mtr_delete_arena(struct mtr_arena* arena);
+
+// frees everything but keeps one block around for the next round of allocations
+void mtr_reset_arena(struct mtr_arena* arena);
+
+void* mtr_arena_alloc(struct mtr_arena* arena, size_t size);
+
+// for arrays that grow. The old memory stays in the arena
+void* mtr_arena_grow(struct mtr_arena* arena, void* old, size_t old_size, size_t new_size);
+
+#endif
@@ -0,0 +1,13 @@
+#include "clock.h"
+
+#include <time.h>
+
+u64 mtr_clock_ns(void) {
+    struct timespec ts;
+#ifdef _WIN32
+    timespec_get(&ts, TIME_UTC);
+#else
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+#endif
+    return (u64) ts.tv_sec * 1000000000 + (u64) ts.tv_nsec;
+}
@@ -0,0 +1,9 @@
+#ifndef MTR_CLOCK_H
+#define MTR_CLOCK_H
+
+#include "types.h"
+
+// nanoseconds on a clock that never goes back, for timing things. Only differences mean something
+u64 mtr_clock_ns(void);
+
+#endif
@@ -1,9 +1,22 @@
+#ifndef _WIN32
+#   define _POSIX_C_SOURCE 200809L
+#   define _DEFAULT_SOURCE // MAP_ANONYMOUS
+#endif
+
 #include "file.h"
 
 #include "log.h"
 
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
+
+#ifndef _WIN32
+#   include <fcntl.h>
+#   include <sys/mman.h>
+#   include <sys/stat.h>
+#   include <unistd.h>
+#endif
 
 char* mtr_read_file(const char* filepath) {
 
@@ -38,3 +51,118 @@ char* mtr_read_file(const char* filepath) {
     return bytes;
 
 }
+
+#ifndef _WIN32
+
+const void* mtr_map_file(const char* filepath, size_t* size) {
+    int fd = open(filepath, O_RDONLY);
+    if (fd < 0) {
+        MTR_LOG_ERROR("Unable to open file at %s", filepath);
+        return NULL;
+    }
+
+    struct stat st;
+    if (fstat(fd, &st) != 0 || st.st_size == 0) {
+        MTR_LOG_ERROR("Unable to map file at %s", filepath);
+        close(fd);
+        return NULL;
+    }
+
+    void* data = mmap(NULL, (size_t) st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd); // the mapping keeps the file alive
+    if (data == MAP_FAILED) {
+        MTR_LOG_ERROR("Unable to map file at %s", filepath);
+        return NULL;
+    }
+
+    *size = (size_t) st.st_size;
+    return data;
+}
+
+void mtr_unmap_file(const void* data, size_t size) {
+    munmap((void*) data, size);
+}
+
+static size_t source_mapping_size(size_t size) {
+    const size_t page = (size_t) sysconf(_SC_PAGESIZE);
+    return (size + 1 + page - 1) / page * page;
+}
+
+const char* mtr_map_source(const char* filepath, size_t* size) {
+    int fd = open(filepath, O_RDONLY);
+    if (fd < 0) {
+        MTR_LOG_ERROR("Unable to open file at %s", filepath);
+        return NULL;
+    }
+
+    struct stat st;
+    if (fstat(fd, &st) != 0) {
+        MTR_LOG_ERROR("Unable to map file at %s", filepath);
+        close(fd);
+        return NULL;
+    }
+
+    // zeroed pages first, then the file on top of them
+    const size_t file_size = (size_t) st.st_size;
+    const size_t length = source_mapping_size(file_size);
+    void* data = mmap(NULL, length, PROT_READ, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (data != MAP_FAILED && file_size > 0
+        && mmap(data, file_size, PROT_READ, MAP_PRIVATE | MAP_FIXED, fd, 0) == MAP_FAILED) {
+        munmap(data, length);
+        data = MAP_FAILED;
+    }
+    close(fd);
+
+    if (data == MAP_FAILED) {
+        MTR_LOG_ERROR("Unable to map file at %s", filepath);
+        return NULL;
+    }
+
+    *size = file_size;
+    return data;
+}
+
+void mtr_unmap_source(const char* source, size_t size) {
+    munmap((void*) source, source_mapping_size(size));
+}
+
+#else
+
+const void* mtr_map_file(const char* filepath, size_t* size) {
+    FILE* file = fopen(filepath, "rb");
+    if (NULL == file) {
+        MTR_LOG_ERROR("Unable to open file at %s", filepath);
+        return NULL;
+    }
+
+    fseek(file, 0L, SEEK_END);
+    *size = ftell(file);
+    rewind(file);
+
+    void* bytes = malloc(*size);
+    if (NULL == bytes || fread(bytes, 1, *size, file) != *size) {
+        MTR_LOG_ERROR("Invalid file read from %s", filepath);
+        free(bytes);
+        fclose(file);
+        return NULL;
+    }
+
+    fclose(file);
+    return bytes;
+}
+
+void mtr_unmap_file(const void* data, size_t size) {
+    free((void*) data);
+}
+
+const char* mtr_map_source(const char* filepath, size_t* size) {
+    char* source = mtr_read_file(filepath);
+    *size = source ? strlen(source) : 0;
+    return source;
+}
+
+void mtr_unmap_source(const char* source, size_t size) {
+    free((void*) source);
+}
+
+#endif
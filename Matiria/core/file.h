@@ -5,4 +5,16 @@
 
 char* mtr_read_file(const char* filepath);
 
+// Maps a whole file read only. Returns NULL on failure.
+// Where mmap is not available the file is read into memory instead.
+const void* mtr_map_file(const char* filepath, size_t* size);
+void mtr_unmap_file(const void* data, size_t size);
+
+// Maps a source file read only and NUL terminated, so it can be handed to the compiler
+// without copying it. The terminator comes from the zeroed tail of the last page, or from
+// an extra zero page when the file fills its last page exactly. size excludes the terminator.
+// The file must not be truncated while it is mapped.
+const char* mtr_map_source(const char* filepath, size_t* size);
+void mtr_unmap_source(const char* source, size_t size);
+
 #endif
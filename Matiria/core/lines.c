@@ -0,0 +1,50 @@
+#include "lines.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+void mtr_init_line_index(struct mtr_line_index* index, const char* source) {
+    index->source = source;
+    index->size = strlen(source);
+
+    u32 capacity = 64;
+    index->starts = malloc(sizeof(u32) * capacity);
+    index->starts[0] = 0;
+    index->count = 1;
+
+    const char* end = source + index->size;
+    for (const char* c = memchr(source, '\n', index->size); c != NULL; c = memchr(c, '\n', (size_t) (end - c))) {
+        c++;
+        if (index->count == capacity) {
+            capacity *= 2;
+            index->starts = realloc(index->starts, sizeof(u32) * capacity);
+        }
+        index->starts[index->count++] = (u32) (c - source);
+    }
+}
+
+void mtr_delete_line_index(struct mtr_line_index* index) {
+    free(index->starts);
+    index->starts = NULL;
+    index->count = 0;
+}
+
+u32 mtr_line_of(const struct mtr_line_index* index, const char* at) {
+    // the terminator belongs to the last line
+    if (at < index->source || at > index->source + index->size) {
+        return 0;
+    }
+
+    const u32 offset = (u32) (at - index->source);
+    u32 low = 0;
+    u32 high = index->count;
+    while (high - low > 1) {
+        const u32 mid = low + (high - low) / 2;
+        if (index->starts[mid] <= offset) {
+            low = mid;
+        } else {
+            high = mid;
+        }
+    }
+    return low + 1;
+}
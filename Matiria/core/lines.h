@@ -0,0 +1,21 @@
+#ifndef MTR_LINES_H
+#define MTR_LINES_H
+
+#include "types.h"
+
+// Where every line of a source starts, built in one pass so finding the
+// line of a character is a binary search instead of a walk from the start.
+struct mtr_line_index {
+    const char* source;
+    size_t size; // of the source, without the terminator
+    u32* starts; // offset of the first character of every line
+    u32 count;
+};
+
+void mtr_init_line_index(struct mtr_line_index* index, const char* source);
+void mtr_delete_line_index(struct mtr_line_index* index);
+
+// line of the character at, starting from 1. 0 if at isn't part of the source
+u32 mtr_line_of(const struct mtr_line_index* index, const char* at);
+
+#endif
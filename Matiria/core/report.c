@@ -1,8 +1,12 @@
 #include "report.h"
 
+#include "core/lines.h"
 #include "core/log.h"
 #include "core/types.h"
 
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
 #include <string.h>
 
 struct report {
@@ -12,73 +16,181 @@ struct report {
     const char* line_start;
 };
 
+// Reports about a source between mtr_report_begin_source and mtr_report_end_source share one
+// line index, built by the first of them. Sources are kept apart by their address
+struct session {
+    struct session* next;
+    const char* source;
+    struct mtr_line_index index;
+    bool built;
+    u32 users;
+};
+
+static struct session* sessions = NULL;
+
+static struct session** find_session(const char* source) {
+    struct session** s = &sessions;
+    while (*s != NULL && (*s)->source != source) {
+        s = &(*s)->next;
+    }
+    return s;
+}
+
+void mtr_report_begin_source(const char* source) {
+    #pragma omp critical (mtr_report_sessions)
+    {
+        struct session** s = find_session(source);
+        if (*s == NULL) {
+            *s = malloc(sizeof(struct session));
+            (*s)->next = NULL;
+            (*s)->source = source;
+            (*s)->built = false;
+            (*s)->users = 0;
+        }
+        (*s)->users++;
+    }
+}
+
+void mtr_report_end_source(const char* source) {
+    #pragma omp critical (mtr_report_sessions)
+    {
+        struct session** s = find_session(source);
+        MTR_ASSERT(*s != NULL, "Source was never begun.");
+        struct session* session = *s;
+        if (--session->users == 0) {
+            *s = session->next;
+            if (session->built) {
+                mtr_delete_line_index(&session->index);
+            }
+            free(session);
+        }
+    }
+}
+
+// the index of the session of source, NULL outside of one
+static const struct mtr_line_index* session_index(const char* source) {
+    const struct mtr_line_index* index = NULL;
+    #pragma omp critical (mtr_report_sessions)
+    {
+        struct session* session = *find_session(source);
+        if (session != NULL) {
+            if (!session->built) {
+                mtr_init_line_index(&session->index, source);
+                session->built = true;
+            }
+            index = &session->index;
+        }
+    }
+    return index;
+}
+
 static struct report locate(struct mtr_token token, const char* const source) {
-    const char* c = source;
+    // the end of the source points at the last character instead
     const char* t = token.start;
-    if (*token.start == '\0') {
+    if (*t == '\0' && t > source) {
         --t;
-        if (*t == '\n')
+        if (*t == '\n' && t > source)
             --t;
     }
 
-    // count lines
-    u32 line = 1;
-    while(c != t) {
-        c++;
-        if (*c == '\n')
-            line++;
+    struct mtr_line_index local;
+    const struct mtr_line_index* index = session_index(source);
+    if (index == NULL) {
+        mtr_init_line_index(&local, source);
+        index = &local;
     }
 
-    const char* line_start = t;
-    while (*(line_start-1) != '\n' && line_start != source)
-        --line_start;
+    struct report r;
+    r.line = mtr_line_of(index, t);
+    if (r.line == 0) {
+        // tokens that don't come from the source, like the names of imported functions
+        r.column = 0;
+        r.eol_index = token.length;
+        r.line_start = token.start;
+    } else {
+        r.line_start = source + index->starts[r.line - 1];
+        r.column = (u32) (t - r.line_start);
+
+        // find the next new line so that it doesnt get printed
+        const char* line_end = t;
+        while (*line_end != '\n' && *line_end != '\0')
+            ++line_end;
+        r.eol_index = (u32) (line_end - r.line_start);
+    }
 
-    u32 column = t - line_start;
+    if (index == &local) {
+        mtr_delete_line_index(&local);
+    }
+    return r;
+}
 
-    // find the next new line so that it doesnt get printed
-    const char* line_end = t;
-    while (*line_end != '\n' && *line_end != '\0')
-        ++line_end;
+// where reports of this thread go. NULL prints them right away
+static _Thread_local struct mtr_report_buffer* current = NULL;
 
-    u32 eol_index = line_end - line_start;
+static void emit(const char* format, ...) {
+    va_list args;
+    va_start(args, format);
 
-    struct report r;
-    r.line = line;
-    r.column = column;
-    r.eol_index = eol_index;
-    r.line_start = line_start;
-    return r;
+    if (current == NULL) {
+        vprintf(format, args);
+        va_end(args);
+        return;
+    }
+
+    va_list copy;
+    va_copy(copy, args);
+    int length = vsnprintf(NULL, 0, format, copy);
+    va_end(copy);
+
+    if (length > 0) {
+        size_t needed = current->size + (size_t) length + 1;
+        if (needed > current->capacity) {
+            current->capacity = needed > current->capacity * 2 ? needed : current->capacity * 2;
+            current->data = realloc(current->data, current->capacity);
+        }
+        vsnprintf(current->data + current->size, (size_t) length + 1, format, args);
+        current->size += (size_t) length;
+    }
+    va_end(args);
 }
 
-void mtr_report_error(struct mtr_token token, const char* message, const char* const source) {
+static void report(const char* prefix, struct mtr_token token, const char* message, const char* const source) {
     struct report r = locate(token, source);
 
-    MTR_LOG_ERROR("[%i:%i]: %s", r.line, r.column, message);
-    MTR_LOG("\t%.*s", r.eol_index, r.line_start);
-
     char buf[256];
     memset(buf, ' ', 256);
-    MTR_LOG(MTR_BOLD_DARK(MTR_GREEN) "\t%.*s%s" MTR_RESET, r.column, buf, "^---");
-}
 
-void mtr_report_warning(struct mtr_token token, const char* message, const char* const source) {
-    struct report r = locate(token, source);
+    emit("%s[%i:%i]: %s\n", prefix, r.line, r.column, message);
+    emit("\t%.*s\n", r.eol_index, r.line_start);
+    emit(MTR_BOLD_DARK(MTR_GREEN) "\t%.*s%s" MTR_RESET "\n", r.column, buf, "^---");
+}
 
-    MTR_LOG_WARN("[%i:%i]: %s", r.line, r.column, message);
-    MTR_LOG("\t%.*s", r.eol_index, r.line_start);
+void mtr_report_error(struct mtr_token token, const char* message, const char* const source) {
+    report(MTR_ERROR_PRE, token, message, source);
+}
 
-    char buf[256];
-    memset(buf, ' ', 256);
-    MTR_LOG(MTR_BOLD_DARK(MTR_GREEN) "\t%.*s%s" MTR_RESET, r.column, buf, "^---");
+void mtr_report_warning(struct mtr_token token, const char* message, const char* const source) {
+    report(MTR_WARN_PRE, token, message, source);
 }
 
 void mtr_report_message(struct mtr_token token, const char* message, const char* const source) {
-    struct report r = locate(token, source);
+    report(MTR_INFO_PRE, token, message, source);
+}
 
-    MTR_LOG_INFO("[%i:%i]: %s", r.line, r.column, message);
-    MTR_LOG("\t%.*s", r.eol_index, r.line_start);
+void mtr_report_buffer_begin(struct mtr_report_buffer* buffer) {
+    current = buffer;
+}
 
-    char buf[256];
-    memset(buf, ' ', 256);
-    MTR_LOG(MTR_BOLD_DARK(MTR_GREEN) "\t%.*s%s" MTR_RESET, r.column, buf, "^---");
+void mtr_report_buffer_end(void) {
+    current = NULL;
+}
+
+void mtr_report_buffer_flush(struct mtr_report_buffer* buffer) {
+    if (buffer->size > 0) {
+        fwrite(buffer->data, 1, buffer->size, stdout);
+    }
+    free(buffer->data);
+    buffer->data = NULL;
+    buffer->size = 0;
+    buffer->capacity = 0;
 }
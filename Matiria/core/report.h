@@ -7,4 +7,25 @@ void mtr_report_error(struct mtr_token token, const char* message, const char* c
 void mtr_report_warning(struct mtr_token token, const char* message, const char* const source);
 void mtr_report_message(struct mtr_token token, const char* message, const char* const source);
 
+// Reports about source find their line through an index of its lines, built on the first report
+// and shared by every thread until the matching end. Without it every report scans the whole source.
+// Calls can nest, the source must not change or move in between
+void mtr_report_begin_source(const char* source);
+void mtr_report_end_source(const char* source);
+
+// Reports can be collected instead of printed so work split between threads
+// is still reported in source order.
+struct mtr_report_buffer {
+    char* data;
+    size_t size;
+    size_t capacity;
+};
+
+// reports of the calling thread go to buffer until mtr_report_buffer_end
+void mtr_report_buffer_begin(struct mtr_report_buffer* buffer);
+void mtr_report_buffer_end(void);
+
+// prints what was collected and empties the buffer
+void mtr_report_buffer_flush(struct mtr_report_buffer* buffer);
+
 #endif
@@ -12,6 +12,18 @@ static inline u32 hash(const char* key, size_t length) {
     return hash;
 }
 
+// 64 bit FNV-1a, for keys that have to survive between runs. 'hash' can continue a previous hash
+static inline u64 hash64(const void* key, size_t length, u64 hash) {
+    const u8* bytes = key;
+    for (size_t i = 0; i < length; i++) {
+        hash ^= bytes[i];
+        hash *= 1099511628211ull;
+    }
+    return hash;
+}
+
+#define MTR_HASH64_SEED 14695981039346656037ull
+
 // got it from http://web.archive.org/web/20071223173210/http:/www.concentric.net/~Ttwang/tech/inthash.htm
 static inline u32 hashi64(i64 key) {
     key = (~key) + (key << 18);
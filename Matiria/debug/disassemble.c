@@ -37,9 +37,9 @@ u8* mtr_disassemble_instruction(u8* instruction, u32 offset) {
     }
 
     case MTR_OP_STRING_LITERAL: {
-        const char* s = READ(const char*);
         u32 l = READ(u32);
-        MTR_LOG("STR %.*s", l, s);
+        MTR_LOG("STR %.*s", l, (const char*) instruction);
+        instruction += l;
         break;
     }
 
@@ -62,9 +62,11 @@ u8* mtr_disassemble_instruction(u8* instruction, u32 offset) {
     }
 
     case MTR_OP_CLOSURE: {
-        void* p = READ(void*);
         u16 count = READ(u16);
-        MTR_LOG("CLOSURE");
+        instruction += count * (sizeof(u16) + sizeof(u8));
+        u32 size = READ(u32);
+        MTR_LOG("CLOSURE (%u upvalues, %u bytes)", count, size);
+        instruction += size;
         break;
     }
 
@@ -88,12 +90,26 @@ u8* mtr_disassemble_instruction(u8* instruction, u32 offset) {
     }
 
     case MTR_OP_OR: {
-        MTR_LOG("OR");
+        i16 to = READ(i16);
+        MTR_LOG("OR %i", to);
         break;
     }
 
     case MTR_OP_AND: {
-        MTR_LOG("AND");
+        i16 to = READ(i16);
+        MTR_LOG("AND %i", to);
+        break;
+    }
+
+    case MTR_OP_OR_LONG: {
+        i32 to = READ(i32);
+        MTR_LOG("lOR %i", to);
+        break;
+    }
+
+    case MTR_OP_AND_LONG: {
+        i32 to = READ(i32);
+        MTR_LOG("lAND %i", to);
         break;
     }
 
@@ -127,6 +143,14 @@ u8* mtr_disassemble_instruction(u8* instruction, u32 offset) {
     case MTR_OP_LESS_F: MTR_LOG("fLSS"); break;
     case MTR_OP_GREATER_F: MTR_LOG("fGTR"); break;
 
+    case MTR_OP_LESS_EQUAL_I: MTR_LOG("LEQ"); break;
+    case MTR_OP_GREATER_EQUAL_I: MTR_LOG("GEQ"); break;
+    case MTR_OP_NOT_EQUAL_I: MTR_LOG("NEQ"); break;
+
+    case MTR_OP_LESS_EQUAL_F: MTR_LOG("fLEQ"); break;
+    case MTR_OP_GREATER_EQUAL_F: MTR_LOG("fGEQ"); break;
+    case MTR_OP_NOT_EQUAL_F: MTR_LOG("fNEQ"); break;
+
     case MTR_OP_GET: {
         u16 index = READ(u16);
         MTR_LOG("GET at %u", index);
@@ -191,6 +215,62 @@ u8* mtr_disassemble_instruction(u8* instruction, u32 offset) {
         break;
     }
 
+    case MTR_OP_JMP_LONG: {
+        i32 to = READ(i32);
+        MTR_LOG("lJMP %i", to);
+        break;
+    }
+
+    case MTR_OP_JMP_Z_LONG: {
+        i32 to = READ(i32);
+        MTR_LOG("lZJMP %i", to);
+        break;
+    }
+
+    case MTR_OP_FOR_RANGE: {
+        i32 to = READ(i32);
+        u16 slot = READ(u16);
+        MTR_LOG("FOR_RANGE %i, %u", to, slot);
+        break;
+    }
+
+    case MTR_OP_FOR_ARRAY: {
+        i32 to = READ(i32);
+        u16 slot = READ(u16);
+        MTR_LOG("FOR_ARRAY %i, %u", to, slot);
+        break;
+    }
+
+    case MTR_OP_FOR_MAP: {
+        i32 to = READ(i32);
+        u16 slot = READ(u16);
+        MTR_LOG("FOR_MAP %i, %u", to, slot);
+        break;
+    }
+
+    case MTR_OP_VARIANT: {
+        u16 tag = READ(u16);
+        MTR_LOG("VARIANT %u", tag);
+        break;
+    }
+
+    case MTR_OP_TAG: {
+        u16 count = READ(u16);
+        MTR_LOG("TAG %u", count);
+        instruction += count * sizeof(u8);
+        break;
+    }
+
+    case MTR_OP_MATCH: {
+        u16 count = READ(u16);
+        MTR_LOG("MATCH %u", count);
+        for (u16 i = 0; i < count; ++i) {
+            i32 to = READ(i32);
+            MTR_LOG("    %u -> %i", i, to);
+        }
+        break;
+    }
+
     case MTR_OP_POP: {
         MTR_LOG("POP");
         break;
@@ -222,8 +302,14 @@ u8* mtr_disassemble_instruction(u8* instruction, u32 offset) {
 void mtr_disassemble(struct mtr_chunk chunk, const char* name) {
     MTR_LOG("====== %s =======", name);
     u8* instruction = chunk.bytecode;
+    u32 line = 0;
     while (instruction != chunk.bytecode + chunk.size) {
-        instruction = mtr_disassemble_instruction(instruction, instruction - chunk.bytecode);
+        const u32 offset = instruction - chunk.bytecode;
+        if (mtr_chunk_line(&chunk, offset) != line) {
+            line = mtr_chunk_line(&chunk, offset);
+            MTR_LOG("line %u:", line);
+        }
+        instruction = mtr_disassemble_instruction(instruction, offset);
     }
     MTR_LOG("\n");
 }
@@ -262,5 +348,6 @@ const char* mtr_obj_type_to_str(struct mtr_object* obj) {
     case MTR_OBJ_MAP:       return "<map>";
     case MTR_OBJ_STRING:    return "<string>";
     case MTR_OBJ_CLOSURE:   return "<closure>";
+    case MTR_OBJ_STUB:      return "<fn>";
     }
 }
@@ -94,6 +94,13 @@ static void dump_expr(struct mtr_expr* expr, u32 offset) {
         IMPLEMENT
         break;
     }
+
+    case MTR_EXPR_VARIANT: {
+        struct mtr_variant* v = (struct mtr_variant*) expr;
+        MTR_PRINT_DEBUG("<%u>", v->tag);
+        dump_expr(v->value, 0);
+        break;
+    }
     }
 }
 
@@ -162,6 +169,37 @@ static void dump_while(struct mtr_while* stmt, u32 offset) {
     MTR_PRINT_DEBUG("\n");
 }
 
+static void dump_for(struct mtr_for* stmt, u32 offset) {
+    MTR_PRINT_DEBUG("for %.*s", (u32) stmt->first.token.length, stmt->first.token.start);
+    if (stmt->second.token.type != MTR_TOKEN_INVALID) {
+        MTR_PRINT_DEBUG(", %.*s", (u32) stmt->second.token.length, stmt->second.token.start);
+    }
+    MTR_PRINT_DEBUG(" in ");
+    dump_expr(stmt->iterable, 0);
+    if (stmt->end) {
+        MTR_PRINT_DEBUG("..");
+        dump_expr(stmt->end, 0);
+    }
+    MTR_PRINT_DEBUG("\n");
+    dump_stmt(stmt->body, offset + 1);
+    MTR_PRINT_DEBUG("\n");
+}
+
+static void dump_match(struct mtr_match* stmt, u32 offset) {
+    MTR_PRINT_DEBUG("match ");
+    dump_expr(stmt->expr, 0);
+    MTR_PRINT_DEBUG("\n");
+    for (u16 i = 0; i < stmt->count; ++i) {
+        const struct mtr_match_case* c = stmt->cases + i;
+        MTR_PRINT_DEBUG("%.*s:\n", (u32) c->symbol.token.length, c->symbol.token.start);
+        dump_stmt(c->body, offset + 1);
+    }
+    if (stmt->otherwise) {
+        MTR_PRINT_DEBUG("else:\n");
+        dump_stmt(stmt->otherwise, offset + 1);
+    }
+}
+
 static void dump_assignment(struct mtr_assignment* stmt, u32 offset) {
     dump_expr(stmt->expression, 0);
     MTR_PRINT_DEBUG(" := ");
@@ -194,6 +232,8 @@ static void dump_stmt(struct mtr_stmt* stmt, u32 offset) {
     case MTR_STMT_VAR: dump_var((struct mtr_variable*) stmt, offset); return;
     case MTR_STMT_IF: dump_if((struct mtr_if*) stmt, offset); return;
     case MTR_STMT_WHILE: dump_while((struct mtr_while*) stmt, offset); return;
+    case MTR_STMT_FOR: dump_for((struct mtr_for*) stmt, offset); return;
+    case MTR_STMT_MATCH: dump_match((struct mtr_match*) stmt, offset); return;
     case MTR_STMT_ASSIGNMENT: dump_assignment((struct mtr_assignment*) stmt, offset); return;
     case MTR_STMT_RETURN: dump_return((struct mtr_return*) stmt, offset); return;
     case MTR_STMT_CALL: dump_expr(((struct mtr_call_stmt*) stmt)->call, offset); return;
@@ -287,6 +327,7 @@ const char* mtr_token_type_to_str(enum mtr_token_type type) {
     case MTR_TOKEN_GREATER_EQUAL: return ">=";
     case MTR_TOKEN_LESS_EQUAL:    return "<=";
     case MTR_TOKEN_DOUBLE_SLASH:  return "//";
+    case MTR_TOKEN_DOUBLE_DOT:    return "..";
     case MTR_TOKEN_STRING_LITERAL:return "STRING";
     case MTR_TOKEN_INT_LITERAL:   return "INT";
     case MTR_TOKEN_FLOAT_LITERAL: return "FLOAT";
@@ -303,6 +344,9 @@ const char* mtr_token_type_to_str(enum mtr_token_type type) {
     case MTR_TOKEN_RETURN:        return "return";
     case MTR_TOKEN_WHILE:         return "while";
     case MTR_TOKEN_FOR:           return "for";
+    case MTR_TOKEN_IN:            return "in";
+    case MTR_TOKEN_MATCH:         return "match";
+    case MTR_TOKEN_IMPORT:        return "import";
     case MTR_TOKEN_INT:           return "Int";
     case MTR_TOKEN_FLOAT:         return "Float";
     case MTR_TOKEN_BOOL:          return "Bool";
@@ -0,0 +1,338 @@
+#ifndef _WIN32
+#   define _POSIX_C_SOURCE 200809L
+#endif
+
+#include "image.h"
+
+#include "AST/type.h"
+#include "core/file.h"
+#include "core/log.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#ifndef _WIN32
+#   include <unistd.h>
+#   define process_id() ((long) getpid())
+#else
+#   include <process.h>
+#   define process_id() ((long) _getpid())
+#endif
+
+// Layout:
+//  header
+//  one entry per global, in global index order
+//  names and type signatures
+//  bytecode of every function, 8 byte aligned
+// All offsets are from the start of the file.
+
+struct image_header {
+    char magic[4];
+    u32 version;
+    u32 count;
+    u32 size; // of the whole file, catches truncated images
+};
+
+enum image_kind {
+    IMAGE_FUNCTION,
+    IMAGE_NATIVE,
+    IMAGE_GENERIC,
+    IMAGE_TYPE
+};
+
+struct image_global {
+    u32 kind;
+    u32 name;
+    u32 name_length;
+    u32 signature;
+    u32 signature_length;
+    u32 code;
+    u32 code_size;
+};
+
+static const char magic[4] = { 'M', 'T', 'R', 'C' };
+
+struct buffer {
+    u8* data;
+    size_t size;
+    size_t capacity;
+};
+
+static void buffer_write(struct buffer* buffer, const void* data, size_t size) {
+    if (buffer->size + size > buffer->capacity) {
+        size_t new_cap = buffer->capacity == 0 ? 256 : buffer->capacity;
+        while (buffer->size + size > new_cap) {
+            new_cap *= 2;
+        }
+        buffer->data = realloc(buffer->data, new_cap);
+        buffer->capacity = new_cap;
+    }
+    memcpy(buffer->data + buffer->size, data, size);
+    buffer->size += size;
+}
+
+static void buffer_str(struct buffer* buffer, const char* str) {
+    buffer_write(buffer, str, strlen(str));
+}
+
+static void buffer_align(struct buffer* buffer, size_t alignment) {
+    static const u8 zeros[16] = { 0 };
+    size_t pad = (alignment - buffer->size % alignment) % alignment;
+    buffer_write(buffer, zeros, pad);
+}
+
+// signatures use the same syntax as the source
+static void write_signature(struct buffer* buffer, const struct mtr_type* type) {
+    switch (type->type) {
+    case MTR_DATA_INVALID: buffer_str(buffer, "?"); return;
+    case MTR_DATA_ANY:     buffer_str(buffer, "Any"); return;
+    case MTR_DATA_VOID:    buffer_str(buffer, "Void"); return;
+    case MTR_DATA_BOOL:    buffer_str(buffer, "Bool"); return;
+    case MTR_DATA_INT:     buffer_str(buffer, "Int"); return;
+    case MTR_DATA_FLOAT:   buffer_str(buffer, "Float"); return;
+    case MTR_DATA_STRING:  buffer_str(buffer, "String"); return;
+
+    case MTR_DATA_ARRAY: {
+        const struct mtr_array_type* a = (const struct mtr_array_type*) type;
+        buffer_str(buffer, "[");
+        write_signature(buffer, a->element);
+        buffer_str(buffer, "]");
+        return;
+    }
+
+    case MTR_DATA_MAP: {
+        const struct mtr_map_type* m = (const struct mtr_map_type*) type;
+        buffer_str(buffer, "[");
+        write_signature(buffer, m->key);
+        buffer_str(buffer, ", ");
+        write_signature(buffer, m->value);
+        buffer_str(buffer, "]");
+        return;
+    }
+
+    case MTR_DATA_FN: {
+        const struct mtr_function_type* f = (const struct mtr_function_type*) type;
+        buffer_str(buffer, "(");
+        for (u8 i = 0; i < f->argc; ++i) {
+            if (i > 0) {
+                buffer_str(buffer, ", ");
+            }
+            write_signature(buffer, f->argv[i]);
+        }
+        buffer_str(buffer, ")");
+        if (f->return_->type != MTR_DATA_VOID) {
+            buffer_str(buffer, " -> ");
+            write_signature(buffer, f->return_);
+        }
+        return;
+    }
+
+    case MTR_DATA_USER:
+    case MTR_DATA_UNION:
+    case MTR_DATA_STRUCT: {
+        const struct mtr_user_type* u = (const struct mtr_user_type*) type;
+        buffer_write(buffer, u->name.start, u->name.length);
+        return;
+    }
+    }
+}
+
+static struct mtr_symbol global_symbol(const struct mtr_stmt* s, enum image_kind* kind) {
+    switch (s->type) {
+    case MTR_STMT_FN: {
+        const struct mtr_function_decl* fn = (const struct mtr_function_decl*) s;
+        *kind = fn->generic ? IMAGE_GENERIC : IMAGE_FUNCTION;
+        return fn->symbol;
+    }
+    case MTR_STMT_NATIVE_FN:
+        *kind = IMAGE_NATIVE;
+        return ((const struct mtr_function_decl*) s)->symbol;
+    case MTR_STMT_STRUCT:
+        *kind = IMAGE_FUNCTION; // the constructor
+        return ((const struct mtr_struct_decl*) s)->symbol;
+    case MTR_STMT_UNION:
+        *kind = IMAGE_TYPE;
+        return ((const struct mtr_union_decl*) s)->symbol;
+    default:
+        break;
+    }
+    MTR_ASSERT(false, "Invalid global statement.");
+    return (struct mtr_symbol) { .index = 0 };
+}
+
+bool mtr_write_image(const struct mtr_package* package, const struct mtr_ast* ast, const char* path) {
+    const struct mtr_block* block = (const struct mtr_block*) ast->head;
+    MTR_ASSERT(block->size == package->count, "Package doesn't belong to the ast.");
+
+    struct image_global* globals = calloc(package->count, sizeof(struct image_global));
+    struct buffer data = { NULL, 0, 0 };
+
+    const size_t data_start = sizeof(struct image_header) + sizeof(struct image_global) * package->count;
+
+    for (size_t i = 0; i < package->count; ++i) {
+        enum image_kind kind;
+        struct mtr_symbol symbol = global_symbol(block->statements[i], &kind);
+        struct image_global* g = globals + i;
+        g->kind = kind;
+
+        g->name = (u32) (data_start + data.size);
+        g->name_length = symbol.token.length;
+        buffer_write(&data, symbol.token.start, symbol.token.length);
+
+        size_t signature = data.size;
+        write_signature(&data, symbol.type);
+        g->signature = (u32) (data_start + signature);
+        g->signature_length = (u32) (data.size - signature);
+    }
+
+    for (size_t i = 0; i < package->count; ++i) {
+        struct image_global* g = globals + i;
+        const struct mtr_function* f = (const struct mtr_function*) package->objects[i];
+        if (g->kind != IMAGE_FUNCTION || f == NULL) {
+            continue;
+        }
+
+        buffer_align(&data, 8);
+        g->code = (u32) (data_start + data.size);
+        g->code_size = (u32) f->chunk.size;
+        buffer_write(&data, f->chunk.bytecode, f->chunk.size);
+    }
+
+    struct image_header header;
+    memcpy(header.magic, magic, sizeof(magic));
+    header.version = MTR_IMAGE_VERSION;
+    header.count = (u32) package->count;
+    header.size = (u32) (data_start + data.size);
+
+    // write next to the target and rename so readers never see half an image.
+    // The process id keeps concurrent writers of the same image apart
+    size_t temp_size = strlen(path) + 32;
+    char* temp = malloc(temp_size);
+    snprintf(temp, temp_size, "%s.%ld.tmp", path, process_id());
+
+    bool ok = false;
+    FILE* file = fopen(temp, "wb");
+    if (file) {
+        ok = fwrite(&header, sizeof(header), 1, file) == 1
+            && fwrite(globals, sizeof(struct image_global), package->count, file) == package->count
+            && fwrite(data.data, 1, data.size, file) == data.size;
+        ok = fclose(file) == 0 && ok;
+        ok = ok && rename(temp, path) == 0;
+        if (!ok) {
+            remove(temp);
+        }
+    }
+
+    if (!ok) {
+        MTR_LOG_ERROR("Unable to write image to %s", path);
+    }
+
+    free(temp);
+    free(data.data);
+    free(globals);
+    return ok;
+}
+
+static bool in_bounds(u32 offset, u32 length, size_t size) {
+    return (size_t) offset + length <= size;
+}
+
+static bool check_image(const u8* image, size_t size, const char* path) {
+    const struct image_header* header = (const struct image_header*) image;
+    if (size < sizeof(struct image_header) || memcmp(header->magic, magic, sizeof(magic)) != 0) {
+        MTR_LOG_ERROR("%s is not a Matiria image.", path);
+        return false;
+    }
+
+    if (header->version != MTR_IMAGE_VERSION) {
+        MTR_LOG_ERROR("%s was compiled for image version %u (expected %u).", path, header->version, MTR_IMAGE_VERSION);
+        return false;
+    }
+
+    if (header->size != size || !in_bounds(sizeof(struct image_header), header->count * sizeof(struct image_global), size)) {
+        MTR_LOG_ERROR("%s is truncated.", path);
+        return false;
+    }
+
+    const struct image_global* globals = (const struct image_global*) (image + sizeof(struct image_header));
+    for (u32 i = 0; i < header->count; ++i) {
+        const struct image_global* g = globals + i;
+        bool ok = g->kind <= IMAGE_TYPE
+            && in_bounds(g->name, g->name_length, size)
+            && in_bounds(g->signature, g->signature_length, size)
+            && in_bounds(g->code, g->code_size, size);
+        if (!ok) {
+            MTR_LOG_ERROR("%s is corrupted.", path);
+            return false;
+        }
+    }
+    return true;
+}
+
+bool mtr_is_image(const char* path) {
+    size_t length = strlen(path);
+    return length > 5 && strcmp(path + length - 5, ".mtrc") == 0;
+}
+
+struct mtr_image_symbol mtr_image_symbol(const struct mtr_package* package, size_t index) {
+    MTR_ASSERT(package->image != NULL && index < package->count, "Package wasn't loaded from an image.");
+    const u8* image = package->image;
+    const struct image_global* g = (const struct image_global*) (image + sizeof(struct image_header)) + index;
+
+    struct mtr_image_symbol symbol;
+    memset(&symbol.name, 0, sizeof(symbol.name));
+    symbol.name.type = MTR_TOKEN_IDENTIFIER;
+    symbol.name.start = (const char*) image + g->name;
+    symbol.name.length = g->name_length;
+    symbol.signature = (const char*) image + g->signature;
+    symbol.signature_length = g->signature_length;
+    symbol.function = g->kind == IMAGE_FUNCTION;
+    symbol.native = g->kind == IMAGE_NATIVE;
+    return symbol;
+}
+
+enum mtr_exit_code mtr_load_image(struct mtr_package* package, const char* path) {
+    size_t size = 0;
+    const u8* image = mtr_map_file(path, &size);
+    if (!image) {
+        return MTR_FILE_ERROR;
+    }
+
+    if (!check_image(image, size, path)) {
+        mtr_unmap_file(image, size);
+        return MTR_FILE_ERROR;
+    }
+
+    const struct image_header* header = (const struct image_header*) image;
+    const struct image_global* globals = (const struct image_global*) (image + sizeof(struct image_header));
+
+    package->image = image;
+    package->image_size = size;
+    package->count = header->count;
+    package->objects = malloc(sizeof(struct mtr_object*) * header->count);
+    package->main = NULL;
+
+    for (u32 i = 0; i < header->count; ++i) {
+        const struct image_global* g = globals + i;
+
+        struct mtr_symbol symbol;
+        memset(&symbol, 0, sizeof(symbol));
+        symbol.token.type = MTR_TOKEN_IDENTIFIER;
+        symbol.token.start = (const char*) image + g->name;
+        symbol.token.length = g->name_length;
+        symbol.index = i;
+        symbol.is_global = true;
+
+        mtr_package_insert_global(package, symbol);
+
+        package->objects[i] = NULL;
+        if (g->kind == IMAGE_FUNCTION) {
+            // the chunk borrows the mapped bytecode
+            struct mtr_chunk chunk = { .bytecode = (u8*) image + g->code, .size = g->code_size, .capacity = 0 };
+            mtr_package_insert_function(package, (struct mtr_object*) mtr_new_function(chunk), symbol);
+        }
+    }
+
+    return MTR_OK;
+}
@@ -0,0 +1,34 @@
+#ifndef MTR_IMAGE_H
+#define MTR_IMAGE_H
+
+#include "package.h"
+
+#include "AST/AST.h"
+#include "core/exitCode.h"
+
+// Compiled packages saved to disk (.mtrc). Everything in an image is addressed by offsets
+// so it can be mapped and executed in place.
+// Bump the version whenever the bytecode or the layout changes.
+#define MTR_IMAGE_VERSION 3
+
+// writes the compiled package. The ast is the one the package was compiled from.
+bool mtr_write_image(const struct mtr_package* package, const struct mtr_ast* ast, const char* path);
+
+// maps the image into an empty package. Native functions still have to be inserted afterwards.
+enum mtr_exit_code mtr_load_image(struct mtr_package* package, const char* path);
+
+// whether path names an image rather than a source
+bool mtr_is_image(const char* path);
+
+// what the image of a package says about one of its globals. Everything points into the image
+struct mtr_image_symbol {
+    struct mtr_token name;
+    const char* signature;
+    size_t signature_length;
+    bool function; // has code
+    bool native;
+};
+
+struct mtr_image_symbol mtr_image_symbol(const struct mtr_package* package, size_t index);
+
+#endif
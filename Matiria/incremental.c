@@ -0,0 +1,361 @@
+#include "incremental.h"
+
+#include "AST/type.h"
+#include "scanner/scanner.h"
+#include "core/log.h"
+#include "core/utils.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+struct dependency {
+    u32 index;
+    u64 fingerprint; // of the global at index when the function was compiled
+};
+
+struct mtr_incremental_entry {
+    u64 fingerprint;
+    struct mtr_chunk chunk;
+    struct dependency* dependencies;
+    u32 count;
+    u64* locals; // hashes of the identifiers of the function that weren't globals
+    u32 local_count;
+    u32 generation; // of the last compile that used it
+    bool used;
+};
+
+void mtr_init_incremental(struct mtr_incremental* incremental) {
+    incremental->entries = NULL;
+    incremental->count = 0;
+    incremental->capacity = 0;
+    incremental->globals = NULL;
+    incremental->names = NULL;
+    incremental->declared = 0;
+    incremental->types = MTR_HASH64_SEED;
+    incremental->generation = 0;
+    incremental->reused = 0;
+}
+
+static void delete_entry(struct mtr_incremental_entry* entry) {
+    mtr_delete_chunk(&entry->chunk);
+    free(entry->dependencies);
+    free(entry->locals);
+    entry->dependencies = NULL;
+    entry->locals = NULL;
+    entry->used = false;
+}
+
+void mtr_delete_incremental(struct mtr_incremental* incremental) {
+    for (size_t i = 0; i < incremental->capacity; ++i) {
+        if (incremental->entries[i].used) {
+            delete_entry(incremental->entries + i);
+        }
+    }
+    free(incremental->entries);
+    free(incremental->globals);
+    free(incremental->names);
+    mtr_init_incremental(incremental);
+}
+
+// user types only by name, what they are made of goes into the fingerprint of the types
+static u64 hash_type(const struct mtr_type* type, u64 h) {
+    if (type == NULL) {
+        return hash64("?", 1, h);
+    }
+
+    const u32 kind = type->type;
+    h = hash64(&kind, sizeof(kind), h);
+    switch (type->type) {
+    case MTR_DATA_ARRAY: {
+        const struct mtr_array_type* a = (const struct mtr_array_type*) type;
+        return hash_type(a->element, h);
+    }
+    case MTR_DATA_MAP: {
+        const struct mtr_map_type* m = (const struct mtr_map_type*) type;
+        return hash_type(m->value, hash_type(m->key, h));
+    }
+    case MTR_DATA_FN: {
+        const struct mtr_function_type* f = (const struct mtr_function_type*) type;
+        h = hash64(&f->argc, sizeof(f->argc), h);
+        for (u8 i = 0; i < f->argc; ++i) {
+            h = hash_type(f->argv[i], h);
+        }
+        return hash_type(f->return_, h);
+    }
+    case MTR_DATA_USER:
+    case MTR_DATA_UNION:
+    case MTR_DATA_STRUCT: {
+        const struct mtr_user_type* u = (const struct mtr_user_type*) type;
+        return hash64(u->name.start, u->name.length, h);
+    }
+    default:
+        return h;
+    }
+}
+
+static u64 hash_symbol(struct mtr_symbol symbol, u64 h) {
+    h = hash64(symbol.token.start, symbol.token.length, h);
+    return hash_type(symbol.type, h);
+}
+
+// member order decides field offsets and union tags, so it is part of the fingerprint
+static u64 hash_user_type(const struct mtr_stmt* stmt, u64 h) {
+    switch (stmt->type) {
+    case MTR_STMT_STRUCT: {
+        const struct mtr_struct_decl* s = (const struct mtr_struct_decl*) stmt;
+        h = hash_symbol(s->symbol, h);
+        for (u8 i = 0; i < s->argc; ++i) {
+            h = hash_symbol(s->members[i]->symbol, h);
+        }
+        return h;
+    }
+    case MTR_STMT_UNION: {
+        const struct mtr_union_decl* u = (const struct mtr_union_decl*) stmt;
+        const struct mtr_union_type* type = (const struct mtr_union_type*) u->symbol.type;
+        h = hash_symbol(u->symbol, h);
+        for (u16 i = 0; i < type->argc; ++i) {
+            h = hash_type(type->types[i], h);
+        }
+        return h;
+    }
+    default:
+        return h;
+    }
+}
+
+static struct mtr_token name_of(const struct mtr_stmt* stmt) {
+    switch (stmt->type) {
+    case MTR_STMT_FN:
+    case MTR_STMT_NATIVE_FN: return ((const struct mtr_function_decl*) stmt)->symbol.token;
+    case MTR_STMT_STRUCT: return ((const struct mtr_struct_decl*) stmt)->symbol.token;
+    case MTR_STMT_UNION: return ((const struct mtr_union_decl*) stmt)->symbol.token;
+    default:
+        break;
+    }
+    MTR_ASSERT(false, "Invalid global statement.");
+    return (struct mtr_token) { 0 };
+}
+
+static u64 hash_name(struct mtr_token name) {
+    return hash64(name.start, name.length, MTR_HASH64_SEED);
+}
+
+static int compare_hashes(const void* a, const void* b) {
+    const u64 l = *(const u64*) a;
+    const u64 r = *(const u64*) b;
+    return (l > r) - (l < r);
+}
+
+static bool is_global_name(const struct mtr_incremental* incremental, u64 name) {
+    return bsearch(&name, incremental->names, incremental->declared, sizeof(u64), compare_hashes) != NULL;
+}
+
+static u64 hash_global(const struct mtr_stmt* stmt) {
+    const u32 kind = stmt->type;
+    u64 h = hash64(&kind, sizeof(kind), MTR_HASH64_SEED);
+    switch (stmt->type) {
+    case MTR_STMT_FN:
+    case MTR_STMT_NATIVE_FN: {
+        const struct mtr_function_decl* fn = (const struct mtr_function_decl*) stmt;
+        return hash_symbol(fn->symbol, h);
+    }
+    case MTR_STMT_STRUCT: return hash_symbol(((const struct mtr_struct_decl*) stmt)->symbol, h);
+    case MTR_STMT_UNION: return hash_symbol(((const struct mtr_union_decl*) stmt)->symbol, h);
+    default:
+        break;
+    }
+    MTR_ASSERT(false, "Invalid global statement.");
+    return h;
+}
+
+void mtr_incremental_begin(struct mtr_incremental* incremental, const struct mtr_ast* ast, size_t declared) {
+    const struct mtr_block* block = (const struct mtr_block*) ast->head;
+
+    incremental->generation++;
+    incremental->reused = 0;
+    incremental->declared = declared;
+    incremental->globals = realloc(incremental->globals, sizeof(u64) * (declared > 0 ? declared : 1));
+    incremental->names = realloc(incremental->names, sizeof(u64) * (declared > 0 ? declared : 1));
+    incremental->types = MTR_HASH64_SEED;
+    for (size_t i = 0; i < declared; ++i) {
+        incremental->globals[i] = hash_global(block->statements[i]);
+        incremental->names[i] = hash_name(name_of(block->statements[i]));
+        incremental->types = hash_user_type(block->statements[i], incremental->types);
+    }
+    qsort(incremental->names, declared, sizeof(u64), compare_hashes);
+}
+
+// the text from the name to the closing brace of the body
+static u64 fingerprint(const struct mtr_incremental* incremental, const struct mtr_function_decl* fn) {
+    const char* start = fn->symbol.token.start;
+    const char* end = fn->deferred + fn->deferred_length;
+    return hash64(start, (size_t) (end - start), incremental->types);
+}
+
+static struct mtr_incremental_entry* find_entry(struct mtr_incremental_entry* entries, size_t capacity, u64 fingerprint) {
+    size_t i = (size_t) fingerprint & (capacity - 1);
+    while (entries[i].used && entries[i].fingerprint != fingerprint) {
+        i = (i + 1) & (capacity - 1);
+    }
+    return entries + i;
+}
+
+struct mtr_function* mtr_incremental_reuse(struct mtr_incremental* incremental, const struct mtr_function_decl* fn) {
+    if (fn->deferred == NULL || incremental->count == 0) {
+        return NULL;
+    }
+
+    struct mtr_incremental_entry* entry = find_entry(incremental->entries, incremental->capacity, fingerprint(incremental, fn));
+    if (!entry->used) {
+        return NULL;
+    }
+
+    for (u32 i = 0; i < entry->count; ++i) {
+        struct dependency d = entry->dependencies[i];
+        if (d.index >= incremental->declared || incremental->globals[d.index] != d.fingerprint) {
+            return NULL;
+        }
+    }
+
+    for (u32 i = 0; i < entry->local_count; ++i) {
+        if (is_global_name(incremental, entry->locals[i])) {
+            return NULL;
+        }
+    }
+
+    entry->generation = incremental->generation;
+    incremental->reused++;
+
+    struct mtr_chunk chunk = { .bytecode = malloc(entry->chunk.size), .size = entry->chunk.size, .capacity = entry->chunk.size };
+    memcpy(chunk.bytecode, entry->chunk.bytecode, entry->chunk.size);
+    return mtr_new_function(chunk);
+}
+
+// evicting drops the entries the current compile didn't use
+static void rehash(struct mtr_incremental* incremental, size_t capacity, bool evict) {
+    struct mtr_incremental_entry* entries = calloc(capacity, sizeof(struct mtr_incremental_entry));
+    size_t count = 0;
+    for (size_t i = 0; i < incremental->capacity; ++i) {
+        struct mtr_incremental_entry* old = incremental->entries + i;
+        if (!old->used) {
+            continue;
+        }
+
+        if (evict && old->generation != incremental->generation) {
+            delete_entry(old);
+            continue;
+        }
+
+        *find_entry(entries, capacity, old->fingerprint) = *old;
+        count++;
+    }
+
+    free(incremental->entries);
+    incremental->entries = entries;
+    incremental->capacity = capacity;
+    incremental->count = count;
+}
+
+// Every identifier from the parameters to the end of the body that isn't a global, which takes in
+// the locals and parameters. Member names come along too, a global named like one only costs a compile
+static void record_locals(const struct mtr_incremental* incremental, struct mtr_incremental_entry* entry, const struct mtr_function_decl* fn) {
+    const char* start = fn->symbol.token.start + fn->symbol.token.length;
+    const char* end = fn->deferred + fn->deferred_length;
+    // scanning to the end of the whole source would make recording every function quadratic
+    struct mtr_scanner scanner = { .source = start, .start = start, .current = start, .end = end, .names = NULL };
+
+    u32 capacity = 0;
+    entry->locals = NULL;
+    entry->local_count = 0;
+    for (struct mtr_token t = mtr_next_token(&scanner); t.type != MTR_TOKEN_EOF && t.start < end; t = mtr_next_token(&scanner)) {
+        if (t.type != MTR_TOKEN_IDENTIFIER) {
+            continue;
+        }
+
+        const u64 name = hash_name(t);
+        if (is_global_name(incremental, name)) {
+            continue;
+        }
+
+        if (entry->local_count == capacity) {
+            capacity = capacity == 0 ? 8 : capacity * 2;
+            entry->locals = realloc(entry->locals, sizeof(u64) * capacity);
+        }
+        entry->locals[entry->local_count++] = name;
+    }
+}
+
+void mtr_incremental_record(struct mtr_incremental* incremental, const struct mtr_function_decl* fn, const struct mtr_function* function, const struct mtr_dependencies* dependencies) {
+    if (fn->deferred == NULL) {
+        return;
+    }
+
+    // calls to specializations can't be checked without checking the caller, so it is always compiled
+    for (size_t i = 0; i < dependencies->count; ++i) {
+        if (dependencies->indices[i] >= incremental->declared) {
+            return;
+        }
+    }
+
+    if (incremental->count + 1 > incremental->capacity * 3 / 4) {
+        rehash(incremental, incremental->capacity == 0 ? 64 : incremental->capacity * 2, false);
+    }
+
+    const u64 f = fingerprint(incremental, fn);
+    struct mtr_incremental_entry* entry = find_entry(incremental->entries, incremental->capacity, f);
+    if (entry->used) {
+        // same text, but what it uses changed
+        delete_entry(entry);
+    } else {
+        incremental->count++;
+    }
+
+    entry->fingerprint = f;
+    entry->generation = incremental->generation;
+    entry->used = true;
+
+    entry->chunk.size = function->chunk.size;
+    entry->chunk.capacity = function->chunk.size;
+    entry->chunk.bytecode = malloc(function->chunk.size);
+    memcpy(entry->chunk.bytecode, function->chunk.bytecode, function->chunk.size);
+
+    entry->count = (u32) dependencies->count;
+    entry->dependencies = malloc(sizeof(struct dependency) * (dependencies->count > 0 ? dependencies->count : 1));
+    for (size_t i = 0; i < dependencies->count; ++i) {
+        const u32 index = dependencies->indices[i];
+        entry->dependencies[i] = (struct dependency) { .index = index, .fingerprint = incremental->globals[index] };
+    }
+
+    record_locals(incremental, entry, fn);
+}
+
+void mtr_incremental_end(struct mtr_incremental* incremental, bool ok) {
+    if (ok && incremental->capacity > 0) {
+        rehash(incremental, incremental->capacity, true);
+    }
+    free(incremental->globals);
+    free(incremental->names);
+    incremental->globals = NULL;
+    incremental->names = NULL;
+    incremental->declared = 0;
+}
+
+void mtr_add_dependency(struct mtr_dependencies* dependencies, u32 index) {
+    // the same global tends to be used several times in a row
+    if (dependencies->count > 0 && dependencies->indices[dependencies->count - 1] == index) {
+        return;
+    }
+
+    if (dependencies->count == dependencies->capacity) {
+        dependencies->capacity = dependencies->capacity == 0 ? 8 : dependencies->capacity * 2;
+        dependencies->indices = realloc(dependencies->indices, sizeof(u32) * dependencies->capacity);
+    }
+    dependencies->indices[dependencies->count++] = index;
+}
+
+void mtr_delete_dependencies(struct mtr_dependencies* dependencies) {
+    free(dependencies->indices);
+    dependencies->indices = NULL;
+    dependencies->count = 0;
+    dependencies->capacity = 0;
+}
@@ -0,0 +1,53 @@
+#ifndef MTR_INCREMENTAL_H
+#define MTR_INCREMENTAL_H
+
+#include "AST/AST.h"
+#include "runtime/object.h"
+
+#include "core/types.h"
+
+// Code of the functions of previous compiles, so compiling an edited source only redoes what changed.
+// A function is reused when its source text and every struct and union are the same as before
+// and the globals its code uses still have the same name, index and type. A new global with the
+// name of one of its locals or parameters would be a redefinition, so that also compiles it again.
+// Only global functions with a block body are kept, everything else is always compiled.
+
+struct mtr_incremental_entry;
+
+struct mtr_incremental {
+    struct mtr_incremental_entry* entries; // by fingerprint
+    size_t count;
+    size_t capacity;
+    u64* globals; // fingerprints of the declared globals of the current compile
+    u64* names; // hashes of the names of the declared globals, sorted
+    size_t declared;
+    u64 types; // fingerprint of every struct and union of the current compile
+    u32 generation;
+    size_t reused; // functions, by the last compile
+};
+
+// indices of the globals the code of a function uses
+struct mtr_dependencies {
+    u32* indices;
+    size_t count;
+    size_t capacity;
+};
+
+void mtr_init_incremental(struct mtr_incremental* incremental);
+void mtr_delete_incremental(struct mtr_incremental* incremental);
+
+// The declared globals of the ast have to be loaded already (see mtr_validate_begin)
+void mtr_incremental_begin(struct mtr_incremental* incremental, const struct mtr_ast* ast, size_t declared);
+
+// NULL if fn has to be compiled
+struct mtr_function* mtr_incremental_reuse(struct mtr_incremental* incremental, const struct mtr_function_decl* fn);
+
+void mtr_incremental_record(struct mtr_incremental* incremental, const struct mtr_function_decl* fn, const struct mtr_function* function, const struct mtr_dependencies* dependencies);
+
+// After a successful compile the functions that were neither reused nor recorded are dropped
+void mtr_incremental_end(struct mtr_incremental* incremental, bool ok);
+
+void mtr_add_dependency(struct mtr_dependencies* dependencies, u32 index);
+void mtr_delete_dependencies(struct mtr_dependencies* dependencies);
+
+#endif
@@ -2,24 +2,46 @@
 
 #include "core/file.h"
 #include "compiler.h"
+#include "image.h"
 #include "package.h"
 #include "runtime/engine.h"
 #include "stl/mtr_stdlib.h"
 
 #include <stdlib.h>
 
+// sources bigger than this are compiled one function at a time
+#define STREAM_THRESHOLD (64 * 1024 * 1024)
+
 enum mtr_exit_code mtr_launch(const char* path) {
-    char* source = mtr_read_file(path);
-    if (!source) {
-        return MTR_FILE_ERROR;
-    }
+    return mtr_launch_with_timeline(path, NULL);
+}
 
+enum mtr_exit_code mtr_launch_with_timeline(const char* path, const char* timeline_path) {
+    const char* source = NULL;
+    size_t size = 0;
     enum mtr_exit_code ec = MTR_OK;
 
+    struct mtr_timeline recorded;
+    struct mtr_timeline* timeline = NULL;
+    if (timeline_path) {
+        mtr_init_timeline(&recorded);
+        timeline = &recorded;
+    }
+
     struct mtr_package package;
     mtr_init_package(&package);
 
-    ec = mtr_compile(source, &package);
+    u64 start = mtr_timeline_now(timeline);
+    if (mtr_is_image(path)) {
+        ec = mtr_load_image(&package, path);
+        mtr_timeline_phase(timeline, "launch", "load image", start);
+    } else {
+        source = mtr_map_source(path, &size);
+        mtr_timeline_phase(timeline, "launch", "read file", start);
+        const struct mtr_compile_options options = { .cache = NULL, .stream = size > STREAM_THRESHOLD, .timeline = timeline };
+        ec = source ? mtr_compile_with_options(source, &package, &options) : MTR_FILE_ERROR;
+    }
+
     if (ec != MTR_OK) {
         goto end;
     }
@@ -27,11 +49,19 @@ enum mtr_exit_code mtr_launch(const char* path) {
     mtr_add_io(&package);
 
     struct mtr_engine* engine = malloc(sizeof(*engine));
-    i32 result = mtr_execute(engine, &package);
+    i32 result = mtr_execute_with_timeline(engine, &package, timeline);
     free(engine);
 
 end:
+    // the names of the functions point into the source
+    if (timeline) {
+        mtr_write_timeline(timeline, &package, timeline_path);
+        mtr_delete_timeline(timeline);
+    }
+
     mtr_delete_package(&package);
-    free(source);
+    if (source) {
+        mtr_unmap_source(source, size);
+    }
     return ec;
 }
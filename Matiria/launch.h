@@ -5,5 +5,8 @@
 
 enum mtr_exit_code mtr_launch(const char* path);
 
+// also writes when reading, compiling and running the script happened to timeline as Chrome trace events (see timeline.h)
+enum mtr_exit_code mtr_launch_with_timeline(const char* path, const char* timeline);
+
 #endif
 
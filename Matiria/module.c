@@ -0,0 +1,223 @@
+#include "module.h"
+
+#include "cache.h"
+#include "compiler.h"
+#include "image.h"
+
+#include "scanner/scanner.h"
+
+#include "core/file.h"
+#include "core/log.h"
+#include "core/report.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+enum mtr_exit_code mtr_load_module(struct mtr_package* module, const char* path, const char* cache) {
+    if (mtr_is_image(path)) {
+        return mtr_load_image(module, path);
+    }
+
+    char* source = mtr_read_file(path);
+    if (source == NULL) {
+        return MTR_FILE_ERROR;
+    }
+
+    const struct mtr_compile_options options = { .cache = NULL };
+    const u64 key = mtr_cache_key(source, mtr_compile_flags(&options));
+
+    enum mtr_exit_code ec = MTR_OK;
+    if (!mtr_cache_load(cache, key, module)) {
+        ec = MTR_FILE_ERROR;
+        if (mtr_cache_prepare(cache)) {
+            // the importer needs the signatures, which only the image has
+            char* image = mtr_cache_path(cache, key);
+            struct mtr_package compiled;
+            mtr_init_package(&compiled);
+            ec = mtr_compile_and_save(source, &compiled, image);
+            mtr_delete_package(&compiled);
+            free(image);
+
+            if (ec == MTR_OK && !mtr_cache_load(cache, key, module)) {
+                ec = MTR_FILE_ERROR;
+            }
+        }
+    }
+
+    free(source);
+    return ec;
+}
+
+static bool same_name(struct mtr_token a, struct mtr_token b) {
+    return a.length == b.length && memcmp(a.start, b.start, a.length) == 0;
+}
+
+static struct mtr_token global_name(const struct mtr_stmt* s) {
+    switch (s->type) {
+    case MTR_STMT_FN:
+    case MTR_STMT_NATIVE_FN: return ((const struct mtr_function_decl*) s)->symbol.token;
+    case MTR_STMT_STRUCT:    return ((const struct mtr_struct_decl*) s)->symbol.token;
+    case MTR_STMT_UNION:     return ((const struct mtr_union_decl*) s)->symbol.token;
+    default:
+        break;
+    }
+    MTR_ASSERT(false, "Invalid global statement.");
+    return (struct mtr_token) { .length = 0 };
+}
+
+// user types of the module mean nothing to the importer
+static bool built_in_types(const char* signature, size_t length) {
+    char* text = malloc(length + 1);
+    memcpy(text, signature, length);
+    text[length] = '\0';
+
+    struct mtr_scanner scanner;
+    mtr_scanner_init(&scanner, text);
+    bool ok = true;
+    for (struct mtr_token t = mtr_next_token(&scanner); t.type != MTR_TOKEN_EOF; t = mtr_next_token(&scanner)) {
+        if (t.type == MTR_TOKEN_IDENTIFIER || t.type == MTR_TOKEN_INVALID) {
+            ok = false;
+            break;
+        }
+    }
+
+    free(text);
+    return ok;
+}
+
+static bool exported(const struct mtr_package* module, size_t index, const struct mtr_image_symbol* symbol) {
+    static const struct mtr_token main = { .start = "main", .length = 4 };
+    if (!symbol->function || symbol->signature_length == 0 || symbol->signature[0] != '(' || same_name(symbol->name, main)) {
+        return false;
+    }
+
+    // specializations share the name of their generic function
+    const struct mtr_symbol* s = mtr_symbol_table_get(&module->symbols, symbol->name.start, symbol->name.length);
+    if (s == NULL || s->index != index) {
+        return false;
+    }
+
+    return built_in_types(symbol->signature, symbol->signature_length);
+}
+
+static u32 add_module(struct mtr_package* package, struct mtr_package* module) {
+    package->modules = realloc(package->modules, sizeof(struct mtr_package*) * (package->module_count + 1));
+    package->modules[package->module_count] = module;
+    return (u32) package->module_count++;
+}
+
+static void add_import(struct mtr_package* package, struct mtr_import_slot slot) {
+    package->imports = realloc(package->imports, sizeof(struct mtr_import_slot) * (package->import_count + 1));
+    package->imports[package->import_count++] = slot;
+}
+
+enum mtr_exit_code mtr_import_modules(struct mtr_parser* parser, struct mtr_ast* ast, struct mtr_package* package, const char* cache) {
+    struct mtr_block* block = (struct mtr_block*) ast->head;
+
+    for (size_t i = 0; i < ast->import_count; ++i) {
+        const struct mtr_token token = ast->imports[i];
+
+        bool seen = false;
+        for (size_t j = 0; j < i && !seen; ++j) {
+            seen = same_name(token, ast->imports[j]);
+        }
+        if (seen) {
+            continue;
+        }
+
+        // skip the quotes
+        char* path = malloc(token.length - 1);
+        memcpy(path, token.start + 1, token.length - 2);
+        path[token.length - 2] = '\0';
+
+        struct mtr_package* module = malloc(sizeof(struct mtr_package));
+        mtr_init_package(module);
+        enum mtr_exit_code ec = mtr_load_module(module, path, cache);
+        free(path);
+
+        if (ec != MTR_OK) {
+            mtr_report_error(token, "Unable to load module.", ast->source);
+            mtr_delete_package(module);
+            free(module);
+            return ec;
+        }
+
+        const u32 m = add_module(package, module);
+        for (size_t g = 0; g < module->count; ++g) {
+            const struct mtr_image_symbol symbol = mtr_image_symbol(module, g);
+            if (!exported(module, g, &symbol)) {
+                continue;
+            }
+
+            for (size_t s = 0; s < block->size; ++s) {
+                if (same_name(symbol.name, global_name(block->statements[s]))) {
+                    MTR_LOG_ERROR("'%.*s' is defined more than once.", (int) symbol.name.length, symbol.name.start);
+                    mtr_report_error(token, "Module exports a name that is already defined.", ast->source);
+                    return MTR_SCOPE_ERROR;
+                }
+            }
+
+            add_import(package, (struct mtr_import_slot) { .global = (u32) block->size, .module = m, .index = (u32) g });
+            struct mtr_stmt* decl = mtr_parse_extern(parser, ast, symbol.name, symbol.signature, symbol.signature_length);
+            mtr_block_append(&ast->arena, block, decl);
+        }
+    }
+
+    return MTR_OK;
+}
+
+// functions run with the globals of the package they come from
+static void set_package(struct mtr_package* package, struct mtr_package* owner) {
+    for (size_t i = 0; i < package->count; ++i) {
+        struct mtr_object* o = package->objects[i];
+        if (o != NULL && o->type == MTR_OBJ_FUNCTION && ((struct mtr_function*) o)->package == NULL) {
+            ((struct mtr_function*) o)->package = owner;
+        }
+    }
+}
+
+static bool link_natives(struct mtr_package* module, struct mtr_package* importer) {
+    for (size_t i = 0; i < module->count; ++i) {
+        if (module->objects[i] != NULL) {
+            continue;
+        }
+
+        const struct mtr_image_symbol symbol = mtr_image_symbol(module, i);
+        if (!symbol.native) {
+            continue;
+        }
+
+        const struct mtr_symbol* s = mtr_symbol_table_get(&importer->symbols, symbol.name.start, symbol.name.length);
+        const struct mtr_object* o = s != NULL ? importer->objects[s->index] : NULL;
+        if (o == NULL || o->type != MTR_OBJ_NATIVE_FN) {
+            MTR_LOG_ERROR("Module needs native function '%.*s'.", (int) symbol.name.length, symbol.name.start);
+            return false;
+        }
+
+        // each package deletes its own objects
+        const struct mtr_native_fn* native = (const struct mtr_native_fn*) o;
+        module->objects[i] = (struct mtr_object*) mtr_new_native_function(native->function);
+    }
+    return true;
+}
+
+bool mtr_link_package(struct mtr_package* package) {
+    if (package->module_count == 0) {
+        return true;
+    }
+
+    for (size_t i = 0; i < package->module_count; ++i) {
+        struct mtr_package* module = package->modules[i];
+        set_package(module, module);
+        if (!link_natives(module, package)) {
+            return false;
+        }
+    }
+    set_package(package, package);
+
+    for (size_t i = 0; i < package->import_count; ++i) {
+        const struct mtr_import_slot slot = package->imports[i];
+        package->objects[slot.global] = package->modules[slot.module]->objects[slot.index];
+    }
+    return true;
+}
@@ -0,0 +1,40 @@
+#ifndef MTR_MODULE_H
+#define MTR_MODULE_H
+
+#include "package.h"
+
+#include "AST/AST.h"
+#include "parser/parser.h"
+#include "core/exitCode.h"
+
+// Packages compiled on their own and linked into the package that imports them.
+// `import 'path';` compiles the source at path (relative to the working directory) into an image
+// in the cache directory, or maps path directly if it is an image already. The importing source
+// only sees the signatures of the exported functions, so it doesn't have to be checked against
+// the module and an unchanged module is never compiled again.
+// A module exports its functions whose signature only uses built in types, except main.
+// Its code keeps using its own global table, importing only fills slots of the importer.
+// Modules can't import other modules.
+
+// where modules are cached when the compile options don't name a cache
+#define MTR_MODULE_CACHE "mtr_modules"
+
+// a global of the importing package that is a function of a module
+struct mtr_import_slot {
+    u32 global;
+    u32 module; // in mtr_package.modules
+    u32 index; // of the function in the module
+};
+
+// loads the module at path into an empty package
+enum mtr_exit_code mtr_load_module(struct mtr_package* module, const char* path, const char* cache);
+
+// loads the modules the ast imports into package and declares what they export in the ast.
+// Has to run before the ast is checked
+enum mtr_exit_code mtr_import_modules(struct mtr_parser* parser, struct mtr_ast* ast, struct mtr_package* package, const char* cache);
+
+// fills the import slots of the package and the native functions of its modules, which take the
+// ones of the importer with the same name. Done by mtr_execute
+bool mtr_link_package(struct mtr_package* package);
+
+#endif
@@ -1,11 +1,16 @@
 #include "package.h"
 
+#include "compiler.h"
+#include "module.h"
+
+#include "core/file.h"
 #include "core/log.h"
 #include "core/utils.h"
 #include "debug/disassemble.h"
 
 #include "debug/dump.h"
 
+#include <stdint.h>
 #include <stdlib.h>
 #include <string.h>
 
@@ -45,6 +50,15 @@ void mtr_init_package(struct mtr_package* package) {
     package->count = 0;
     package->objects = NULL;
     package->main = NULL;
+    package->image = NULL;
+    package->image_size = 0;
+    package->lazy = NULL;
+    package->modules = NULL;
+    package->module_count = 0;
+    package->imports = NULL;
+    package->import_count = 0;
+    package->specializations = NULL;
+    package->specialization_count = 0;
     mtr_init_symbol_table(&package->symbols);
 }
 
@@ -58,25 +72,36 @@ void mtr_load_package(struct mtr_package* package, struct mtr_ast* ast) {
         MTR_ASSERT(valid_as_global(block->statements[i]), "Statement is not valid as global statement!");
         struct mtr_symbol s = get_symbol(block->statements[i]);
         MTR_ASSERT(s.index == i, "Wrong index");
-        mtr_symbol_table_insert(&package->symbols, s.token.start, s.token.length, s);
+        mtr_package_insert_global(package, s);
         package->objects[i] = NULL;
     }
 
     package->count = block->size;
 }
 
+void mtr_package_insert_global(struct mtr_package* package, struct mtr_symbol symbol) {
+    // specializations share the name of their generic function and are only reached by index
+    const struct mtr_symbol* generic = mtr_symbol_table_get(&package->symbols, symbol.token.start, symbol.token.length);
+    if (generic == NULL) {
+        mtr_symbol_table_insert(&package->symbols, symbol.token.start, symbol.token.length, symbol);
+        return;
+    }
+
+    package->specializations = realloc(package->specializations, sizeof(struct mtr_specialization) * (package->specialization_count + 1));
+    package->specializations[package->specialization_count++] = (struct mtr_specialization) { symbol.index, generic->index };
+}
+
 void mtr_package_insert_function(struct mtr_package* package, struct mtr_object* object, struct mtr_symbol symbol) {
-    const struct mtr_symbol* s = mtr_symbol_table_get(&package->symbols, symbol.token.start, symbol.token.length);
-    if (s == NULL) {
+    if (symbol.index >= package->count) {
         MTR_LOG_WARN("Name '%.*s' not found!", symbol.token.length, symbol.token.start);
         return;
     }
 
-    if (is_main(*s)) {
+    if (is_main(symbol)) {
         package->main = (struct mtr_function*) object;
     }
 
-    package->objects[s->index] = object;
+    package->objects[symbol.index] = object;
 }
 
 void mtr_package_insert_native_function(struct mtr_package* package, struct mtr_object* object, const char* name) {
@@ -112,7 +137,15 @@ struct mtr_object* mtr_package_get_function_by_name(struct mtr_package* package,
 }
 
 void mtr_delete_package(struct mtr_package* package) {
-    for (size_t i = 0; i < package->symbols.size; ++i) {
+    // imported functions belong to their module
+    for (size_t i = 0; i < package->import_count && package->objects; ++i) {
+        package->objects[package->imports[i].global] = NULL;
+    }
+    free(package->imports);
+    package->imports = NULL;
+    package->import_count = 0;
+
+    for (size_t i = 0; i < package->count; ++i) {
         if (!package->objects[i]) continue;
         mtr_delete_object(package->objects[i]);
     }
@@ -120,4 +153,120 @@ void mtr_delete_package(struct mtr_package* package) {
     free(package->objects);
     package->objects = NULL;
     mtr_delete_symbol_table(&package->symbols);
+    free(package->specializations);
+    package->specializations = NULL;
+    package->specialization_count = 0;
+
+    if (package->lazy) {
+        mtr_delete_lazy(package->lazy);
+        package->lazy = NULL;
+    }
+
+    // symbol names and bytecode point into the image so it goes last
+    if (package->image) {
+        mtr_unmap_file(package->image, package->image_size);
+        package->image = NULL;
+        package->image_size = 0;
+    }
+
+    // the names of the imports point into the images of the modules
+    for (size_t i = 0; i < package->module_count; ++i) {
+        mtr_delete_package(package->modules[i]);
+        free(package->modules[i]);
+    }
+    free(package->modules);
+    package->modules = NULL;
+    package->module_count = 0;
+}
+
+struct mtr_function_name {
+    const void* object;
+    struct mtr_token token;
+};
+
+static void add_name(struct mtr_function_names* names, const void* object, struct mtr_token token) {
+    if (names->count == names->capacity) {
+        names->capacity = names->capacity == 0 ? 64 : names->capacity * 2;
+        names->names = realloc(names->names, sizeof(struct mtr_function_name) * names->capacity);
+    }
+    names->names[names->count++] = (struct mtr_function_name) { object, token };
+}
+
+static void add_names(struct mtr_function_names* names, const struct mtr_package* package) {
+    // the symbols by global, so specializations can take the name of their generic
+    const struct mtr_token** tokens = calloc(package->count + 1, sizeof(struct mtr_token*));
+
+    size_t index = 0;
+    for (struct mtr_symbol* s = mtr_symbol_table_next(&package->symbols, &index); s; s = mtr_symbol_table_next(&package->symbols, &index)) {
+        if (s->index >= package->count) {
+            continue;
+        }
+
+        tokens[s->index] = &s->token;
+        if (package->objects[s->index] != NULL) {
+            add_name(names, package->objects[s->index], s->token);
+        }
+    }
+
+    for (size_t i = 0; i < package->specialization_count; ++i) {
+        const struct mtr_specialization* s = package->specializations + i;
+        if (s->index < package->count && package->objects[s->index] != NULL && tokens[s->generic] != NULL) {
+            add_name(names, package->objects[s->index], *tokens[s->generic]);
+        }
+    }
+    free(tokens);
+
+    for (size_t i = 0; i < package->module_count; ++i) {
+        add_names(names, package->modules[i]);
+    }
+}
+
+static int compare_names(const void* a, const void* b) {
+    const uintptr_t l = (uintptr_t) ((const struct mtr_function_name*) a)->object;
+    const uintptr_t r = (uintptr_t) ((const struct mtr_function_name*) b)->object;
+    return (l > r) - (l < r);
+}
+
+void mtr_init_function_names(struct mtr_function_names* names, const struct mtr_package* package) {
+    names->names = NULL;
+    names->count = 0;
+    names->capacity = 0;
+    add_names(names, package);
+    qsort(names->names, names->count, sizeof(struct mtr_function_name), compare_names);
+}
+
+void mtr_delete_function_names(struct mtr_function_names* names) {
+    free(names->names);
+    names->names = NULL;
+    names->count = 0;
+    names->capacity = 0;
+}
+
+const struct mtr_token* mtr_function_name(const struct mtr_function_names* names, const void* object) {
+    const struct mtr_function_name key = { object, { 0 } };
+    const struct mtr_function_name* name = bsearch(&key, names->names, names->count, sizeof(struct mtr_function_name), compare_names);
+    return name ? &name->token : NULL;
+}
+
+void mtr_write_function_name(FILE* file, const struct mtr_function_names* names, const void* object, u8 type) {
+    const struct mtr_token* name = type == MTR_OBJ_CLOSURE ? NULL : mtr_function_name(names, object);
+    if (name) {
+        fprintf(file, "%.*s", (int) name->length, name->start);
+        return;
+    }
+
+    switch (type) {
+    case MTR_OBJ_CLOSURE:   fputs("<closure>", file); return;
+    case MTR_OBJ_NATIVE_FN: fputs("<native>", file); return;
+    default:
+        fputs("<function>", file);
+        return;
+    }
+}
+
+void mtr_write_json_function_name(FILE* file, const struct mtr_function_names* names, const void* object, u8 type) {
+    // names are identifiers, there is nothing to escape
+    fputc('"', file);
+    mtr_write_function_name(file, names, object, type);
+    fputc('"', file);
 }
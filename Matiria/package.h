@@ -5,21 +5,61 @@
 #include "runtime/object.h"
 #include "validator/symbolTable.h"
 
+#include <stdio.h>
+
+// a global copied from a generic function. It shares the name of the generic and isn't in the symbols
+struct mtr_specialization {
+    size_t index;
+    size_t generic;
+};
+
 struct mtr_package {
     struct mtr_symbol_table symbols;
+    struct mtr_specialization* specializations;
+    size_t specialization_count;
     struct mtr_object** objects;
     struct mtr_function* main;
     size_t count;
+    const void* image; // mapped .mtrc file the functions run from. NULL when compiled from source
+    size_t image_size;
+    struct mtr_lazy* lazy; // what the bodies compiled on their first call need. NULL if everything is compiled
+    struct mtr_package** modules; // imported, owned by the package (see module.h)
+    size_t module_count;
+    struct mtr_import_slot* imports;
+    size_t import_count;
 };
 
 void mtr_init_package(struct mtr_package* package);
 void mtr_load_package(struct mtr_package* package, struct mtr_ast* ast);
 void mtr_delete_package(struct mtr_package* package);
 
+// Adds the symbol of a global, or records it as a specialization of the global with its name
+void mtr_package_insert_global(struct mtr_package* package, struct mtr_symbol symbol);
+
 void mtr_package_insert_function(struct mtr_package* package, struct mtr_object* object, struct mtr_symbol symbol);
 void mtr_package_insert_native_function(struct mtr_package* package, struct mtr_object* object, const char* name);
 
 struct mtr_object* mtr_package_get_function(struct mtr_package* package, struct mtr_symbol symbol);
 struct mtr_object* mtr_package_get_function_by_name(struct mtr_package* package, const char*);
 
+// What the functions of a package and its modules are called, to name the objects a profile saw.
+// Specializations are named after their generic function, closures have no name
+struct mtr_function_names {
+    struct mtr_function_name* names; // sorted by object
+    size_t count;
+    size_t capacity;
+};
+
+void mtr_init_function_names(struct mtr_function_names* names, const struct mtr_package* package);
+void mtr_delete_function_names(struct mtr_function_names* names);
+
+// NULL if object isn't a function of the package
+const struct mtr_token* mtr_function_name(const struct mtr_function_names* names, const void* object);
+
+// Writes what the profiles call a function: its name, or what kind of function it is when it has none.
+// type is its enum mtr_object_t, closures are named by their code and never looked up
+void mtr_write_function_name(FILE* file, const struct mtr_function_names* names, const void* object, u8 type);
+// the same as a JSON string
+void mtr_write_json_function_name(FILE* file, const struct mtr_function_names* names, const void* object, u8 type);
+
 #endif
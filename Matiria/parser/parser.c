@@ -15,32 +15,25 @@
 #include "scanner/scanner.h"
 #include "scanner/token.h"
 
-#define ALLOCATE_EXPR(type, expr) allocate_expr(type, sizeof(struct expr))
-#define ALLOCATE_STMT(type, stmt) allocate_stmt(type, sizeof(struct stmt))
-#define ALLOCATE_TYPE(type, obj)  allocate_type(type, obj ? sizeof(obj) : sizeof(struct mtr_type))
+#define ALLOCATE_EXPR(type, expr) allocate_expr(parser->arena, type, sizeof(struct expr))
+#define ALLOCATE_STMT(type, stmt) allocate_stmt(parser->arena, type, sizeof(struct stmt))
+#define ALLOCATE_ARRAY(type, count) mtr_arena_alloc(parser->arena, sizeof(type) * (count))
 
-static void init_block(struct mtr_block* block);
-static void write_block(struct mtr_block* block, struct mtr_stmt* declaration);
-static void delete_block(struct mtr_block* block);
+static void init_block(struct mtr_arena* arena, struct mtr_block* block);
+static void write_block(struct mtr_arena* arena, struct mtr_block* block, struct mtr_stmt* declaration);
 
-static void* allocate_expr(enum mtr_expr_type type, size_t size) {
-    struct mtr_expr* node = malloc(size);
+static void* allocate_expr(struct mtr_arena* arena, enum mtr_expr_type type, size_t size) {
+    struct mtr_expr* node = mtr_arena_alloc(arena, size);
     node->type = type;
     return node;
 }
 
-static void* allocate_stmt(enum mtr_stmt_type type, size_t size) {
-    struct mtr_stmt* node = malloc(size);
+static void* allocate_stmt(struct mtr_arena* arena, enum mtr_stmt_type type, size_t size) {
+    struct mtr_stmt* node = mtr_arena_alloc(arena, size);
     node->type = type;
     return node;
 }
 
-static void* allocate_type(enum mtr_data_type type, size_t size) {
-    struct mtr_type* t = malloc(size);
-    t->type = type;
-    return t;
-}
-
 static void parser_error(struct mtr_parser* parser, const char* message) {
     parser->had_error = true;
     if (!parser->panic)
@@ -87,6 +80,7 @@ static struct mtr_token consume(struct mtr_parser* parser, enum mtr_token_type t
 void mtr_parser_init(struct mtr_parser* parser, const char* source) {
     mtr_scanner_init(&parser->scanner, source);
     parser->current_function = NULL;
+    parser->defer_bodies = false;
     parser->had_error = false;
     parser->panic = false;
 }
@@ -105,6 +99,9 @@ static void synchronize(struct mtr_parser* parser) {
         case MTR_TOKEN_FN:
         case MTR_TOKEN_IF:
         case MTR_TOKEN_WHILE:
+        case MTR_TOKEN_FOR:
+        case MTR_TOKEN_MATCH:
+        case MTR_TOKEN_IMPORT:
         case MTR_TOKEN_CURLY_L:
         case MTR_TOKEN_CURLY_R:
             return;
@@ -187,6 +184,7 @@ static const struct parser_rule rules[] = {
     [MTR_TOKEN_AND] = { .prefix = NULL, .infix = binary, .precedence = LOGIC },
     [MTR_TOKEN_OR] = { .prefix = NULL, .infix = binary, .precedence = LOGIC },
     [MTR_TOKEN_PIPE] = {NO_OP},
+    [MTR_TOKEN_DOUBLE_DOT] = { NO_OP },
     [MTR_TOKEN_ELLIPSIS] = { NO_OP },
     [MTR_TOKEN_TYPE] = { NO_OP },
     [MTR_TOKEN_IF] = { NO_OP },
@@ -197,6 +195,8 @@ static const struct parser_rule rules[] = {
     [MTR_TOKEN_RETURN] = { NO_OP },
     [MTR_TOKEN_WHILE] = { NO_OP },
     [MTR_TOKEN_FOR] = { NO_OP },
+    [MTR_TOKEN_IN] = { NO_OP },
+    [MTR_TOKEN_MATCH] = { NO_OP },
     [MTR_TOKEN_INT] = { NO_OP },
     [MTR_TOKEN_FLOAT] = { NO_OP },
     [MTR_TOKEN_BOOL] = { NO_OP },
@@ -282,7 +282,7 @@ static struct mtr_expr* array_literal(struct mtr_parser* parser, struct mtr_toke
     }
 
     node->count = count;
-    node->expressions = malloc(sizeof(struct mtr_expr*) * count);
+    node->expressions = ALLOCATE_ARRAY(struct mtr_expr*, count);
     memcpy(node->expressions, exprs, sizeof(struct mtr_expr*) * count);
 
     return (struct mtr_expr*) node;
@@ -308,7 +308,7 @@ static struct mtr_expr* map_literal(struct mtr_parser* parser, struct mtr_token
     }
 
     node->count = count;
-    node->entries = malloc(sizeof(struct mtr_map_entry) * count);
+    node->entries = ALLOCATE_ARRAY(struct mtr_map_entry, count);
     memcpy(node->entries, entries, sizeof(struct mtr_map_entry) * count);
 
     return (struct mtr_expr*) node;
@@ -319,6 +319,7 @@ static struct mtr_expr* call(struct mtr_parser* parser, struct mtr_token paren,
     node->callable = name;
     node->argc = 0;
     node->argv = NULL;
+    node->returns = NULL;
 
     if (CHECK(MTR_TOKEN_PAREN_R)) {
         // skip args because function has no params
@@ -339,7 +340,7 @@ static struct mtr_expr* call(struct mtr_parser* parser, struct mtr_token paren,
     }
 
     node->argc = argc;
-    node->argv = malloc(sizeof(struct mtr_expr*) * argc);
+    node->argv = ALLOCATE_ARRAY(struct mtr_expr*, argc);
     memcpy(node->argv, exprs, sizeof(struct mtr_expr*) * argc);
 
     return (struct mtr_expr*) node;
@@ -490,13 +491,13 @@ static struct mtr_stmt* expr_stmt(struct mtr_parser* parser) {
 
 static struct mtr_stmt* block(struct mtr_parser* parser) {
     struct mtr_block* node = ALLOCATE_STMT(MTR_STMT_BLOCK, mtr_block);
-    init_block(node);
+    init_block(parser->arena, node);
 
     consume(parser, MTR_TOKEN_CURLY_L, "Expected '{'.");
     while(!CHECK(MTR_TOKEN_CURLY_R) && !CHECK(MTR_TOKEN_EOF)) {
         struct mtr_stmt* s = declaration(parser);
         synchronize(parser);
-        write_block(node, s);
+        write_block(parser->arena, node, s);
     }
     consume(parser, MTR_TOKEN_CURLY_R, "Expected '}'.");
 
@@ -551,6 +552,94 @@ static struct mtr_stmt* while_stmt(struct mtr_parser* parser) {
     return (struct mtr_stmt*) node;
 }
 
+static struct mtr_stmt* for_stmt(struct mtr_parser* parser) {
+    struct mtr_for* node = ALLOCATE_STMT(MTR_STMT_FOR, mtr_for);
+
+    advance(parser);
+    node->first.token = consume(parser, MTR_TOKEN_IDENTIFIER, "Expected identifier.");
+    node->second.token = invalid_token;
+    if (CHECK(MTR_TOKEN_COMMA)) {
+        advance(parser);
+        node->second.token = consume(parser, MTR_TOKEN_IDENTIFIER, "Expected identifier.");
+    }
+    consume(parser, MTR_TOKEN_IN, "Expected 'in'.");
+
+    node->iterable = expression(parser);
+    node->end = NULL;
+    if (CHECK(MTR_TOKEN_DOUBLE_DOT)) {
+        advance(parser);
+        node->end = expression(parser);
+    }
+
+    consume(parser, MTR_TOKEN_COLON, "Expected ':'.");
+    if (CHECK(MTR_TOKEN_CURLY_L)) {
+        node->body = block(parser);
+    } else {
+        node->body = declaration(parser);
+    }
+
+    return (struct mtr_stmt*) node;
+}
+
+static struct mtr_stmt* case_body(struct mtr_parser* parser) {
+    consume(parser, MTR_TOKEN_COLON, "Expected ':'.");
+    if (CHECK(MTR_TOKEN_CURLY_L)) {
+        return block(parser);
+    }
+    return declaration(parser);
+}
+
+static struct mtr_stmt* match_stmt(struct mtr_parser* parser) {
+    struct mtr_match* node = ALLOCATE_STMT(MTR_STMT_MATCH, mtr_match);
+    node->cases = NULL;
+    node->otherwise = NULL;
+    node->count = 0;
+    node->capacity = 0;
+    node->variants = 0;
+
+    node->token = advance(parser);
+    node->expr = expression(parser);
+    consume(parser, MTR_TOKEN_COLON, "Expected ':'.");
+    consume(parser, MTR_TOKEN_CURLY_L, "Expected '{'.");
+
+    while (!CHECK(MTR_TOKEN_CURLY_R) && !CHECK(MTR_TOKEN_EOF)) {
+        if (CHECK(MTR_TOKEN_ELSE)) {
+            struct mtr_token else_ = advance(parser);
+            struct mtr_stmt* body = case_body(parser);
+            if (node->otherwise) {
+                parser->had_error = true;
+                mtr_report_error(else_, "Duplicate 'else' case.", parser->scanner.source);
+            } else {
+                node->otherwise = body;
+            }
+            synchronize(parser);
+            continue;
+        }
+
+        if (node->count == UINT16_MAX) {
+            parser_error(parser, "Too many cases.");
+            break;
+        }
+
+        struct mtr_match_case c;
+        c.symbol.type = parse_var_type(parser);
+        c.symbol.token = consume(parser, MTR_TOKEN_IDENTIFIER, "Expected identifier.");
+        c.body = case_body(parser);
+        c.variant = 0;
+
+        if (node->count == node->capacity) {
+            u16 old = node->capacity;
+            node->capacity = node->capacity == 0 ? 4 : node->capacity * 2;
+            node->cases = mtr_arena_grow(parser->arena, node->cases, sizeof(struct mtr_match_case) * old, sizeof(struct mtr_match_case) * node->capacity);
+        }
+        node->cases[node->count++] = c;
+        synchronize(parser);
+    }
+    consume(parser, MTR_TOKEN_CURLY_R, "Expected '}'.");
+
+    return (struct mtr_stmt*) node;
+}
+
 static struct mtr_stmt* return_stmt(struct mtr_parser* parser) {
     struct mtr_return* node = ALLOCATE_STMT(MTR_STMT_RETURN, mtr_return);
     node->expr = NULL;
@@ -571,6 +660,8 @@ static struct mtr_stmt* statement(struct mtr_parser* parser) {
     {
     case MTR_TOKEN_IF:      return if_stmt(parser);
     case MTR_TOKEN_WHILE:   return while_stmt(parser);
+    case MTR_TOKEN_FOR:     return for_stmt(parser);
+    case MTR_TOKEN_MATCH:   return match_stmt(parser);
     case MTR_TOKEN_CURLY_L: return scope(parser);
     case MTR_TOKEN_RETURN:  return return_stmt(parser);
     default:
@@ -598,7 +689,27 @@ static struct mtr_stmt* variable(struct mtr_parser* parser) {
     return (struct mtr_stmt*) node;
 }
 
-static struct mtr_stmt* func_decl(struct mtr_parser* parser) {
+// Only matches braces, nothing is built and no token is made. Errors in the body are reported when it's parsed for real
+static const char* skip_block(struct mtr_parser* parser, size_t* length) {
+    const char* start = parser->token.start;
+    *length = 0;
+    if (!CHECK(MTR_TOKEN_CURLY_L)) {
+        consume(parser, MTR_TOKEN_CURLY_L, "Expected '{'.");
+        return start;
+    }
+
+    // the '{' is the lookahead, so the scanner is already inside the block
+    bool closed = mtr_skip_block(&parser->scanner);
+    *length = (size_t) (parser->scanner.current - start);
+    advance(parser);
+
+    if (!closed) {
+        parser_error(parser, "Expected '}'.");
+    }
+    return start;
+}
+
+static struct mtr_stmt* func_decl(struct mtr_parser* parser, bool defer) {
     struct mtr_function_decl* node = ALLOCATE_STMT(MTR_STMT_FN, mtr_function_decl);
     parser->current_function = node;
 
@@ -609,6 +720,9 @@ static struct mtr_stmt* func_decl(struct mtr_parser* parser) {
 
     node->argc = 0;
     node->argv = NULL;
+    node->deferred = NULL;
+    node->deferred_length = 0;
+    node->generic = false;
 
     u32 argc = 0;
     struct mtr_variable vars[255];
@@ -642,7 +756,7 @@ static struct mtr_stmt* func_decl(struct mtr_parser* parser) {
 
     // because we are here we now that argc > 0
     node->argc = argc;
-    node->argv = malloc(sizeof(struct mtr_variable) * argc);
+    node->argv = ALLOCATE_ARRAY(struct mtr_variable, argc);
     memcpy(node->argv, vars, sizeof(struct mtr_variable) * argc);
 
 type_check:; // this is some weird shit with labels. prob a clang bug
@@ -667,6 +781,8 @@ type_check:; // this is some weird shit with labels. prob a clang bug
         consume(parser, MTR_TOKEN_SEMICOLON, "Expected ';'.");
         r->from = node;
         node->body = (struct mtr_stmt*) r;
+    } else if (defer) {
+        node->deferred = skip_block(parser, &node->deferred_length);
     } else {
         node->body = block(parser);
     }
@@ -680,11 +796,9 @@ static struct mtr_stmt* closure(struct mtr_parser* parser) {
 
     struct mtr_function_decl* current_function = parser->current_function;
 
-    struct mtr_stmt* fn = func_decl(parser);
+    struct mtr_stmt* fn = func_decl(parser, false);
     if (fn->type == MTR_STMT_NATIVE_FN) {
         parser_error(parser, "Closures cannot be native functions.");
-        mtr_free_stmt(fn);
-        free(closure);
         return NULL;
     }
 
@@ -762,7 +876,7 @@ static struct mtr_stmt* struct_type(struct mtr_parser* parser, struct mtr_token
         parser_error(parser, "Exceded maximum number of members.");
     }
 
-    struct_->members = malloc(sizeof(struct mtr_variable*) * argc);
+    struct_->members = ALLOCATE_ARRAY(struct mtr_variable*, argc);
     memcpy(struct_->members, vars, sizeof(struct mtr_variable*) * argc);
     struct_->argc = argc;
 
@@ -815,10 +929,27 @@ static struct mtr_stmt* declaration(struct mtr_parser* parser) {
     }
 }
 
+// import 'path';
+static void import(struct mtr_parser* parser, struct mtr_ast* ast) {
+    advance(parser);
+    struct mtr_token path = consume(parser, MTR_TOKEN_STRING_LITERAL, "Expected the path of the module.");
+    consume(parser, MTR_TOKEN_SEMICOLON, "Expected ';'.");
+    if (path.type != MTR_TOKEN_STRING_LITERAL) {
+        return;
+    }
+
+    if (ast->import_count == ast->import_capacity) {
+        size_t new_cap = ast->import_capacity == 0 ? 4 : ast->import_capacity * 2;
+        ast->imports = mtr_arena_grow(&ast->arena, ast->imports, ast->import_capacity * sizeof(struct mtr_token), new_cap * sizeof(struct mtr_token));
+        ast->import_capacity = new_cap;
+    }
+    ast->imports[ast->import_count++] = path;
+}
+
 static struct mtr_stmt* global_declaration(struct mtr_parser* parser) {
     switch (parser->token.type)
     {
-    case MTR_TOKEN_FN: return func_decl(parser);
+    case MTR_TOKEN_FN: return func_decl(parser, parser->defer_bodies);
     case MTR_TOKEN_TYPE: return type(parser);
     default:
         break;
@@ -832,270 +963,309 @@ static struct mtr_stmt* global_declaration(struct mtr_parser* parser) {
 // ========================================================================
 
 struct mtr_ast mtr_parse(struct mtr_parser* parser) {
+    struct mtr_ast ast;
+    mtr_init_names(&ast.names);
+    parser->scanner.names = &ast.names;
+
     advance(parser);
 
-    struct mtr_ast ast;
+    mtr_init_arena(&ast.arena);
+    parser->arena = &ast.arena;
+
     struct mtr_block* block = ALLOCATE_STMT(MTR_STMT_BLOCK, mtr_block);
     ast.head = (struct mtr_stmt*) block;
     ast.source = parser->scanner.source;
-    init_block(block);
+    init_block(parser->arena, block);
     mtr_type_list_init(&ast.type_list);
 
+    ast.imports = NULL;
+    ast.import_count = 0;
+    ast.import_capacity = 0;
+
     parser->type_list = &ast.type_list;
     while (parser->token.type != MTR_TOKEN_EOF) {
+        if (parser->token.type == MTR_TOKEN_IMPORT) {
+            import(parser, &ast);
+            synchronize(parser);
+            continue;
+        }
+
         struct mtr_stmt* stmt = global_declaration(parser);
         if (NULL == stmt) {
             return ast;
         }
         synchronize(parser);
-        write_block(block, stmt);
+        write_block(parser->arena, block, stmt);
     }
 
     return ast;
 }
 
+struct mtr_stmt* mtr_parse_body(struct mtr_parser* parser, struct mtr_ast* ast, struct mtr_function_decl* fn, struct mtr_arena* arena) {
+    parser->scanner.current = fn->deferred;
+    parser->scanner.names = &ast->names;
+    parser->arena = arena;
+    parser->type_list = &ast->type_list;
+    parser->current_function = fn;
+    parser->panic = false;
+    advance(parser);
+
+    fn->body = block(parser);
+    return fn->body;
+}
+
+struct mtr_stmt* mtr_parse_extern(struct mtr_parser* parser, struct mtr_ast* ast, struct mtr_token name, const char* signature, size_t length) {
+    // the scanner still has bodies to go back to
+    const struct mtr_scanner scanner = parser->scanner;
+    const struct mtr_token token = parser->token;
+
+    char* text = mtr_arena_alloc(&ast->arena, length + 1);
+    memcpy(text, signature, length);
+    text[length] = '\0';
+
+    mtr_scanner_init(&parser->scanner, text);
+    parser->scanner.names = &ast->names;
+    parser->arena = &ast->arena;
+    parser->type_list = &ast->type_list;
+    advance(parser);
+
+    struct mtr_function_decl* node = ALLOCATE_STMT(MTR_STMT_NATIVE_FN, mtr_function_decl);
+    node->symbol.token = name;
+    node->symbol.token.type = MTR_TOKEN_IDENTIFIER;
+    node->symbol.token.id = mtr_intern(&ast->names, name.start, name.length);
+    node->symbol.type = parse_var_type(parser);
+    node->body = NULL;
+    node->deferred = NULL;
+    node->deferred_length = 0;
+    node->argv = NULL;
+    node->argc = 0;
+    node->generic = false;
+
+    parser->scanner = scanner;
+    parser->token = token;
+    return (struct mtr_stmt*) node;
+}
+
 // =======================================================================
 
 void mtr_delete_ast(struct mtr_ast* ast) {
-    delete_block((struct mtr_block*) ast->head);
+    mtr_delete_arena(&ast->arena);
     mtr_type_list_delete(&ast->type_list);
+    mtr_delete_names(&ast->names);
     ast->head = NULL;
 }
 
-static void init_block(struct mtr_block* block) {
-    void* temp = malloc(sizeof(struct mtr_stmt*) * 8);
+static void init_block(struct mtr_arena* arena, struct mtr_block* block) {
     block->capacity = 8;
     block->size = 0;
-    block->statements = temp;
+    block->statements = mtr_arena_alloc(arena, sizeof(struct mtr_stmt*) * block->capacity);
 }
 
-static void write_block(struct mtr_block* block, struct mtr_stmt* statement) {
+static void write_block(struct mtr_arena* arena, struct mtr_block* block, struct mtr_stmt* statement) {
     if (block->size == block->capacity) {
         size_t new_cap = block->capacity * 2;
-        block->statements = realloc(block->statements, new_cap * sizeof(struct mtr_stmt*));
+        block->statements = mtr_arena_grow(arena, block->statements, block->capacity * sizeof(struct mtr_stmt*), new_cap * sizeof(struct mtr_stmt*));
         block->capacity = new_cap;
     }
     block->statements[block->size++] = statement;
 }
 
-static void delete_block(struct mtr_block* block) {
-    for (size_t i = 0; i < block->size; i++) {
-        struct mtr_stmt* s = block->statements[i];
-        mtr_free_stmt(s);
-    }
+// =======================================================================
+// Deep copies of trees that haven't been validated yet. Used to specialize generic functions.
+// Types are interned in the type list so they are shared, not copied.
 
-    free(block->statements);
-    block->statements = NULL;
-    block->size = 0;
-    block->capacity = 0;
-    free(block);
-}
+#define COPY_NODE(type, node) memcpy(mtr_arena_alloc(arena, sizeof(struct type)), node, sizeof(struct type))
 
-// =======================================================================
+static struct mtr_stmt* copy_stmt(struct mtr_arena* arena, const struct mtr_stmt* s, struct mtr_function_decl* from);
 
-void mtr_free_stmt(struct mtr_stmt* s) {
-    if (s == NULL) {
-        MTR_LOG_DEBUG("Freeing NULL stmt.");
-        return;
+struct mtr_expr* mtr_copy_expr(struct mtr_arena* arena, const struct mtr_expr* node) {
+    switch (node->type)
+    {
+    case MTR_EXPR_BINARY: {
+        struct mtr_binary* b = COPY_NODE(mtr_binary, node);
+        b->left = mtr_copy_expr(arena, b->left);
+        b->right = mtr_copy_expr(arena, b->right);
+        return (struct mtr_expr*) b;
     }
-    switch (s->type) {
-        case MTR_STMT_SCOPE:
-        case MTR_STMT_BLOCK: {
-            delete_block((struct mtr_block*) s);
-            break;
-        }
-        case MTR_STMT_ASSIGNMENT: {
-            struct mtr_assignment* a = (struct mtr_assignment*) s;
-            mtr_free_expr(a->right);
-            mtr_free_expr(a->expression);
-            a->right = NULL;
-            a->expression = NULL;
-            free(a);
-            break;
-        }
-        case MTR_STMT_CLOSURE: {
-            struct mtr_closure_decl* c = (struct mtr_closure_decl*) s;
-            mtr_free_stmt((struct mtr_stmt*) c->function);
-            free(c->upvalues);
-            c->upvalues = NULL;
-            c->count = 0;
-            c->capacity = 0;
-            free(c);
-            break;
-        }
-        case MTR_STMT_NATIVE_FN:
-        case MTR_STMT_FN: {
-            struct mtr_function_decl* f = (struct mtr_function_decl*) s;
-            for (u8 i = 0; i < f->argc; ++i) {
-                struct mtr_variable* v = f->argv + i;
-                if (v->value) {
-                    mtr_free_expr(v->value);
-                }
-            }
-            free(f->argv);
-            if (f->body) {
-                mtr_free_stmt(f->body);
-            }
-            f->argv = NULL;
-            f->argc = 0;
-            f->body = NULL;
-            free(f);
-            break;
-        }
-        case MTR_STMT_UNION: {
-            struct mtr_union_decl* u = (struct mtr_union_decl*) s;
-            free(u);
-            break;
-        }
-        case MTR_STMT_STRUCT: {
-            struct mtr_struct_decl* st = (struct mtr_struct_decl*) s;
-            for (u8 i = 0; i < st->argc; ++i) {
-                mtr_free_stmt((struct mtr_stmt*) st->members[i]);
-            }
-            free(st->members);
-            free(st);
-            break;
-        }
-        case MTR_STMT_IF: {
-            struct mtr_if* i = (struct mtr_if*) s;
-            mtr_free_stmt(i->then);
-            if (i->otherwise)
-                mtr_free_stmt(i->otherwise);
-            mtr_free_expr(i->condition);
-            i->otherwise = NULL;
-            i->condition = NULL;
-            free(i);
-            break;
-        }
-        case MTR_STMT_WHILE: {
-            struct mtr_while* w = (struct mtr_while*) s;
-            mtr_free_expr(w->condition);
-            mtr_free_stmt(w->body);
-            w->body = NULL;
-            w->condition = NULL;
-            free(w);
-            break;
-        }
-        case MTR_STMT_VAR: {
-            struct mtr_variable* v = (struct mtr_variable*) s;
-            if (v->value)
-                mtr_free_expr(v->value);
-            v->value = NULL;
-            free(v);
-            break;
+    case MTR_EXPR_GROUPING: {
+        struct mtr_grouping* g = COPY_NODE(mtr_grouping, node);
+        g->expression = mtr_copy_expr(arena, g->expression);
+        return (struct mtr_expr*) g;
+    }
+    case MTR_EXPR_PRIMARY: return (struct mtr_expr*) COPY_NODE(mtr_primary, node);
+    case MTR_EXPR_LITERAL: return (struct mtr_expr*) COPY_NODE(mtr_literal, node);
+    case MTR_EXPR_UNARY: {
+        struct mtr_unary* u = COPY_NODE(mtr_unary, node);
+        u->right = mtr_copy_expr(arena, u->right);
+        return (struct mtr_expr*) u;
+    }
+    case MTR_EXPR_ARRAY_LITERAL: {
+        struct mtr_array_literal* a = COPY_NODE(mtr_array_literal, node);
+        a->expressions = mtr_arena_alloc(arena, sizeof(struct mtr_expr*) * a->count);
+        for (u8 i = 0; i < a->count; ++i) {
+            a->expressions[i] = mtr_copy_expr(arena, ((const struct mtr_array_literal*) node)->expressions[i]);
         }
-
-        case MTR_STMT_RETURN: {
-            struct mtr_return* r = (struct mtr_return*) s;
-            if (r->expr) {
-                mtr_free_expr(r->expr);
-            }
-            r->expr = NULL;
-            r->from = NULL;
-            free(r);
-            break;
+        return (struct mtr_expr*) a;
+    }
+    case MTR_EXPR_MAP_LITERAL: {
+        struct mtr_map_literal* m = COPY_NODE(mtr_map_literal, node);
+        m->entries = mtr_arena_alloc(arena, sizeof(struct mtr_map_entry) * m->count);
+        for (u8 i = 0; i < m->count; ++i) {
+            const struct mtr_map_entry* e = ((const struct mtr_map_literal*) node)->entries + i;
+            m->entries[i].key = mtr_copy_expr(arena, e->key);
+            m->entries[i].value = mtr_copy_expr(arena, e->value);
         }
-
-        case MTR_STMT_CALL: {
-            struct mtr_call_stmt* c = (struct mtr_call_stmt*) s;
-            mtr_free_expr(c->call);
-            c->call = NULL;
-            free(c);
-            break;
+        return (struct mtr_expr*) m;
+    }
+    case MTR_EXPR_CALL: {
+        struct mtr_call* c = COPY_NODE(mtr_call, node);
+        c->callable = mtr_copy_expr(arena, c->callable);
+        c->argv = c->argc > 0 ? mtr_arena_alloc(arena, sizeof(struct mtr_expr*) * c->argc) : NULL;
+        for (u8 i = 0; i < c->argc; ++i) {
+            c->argv[i] = mtr_copy_expr(arena, ((const struct mtr_call*) node)->argv[i]);
         }
+        return (struct mtr_expr*) c;
     }
+    case MTR_EXPR_CAST: {
+        struct mtr_cast* c = COPY_NODE(mtr_cast, node);
+        c->right = mtr_copy_expr(arena, c->right);
+        return (struct mtr_expr*) c;
+    }
+    case MTR_EXPR_ACCESS:
+    case MTR_EXPR_SUBSCRIPT: {
+        struct mtr_access* a = COPY_NODE(mtr_access, node);
+        a->object = mtr_copy_expr(arena, a->object);
+        a->element = mtr_copy_expr(arena, a->element);
+        return (struct mtr_expr*) a;
+    }
+    case MTR_EXPR_VARIANT: {
+        struct mtr_variant* v = COPY_NODE(mtr_variant, node);
+        v->value = mtr_copy_expr(arena, v->value);
+        return (struct mtr_expr*) v;
+    }
+    }
+    MTR_ASSERT(false, "Invalid expr type.");
+    return NULL;
 }
 
-static void free_binary(struct mtr_binary* node) {
-    mtr_free_expr(node->left);
-    mtr_free_expr(node->right);
-    node->left = NULL;
-    node->right = NULL;
-    free(node);
-}
-
-static void free_grouping(struct mtr_grouping* node) {
-    mtr_free_expr(node->expression);
-    node->expression = NULL;
-    free(node);
-}
-
-static void free_primary(struct mtr_primary* node) {
-    // primary symbol type is freed by its declaration
-    free(node);
-}
-
-static void free_unary(struct mtr_unary* node) {
-    mtr_free_expr(node->right);
-    node->right = NULL;
-    free(node);
-}
-
-static void free_literal(struct mtr_literal* node) {
-    free(node);
-}
-
-static void free_array_lit(struct mtr_array_literal* node) {
-    for (u8 i = 0; i < node->count; ++i) {
-        mtr_free_expr(node->expressions[i]);
+static struct mtr_function_decl* copy_function(struct mtr_arena* arena, const struct mtr_function_decl* fn) {
+    struct mtr_function_decl* f = COPY_NODE(mtr_function_decl, fn);
+    if (f->argc > 0) {
+        f->argv = mtr_arena_alloc(arena, sizeof(struct mtr_variable) * f->argc);
+        memcpy(f->argv, fn->argv, sizeof(struct mtr_variable) * f->argc);
+        for (u8 i = 0; i < f->argc; ++i) {
+            if (f->argv[i].value)
+                f->argv[i].value = mtr_copy_expr(arena, f->argv[i].value);
+        }
     }
-    free(node->expressions);
-    node->expressions = NULL;
-    free(node);
+    // returns have to point to the new function
+    f->body = f->body ? copy_stmt(arena, f->body, f) : NULL;
+    return f;
 }
 
-static void free_map_lit(struct mtr_map_literal* node) {
-    for (u8 i = 0; i < node->count; ++i) {
-        mtr_free_expr(node->entries[i].key);
-        mtr_free_expr(node->entries[i].value);
+static struct mtr_stmt* copy_stmt(struct mtr_arena* arena, const struct mtr_stmt* s, struct mtr_function_decl* from) {
+    if (s == NULL) {
+        return NULL;
     }
-    free(node->entries);
-    node->entries = NULL;
-    free(node);
-}
 
-static void free_call(struct mtr_call* node) {
-    if (node->argc > 0) {
-        for (u8 i = 0; i < node->argc; ++i) {
-            mtr_free_expr(node->argv[i]);
+    switch (s->type)
+    {
+    case MTR_STMT_SCOPE:
+    case MTR_STMT_BLOCK: {
+        const struct mtr_block* b = (const struct mtr_block*) s;
+        struct mtr_block* block = allocate_stmt(arena, s->type, sizeof(struct mtr_block));
+        init_block(arena, block);
+        for (size_t i = 0; i < b->size; ++i) {
+            write_block(arena, block, copy_stmt(arena, b->statements[i], from));
         }
+        block->var_count = b->var_count;
+        return (struct mtr_stmt*) block;
     }
-    free(node->argv);
-    mtr_free_expr(node->callable);
-    node->argv = NULL;
-    node->argc = 0;
-    node->callable = NULL;
-    free(node);
+    case MTR_STMT_ASSIGNMENT: {
+        struct mtr_assignment* a = COPY_NODE(mtr_assignment, s);
+        a->right = mtr_copy_expr(arena, a->right);
+        a->expression = mtr_copy_expr(arena, a->expression);
+        return (struct mtr_stmt*) a;
+    }
+    case MTR_STMT_CLOSURE: {
+        struct mtr_closure_decl* c = COPY_NODE(mtr_closure_decl, s);
+        c->function = copy_function(arena, c->function);
+        c->upvalues = NULL;
+        c->capacity = 0;
+        c->count = 0;
+        return (struct mtr_stmt*) c;
+    }
+    case MTR_STMT_NATIVE_FN:
+    case MTR_STMT_FN:
+        return (struct mtr_stmt*) copy_function(arena, (const struct mtr_function_decl*) s);
+    case MTR_STMT_UNION:
+        return (struct mtr_stmt*) COPY_NODE(mtr_union_decl, s);
+    case MTR_STMT_STRUCT: {
+        struct mtr_struct_decl* st = COPY_NODE(mtr_struct_decl, s);
+        st->members = mtr_arena_alloc(arena, sizeof(struct mtr_variable*) * st->argc);
+        for (u8 i = 0; i < st->argc; ++i) {
+            st->members[i] = (struct mtr_variable*) copy_stmt(arena, (struct mtr_stmt*) ((const struct mtr_struct_decl*) s)->members[i], from);
+        }
+        return (struct mtr_stmt*) st;
+    }
+    case MTR_STMT_IF: {
+        struct mtr_if* i = COPY_NODE(mtr_if, s);
+        i->condition = mtr_copy_expr(arena, i->condition);
+        i->then = copy_stmt(arena, i->then, from);
+        i->otherwise = copy_stmt(arena, i->otherwise, from);
+        return (struct mtr_stmt*) i;
+    }
+    case MTR_STMT_WHILE: {
+        struct mtr_while* w = COPY_NODE(mtr_while, s);
+        w->condition = mtr_copy_expr(arena, w->condition);
+        w->body = copy_stmt(arena, w->body, from);
+        return (struct mtr_stmt*) w;
+    }
+    case MTR_STMT_FOR: {
+        struct mtr_for* f = COPY_NODE(mtr_for, s);
+        f->iterable = mtr_copy_expr(arena, f->iterable);
+        f->end = f->end ? mtr_copy_expr(arena, f->end) : NULL;
+        f->body = copy_stmt(arena, f->body, from);
+        return (struct mtr_stmt*) f;
+    }
+    case MTR_STMT_MATCH: {
+        struct mtr_match* m = COPY_NODE(mtr_match, s);
+        m->expr = mtr_copy_expr(arena, m->expr);
+        m->cases = m->capacity > 0 ? mtr_arena_alloc(arena, sizeof(struct mtr_match_case) * m->capacity) : NULL;
+        for (u16 i = 0; i < m->count; ++i) {
+            m->cases[i] = ((const struct mtr_match*) s)->cases[i];
+            m->cases[i].body = copy_stmt(arena, m->cases[i].body, from);
+        }
+        m->otherwise = copy_stmt(arena, m->otherwise, from);
+        return (struct mtr_stmt*) m;
+    }
+    case MTR_STMT_VAR: {
+        struct mtr_variable* v = COPY_NODE(mtr_variable, s);
+        v->value = v->value ? mtr_copy_expr(arena, v->value) : NULL;
+        return (struct mtr_stmt*) v;
+    }
+    case MTR_STMT_RETURN: {
+        struct mtr_return* r = COPY_NODE(mtr_return, s);
+        r->expr = r->expr ? mtr_copy_expr(arena, r->expr) : NULL;
+        r->from = from;
+        return (struct mtr_stmt*) r;
+    }
+    case MTR_STMT_CALL: {
+        struct mtr_call_stmt* c = COPY_NODE(mtr_call_stmt, s);
+        c->call = mtr_copy_expr(arena, c->call);
+        return (struct mtr_stmt*) c;
+    }
+    }
+    MTR_ASSERT(false, "Invalid stmt type.");
+    return NULL;
 }
 
-static void free_cast(struct mtr_cast* node) {
-    mtr_free_expr(node->right);
-    node->right = NULL;
-    free(node);
-}
+#undef COPY_NODE
 
-static void free_sub(struct mtr_access* node) {
-    mtr_free_expr(node->object);
-    mtr_free_expr(node->element);
-    node->object = NULL;
-    node->element = NULL;
-    free(node);
+struct mtr_stmt* mtr_copy_stmt(struct mtr_arena* arena, const struct mtr_stmt* s) {
+    return copy_stmt(arena, s, NULL);
 }
 
-void mtr_free_expr(struct mtr_expr* node) {
-    switch (node->type)
-    {
-    case MTR_EXPR_BINARY:   free_binary((struct mtr_binary*) node); return;
-    case MTR_EXPR_GROUPING: free_grouping((struct mtr_grouping*) node); return;
-    case MTR_EXPR_PRIMARY:  free_primary((struct mtr_primary*) node); return;
-    case MTR_EXPR_UNARY:    free_unary((struct mtr_unary*) node); return;
-    case MTR_EXPR_LITERAL:  free_literal((struct mtr_literal*) node); return;
-    case MTR_EXPR_ARRAY_LITERAL: free_array_lit((struct mtr_array_literal*) node); return;
-    case MTR_EXPR_MAP_LITERAL: free_map_lit((struct mtr_map_literal*) node); return;
-    case MTR_EXPR_CALL:     free_call((struct mtr_call*) node); return;
-    case MTR_EXPR_CAST:     free_cast((struct mtr_cast*) node); return;
-    case MTR_EXPR_ACCESS:
-    case MTR_EXPR_SUBSCRIPT:
-        free_sub((struct mtr_access*) node); return;
-    }
+void mtr_block_append(struct mtr_arena* arena, struct mtr_block* block, struct mtr_stmt* s) {
+    write_block(arena, block, s);
 }
@@ -12,6 +12,8 @@ struct mtr_parser {
     struct mtr_token token;
     struct mtr_function_decl* current_function;
     struct mtr_type_list* type_list;
+    struct mtr_arena* arena;
+    bool defer_bodies; // of global functions, for streaming
     bool had_error;
     bool panic;
 };
@@ -20,4 +22,11 @@ void mtr_parser_init(struct mtr_parser* parser, const char* source);
 
 struct mtr_ast mtr_parse(struct mtr_parser* parser);
 
+// Parses a body skipped by mtr_parse (defer_bodies) into arena.
+struct mtr_stmt* mtr_parse_body(struct mtr_parser* parser, struct mtr_ast* ast, struct mtr_function_decl* fn, struct mtr_arena* arena);
+
+// Declares a function that lives somewhere else (like a native function) from its signature,
+// in the syntax of a function type. The signature must only use built in types
+struct mtr_stmt* mtr_parse_extern(struct mtr_parser* parser, struct mtr_ast* ast, struct mtr_token name, const char* signature, size_t length);
+
 #endif
@@ -0,0 +1,229 @@
+#include "profile.h"
+
+#include "bytecode.h"
+
+#include "core/log.h"
+#include "core/utils.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+static const char header[] = "# matiria profile 2\n";
+
+struct mtr_profile_entry {
+    u64 key;
+    u64 count; // 0 for free entries
+};
+
+void mtr_init_profile(struct mtr_profile* profile) {
+    profile->entries = NULL;
+    profile->count = 0;
+    profile->capacity = 0;
+}
+
+void mtr_delete_profile(struct mtr_profile* profile) {
+    free(profile->entries);
+    mtr_init_profile(profile);
+}
+
+static struct mtr_profile_entry* find_entry(struct mtr_profile_entry* entries, size_t capacity, u64 key) {
+    size_t i = (size_t) hash64(&key, sizeof(key), MTR_HASH64_SEED) & (capacity - 1);
+    while (entries[i].count != 0 && entries[i].key != key) {
+        i = (i + 1) & (capacity - 1);
+    }
+    return entries + i;
+}
+
+static void grow(struct mtr_profile* profile) {
+    const size_t capacity = profile->capacity == 0 ? 64 : profile->capacity * 2;
+    struct mtr_profile_entry* entries = calloc(capacity, sizeof(struct mtr_profile_entry));
+    for (size_t i = 0; i < profile->capacity; ++i) {
+        if (profile->entries[i].count != 0) {
+            *find_entry(entries, capacity, profile->entries[i].key) = profile->entries[i];
+        }
+    }
+    free(profile->entries);
+    profile->entries = entries;
+    profile->capacity = capacity;
+}
+
+void mtr_profile_add(struct mtr_profile* profile, u64 key, u64 count) {
+    // entries that count nothing are free
+    if (count == 0) {
+        return;
+    }
+
+    if (profile->count + 1 > profile->capacity * 3 / 4) {
+        grow(profile);
+    }
+
+    struct mtr_profile_entry* entry = find_entry(profile->entries, profile->capacity, key);
+    if (entry->count == 0) {
+        entry->key = key;
+        profile->count++;
+    }
+    entry->count += count;
+}
+
+u64 mtr_profile_get(const struct mtr_profile* profile, u64 key) {
+    if (profile->count == 0) {
+        return 0;
+    }
+    return find_entry(profile->entries, profile->capacity, key)->count;
+}
+
+// addresses of user space take at most 48 bits
+u64 mtr_profile_at(const u8* ip, u16 event) {
+    return ((u64) (uintptr_t) ip << 16) | event;
+}
+
+// the top two bits say what the key is of, globals take the 30 below them
+#define KEY_BRANCH (1ull << 62)
+#define KEY_VARIANT (2ull << 62)
+#define KEY_GLOBAL(global) (((u64) (global) & 0x3FFFFFFF) << 32)
+
+u64 mtr_profile_site(u32 global, u32 call) {
+    return KEY_GLOBAL(global) | call;
+}
+
+u64 mtr_profile_branch(u32 global, u32 branch, bool taken) {
+    return KEY_BRANCH | KEY_GLOBAL(global) | ((u64) branch << 1) | taken;
+}
+
+u64 mtr_profile_variant(u32 global, u32 match, u16 tag) {
+    return KEY_VARIANT | KEY_GLOBAL(global) | ((u64) (match & 0xFFFF) << 16) | tag;
+}
+
+u64 mtr_profile_hash(const struct mtr_profile* profile) {
+    u64 h = 0;
+    for (size_t i = 0; i < profile->capacity; ++i) {
+        const struct mtr_profile_entry* e = profile->entries + i;
+        if (e->count != 0) {
+            h += hash64(e, sizeof(*e), MTR_HASH64_SEED);
+        }
+    }
+    return h;
+}
+
+static const struct mtr_function* code_of(const struct mtr_object* object) {
+    if (object == NULL) {
+        return NULL;
+    }
+
+    switch (object->type) {
+    case MTR_OBJ_FUNCTION: return (const struct mtr_function*) object;
+    case MTR_OBJ_STUB: return ((const struct mtr_stub*) object)->function;
+    default:
+        return NULL;
+    }
+}
+
+bool mtr_write_profile(const struct mtr_profile* profile, const struct mtr_package* package, const char* path) {
+    FILE* file = fopen(path, "wb");
+    if (file == NULL) {
+        MTR_LOG_ERROR("Unable to write profile to %s", path);
+        return false;
+    }
+
+    fputs(header, file);
+    for (size_t i = 0; i < package->count; ++i) {
+        const struct mtr_function* f = code_of(package->objects[i]);
+        // imported functions are counted by the module
+        if (f == NULL || (f->package != NULL && f->package != package)) {
+            continue;
+        }
+
+        const u8* end = f->chunk.bytecode + f->chunk.size;
+        u32 call = 0;
+        u32 branch = 0;
+        u32 match = 0;
+        for (const u8* ip = f->chunk.bytecode; ip < end; ip = mtr_next_instruction(ip)) {
+            switch (*ip) {
+            case MTR_OP_CALL: {
+                const u64 count = mtr_profile_get(profile, mtr_profile_at(ip, 0));
+                if (count > 0) {
+                    fprintf(file, "call %zu %u %llu\n", i, call, (unsigned long long) count);
+                }
+                call++;
+                break;
+            }
+
+            case MTR_OP_JMP_Z:
+            case MTR_OP_JMP_Z_LONG: {
+                const u64 taken = mtr_profile_get(profile, mtr_profile_at(ip, 1));
+                const u64 not_taken = mtr_profile_get(profile, mtr_profile_at(ip, 0));
+                if (taken + not_taken > 0) {
+                    fprintf(file, "branch %zu %u %llu %llu\n", i, branch, (unsigned long long) taken, (unsigned long long) not_taken);
+                }
+                branch++;
+                break;
+            }
+
+            case MTR_OP_MATCH: {
+                u16 count;
+                memcpy(&count, ip + 1, sizeof(u16));
+                for (u16 tag = 0; tag < count; ++tag) {
+                    const u64 seen = mtr_profile_get(profile, mtr_profile_at(ip, tag));
+                    if (seen > 0) {
+                        fprintf(file, "match %zu %u %u %llu\n", i, match, tag, (unsigned long long) seen);
+                    }
+                }
+                match++;
+                break;
+            }
+
+            default:
+                break;
+            }
+        }
+    }
+
+    const bool ok = fclose(file) == 0;
+    if (!ok) {
+        MTR_LOG_ERROR("Unable to write profile to %s", path);
+    }
+    return ok;
+}
+
+enum mtr_exit_code mtr_load_profile(struct mtr_profile* profile, const char* path) {
+    FILE* file = fopen(path, "rb");
+    if (file == NULL) {
+        MTR_LOG_ERROR("Unable to open profile at %s", path);
+        return MTR_FILE_ERROR;
+    }
+
+    char line[sizeof(header)];
+    bool ok = fgets(line, sizeof(line), file) != NULL && strcmp(line, header) == 0;
+
+    char kind[8];
+    unsigned global;
+    unsigned index;
+    unsigned long long count;
+    while (ok && fscanf(file, "%7s %u %u", kind, &global, &index) == 3) {
+        if (strcmp(kind, "call") == 0) {
+            ok = fscanf(file, "%llu", &count) == 1;
+            mtr_profile_add(profile, mtr_profile_site(global, index), count);
+        } else if (strcmp(kind, "branch") == 0) {
+            unsigned long long not_taken;
+            ok = fscanf(file, "%llu %llu", &count, &not_taken) == 2;
+            mtr_profile_add(profile, mtr_profile_branch(global, index, true), count);
+            mtr_profile_add(profile, mtr_profile_branch(global, index, false), not_taken);
+        } else if (strcmp(kind, "match") == 0) {
+            unsigned tag;
+            ok = fscanf(file, "%u %llu", &tag, &count) == 2 && tag <= UINT16_MAX;
+            mtr_profile_add(profile, mtr_profile_variant(global, index, (u16) tag), count);
+        } else {
+            ok = false;
+        }
+    }
+    ok = ok && feof(file);
+    fclose(file);
+
+    if (!ok) {
+        MTR_LOG_ERROR("%s is not a Matiria profile.", path);
+        mtr_delete_profile(profile);
+        return MTR_FILE_ERROR;
+    }
+    return MTR_OK;
+}
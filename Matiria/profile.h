@@ -0,0 +1,54 @@
+#ifndef MTR_PROFILE_H
+#define MTR_PROFILE_H
+
+#include "package.h"
+
+#include "core/exitCode.h"
+#include "core/types.h"
+
+// How often each call of a run was made, which way its branches went and which members of a union
+// its matches saw, for compiling the next package with (see mtr_compile_options.profile).
+// While the engine runs, they are counted by the address of their instruction. Written out they are
+// keyed by the index of the global they are in and their position among its calls, its branches
+// (JMP_Z) or its matches, so a profile fits packages compiled from the same source. Closures aren't
+// counted and the package that is profiled has to be compiled without a profile, inlining and
+// branch layout move the code around.
+
+// calls of a site before it is worth inlining, and runs of a branch or match before its layout follows the profile
+#define MTR_PROFILE_HOT 64
+
+struct mtr_profile_entry;
+
+struct mtr_profile {
+    struct mtr_profile_entry* entries;
+    size_t count;
+    size_t capacity;
+};
+
+void mtr_init_profile(struct mtr_profile* profile);
+void mtr_delete_profile(struct mtr_profile* profile);
+
+void mtr_profile_add(struct mtr_profile* profile, u64 key, u64 count);
+u64 mtr_profile_get(const struct mtr_profile* profile, u64 key);
+
+// the key the engine counts the instruction at ip by. Calls are event 0, branches 1 when they jump
+// and matches the tag of the value
+u64 mtr_profile_at(const u8* ip, u16 event);
+
+// the key of the call-th call of the code of a global
+u64 mtr_profile_site(u32 global, u32 call);
+// the key of the times the branch-th branch of the code of a global jumped, or didn't
+u64 mtr_profile_branch(u32 global, u32 branch, bool taken);
+// the key of the values with tag the match-th match of the code of a global saw
+u64 mtr_profile_variant(u32 global, u32 match, u16 tag);
+
+// the same for equal profiles, whatever order they were counted in
+u64 mtr_profile_hash(const struct mtr_profile* profile);
+
+// writes what the engine counted running package
+bool mtr_write_profile(const struct mtr_profile* profile, const struct mtr_package* package, const char* path);
+
+// reads a profile written by mtr_write_profile into an empty profile
+enum mtr_exit_code mtr_load_profile(struct mtr_profile* profile, const char* path);
+
+#endif
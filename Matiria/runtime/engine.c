@@ -5,6 +5,8 @@
 #include "value.h"
 #include "memory.h"
 
+#include "module.h"
+
 #include "debug/disassemble.h"
 
 #include "core/log.h"
@@ -35,6 +37,21 @@ static void push(struct mtr_engine* engine, mtr_value value) {
 
 static void call(struct mtr_engine* engine, const struct mtr_chunk chunk, u8 argc, mtr_value* closed);
 
+// calls into another package switch to its globals
+static void call_in(struct mtr_engine* engine, struct mtr_package* package, const struct mtr_chunk chunk, u8 argc, mtr_value* closed) {
+    if (package == NULL || package == engine->package) {
+        call(engine, chunk, argc, closed);
+        return;
+    }
+
+    struct mtr_package* caller = engine->package;
+    engine->package = package;
+    engine->globals = package->objects;
+    call(engine, chunk, argc, closed);
+    engine->package = caller;
+    engine->globals = caller->objects;
+}
+
 #define BINARY_OP(op, t, tag)                                            \
     do {                                                               \
         const mtr_value r = pop(engine);                               \
@@ -43,9 +60,92 @@ static void call(struct mtr_engine* engine, const struct mtr_chunk chunk, u8 arg
         push(engine, res);                                             \
     } while (false)
 
+// floats are compared the way the comparison and NOT would, NaN included
+#define NEGATED_OP(op, t)                                              \
+    do {                                                               \
+        const mtr_value r = pop(engine);                               \
+        const mtr_value l = pop(engine);                               \
+        push(engine, MTR_INT(!(l.t op r.t)));                          \
+    } while (false)
+
 #define READ(type) *((type*)ip); ip += sizeof(type)
+
+#define TRACE(key, type)                                               \
+    do {                                                               \
+        if (engine->tracer) {                                          \
+            mtr_trace_enter(engine->tracer, key, type);                \
+        }                                                              \
+    } while (false)
+
+#ifdef MTR_OPCODE_STATS
+#   define COUNT_OPCODE()                                              \
+    do {                                                               \
+        if (engine->opcode_stats) {                                    \
+            mtr_count_opcode(engine->opcode_stats, *ip);               \
+        }                                                              \
+    } while (false)
+#else
+#   define COUNT_OPCODE()
+#endif
 #define LINK(obj) mtr_link_obj(engine, (struct mtr_object*) obj)
 
+// the sandbox gives up quietly, the evaluation just doesn't happen at compile time
+#define RUNTIME_ERROR(...)                                             \
+    do {                                                               \
+        if (engine->sandbox) {                                         \
+            longjmp(*engine->sandbox, 1);                              \
+        }                                                              \
+        MTR_LOG_ERROR(__VA_ARGS__);                                    \
+        report_line(&chunk, ip);                                       \
+        exit(-1);                                                      \
+    } while (false)
+
+// ip is somewhere after the start of the failing instruction, which is the last one to start before it
+static void report_line(const struct mtr_chunk* chunk, const u8* ip) {
+    const u32 line = mtr_chunk_line(chunk, (size_t) (ip - chunk->bytecode) - 1);
+    if (line > 0) {
+        MTR_LOG_ERROR("At line %u.", line);
+    }
+}
+
+// which union members a value can be, for TAG
+static u8 value_kind(mtr_value value) {
+    switch (value.type) {
+    case MTR_VAL_INT: return MTR_TAG_INT;
+    case MTR_VAL_FLOAT: return MTR_TAG_FLOAT;
+    case MTR_VAL_OBJ: break;
+    }
+
+    switch (MTR_AS_OBJ(value)->type) {
+    case MTR_OBJ_STRUCT: return MTR_TAG_STRUCT;
+    case MTR_OBJ_STRING: return MTR_TAG_STRING;
+    case MTR_OBJ_ARRAY: return MTR_TAG_ARRAY;
+    case MTR_OBJ_MAP: return MTR_TAG_MAP;
+    default: return MTR_TAG_FN;
+    }
+}
+
+// Calls and backward jumps are where the sandbox counts down its budget and the sampler takes samples
+static void checkpoint(struct mtr_engine* engine) {
+    if (engine->sandbox && --engine->budget == 0) {
+        longjmp(*engine->sandbox, 1);
+    }
+
+    struct mtr_sampler* sampler = engine->sampler;
+    if (sampler && (sampler->due || (sampler->interval == 0 && --sampler->countdown == 0))) {
+        sampler->due = 0;
+        sampler->countdown = MTR_SAMPLE_PERIOD;
+        mtr_take_sample(sampler, engine->depth);
+    }
+}
+
+#define CHECKPOINT()                                                   \
+    do {                                                               \
+        if (engine->watched) {                                         \
+            checkpoint(engine);                                        \
+        }                                                              \
+    } while (false)
+
 static void call(struct mtr_engine* engine, const struct mtr_chunk chunk, u8 argc, mtr_value* closed) {
     struct frame frame;
     frame.stack = engine->stack_top - argc;
@@ -57,6 +157,7 @@ static void call(struct mtr_engine* engine, const struct mtr_chunk chunk, u8 arg
         // mtr_dump_stack(frame.stack, engine->stack_top);
         // mtr_disassemble_instruction(ip, ip - chunk.bytecode);
 
+        COUNT_OPCODE();
         switch (*ip++)
         {
             case MTR_OP_INT: {
@@ -86,9 +187,9 @@ static void call(struct mtr_engine* engine, const struct mtr_chunk chunk, u8 arg
             }
 
             case MTR_OP_STRING_LITERAL: {
-                const char* string = READ(const char*);
-                u32 length = READ(u32);
-                struct mtr_string* s = mtr_new_string(string, length);
+                const u32 length = READ(u32);
+                struct mtr_string* s = mtr_new_string((const char*) ip, length);
+                ip += length;
                 LINK(s);
                 push(engine, MTR_OBJ(s));
                 break;
@@ -137,23 +238,33 @@ static void call(struct mtr_engine* engine, const struct mtr_chunk chunk, u8 arg
             }
 
             case MTR_OP_CLOSURE: {
-                struct mtr_closure* c = READ(struct mtr_closure*);
-                LINK(c);
-                u16 count = c->count;
-
-                c->upvalues = malloc(sizeof(mtr_value) * count);
+                const u16 count = READ(u16);
+                mtr_value* upvalues = malloc(sizeof(mtr_value) * count);
 
                 for (u16 i = 0; i < count; ++i) {
                     u16 index = READ(u16);
                     bool local = READ(bool);
 
                     if (local) {
-                        c->upvalues[i] = frame.stack[index];
+                        upvalues[i] = frame.stack[index];
                     } else {
-                        c->upvalues[i] = frame.closed[index];
+                        upvalues[i] = frame.closed[index];
                     }
                 }
 
+                // the code and its lines are borrowed from this chunk
+                const u32 size = READ(u32);
+                struct mtr_chunk code = {
+                    .bytecode = ip, .size = size, .capacity = 0,
+                    .lines = chunk.lines, .lines_size = chunk.lines_size, .lines_offset = chunk.lines_offset + (size_t) (ip - chunk.bytecode)
+                };
+                ip += size;
+
+                struct mtr_closure* c = mtr_new_closure(code, NULL, count);
+                c->upvalues = upvalues;
+                c->package = engine->package;
+                LINK(c);
+
                 push(engine, MTR_OBJ(c));
                 break;
             }
@@ -213,6 +324,28 @@ static void call(struct mtr_engine* engine, const struct mtr_chunk chunk, u8 arg
                 break;
             }
 
+            case MTR_OP_OR_LONG: {
+                const i32 where = READ(i32);
+                const mtr_value condition = peek(engine, 0);
+                if (condition.integer) {
+                    ip += where;
+                } else {
+                    pop(engine);
+                }
+                break;
+            }
+
+            case MTR_OP_AND_LONG: {
+                const i32 where = READ(i32);
+                const mtr_value condition = peek(engine, 0);
+                if (!condition.integer) {
+                    ip += where;
+                } else {
+                    pop(engine);
+                }
+                break;
+            }
+
             case MTR_OP_NEGATE_I: {
                 (engine->stack_top - 1)->integer = -((engine->stack_top - 1)->integer);
                 break;
@@ -226,7 +359,13 @@ static void call(struct mtr_engine* engine, const struct mtr_chunk chunk, u8 arg
             case MTR_OP_ADD_I: BINARY_OP(+, integer, MTR_VAL_INT); break;
             case MTR_OP_SUB_I: BINARY_OP(-, integer, MTR_VAL_INT); break;
             case MTR_OP_MUL_I: BINARY_OP(*, integer, MTR_VAL_INT); break;
-            case MTR_OP_DIV_I: BINARY_OP(/, integer, MTR_VAL_INT); break;
+            case MTR_OP_DIV_I: {
+                if (MTR_AS_INT(peek(engine, 0)) == 0) {
+                    RUNTIME_ERROR("Division by zero.");
+                }
+                BINARY_OP(/, integer, MTR_VAL_INT);
+                break;
+            }
 
             case MTR_OP_ADD_F: BINARY_OP(+, floating, MTR_VAL_FLOAT); break;
             case MTR_OP_SUB_F: BINARY_OP(-, floating, MTR_VAL_FLOAT); break;
@@ -241,6 +380,14 @@ static void call(struct mtr_engine* engine, const struct mtr_chunk chunk, u8 arg
             case MTR_OP_GREATER_F: BINARY_OP(>, floating, MTR_VAL_FLOAT); break;
             case MTR_OP_EQUAL_F: BINARY_OP(==, floating, MTR_VAL_FLOAT); break;
 
+            case MTR_OP_LESS_EQUAL_I: BINARY_OP(<=, integer, MTR_VAL_INT); break;
+            case MTR_OP_GREATER_EQUAL_I: BINARY_OP(>=, integer, MTR_VAL_INT); break;
+            case MTR_OP_NOT_EQUAL_I: BINARY_OP(!=, integer, MTR_VAL_INT); break;
+
+            case MTR_OP_LESS_EQUAL_F: NEGATED_OP(>, floating); break;
+            case MTR_OP_GREATER_EQUAL_F: NEGATED_OP(<, floating); break;
+            case MTR_OP_NOT_EQUAL_F: NEGATED_OP(==, floating); break;
+
             case MTR_OP_GET: {
                 const u16 index = READ(u16);
                 push(engine, frame.stack[index]);
@@ -282,15 +429,12 @@ static void call(struct mtr_engine* engine, const struct mtr_chunk chunk, u8 arg
                     const i64 i = MTR_AS_INT(key);
                     const size_t index = mtr_reinterpret_cast(size_t, i);
                     if (index >= string->length) {
-                        IMPLEMENT // runtime error;
-                        MTR_LOG_ERROR("Indexing string of size %zu with index %zu", string->length, index);
-                        exit(-1);
+                        RUNTIME_ERROR("Indexing string of size %zu with index %zu", string->length, index);
                         break;
                     }
                     // need to think whether to malloc a whole new string for a single char or not.
                     // I dont like the idea. I could have a reference to it
-                    MTR_LOG_ERROR("String indexing not yet implemented");
-                    exit(-1);
+                    RUNTIME_ERROR("String indexing not yet implemented");
                     break;
                 }
                 case MTR_OBJ_ARRAY: {
@@ -298,9 +442,7 @@ static void call(struct mtr_engine* engine, const struct mtr_chunk chunk, u8 arg
                     const i64 i = MTR_AS_INT(key);
                     const size_t index = mtr_reinterpret_cast(size_t, i);
                     if (index >= array->size) {
-                        IMPLEMENT // runtime error;
-                        MTR_LOG_ERROR("Out of bounds: Indexing array of size %zu with index %zu", array->size, index);
-                        exit(-1);
+                        RUNTIME_ERROR("Out of bounds: Indexing array of size %zu with index %zu", array->size, index);
                         break;
                     }
                     push(engine, array->elements[index]);
@@ -313,8 +455,7 @@ static void call(struct mtr_engine* engine, const struct mtr_chunk chunk, u8 arg
                     break;
                 }
                 default:
-                    IMPLEMENT // runtime error
-                    exit(-1);
+                    RUNTIME_ERROR("Object can't be indexed.");
                     break;
                 }
                 break;
@@ -326,8 +467,7 @@ static void call(struct mtr_engine* engine, const struct mtr_chunk chunk, u8 arg
                 mtr_value val = pop(engine);
                 switch (object->type) {
                 case MTR_OBJ_STRING: {
-                    MTR_LOG_ERROR("<String> object does not support item assignment.");
-                    exit(-1);
+                    RUNTIME_ERROR("<String> object does not support item assignment.");
                     break;
                 }
                 case MTR_OBJ_ARRAY: {
@@ -335,9 +475,7 @@ static void call(struct mtr_engine* engine, const struct mtr_chunk chunk, u8 arg
                     const i64 i = MTR_AS_INT(key);
                     const size_t index = mtr_reinterpret_cast(size_t, i);
                     if (index >= array->size) {
-                        IMPLEMENT // runtime error;
-                        MTR_LOG_ERROR("Out of bounds: Indexing array of size %zu with index %zu", array->size, index);
-                        exit(-1);
+                        RUNTIME_ERROR("Out of bounds: Indexing array of size %zu with index %zu", array->size, index);
                         break;
                     }
                     array->elements[index] = val;
@@ -375,6 +513,7 @@ static void call(struct mtr_engine* engine, const struct mtr_chunk chunk, u8 arg
             case MTR_OP_JMP: {
                 const i16 where = READ(i16);
                 ip += where;
+                CHECKPOINT();
                 break;
             }
 
@@ -382,10 +521,122 @@ static void call(struct mtr_engine* engine, const struct mtr_chunk chunk, u8 arg
                 const mtr_value value = pop(engine);
                 const bool condition = MTR_AS_INT(value);
                 const i16 where = READ(i16);
+                if (engine->profile) {
+                    mtr_profile_add(engine->profile, mtr_profile_at(ip - 1 - sizeof(i16), condition == false), 1);
+                }
                 ip += where * (condition == false);
                 break;
             }
 
+            case MTR_OP_JMP_LONG: {
+                const i32 where = READ(i32);
+                ip += where;
+                CHECKPOINT();
+                break;
+            }
+
+            case MTR_OP_JMP_Z_LONG: {
+                const mtr_value value = pop(engine);
+                const bool condition = MTR_AS_INT(value);
+                const i32 where = READ(i32);
+                if (engine->profile) {
+                    mtr_profile_add(engine->profile, mtr_profile_at(ip - 1 - sizeof(i32), condition == false), 1);
+                }
+                ip += where * (condition == false);
+                break;
+            }
+
+            // the loop state sits in frame slots: [counter/object] [end/index] [vars...]
+            case MTR_OP_FOR_RANGE: {
+                const i32 where = READ(i32);
+                u8* const loop = ip + where;
+                const u16 slot = READ(u16);
+                mtr_value* const iter = frame.stack + slot;
+                if (MTR_AS_INT(iter[0]) < MTR_AS_INT(iter[1])) {
+                    iter[2] = iter[0];
+                    MTR_AS_INT(iter[0])++;
+                    ip = loop;
+                    CHECKPOINT();
+                }
+                break;
+            }
+
+            case MTR_OP_FOR_ARRAY: {
+                const i32 where = READ(i32);
+                u8* const loop = ip + where;
+                const u16 slot = READ(u16);
+                mtr_value* const iter = frame.stack + slot;
+                const struct mtr_array* array = (struct mtr_array*) MTR_AS_OBJ(iter[0]);
+                const size_t index = (size_t) MTR_AS_INT(iter[1]);
+                if (index < array->size) {
+                    iter[2] = array->elements[index];
+                    MTR_AS_INT(iter[1])++;
+                    ip = loop;
+                    CHECKPOINT();
+                }
+                break;
+            }
+
+            case MTR_OP_FOR_MAP: {
+                const i32 where = READ(i32);
+                u8* const loop = ip + where;
+                const u16 slot = READ(u16);
+                mtr_value* const iter = frame.stack + slot;
+                size_t index = (size_t) MTR_AS_INT(iter[1]);
+                const struct mtr_map_element* element = mtr_map_next((struct mtr_map*) MTR_AS_OBJ(iter[0]), &index);
+                if (element) {
+                    MTR_AS_INT(iter[1]) = (i64) index;
+                    iter[2] = element->key;
+                    iter[3] = element->value;
+                    ip = loop;
+                    CHECKPOINT();
+                }
+                break;
+            }
+
+            case MTR_OP_VARIANT: {
+                const u16 tag = READ(u16);
+                (engine->stack_top - 1)->tag = tag;
+                break;
+            }
+
+            case MTR_OP_TAG: {
+                const u16 count = READ(u16);
+                const u8* const kinds = ip;
+                ip += count * sizeof(u8);
+                mtr_value* const value = engine->stack_top - 1;
+                const u8 kind = value_kind(*value);
+                if (value->tag < count && (kinds[value->tag] == kind || kinds[value->tag] == MTR_TAG_ANY)) {
+                    break;
+                }
+
+                u16 tag = 0;
+                while (tag < count && kinds[tag] != kind && kinds[tag] != MTR_TAG_ANY) {
+                    tag++;
+                }
+
+                if (tag == count) {
+                    RUNTIME_ERROR("Value is not a member of the union.");
+                }
+                value->tag = tag;
+                break;
+            }
+
+            case MTR_OP_MATCH: {
+                const u16 count = READ(u16);
+                const u32 tag = (engine->stack_top - 1)->tag;
+                if (tag >= count) {
+                    RUNTIME_ERROR("Invalid union tag.");
+                }
+                if (engine->profile) {
+                    mtr_profile_add(engine->profile, mtr_profile_at(ip - 1 - sizeof(u16), (u16) tag), 1);
+                }
+                u8* const entry = ip + tag * sizeof(i32);
+                const i32 where = *((i32*) entry);
+                ip = entry + sizeof(i32) + where;
+                break;
+            }
+
             case MTR_OP_POP: {
                 pop(engine);
                 break;
@@ -399,23 +650,65 @@ static void call(struct mtr_engine* engine, const struct mtr_chunk chunk, u8 arg
 
             case MTR_OP_CALL: {
                 const u8 argc = READ(u8);
+                if (engine->profile) {
+                    mtr_profile_add(engine->profile, mtr_profile_at(ip - 2, 0), 1);
+                }
                 struct mtr_object* object = MTR_AS_OBJ(pop(engine));
+                engine->depth++;
+                // the timeline only shows what main calls
+                const bool timed = engine->timeline && engine->depth == 1;
+                const u64 start = timed ? mtr_timeline_now(engine->timeline) : 0;
+                if (engine->watched) {
+                    if (engine->sampler && engine->depth < MTR_SAMPLE_DEPTH) {
+                        engine->sampler->stack[engine->depth] = object;
+                    }
+                    checkpoint(engine);
+                    // the stack isn't checked outside of debug builds so leave some room for the frame
+                    if (engine->sandbox && (engine->depth > MTR_SANDBOX_DEPTH || engine->stack_top + 256 > engine->stack + MTR_MAX_STACK)) {
+                        longjmp(*engine->sandbox, 1);
+                    }
+                }
+
                 if (object->type == MTR_OBJ_FUNCTION) {
                     struct mtr_function* f = (struct mtr_function*) object;
-                    call(engine, f->chunk, argc, NULL);
-                    break;
+                    TRACE(f, MTR_OBJ_FUNCTION);
+                    call_in(engine, f->package, f->chunk, argc, NULL);
                 } else if (object->type == MTR_OBJ_CLOSURE) {
                     struct mtr_closure* c = (struct mtr_closure*) object;
-                    call(engine, c->chunk, argc, c->upvalues);
-                    break;
+                    // every closure is a new object, the code stays the same
+                    TRACE(c->chunk.bytecode, MTR_OBJ_CLOSURE);
+                    call_in(engine, c->package, c->chunk, argc, c->upvalues);
+                } else if (object->type == MTR_OBJ_STUB) {
+                    struct mtr_stub* s = (struct mtr_stub*) object;
+                    struct mtr_function* f = s->function ? s->function : s->compile(s);
+                    // compiling can add specializations, which moves the globals
+                    engine->globals = engine->package->objects;
+                    if (engine->sampler && engine->depth < MTR_SAMPLE_DEPTH) {
+                        engine->sampler->stack[engine->depth] = (struct mtr_object*) f;
+                    }
+                    // the caller pays for compiling it
+                    TRACE(f, MTR_OBJ_FUNCTION);
+                    call_in(engine, s->package, f->chunk, argc, NULL);
                 } else if (object->type == MTR_OBJ_NATIVE_FN) {
                     struct mtr_native_fn* n = (struct mtr_native_fn*) object;
+                    TRACE(n, MTR_OBJ_NATIVE_FN);
                     mtr_value val = n->function(argc, engine->stack_top - argc);
                     engine->stack_top -= argc;
                     push(engine, val);
-                    break;
+                } else {
+                    MTR_ASSERT(false, "Object is not invokable");
                 }
-                MTR_ASSERT(false, "Object is not invokable");
+
+                if (engine->tracer) {
+                    mtr_trace_exit(engine->tracer);
+                }
+
+                if (timed) {
+                    const struct mtr_object* called = object->type == MTR_OBJ_STUB ? (struct mtr_object*) ((struct mtr_stub*) object)->function : object;
+                    mtr_timeline_call(engine->timeline, called, called->type, start);
+                }
+
+                engine->depth--;
                 break;
             }
 
@@ -444,28 +737,132 @@ static void call(struct mtr_engine* engine, const struct mtr_chunk chunk, u8 arg
 }
 
 #undef BINARY_OP
+#undef NEGATED_OP
 #undef READ
+#undef COUNT_OPCODE
+#undef TRACE
 
-i32 mtr_execute(struct mtr_engine* engine, struct mtr_package* package) {
+static i32 run(struct mtr_engine* engine, struct mtr_package* package, struct mtr_profile* profile, struct mtr_sampler* sampler, struct mtr_tracer* tracer, struct mtr_timeline* timeline) {
+    if (!mtr_link_package(package)) {
+        return -1;
+    }
+
+    engine->package = package;
     engine->globals = package->objects;
     engine->stack_top = engine->stack;
     engine->objects = NULL;
+    engine->sandbox = NULL;
+    engine->depth = 0;
+    engine->profile = profile;
+    engine->sampler = sampler;
+    engine->watched = sampler != NULL;
+    engine->tracer = tracer;
+    engine->timeline = timeline;
     struct mtr_function* f = package->main;
     if (NULL == f) {
         MTR_LOG_ERROR("Did not find main.");
         return -1;
     }
 
+    if (sampler) {
+        sampler->stack[0] = (struct mtr_object*) f;
+        mtr_start_sampler(sampler);
+    }
+
+#ifdef MTR_OPCODE_STATS
+    struct mtr_opcode_stats* stats = malloc(sizeof(struct mtr_opcode_stats));
+    mtr_init_opcode_stats(stats);
+    engine->opcode_stats = stats;
+#endif
+
+    if (tracer) {
+        mtr_trace_enter(tracer, f, MTR_OBJ_FUNCTION);
+    }
+
+    u64 start = mtr_timeline_now(timeline);
     call(engine, f->chunk, 0, NULL);
+    if (timeline) {
+        mtr_timeline_call(timeline, f, MTR_OBJ_FUNCTION, start);
+    }
+
+    if (tracer) {
+        mtr_trace_exit(tracer);
+    }
+
+#ifdef MTR_OPCODE_STATS
+    engine->opcode_stats = NULL;
+    mtr_report_opcode_stats(stats);
+    free(stats);
+#endif
+
+    if (sampler) {
+        mtr_stop_sampler(sampler);
+    }
+
+    start = mtr_timeline_now(timeline);
+    mtr_engine_collect(engine);
+    mtr_timeline_phase(timeline, "gc", "collect", start);
+
+    // mtr_dump_stack(engine->stack, engine->stack_top);
+    return 0;
+}
+
+i32 mtr_execute(struct mtr_engine* engine, struct mtr_package* package) {
+    return run(engine, package, NULL, NULL, NULL, NULL);
+}
+
+i32 mtr_execute_with_profile(struct mtr_engine* engine, struct mtr_package* package, struct mtr_profile* profile) {
+    return run(engine, package, profile, NULL, NULL, NULL);
+}
+
+i32 mtr_execute_with_sampler(struct mtr_engine* engine, struct mtr_package* package, struct mtr_sampler* sampler) {
+    return run(engine, package, NULL, sampler, NULL, NULL);
+}
 
+i32 mtr_execute_with_tracer(struct mtr_engine* engine, struct mtr_package* package, struct mtr_tracer* tracer) {
+    return run(engine, package, NULL, NULL, tracer, NULL);
+}
+
+i32 mtr_execute_with_timeline(struct mtr_engine* engine, struct mtr_package* package, struct mtr_timeline* timeline) {
+    return run(engine, package, NULL, NULL, NULL, timeline);
+}
+
+bool mtr_evaluate(struct mtr_engine* engine, struct mtr_package* package, struct mtr_chunk chunk, u64 budget, mtr_value* result) {
+    jmp_buf sandbox;
+    engine->package = package;
+    engine->globals = package->objects;
+    engine->stack_top = engine->stack;
+    engine->objects = NULL;
+    engine->sandbox = &sandbox;
+    engine->budget = budget;
+    engine->depth = 0;
+    engine->profile = NULL;
+    engine->sampler = NULL;
+    engine->watched = true;
+    engine->tracer = NULL;
+    engine->timeline = NULL;
+#ifdef MTR_OPCODE_STATS
+    engine->opcode_stats = NULL;
+#endif
+
+    // everything the evaluation created is still linked to the engine after a jump back here
+    if (setjmp(sandbox) != 0) {
+        engine->sandbox = NULL;
+        return false;
+    }
+
+    call(engine, chunk, 0, NULL);
+    *result = engine->stack[0];
+    engine->sandbox = NULL;
+    return true;
+}
+
+void mtr_engine_collect(struct mtr_engine* engine) {
     struct mtr_object* o = engine->objects;
     while (o) {
         struct mtr_object* next = o->next;
         mtr_delete_object(o);
         o = next;
-
     }
-
-    // mtr_dump_stack(engine->stack, engine->stack_top);
-    return 0;
+    engine->objects = NULL;
 }
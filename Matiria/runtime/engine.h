@@ -3,18 +3,60 @@
 
 #include "value.h"
 #include "package.h"
+#include "profile.h"
+#include "sampler.h"
+#include "tracer.h"
+#include "timeline.h"
+#include "opstats.h"
 
 #include "core/types.h"
 
+#include <setjmp.h>
+
 #define MTR_MAX_STACK 1024
 
+// calls deep code evaluated at compile time can go
+#define MTR_SANDBOX_DEPTH 200
+
 struct mtr_engine {
     mtr_value stack[MTR_MAX_STACK];
     mtr_value* stack_top;
-    struct mtr_object** globals;
+    struct mtr_object** globals; // of the package that is running
+    struct mtr_package* package;
     struct mtr_object* objects;
+    jmp_buf* sandbox; // where runtime errors go instead of exiting. NULL outside of mtr_evaluate
+    u64 budget; // jumps and calls the sandbox has left
+    u32 depth;
+    struct mtr_profile* profile; // counts the calls, branches and matches when not NULL
+    struct mtr_sampler* sampler; // takes samples when not NULL
+    bool watched; // the sandbox or the sampler look at every call and backward jump
+    struct mtr_tracer* tracer; // times every call when not NULL
+    struct mtr_timeline* timeline; // gets the calls main makes when not NULL
+#ifdef MTR_OPCODE_STATS
+    struct mtr_opcode_stats* opcode_stats; // of mtr_execute, NULL while evaluating
+#endif
 };
 
 i32 mtr_execute(struct mtr_engine* engine, struct mtr_package* package);
 
+// also counts every call, branch and match into profile (see profile.h)
+i32 mtr_execute_with_profile(struct mtr_engine* engine, struct mtr_package* package, struct mtr_profile* profile);
+
+// also samples where the run spends its time into sampler (see sampler.h)
+i32 mtr_execute_with_sampler(struct mtr_engine* engine, struct mtr_package* package, struct mtr_sampler* sampler);
+
+// also times every call into tracer (see tracer.h)
+i32 mtr_execute_with_tracer(struct mtr_engine* engine, struct mtr_package* package, struct mtr_tracer* tracer);
+
+// also adds main, the calls it makes and collecting the objects of the run to timeline (see timeline.h)
+i32 mtr_execute_with_timeline(struct mtr_engine* engine, struct mtr_package* package, struct mtr_timeline* timeline);
+
+// Runs chunk with the globals of package, for evaluating code while compiling. False if it
+// hits a runtime error or runs out of budget (jumps and calls). The result stays valid
+// until mtr_engine_collect
+bool mtr_evaluate(struct mtr_engine* engine, struct mtr_package* package, struct mtr_chunk chunk, u64 budget, mtr_value* result);
+
+// deletes every object the engine created
+void mtr_engine_collect(struct mtr_engine* engine);
+
 #endif
@@ -50,6 +50,9 @@ void mtr_delete_object(struct mtr_object* object) {
         free(c->upvalues);
         free(c);
     }
+    case MTR_OBJ_STUB:
+        // owned by the package
+        break;
     default:
         break;
     }
@@ -79,6 +82,7 @@ struct mtr_function* mtr_new_function(struct mtr_chunk chunk) {
     struct mtr_function* fn = malloc(sizeof(*fn));
     fn->obj.type = MTR_OBJ_FUNCTION;
     fn->chunk = chunk;
+    fn->package = NULL;
     return fn;
 }
 
@@ -89,6 +93,8 @@ struct mtr_closure* mtr_new_closure(struct mtr_chunk chunk, mtr_value* upvalues,
     cl->obj.type = MTR_OBJ_CLOSURE;
     cl->chunk = chunk;
     cl->count = count;
+    cl->upvalues = NULL;
+    cl->package = NULL;
     if (upvalues != NULL && count > 0) {
         cl->upvalues = malloc(sizeof(mtr_value) * count);
         memcpy(cl->upvalues, upvalues, sizeof(mtr_value) * count);
@@ -161,6 +167,18 @@ struct mtr_map_element* mtr_get_key_value_pair(struct mtr_map* map, size_t index
     return entry->is_used ? (struct mtr_map_element*) entry : NULL;
 }
 
+struct mtr_map_element* mtr_map_next(struct mtr_map* map, size_t* index) {
+    for (size_t i = *index; i < map->capacity; ++i) {
+        struct map_entry* entry = map->entries + i;
+        if (entry->is_used && !entry->is_tombstone) {
+            *index = i + 1;
+            return (struct mtr_map_element*) entry;
+        }
+    }
+    *index = map->capacity;
+    return NULL;
+}
+
 struct mtr_map* mtr_new_map(void) {
 
     struct mtr_map* map = malloc(sizeof(*map));
@@ -257,7 +275,9 @@ void mtr_map_insert(struct mtr_map* map, mtr_value key, mtr_value value) {
     entry->key = key;
     entry->is_used = true;
 
+    // tombstones are still counted in size
     if (entry->is_tombstone) {
+        entry->is_tombstone = false;
         return;
     }
 
@@ -11,6 +11,7 @@ enum mtr_object_t {
     MTR_OBJ_FUNCTION,
     MTR_OBJ_NATIVE_FN,
     MTR_OBJ_CLOSURE,
+    MTR_OBJ_STUB,
     MTR_OBJ_STRING,
     MTR_OBJ_ARRAY,
     MTR_OBJ_MAP
@@ -41,13 +42,26 @@ struct mtr_native_fn {
 
 struct mtr_native_fn* mtr_new_native_function(mtr_native native);
 
+struct mtr_package;
+
 struct mtr_function {
     struct mtr_object obj;
     struct mtr_chunk chunk;
+    struct mtr_package* package; // whose globals the code uses. NULL for the running package
 };
 
 struct mtr_function* mtr_new_function(struct mtr_chunk chunk);
 
+// Stands in for a function that is compiled on its first call (see mtr_compile_options.lazy).
+// Stubs are owned by the package, references taken before the first call forward to the function
+struct mtr_stub {
+    struct mtr_object obj;
+    struct mtr_function* function; // NULL until compiled
+    struct mtr_function* (*compile)(struct mtr_stub* stub);
+    struct mtr_package* package;
+    u32 index;
+};
+
 struct mtr_upvalue {
     mtr_value value;
     mtr_value* ptr;
@@ -58,6 +72,7 @@ struct mtr_closure {
     struct mtr_object obj;
     struct mtr_chunk chunk;
     mtr_value* upvalues;
+    struct mtr_package* package; // the one of the function it was created in
     u8 count;
 };
 
@@ -98,6 +113,8 @@ struct mtr_map_element {
 };
 
 struct mtr_map_element* mtr_get_key_value_pair(struct mtr_map* map, size_t index);
+// returns the first live element at or after *index and moves *index past it. NULL when there are none left
+struct mtr_map_element* mtr_map_next(struct mtr_map* map, size_t* index);
 
 struct mtr_map* mtr_new_map(void);
 void mtr_delete_map(struct mtr_map* map);
@@ -0,0 +1,145 @@
+#include "core/log.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#ifdef MTR_OPCODE_STATS
+
+#include "opstats.h"
+
+static const char* const names[MTR_OP_COUNT] = {
+    [MTR_OP_INT] = "INT",
+    [MTR_OP_FLOAT] = "FLOAT",
+    [MTR_OP_FALSE] = "FALSE",
+    [MTR_OP_TRUE] = "TRUE",
+    [MTR_OP_STRING_LITERAL] = "STRING_LITERAL",
+    [MTR_OP_ARRAY_LITERAL] = "ARRAY_LITERAL",
+    [MTR_OP_MAP_LITERAL] = "MAP_LITERAL",
+    [MTR_OP_CONSTRUCTOR] = "CONSTRUCTOR",
+    [MTR_OP_CLOSURE] = "CLOSURE",
+    [MTR_OP_NIL] = "NIL",
+    [MTR_OP_EMPTY_STRING] = "EMPTY_STRING",
+    [MTR_OP_EMPTY_ARRAY] = "EMPTY_ARRAY",
+    [MTR_OP_EMPTY_MAP] = "EMPTY_MAP",
+    [MTR_OP_OR] = "OR",
+    [MTR_OP_AND] = "AND",
+    [MTR_OP_OR_LONG] = "OR_LONG",
+    [MTR_OP_AND_LONG] = "AND_LONG",
+    [MTR_OP_NOT] = "NOT",
+    [MTR_OP_NEGATE_I] = "NEGATE_I",
+    [MTR_OP_NEGATE_F] = "NEGATE_F",
+    [MTR_OP_ADD_I] = "ADD_I",
+    [MTR_OP_SUB_I] = "SUB_I",
+    [MTR_OP_MUL_I] = "MUL_I",
+    [MTR_OP_DIV_I] = "DIV_I",
+    [MTR_OP_ADD_F] = "ADD_F",
+    [MTR_OP_SUB_F] = "SUB_F",
+    [MTR_OP_MUL_F] = "MUL_F",
+    [MTR_OP_DIV_F] = "DIV_F",
+    [MTR_OP_LESS_I] = "LESS_I",
+    [MTR_OP_GREATER_I] = "GREATER_I",
+    [MTR_OP_EQUAL_I] = "EQUAL_I",
+    [MTR_OP_LESS_F] = "LESS_F",
+    [MTR_OP_GREATER_F] = "GREATER_F",
+    [MTR_OP_EQUAL_F] = "EQUAL_F",
+    [MTR_OP_LESS_EQUAL_I] = "LESS_EQUAL_I",
+    [MTR_OP_GREATER_EQUAL_I] = "GREATER_EQUAL_I",
+    [MTR_OP_NOT_EQUAL_I] = "NOT_EQUAL_I",
+    [MTR_OP_LESS_EQUAL_F] = "LESS_EQUAL_F",
+    [MTR_OP_GREATER_EQUAL_F] = "GREATER_EQUAL_F",
+    [MTR_OP_NOT_EQUAL_F] = "NOT_EQUAL_F",
+    [MTR_OP_GET] = "GET",
+    [MTR_OP_SET] = "SET",
+    [MTR_OP_GLOBAL_GET] = "GLOBAL_GET",
+    [MTR_OP_UPVALUE_GET] = "UPVALUE_GET",
+    [MTR_OP_UPVALUE_SET] = "UPVALUE_SET",
+    [MTR_OP_INDEX_GET] = "INDEX_GET",
+    [MTR_OP_INDEX_SET] = "INDEX_SET",
+    [MTR_OP_STRUCT_GET] = "STRUCT_GET",
+    [MTR_OP_STRUCT_SET] = "STRUCT_SET",
+    [MTR_OP_JMP] = "JMP",
+    [MTR_OP_JMP_Z] = "JMP_Z",
+    [MTR_OP_JMP_LONG] = "JMP_LONG",
+    [MTR_OP_JMP_Z_LONG] = "JMP_Z_LONG",
+    [MTR_OP_FOR_RANGE] = "FOR_RANGE",
+    [MTR_OP_FOR_ARRAY] = "FOR_ARRAY",
+    [MTR_OP_FOR_MAP] = "FOR_MAP",
+    [MTR_OP_VARIANT] = "VARIANT",
+    [MTR_OP_TAG] = "TAG",
+    [MTR_OP_MATCH] = "MATCH",
+    [MTR_OP_POP] = "POP",
+    [MTR_OP_POP_V] = "POP_V",
+    [MTR_OP_CALL] = "CALL",
+    [MTR_OP_INT_CAST] = "INT_CAST",
+    [MTR_OP_FLOAT_CAST] = "FLOAT_CAST",
+    [MTR_OP_RETURN] = "RETURN",
+};
+
+const char* mtr_op_name(u8 op) {
+    return op < MTR_OP_COUNT && names[op] ? names[op] : "?";
+}
+
+void mtr_init_opcode_stats(struct mtr_opcode_stats* stats) {
+    memset(stats, 0, sizeof(*stats));
+    // so the first instruction is counted as following a RETURN
+    stats->previous = MTR_OP_RETURN;
+}
+
+struct ranked {
+    u64 count;
+    u16 index; // opcode, or first * MTR_OP_COUNT + second for pairs
+};
+
+static int by_count(const void* a, const void* b) {
+    const u64 l = ((const struct ranked*) a)->count;
+    const u64 r = ((const struct ranked*) b)->count;
+    return (l < r) - (l > r);
+}
+
+void mtr_report_opcode_stats(struct mtr_opcode_stats* stats) {
+    const char* path = getenv("MTR_OPCODE_STATS");
+    FILE* file = path ? fopen(path, "a") : stderr;
+    if (file == NULL) {
+        MTR_LOG_ERROR("Unable to write opcode stats to %s", path);
+        return;
+    }
+
+    u64 total = 0;
+    struct ranked ops[MTR_OP_COUNT];
+    for (u16 i = 0; i < MTR_OP_COUNT; ++i) {
+        ops[i] = (struct ranked) { stats->counts[i], i };
+        total += stats->counts[i];
+    }
+    qsort(ops, MTR_OP_COUNT, sizeof(struct ranked), by_count);
+
+    fprintf(file, "%-18s %14s %7s %10s\n", "opcode", "count", "%", "cycles");
+    for (u16 i = 0; i < MTR_OP_COUNT && ops[i].count > 0; ++i) {
+        const u16 op = ops[i].index;
+        const double cycles = stats->timed[op] ? (double) stats->cycles[op] / (double) stats->timed[op] : 0.0;
+        fprintf(file, "%-18s %14llu %6.2f%% %10.1f\n", names[op], (unsigned long long) ops[i].count,
+            100.0 * (double) ops[i].count / (double) total, cycles);
+    }
+
+    struct ranked* pairs = malloc(sizeof(struct ranked) * MTR_OP_COUNT * MTR_OP_COUNT);
+    for (u16 i = 0; i < MTR_OP_COUNT * MTR_OP_COUNT; ++i) {
+        pairs[i] = (struct ranked) { stats->pairs[i / MTR_OP_COUNT][i % MTR_OP_COUNT], i };
+    }
+    qsort(pairs, MTR_OP_COUNT * MTR_OP_COUNT, sizeof(struct ranked), by_count);
+
+    fprintf(file, "\n%-37s %14s %7s\n", "pair", "count", "%");
+    for (u16 i = 0; i < 32 && pairs[i].count > 0; ++i) {
+        const u16 first = pairs[i].index / MTR_OP_COUNT;
+        const u16 second = pairs[i].index % MTR_OP_COUNT;
+        fprintf(file, "%-18s %-18s %14llu %6.2f%%\n", names[first], names[second], (unsigned long long) pairs[i].count,
+            100.0 * (double) pairs[i].count / (double) total);
+    }
+    fputc('\n', file);
+    free(pairs);
+
+    if (path) {
+        fclose(file);
+    }
+}
+
+#endif
@@ -0,0 +1,78 @@
+#ifdef MTR_OPCODE_STATS
+
+#ifndef MTR_OPSTATS_H
+#define MTR_OPSTATS_H
+
+#include "bytecode.h"
+
+#include "core/types.h"
+
+// How often every instruction runs, which instruction follows which, and what they cost, to see
+// what the dispatch in the engine should be good at. Only built with MTR_OPCODE_STATS defined
+// (make opstats=1) and kept by mtr_execute, which reports them when the run is done. Instructions
+// evaluated at compile time aren't counted.
+
+#define MTR_OP_COUNT (MTR_OP_RETURN + 1)
+
+// every this many instructions one is timed, reading the time stamp counter costs about as much
+// as running one
+#define MTR_OPCODE_TIMED 64
+
+struct mtr_opcode_stats {
+    u64 counts[MTR_OP_COUNT];
+    u64 pairs[MTR_OP_COUNT][MTR_OP_COUNT]; // [first][second]
+    u64 cycles[MTR_OP_COUNT];
+    u64 timed[MTR_OP_COUNT]; // instructions the cycles were measured on
+    u64 start; // time stamp the timed instruction started at
+    u32 tick;
+    u8 previous;
+    bool timing; // previous is being timed
+};
+
+void mtr_init_opcode_stats(struct mtr_opcode_stats* stats);
+
+#if defined(_MSC_VER)
+#   include <intrin.h>
+#   define MTR_TICKS() __rdtsc()
+#elif defined(__x86_64__) || defined(__i386__)
+#   include <x86intrin.h>
+#   define MTR_TICKS() __rdtsc()
+#else
+#   include <time.h>
+static inline u64 mtr_ticks(void) {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (u64) now.tv_sec * 1000000000 + (u64) now.tv_nsec;
+}
+#   define MTR_TICKS() mtr_ticks() // nanoseconds where there is no time stamp counter
+#endif
+
+// called by the engine before running the instruction op. The time an instruction takes runs
+// until the next one starts, the ones of a call until the first one of the function called
+static inline void mtr_count_opcode(struct mtr_opcode_stats* stats, u8 op) {
+    if (stats->timing) {
+        stats->cycles[stats->previous] += MTR_TICKS() - stats->start;
+        stats->timed[stats->previous]++;
+        stats->timing = false;
+    }
+
+    stats->counts[op]++;
+    stats->pairs[stats->previous][op]++;
+    stats->previous = op;
+
+    if (++stats->tick == MTR_OPCODE_TIMED) {
+        stats->tick = 0;
+        stats->timing = true;
+        stats->start = MTR_TICKS();
+    }
+}
+
+// Writes the instructions and the 32 most common pairs, most frequent first, to the file at the
+// MTR_OPCODE_STATS environment variable or to stderr
+void mtr_report_opcode_stats(struct mtr_opcode_stats* stats);
+
+const char* mtr_op_name(u8 op);
+
+#endif
+
+#endif
@@ -11,7 +11,7 @@ enum mtr_value_type {
 
 typedef struct {
     enum mtr_value_type type;
-    u32 pad; // I have an extra four bytes use because of alignment
+    u32 tag; // the extra four bytes from alignment. Union values store which member they hold here
     union {
         i64 integer;
         f64 floating;
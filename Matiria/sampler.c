@@ -0,0 +1,174 @@
+#ifndef _WIN32
+#   define _XOPEN_SOURCE 700
+#endif
+
+#include "sampler.h"
+
+#include "runtime/object.h"
+
+#include "core/log.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#ifndef _WIN32
+#   include <sys/time.h>
+#endif
+
+// Samples are kept as a tree of the stacks they were taken in, children of a node are the frames
+// that were called from it
+struct mtr_sample_node {
+    const struct mtr_object* object;
+    struct mtr_sample_node* child;
+    struct mtr_sample_node* next; // sibling
+    u64 count; // samples taken with this frame on top
+};
+
+static struct mtr_sample_node* new_node(const struct mtr_object* object) {
+    struct mtr_sample_node* node = malloc(sizeof(struct mtr_sample_node));
+    node->object = object;
+    node->child = NULL;
+    node->next = NULL;
+    node->count = 0;
+    return node;
+}
+
+static void delete_node(struct mtr_sample_node* node) {
+    while (node) {
+        struct mtr_sample_node* next = node->next;
+        delete_node(node->child);
+        free(node);
+        node = next;
+    }
+}
+
+void mtr_init_sampler(struct mtr_sampler* sampler, u32 interval) {
+    memset(sampler->stack, 0, sizeof(sampler->stack));
+    sampler->root = new_node(NULL);
+    sampler->samples = 0;
+#ifdef _WIN32
+    interval = 0;
+#endif
+    sampler->interval = interval;
+    sampler->countdown = MTR_SAMPLE_PERIOD;
+    sampler->due = 0;
+}
+
+void mtr_delete_sampler(struct mtr_sampler* sampler) {
+    delete_node(sampler->root);
+    sampler->root = NULL;
+    sampler->samples = 0;
+}
+
+#ifndef _WIN32
+static struct mtr_sampler* volatile timed = NULL;
+static struct sigaction previous;
+
+static void on_timer(int signal) {
+    (void) signal;
+    struct mtr_sampler* sampler = timed;
+    if (sampler) {
+        sampler->due = 1;
+    }
+}
+
+static void set_timer(u32 interval) {
+    struct itimerval timer;
+    timer.it_interval.tv_sec = interval / 1000000;
+    timer.it_interval.tv_usec = interval % 1000000;
+    timer.it_value = timer.it_interval;
+    setitimer(ITIMER_PROF, &timer, NULL);
+}
+#endif
+
+void mtr_start_sampler(struct mtr_sampler* sampler) {
+    sampler->countdown = MTR_SAMPLE_PERIOD;
+    sampler->due = 0;
+#ifndef _WIN32
+    if (sampler->interval == 0) {
+        return;
+    }
+
+    timed = sampler;
+    struct sigaction action;
+    memset(&action, 0, sizeof(action));
+    action.sa_handler = on_timer;
+    action.sa_flags = SA_RESTART;
+    sigemptyset(&action.sa_mask);
+    sigaction(SIGPROF, &action, &previous);
+    set_timer(sampler->interval);
+#endif
+}
+
+void mtr_stop_sampler(struct mtr_sampler* sampler) {
+#ifndef _WIN32
+    if (sampler->interval == 0) {
+        return;
+    }
+
+    set_timer(0);
+    sigaction(SIGPROF, &previous, NULL);
+    timed = NULL;
+#endif
+}
+
+void mtr_take_sample(struct mtr_sampler* sampler, u32 depth) {
+    const u32 frames = depth < MTR_SAMPLE_DEPTH ? depth + 1 : MTR_SAMPLE_DEPTH;
+    struct mtr_sample_node* node = sampler->root;
+    for (u32 i = 0; i < frames; ++i) {
+        const struct mtr_object* object = sampler->stack[i];
+        struct mtr_sample_node** child = &node->child;
+        while (*child != NULL && (*child)->object != object) {
+            child = &(*child)->next;
+        }
+        if (*child == NULL) {
+            *child = new_node(object);
+        }
+        node = *child;
+    }
+    node->count++;
+    sampler->samples++;
+}
+
+static void write_stacks(FILE* file, const struct mtr_function_names* names, const struct mtr_sample_node** path, u32 depth) {
+    const struct mtr_sample_node* node = path[depth - 1];
+    if (node->count > 0) {
+        for (u32 i = 0; i < depth; ++i) {
+            if (i > 0) {
+                fputc(';', file);
+            }
+            mtr_write_function_name(file, names, path[i]->object, (u8) path[i]->object->type);
+        }
+        fprintf(file, " %llu\n", (unsigned long long) node->count);
+    }
+
+    for (const struct mtr_sample_node* child = node->child; child; child = child->next) {
+        path[depth] = child;
+        write_stacks(file, names, path, depth + 1);
+    }
+}
+
+bool mtr_write_samples(const struct mtr_sampler* sampler, const struct mtr_package* package, const char* path) {
+    FILE* file = fopen(path, "wb");
+    if (file == NULL) {
+        MTR_LOG_ERROR("Unable to write samples to %s", path);
+        return false;
+    }
+
+    struct mtr_function_names names;
+    mtr_init_function_names(&names, package);
+
+    const struct mtr_sample_node* stack[MTR_SAMPLE_DEPTH];
+    for (const struct mtr_sample_node* main = sampler->root->child; main; main = main->next) {
+        stack[0] = main;
+        write_stacks(file, &names, stack, 1);
+    }
+    mtr_delete_function_names(&names);
+
+    const bool ok = fclose(file) == 0;
+    if (!ok) {
+        MTR_LOG_ERROR("Unable to write samples to %s", path);
+    }
+    return ok;
+}
@@ -0,0 +1,49 @@
+#ifndef MTR_SAMPLER_H
+#define MTR_SAMPLER_H
+
+#include "package.h"
+
+#include "core/types.h"
+
+#include <signal.h>
+
+// Where a running script spends its time (see mtr_execute_with_sampler). The engine keeps what every
+// frame runs and looks at each call and backward jump whether a sample is due, which a cpu time
+// timer (SIGPROF) says. Without a timer every MTR_SAMPLE_PERIOD-th look takes one, which counts
+// loops and calls rather than time but is the same on every run. Time in natives goes to the
+// function that called them and every closure is '<closure>'.
+
+// frames of a sample, deeper ones are left out
+#define MTR_SAMPLE_DEPTH 128
+
+// calls and backward jumps between samples without a timer
+#define MTR_SAMPLE_PERIOD 1024
+
+struct mtr_sample_node;
+
+struct mtr_sampler {
+    const struct mtr_object* stack[MTR_SAMPLE_DEPTH]; // what each frame runs, kept by the engine
+    struct mtr_sample_node* root;
+    u64 samples;
+    u32 interval; // microseconds of cpu time between samples, 0 counts calls and jumps instead
+    u32 countdown;
+    volatile sig_atomic_t due; // set by the timer
+};
+
+// the timer isn't available on Windows, interval is ignored there
+void mtr_init_sampler(struct mtr_sampler* sampler, u32 interval);
+void mtr_delete_sampler(struct mtr_sampler* sampler);
+
+// The timer runs in between, only one sampler can use it at a time. Done by the engine
+void mtr_start_sampler(struct mtr_sampler* sampler);
+void mtr_stop_sampler(struct mtr_sampler* sampler);
+
+// adds a sample of the frames from main down to depth
+void mtr_take_sample(struct mtr_sampler* sampler, u32 depth);
+
+// Writes a line per stack that was sampled, with the functions from main down and the number of samples:
+// 'main;process;parse 1234', like flame graph tools expect. Functions are named by the symbols of the
+// package and its modules, so the source they were compiled from has to be around
+bool mtr_write_samples(const struct mtr_sampler* sampler, const struct mtr_package* package, const char* path);
+
+#endif
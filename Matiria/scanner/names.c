@@ -0,0 +1,72 @@
+#include "names.h"
+
+#include "core/utils.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+struct name_entry {
+    const char* start;
+    u32 length;
+    u32 hash;
+    u32 id; // MTR_NO_NAME for empty entries
+};
+
+void mtr_init_names(struct mtr_names* names) {
+    names->capacity = 256;
+    names->count = 0;
+    names->entries = calloc(names->capacity, sizeof(struct name_entry));
+}
+
+void mtr_delete_names(struct mtr_names* names) {
+    free(names->entries);
+    names->entries = NULL;
+    names->capacity = 0;
+    names->count = 0;
+}
+
+static struct name_entry* find_entry(struct name_entry* entries, u32 capacity, const char* start, u32 length, u32 hash) {
+    u32 index = hash & (capacity - 1);
+    struct name_entry* entry = entries + index;
+    while (entry->id != MTR_NO_NAME) {
+        if (entry->hash == hash && entry->length == length && memcmp(entry->start, start, length) == 0) {
+            break;
+        }
+        index = (index + 1) & (capacity - 1);
+        entry = entries + index;
+    }
+    return entry;
+}
+
+static void grow(struct mtr_names* names) {
+    u32 capacity = names->capacity * 2;
+    struct name_entry* entries = calloc(capacity, sizeof(struct name_entry));
+    for (u32 i = 0; i < names->capacity; ++i) {
+        struct name_entry* old = names->entries + i;
+        if (old->id != MTR_NO_NAME) {
+            *find_entry(entries, capacity, old->start, old->length, old->hash) = *old;
+        }
+    }
+    free(names->entries);
+    names->entries = entries;
+    names->capacity = capacity;
+}
+
+u32 mtr_intern(struct mtr_names* names, const char* start, u32 length) {
+    const u32 h = hash(start, length);
+    struct name_entry* entry = find_entry(names->entries, names->capacity, start, length, h);
+    if (entry->id != MTR_NO_NAME) {
+        return entry->id;
+    }
+
+    entry->start = start;
+    entry->length = length;
+    entry->hash = h;
+    entry->id = ++names->count;
+
+    // load factor of 1/2
+    if (names->count * 2 >= names->capacity) {
+        grow(names);
+    }
+    return names->count;
+}
@@ -0,0 +1,23 @@
+#ifndef MTR_NAMES_H
+#define MTR_NAMES_H
+
+#include "core/types.h"
+
+// Interns identifiers. Every distinct identifier of a source gets an id, starting at 1,
+// so later stages can compare and look up names without touching their characters.
+// The table only points into the source, it doesn't copy it.
+
+#define MTR_NO_NAME 0
+
+struct mtr_names {
+    struct name_entry* entries;
+    u32 count; // ids in use are 1 to count
+    u32 capacity;
+};
+
+void mtr_init_names(struct mtr_names* names);
+void mtr_delete_names(struct mtr_names* names);
+
+u32 mtr_intern(struct mtr_names* names, const char* start, u32 length);
+
+#endif
@@ -1,12 +1,22 @@
 #include "scanner.h"
 #include "scanner/token.h"
 
+#include "core/types.h"
+
 #include <string.h>
 
+#if defined(__AVX2__)
+#   include <immintrin.h>
+#elif defined(__SSE2__) || defined(_M_X64)
+#   include <emmintrin.h>
+#endif
+
 void mtr_scanner_init(struct mtr_scanner* scanner, const char* source) {
     scanner->source = source;
     scanner->current = source;
     scanner->start = source;
+    scanner->end = source + strlen(source);
+    scanner->names = NULL;
 }
 
 struct keyword_entry {
@@ -15,32 +25,46 @@ struct keyword_entry {
     const size_t str_len;
 };
 
-#define FIRST_KEYWORD MTR_TOKEN_ANY
-#define LAST_KEYWORD  MTR_TOKEN_STRING
-#define KEYWORD_COUNT LAST_KEYWORD - FIRST_KEYWORD + 1
-
-// once I have all of the keywords dialed in I will remove this
-static const struct keyword_entry keywords[KEYWORD_COUNT] = {
-    { .type = MTR_TOKEN_ANY,    .str = "Any",    .str_len = strlen("Any")    },
-    { .type = MTR_TOKEN_TYPE,   .str = "type",   .str_len = strlen("type")   },
-    { .type = MTR_TOKEN_IF,     .str = "if",     .str_len = strlen("if")     },
-    { .type = MTR_TOKEN_ELSE,   .str = "else",   .str_len = strlen("else")   },
-    { .type = MTR_TOKEN_TRUE,   .str = "true",   .str_len = strlen("true")   },
-    { .type = MTR_TOKEN_FALSE,  .str = "false",  .str_len = strlen("false")  },
-    { .type = MTR_TOKEN_FN,     .str = "fn",     .str_len = strlen("fn")     },
-    { .type = MTR_TOKEN_RETURN, .str = "return", .str_len = strlen("return") },
-    { .type = MTR_TOKEN_WHILE,  .str = "while",  .str_len = strlen("while")  },
-    { .type = MTR_TOKEN_FOR,    .str = "for",    .str_len = strlen("for")    },
-    { .type = MTR_TOKEN_INT,    .str = "Int",    .str_len = strlen("Int")    },
-    { .type = MTR_TOKEN_FLOAT,  .str = "Float",  .str_len = strlen("Float")  },
-    { .type = MTR_TOKEN_BOOL,   .str = "Bool",   .str_len = strlen("Bool")   },
-    { .type = MTR_TOKEN_STRING, .str = "String", .str_len = strlen("String") }
+// Keywords are found with a perfect hash over the length and the first two characters.
+// The multipliers were searched for offline so that no two keywords collide, adding a
+// keyword means searching again (and growing the table if nothing fits).
+#define KEYWORD_MIN_LENGTH 2
+#define KEYWORD_MAX_LENGTH 6
+#define KEYWORD_TABLE_SIZE 32
+
+static inline u32 keyword_hash(const char* start, size_t length) {
+    return (u32) (length + (u8) start[0] * 5 + (u8) start[1] * 13) & (KEYWORD_TABLE_SIZE - 1);
+}
+
+#define KEYWORD(t, s) { .type = t, .str = s, .str_len = sizeof(s) - 1 }
+
+static const struct keyword_entry keywords[KEYWORD_TABLE_SIZE] = {
+    [0]  = KEYWORD(MTR_TOKEN_WHILE,  "while"),
+    [1]  = KEYWORD(MTR_TOKEN_RETURN, "return"),
+    [4]  = KEYWORD(MTR_TOKEN_FOR,    "for"),
+    [5]  = KEYWORD(MTR_TOKEN_IN,     "in"),
+    [6]  = KEYWORD(MTR_TOKEN_INT,    "Int"),
+    [9]  = KEYWORD(MTR_TOKEN_STRING, "String"),
+    [13] = KEYWORD(MTR_TOKEN_TYPE,   "type"),
+    [16] = KEYWORD(MTR_TOKEN_FALSE,  "false"),
+    [17] = KEYWORD(MTR_TOKEN_BOOL,   "Bool"),
+    [18] = KEYWORD(MTR_TOKEN_TRUE,   "true"),
+    [19] = KEYWORD(MTR_TOKEN_MATCH,  "match"),
+    [22] = KEYWORD(MTR_TOKEN_FN,     "fn"),
+    [25] = KEYWORD(MTR_TOKEN_ELSE,   "else"),
+    [28] = KEYWORD(MTR_TOKEN_IMPORT, "import"),
+    [29] = KEYWORD(MTR_TOKEN_IF,     "if"),
+    [30] = KEYWORD(MTR_TOKEN_ANY,    "Any"),
+    [31] = KEYWORD(MTR_TOKEN_FLOAT,  "Float"),
 };
 
+#undef KEYWORD
+
 const struct mtr_token invalid_token = {
     .type = MTR_TOKEN_INVALID,
     .start = NULL,
-    .length = 0
+    .length = 0,
+    .id = MTR_NO_NAME
 };
 
 static bool is_numeric(char c);
@@ -62,6 +86,10 @@ struct mtr_token mtr_next_token(struct mtr_scanner* scanner) {
 
     scanner->start = scanner->current;
 
+    if (scanner->current == scanner->end) {
+        return make_token(scanner, MTR_TOKEN_EOF);
+    }
+
     char c_ = advance(scanner);
     char current = *scanner->current;
 
@@ -102,7 +130,7 @@ struct mtr_token mtr_next_token(struct mtr_scanner* scanner) {
                 advance(scanner);
                 return make_token(scanner, MTR_TOKEN_ELLIPSIS);
             }
-            return invalid_token;
+            return make_token(scanner, MTR_TOKEN_DOUBLE_DOT);
         }
         return make_token(scanner, MTR_TOKEN_DOT);
     }
@@ -176,9 +204,6 @@ struct mtr_token mtr_next_token(struct mtr_scanner* scanner) {
     case '_':
         return scan_identifier(scanner);
 
-    case '\0':
-        return make_token(scanner, MTR_TOKEN_EOF);
-
     }
 
     return make_token(scanner, MTR_TOKEN_INVALID);
@@ -200,9 +225,112 @@ static char advance(struct mtr_scanner* scanner) {
     return *(scanner->current++);
 }
 
+// Character classes are matched a whole vector at a time. Each *_mask function sets
+// bit i when byte i belongs to the class, the scan stops at the first clear bit.
+// Vectors are only loaded while they fit before the terminator, the tail is scalar.
+#if defined(__AVX2__)
+
+#define VECTOR_SIZE 32
+#define FULL_MASK   0xFFFFFFFFu
+
+typedef __m256i vector;
+
+static inline vector load(const char* c) { return _mm256_loadu_si256((const __m256i*) c); }
+static inline vector splat(char c) { return _mm256_set1_epi8(c); }
+static inline vector eq(vector a, char c) { return _mm256_cmpeq_epi8(a, splat(c)); }
+static inline vector either(vector a, vector b) { return _mm256_or_si256(a, b); }
+static inline vector both(vector a, vector b) { return _mm256_and_si256(a, b); }
+static inline vector gt(vector a, char c) { return _mm256_cmpgt_epi8(a, splat(c)); }
+static inline vector lt(vector a, char c) { return _mm256_cmpgt_epi8(splat(c), a); }
+static inline u32 mask(vector a) { return (u32) _mm256_movemask_epi8(a); }
+
+#elif defined(__SSE2__) || defined(_M_X64)
+
+#define VECTOR_SIZE 16
+#define FULL_MASK   0xFFFFu
+
+typedef __m128i vector;
+
+static inline vector load(const char* c) { return _mm_loadu_si128((const __m128i*) c); }
+static inline vector splat(char c) { return _mm_set1_epi8(c); }
+static inline vector eq(vector a, char c) { return _mm_cmpeq_epi8(a, splat(c)); }
+static inline vector either(vector a, vector b) { return _mm_or_si128(a, b); }
+static inline vector both(vector a, vector b) { return _mm_and_si128(a, b); }
+static inline vector gt(vector a, char c) { return _mm_cmpgt_epi8(a, splat(c)); }
+static inline vector lt(vector a, char c) { return _mm_cmpgt_epi8(splat(c), a); }
+static inline u32 mask(vector a) { return (u32) _mm_movemask_epi8(a); }
+
+#endif
+
+#ifdef VECTOR_SIZE
+
+// Signed compares are fine here, bytes >= 0x80 are negative and fall outside every range.
+static inline vector in_range(vector a, char lo, char hi) {
+    return both(gt(a, lo - 1), lt(a, hi + 1));
+}
+
+static inline u32 whitespace_mask(vector v) {
+    return mask(either(either(eq(v, ' '), eq(v, '\t')), either(eq(v, '\r'), eq(v, '\n'))));
+}
+
+static inline u32 numeric_mask(vector v) {
+    return mask(in_range(v, '0', '9'));
+}
+
+static inline u32 alphanumeric_mask(vector v) {
+    vector lower = either(v, splat(0x20));
+    return mask(either(either(in_range(lower, 'a', 'z'), in_range(v, '0', '9')), eq(v, '_')));
+}
+
+// everything up to the closing quote
+static inline u32 string_mask(vector v) {
+    return ~mask(eq(v, '\''));
+}
+
+static inline u32 comment_mask(vector v) {
+    return ~mask(eq(v, '\n'));
+}
+
+// everything that can't open or close a block
+static inline u32 block_mask(vector v) {
+    return ~mask(either(either(eq(v, '{'), eq(v, '}')), either(eq(v, '\''), eq(v, '#'))));
+}
+
+#if defined(_MSC_VER)
+#   include <intrin.h>
+static inline u32 first_clear(u32 m) { unsigned long i; _BitScanForward(&i, ~m); return (u32) i; }
+#else
+static inline u32 first_clear(u32 m) { return (u32) __builtin_ctz(~m); }
+#endif
+
+#define SKIP_VECTORS(c, end, class_mask)                       \
+    while ((end) - (c) >= VECTOR_SIZE) {                      \
+        u32 m = class_mask(load(c)) & FULL_MASK;              \
+        if (m != FULL_MASK) {                                 \
+            (c) += first_clear(m);                            \
+            break;                                            \
+        }                                                     \
+        (c) += VECTOR_SIZE;                                   \
+    }
+
+#else
+
+#define SKIP_VECTORS(c, end, class_mask)
+
+#endif
+
+static bool is_whitespace(char c) {
+    return c == ' ' || c == '\t' || c == '\r' || c == '\n';
+}
+
 static void skip_whitespace(struct mtr_scanner* scanner) {
     const char* c = scanner->current;
-    while(*c == ' ' || *c == '\t' || *c == '\r' || *c == '\n')
+    const char* end = scanner->end;
+    // most runs are a single space, only go wide for indentation and blank lines
+    if (c + 1 < end && is_whitespace(c[0]) && is_whitespace(c[1])) {
+        SKIP_VECTORS(c, end, whitespace_mask);
+    }
+    while (c < end && is_whitespace(*c))
         c++;
     scanner->current = c;
 }
@@ -211,55 +339,131 @@ static struct mtr_token make_token(const struct mtr_scanner* scanner, enum mtr_t
     struct mtr_token t = {
         .type = type,
         .start = scanner->start,
-        .length = scanner->current - scanner->start
+        .length = scanner->current - scanner->start,
+        .id = MTR_NO_NAME
     };
     return t;
 }
 
 static struct mtr_token scan_string(struct mtr_scanner* scanner) {
-    while (*scanner->current != '\'')
-        advance(scanner);
-    advance(scanner); // closing "
+    const char* c = scanner->current;
+    const char* end = scanner->end;
+    SKIP_VECTORS(c, end, string_mask);
+    while (c < end && *c != '\'')
+        c++;
+    scanner->current = c;
+
+    if (c == end) {
+        return make_token(scanner, MTR_TOKEN_INVALID); // unterminated
+    }
+    advance(scanner); // closing '
     return make_token(scanner, MTR_TOKEN_STRING_LITERAL);
 }
 
+// Most identifiers and numbers are short, only go wide once a token is longer than
+// SHORT_TOKEN bytes
+#define SHORT_TOKEN 8
+
+static const char* skip_numeric(const char* c, const char* end) {
+    const char* short_end = c + SHORT_TOKEN;
+    while (c < short_end && is_numeric(*c))
+        c++;
+    if (c == short_end) {
+        SKIP_VECTORS(c, end, numeric_mask);
+    }
+    while (is_numeric(*c))
+        c++;
+    return c;
+}
+
 static struct mtr_token scan_number(struct mtr_scanner* scanner) {
-    while (is_numeric(*scanner->current))
-        advance(scanner);
+    scanner->current = skip_numeric(scanner->current, scanner->end);
 
     if (*scanner->current == '.' && is_numeric(*(scanner->current + 1))) {
         advance(scanner);
-        while (is_numeric(*scanner->current))
-            advance(scanner);
+        scanner->current = skip_numeric(scanner->current, scanner->end);
         return make_token(scanner, MTR_TOKEN_FLOAT_LITERAL);
     }
 
     return make_token(scanner, MTR_TOKEN_INT_LITERAL);
 }
 
-static bool check_keyword(const char* start, const char* end, const struct keyword_entry k) {
-    return (size_t) (end - start) == k.str_len && memcmp(k.str, start, k.str_len) == 0;
+static enum mtr_token_type identifier_type(const char* start, size_t length) {
+    if (length < KEYWORD_MIN_LENGTH || length > KEYWORD_MAX_LENGTH) {
+        return MTR_TOKEN_IDENTIFIER;
+    }
+
+    const struct keyword_entry* k = keywords + keyword_hash(start, length);
+    if (k->str_len == length && memcmp(k->str, start, length) == 0) {
+        return k->type;
+    }
+    return MTR_TOKEN_IDENTIFIER;
 }
 
 static struct mtr_token scan_identifier(struct mtr_scanner* scanner) {
-    while (is_alphanumeric(*scanner->current))
-        advance(scanner);
-
-    for (int i = 0; i < KEYWORD_COUNT; ++i) {
-        const struct keyword_entry k = keywords[i];
-        if (check_keyword(scanner->start, scanner->current, k))
-            return make_token(scanner, k.type);
+    const char* c = scanner->current;
+    const char* short_end = c + SHORT_TOKEN;
+    while (c < short_end && is_alphanumeric(*c))
+        c++;
+    if (c == short_end) {
+        SKIP_VECTORS(c, scanner->end, alphanumeric_mask);
     }
+    while (is_alphanumeric(*c))
+        c++;
+    scanner->current = c;
 
-    return make_token(scanner, MTR_TOKEN_IDENTIFIER);
+    struct mtr_token token = make_token(scanner, identifier_type(scanner->start, scanner->current - scanner->start));
+    if (token.type == MTR_TOKEN_IDENTIFIER && scanner->names) {
+        token.id = mtr_intern(scanner->names, token.start, token.length);
+    }
+    return token;
 }
 
 static struct mtr_token scan_comment(struct mtr_scanner* scanner) {
-    while (*scanner->current != '\n')
-        advance(scanner);
+    const char* c = scanner->current;
+    const char* end = scanner->end;
+    SKIP_VECTORS(c, end, comment_mask);
+    while (c < end && *c != '\n')
+        c++;
+    scanner->current = c;
     return make_token(scanner, MTR_TOKEN_COMMENT);
 }
 
+bool mtr_skip_block(struct mtr_scanner* scanner) {
+    const char* c = scanner->current;
+    const char* end = scanner->end;
+    size_t depth = 1;
+    while (c < end) {
+        SKIP_VECTORS(c, end, block_mask);
+        switch (*c++) {
+        case '{':
+            depth++;
+            break;
+        case '}':
+            if (--depth == 0) {
+                scanner->current = c;
+                return true;
+            }
+            break;
+        case '\'':
+            SKIP_VECTORS(c, end, string_mask);
+            while (c < end && *c != '\'')
+                c++;
+            c += c < end;
+            break;
+        case '#':
+            SKIP_VECTORS(c, end, comment_mask);
+            while (c < end && *c != '\n')
+                c++;
+            break;
+        default:
+            break;
+        }
+    }
+    scanner->current = end;
+    return false;
+}
+
 bool mtr_token_compare(struct mtr_token t1, struct mtr_token t2) {
     bool same_type = t1.type == t2.type;
     return same_type && t1.length == t2.length && memcmp(t1.start, t2.start, t1.length) == 0;
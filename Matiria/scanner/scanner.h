@@ -2,15 +2,22 @@
 #define MTR_SCANNER_H
 
 #include "token.h"
+#include "names.h"
 
 struct mtr_scanner {
     const char* source;
     const char* start;
     const char* current;
+    const char* end; // the terminating '\0'
+    struct mtr_names* names; // identifiers are interned here when set
 };
 
 void mtr_scanner_init(struct mtr_scanner* scanner, const char* source);
 
 struct mtr_token mtr_next_token(struct mtr_scanner* scanner);
 
+// Moves past the '}' that closes the block opened by the last token. Only strings and comments
+// are looked into, for braces that don't count. False if the block is never closed
+bool mtr_skip_block(struct mtr_scanner* scanner);
+
 #endif
@@ -20,6 +20,7 @@ enum mtr_token_type {
     MTR_TOKEN_ARROW,
     MTR_TOKEN_BANG_EQUAL, MTR_TOKEN_EQUAL, MTR_TOKEN_GREATER_EQUAL, MTR_TOKEN_LESS_EQUAL,
     MTR_TOKEN_DOUBLE_SLASH,
+    MTR_TOKEN_DOUBLE_DOT,
 
     MTR_TOKEN_ELLIPSIS,
 
@@ -33,7 +34,9 @@ enum mtr_token_type {
     MTR_TOKEN_TRUE, MTR_TOKEN_FALSE,
     MTR_TOKEN_FN,
     MTR_TOKEN_RETURN,
-    MTR_TOKEN_WHILE, MTR_TOKEN_FOR,
+    MTR_TOKEN_WHILE, MTR_TOKEN_FOR, MTR_TOKEN_IN,
+    MTR_TOKEN_MATCH,
+    MTR_TOKEN_IMPORT,
 
     // types
     MTR_TOKEN_INT,
@@ -52,6 +55,7 @@ struct mtr_token {
     enum mtr_token_type type;
     const char* start;
     u32 length;
+    u32 id; // interned name of identifiers (see names.h), MTR_NO_NAME for everything else
 };
 
 bool mtr_token_compare(struct mtr_token t1, struct mtr_token t2);
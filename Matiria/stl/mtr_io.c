@@ -87,6 +87,7 @@ static void print_value(mtr_value value) {
             break;
         }
         case MTR_OBJ_FUNCTION:
+        case MTR_OBJ_STUB:
         case MTR_OBJ_NATIVE_FN:
             MTR_PRINT("%s", mtr_obj_type_to_str(value.object));
         case MTR_OBJ_STRUCT:
@@ -0,0 +1,101 @@
+#ifndef _WIN32
+#   define _XOPEN_SOURCE 700
+#endif
+
+#include "timeline.h"
+
+#include "runtime/object.h"
+
+#include "core/clock.h"
+#include "core/log.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#ifdef _OPENMP
+#   include <omp.h>
+#endif
+
+void mtr_init_timeline(struct mtr_timeline* timeline) {
+    timeline->events = NULL;
+    timeline->count = 0;
+    timeline->capacity = 0;
+    timeline->origin = mtr_clock_ns();
+}
+
+void mtr_delete_timeline(struct mtr_timeline* timeline) {
+    free(timeline->events);
+    timeline->events = NULL;
+    timeline->count = 0;
+    timeline->capacity = 0;
+}
+
+u64 mtr_timeline_now(const struct mtr_timeline* timeline) {
+    return timeline ? mtr_clock_ns() - timeline->origin : 0;
+}
+
+static void add(struct mtr_timeline* timeline, struct mtr_timeline_event event) {
+    event.duration = mtr_timeline_now(timeline) - event.start;
+#ifdef _OPENMP
+    event.thread = (u32) omp_get_thread_num();
+#else
+    event.thread = 0;
+#endif
+
+    #pragma omp critical (mtr_timeline)
+    {
+        if (timeline->count == timeline->capacity) {
+            timeline->capacity = timeline->capacity == 0 ? 256 : timeline->capacity * 2;
+            timeline->events = realloc(timeline->events, sizeof(struct mtr_timeline_event) * timeline->capacity);
+        }
+        timeline->events[timeline->count++] = event;
+    }
+}
+
+void mtr_timeline_span(struct mtr_timeline* timeline, const char* category, const char* name, u32 length, u64 start) {
+    add(timeline, (struct mtr_timeline_event) { .category = category, .name = name, .length = length, .start = start });
+}
+
+void mtr_timeline_call(struct mtr_timeline* timeline, const void* object, u8 type, u64 start) {
+    add(timeline, (struct mtr_timeline_event) { .category = "run", .object = object, .type = type, .start = start });
+}
+
+void mtr_timeline_phase(struct mtr_timeline* timeline, const char* category, const char* name, u64 start) {
+    if (timeline) {
+        mtr_timeline_span(timeline, category, name, (u32) strlen(name), start);
+    }
+}
+
+bool mtr_write_timeline(const struct mtr_timeline* timeline, const struct mtr_package* package, const char* path) {
+    FILE* file = fopen(path, "wb");
+    if (file == NULL) {
+        MTR_LOG_ERROR("Unable to write timeline to %s", path);
+        return false;
+    }
+
+    struct mtr_function_names names;
+    mtr_init_function_names(&names, package);
+
+    // complete events in microseconds. Spans are named by phases and identifiers, like the functions
+    fputs("{\"displayTimeUnit\": \"ms\", \"traceEvents\": [\n", file);
+    for (size_t i = 0; i < timeline->count; ++i) {
+        const struct mtr_timeline_event* e = timeline->events + i;
+        fputs("    {\"name\": ", file);
+        if (e->name) {
+            fprintf(file, "\"%.*s\"", (int) e->length, e->name);
+        } else {
+            mtr_write_json_function_name(file, &names, e->object, e->type);
+        }
+        fprintf(file, ", \"cat\": \"%s\", \"ph\": \"X\", \"ts\": %.3f, \"dur\": %.3f, \"pid\": 1, \"tid\": %u}%s\n", e->category,
+            (double) e->start / 1e3, (double) e->duration / 1e3, e->thread, i + 1 < timeline->count ? "," : "");
+    }
+    fputs("]}\n", file);
+    mtr_delete_function_names(&names);
+
+    const bool ok = fclose(file) == 0;
+    if (!ok) {
+        MTR_LOG_ERROR("Unable to write timeline to %s", path);
+    }
+    return ok;
+}
@@ -0,0 +1,48 @@
+#ifndef MTR_TIMELINE_H
+#define MTR_TIMELINE_H
+
+#include "package.h"
+
+#include "core/types.h"
+
+// When the phases of a compile and a run happened, to see where the time before a script starts
+// goes and where it stops while it runs. Written as Chrome trace events, which chrome://tracing and
+// Perfetto show as a timeline with a row per thread. Compiling records the phases when the options
+// have a timeline, running records the calls main makes and collecting the objects at the end.
+
+struct mtr_timeline_event {
+    const char* category;
+    const char* name; // NULL for calls, which are named by object
+    u32 length;
+    const void* object; // called
+    u8 type; // enum mtr_obj_type of object
+    u32 thread;
+    u64 start; // nanoseconds since the timeline started
+    u64 duration;
+};
+
+struct mtr_timeline {
+    struct mtr_timeline_event* events;
+    size_t count;
+    size_t capacity;
+    u64 origin;
+};
+
+void mtr_init_timeline(struct mtr_timeline* timeline);
+void mtr_delete_timeline(struct mtr_timeline* timeline);
+
+// nanoseconds since the timeline started, 0 without one
+u64 mtr_timeline_now(const struct mtr_timeline* timeline);
+
+// Adds what ran from start until now on the calling thread. name isn't copied, the names of
+// functions point into their source. Can be called from several threads at once
+void mtr_timeline_span(struct mtr_timeline* timeline, const char* category, const char* name, u32 length, u64 start);
+void mtr_timeline_call(struct mtr_timeline* timeline, const void* object, u8 type, u64 start);
+
+// a span named by a string constant, for the phases of a launch or a compile. Does nothing without a timeline
+void mtr_timeline_phase(struct mtr_timeline* timeline, const char* category, const char* name, u64 start);
+
+// Functions are named by the symbols of the package and its modules, so the sources have to be around
+bool mtr_write_timeline(const struct mtr_timeline* timeline, const struct mtr_package* package, const char* path);
+
+#endif
@@ -0,0 +1,208 @@
+#ifndef _WIN32
+#   define _XOPEN_SOURCE 700
+#endif
+
+#include "tracer.h"
+
+#include "runtime/object.h"
+
+#include "core/clock.h"
+#include "core/log.h"
+#include "core/utils.h"
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+void mtr_init_tracer(struct mtr_tracer* tracer) {
+    tracer->entries = NULL;
+    tracer->count = 0;
+    tracer->capacity = 0;
+    tracer->slots = NULL;
+    tracer->slot_count = 0;
+    tracer->frames = NULL;
+    tracer->depth = 0;
+    tracer->frame_capacity = 0;
+}
+
+void mtr_delete_tracer(struct mtr_tracer* tracer) {
+    free(tracer->entries);
+    free(tracer->slots);
+    free(tracer->frames);
+    mtr_init_tracer(tracer);
+}
+
+static u32* find_slot(u32* slots, u32 slot_count, const struct mtr_trace_entry* entries, const void* key) {
+    u32 i = (u32) hash64(&key, sizeof(key), MTR_HASH64_SEED) & (slot_count - 1);
+    while (slots[i] != 0 && entries[slots[i] - 1].key != key) {
+        i = (i + 1) & (slot_count - 1);
+    }
+    return slots + i;
+}
+
+static void grow(struct mtr_tracer* tracer) {
+    const u32 slot_count = tracer->slot_count == 0 ? 64 : tracer->slot_count * 2;
+    u32* slots = calloc(slot_count, sizeof(u32));
+    for (u32 i = 0; i < tracer->count; ++i) {
+        *find_slot(slots, slot_count, tracer->entries, tracer->entries[i].key) = i + 1;
+    }
+    free(tracer->slots);
+    tracer->slots = slots;
+    tracer->slot_count = slot_count;
+}
+
+static u32 entry_of(struct mtr_tracer* tracer, const void* key, u8 type) {
+    if (tracer->count + 1 > tracer->slot_count / 2) {
+        grow(tracer);
+    }
+
+    u32* slot = find_slot(tracer->slots, tracer->slot_count, tracer->entries, key);
+    if (*slot != 0) {
+        return *slot - 1;
+    }
+
+    if (tracer->count == tracer->capacity) {
+        tracer->capacity = tracer->capacity == 0 ? 32 : tracer->capacity * 2;
+        tracer->entries = realloc(tracer->entries, sizeof(struct mtr_trace_entry) * tracer->capacity);
+    }
+    tracer->entries[tracer->count] = (struct mtr_trace_entry) { .key = key, .type = type };
+    *slot = ++tracer->count;
+    return *slot - 1;
+}
+
+void mtr_trace_enter(struct mtr_tracer* tracer, const void* key, u8 type) {
+    const u32 entry = entry_of(tracer, key, type);
+    tracer->entries[entry].calls++;
+    tracer->entries[entry].active++;
+
+    if (tracer->depth == tracer->frame_capacity) {
+        tracer->frame_capacity = tracer->frame_capacity == 0 ? 64 : tracer->frame_capacity * 2;
+        tracer->frames = realloc(tracer->frames, sizeof(struct mtr_trace_frame) * tracer->frame_capacity);
+    }
+    tracer->frames[tracer->depth++] = (struct mtr_trace_frame) { entry, mtr_clock_ns(), 0 };
+}
+
+void mtr_trace_exit(struct mtr_tracer* tracer) {
+    const struct mtr_trace_frame* frame = tracer->frames + --tracer->depth;
+    const u64 elapsed = mtr_clock_ns() - frame->start;
+    struct mtr_trace_entry* entry = tracer->entries + frame->entry;
+    entry->exclusive += elapsed - frame->children;
+    // the outermost of recursive calls already counts the inner ones
+    if (--entry->active == 0) {
+        entry->inclusive += elapsed;
+    }
+
+    if (tracer->depth > 0) {
+        tracer->frames[tracer->depth - 1].children += elapsed;
+    }
+}
+
+const struct mtr_trace_entry* mtr_trace_get(const struct mtr_tracer* tracer, const void* key) {
+    if (tracer->count == 0) {
+        return NULL;
+    }
+
+    const u32 slot = *find_slot(tracer->slots, tracer->slot_count, tracer->entries, key);
+    return slot ? tracer->entries + slot - 1 : NULL;
+}
+
+static int by_exclusive(const void* a, const void* b) {
+    const u64 l = (*(const struct mtr_trace_entry* const*) a)->exclusive;
+    const u64 r = (*(const struct mtr_trace_entry* const*) b)->exclusive;
+    return (l < r) - (l > r);
+}
+
+// sorted pointers to the entries, freed by the caller
+static const struct mtr_trace_entry** sorted(const struct mtr_tracer* tracer) {
+    const struct mtr_trace_entry** entries = malloc(sizeof(struct mtr_trace_entry*) * (tracer->count + 1));
+    for (u32 i = 0; i < tracer->count; ++i) {
+        entries[i] = tracer->entries + i;
+    }
+    qsort(entries, tracer->count, sizeof(struct mtr_trace_entry*), by_exclusive);
+    return entries;
+}
+
+static const char* kind_of(const struct mtr_trace_entry* entry) {
+    switch (entry->type) {
+    case MTR_OBJ_CLOSURE:   return "closure";
+    case MTR_OBJ_NATIVE_FN: return "native";
+    default:
+        return "function";
+    }
+}
+
+static FILE* open_trace(const char* path) {
+    FILE* file = fopen(path, "wb");
+    if (file == NULL) {
+        MTR_LOG_ERROR("Unable to write trace to %s", path);
+    }
+    return file;
+}
+
+static bool close_trace(FILE* file, const char* path) {
+    const bool ok = fclose(file) == 0;
+    if (!ok) {
+        MTR_LOG_ERROR("Unable to write trace to %s", path);
+    }
+    return ok;
+}
+
+bool mtr_write_trace_table(const struct mtr_tracer* tracer, const struct mtr_package* package, const char* path) {
+    FILE* file = open_trace(path);
+    if (file == NULL) {
+        return false;
+    }
+
+    struct mtr_function_names names;
+    mtr_init_function_names(&names, package);
+    const struct mtr_trace_entry** entries = sorted(tracer);
+
+    u64 script = 0;
+    u64 natives = 0;
+    fprintf(file, "%12s %14s %14s %12s  %-8s %s\n", "calls", "inclusive ms", "exclusive ms", "us per call", "kind", "name");
+    for (u32 i = 0; i < tracer->count; ++i) {
+        const struct mtr_trace_entry* e = entries[i];
+        if (e->type == MTR_OBJ_NATIVE_FN) {
+            natives += e->exclusive;
+        } else {
+            script += e->exclusive;
+        }
+
+        fprintf(file, "%12llu %14.3f %14.3f %12.3f  %-8s ", (unsigned long long) e->calls, (double) e->inclusive / 1e6,
+            (double) e->exclusive / 1e6, e->calls ? (double) e->inclusive / 1e3 / (double) e->calls : 0.0, kind_of(e));
+        mtr_write_function_name(file, &names, e->key, e->type);
+        fputc('\n', file);
+    }
+    fprintf(file, "\nscript %.3f ms, natives %.3f ms\n", (double) script / 1e6, (double) natives / 1e6);
+
+    free(entries);
+    mtr_delete_function_names(&names);
+    return close_trace(file, path);
+}
+
+bool mtr_write_trace_json(const struct mtr_tracer* tracer, const struct mtr_package* package, const char* path) {
+    FILE* file = open_trace(path);
+    if (file == NULL) {
+        return false;
+    }
+
+    struct mtr_function_names names;
+    mtr_init_function_names(&names, package);
+    const struct mtr_trace_entry** entries = sorted(tracer);
+
+    fputs("[\n", file);
+    for (u32 i = 0; i < tracer->count; ++i) {
+        const struct mtr_trace_entry* e = entries[i];
+        fputs("    { \"name\": ", file);
+        mtr_write_json_function_name(file, &names, e->key, e->type);
+        fprintf(file, ", \"kind\": \"%s\", \"calls\": %llu, \"inclusive_ns\": %llu, \"exclusive_ns\": %llu }%s\n", kind_of(e),
+            (unsigned long long) e->calls, (unsigned long long) e->inclusive, (unsigned long long) e->exclusive,
+            i + 1 < tracer->count ? "," : "");
+    }
+    fputs("]\n", file);
+
+    free(entries);
+    mtr_delete_function_names(&names);
+    return close_trace(file, path);
+}
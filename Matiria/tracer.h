@@ -0,0 +1,57 @@
+#ifndef MTR_TRACER_H
+#define MTR_TRACER_H
+
+#include "package.h"
+
+#include "core/types.h"
+
+// How often every function is called and how long it runs (see mtr_execute_with_tracer), timed
+// on every call and return, which costs two reads of a monotonic clock and a lookup per call.
+// Inclusive time counts the functions called too, once for recursive calls. Exclusive time is
+// what is left without them. Natives are functions of their own so the time spent in the host
+// shows apart from the time of the script, closures are told apart by their code.
+
+struct mtr_trace_entry {
+    const void* key; // the function, native or the code of the closure
+    u64 calls;
+    u64 inclusive; // nanoseconds
+    u64 exclusive;
+    u32 active; // calls running now
+    u8 type; // enum mtr_obj_type of what was called
+};
+
+struct mtr_trace_frame {
+    u32 entry;
+    u64 start;
+    u64 children; // inclusive time of the calls made from the frame
+};
+
+struct mtr_tracer {
+    struct mtr_trace_entry* entries;
+    u32 count;
+    u32 capacity;
+    u32* slots; // open addressing into entries, + 1 so 0 is free
+    u32 slot_count;
+    struct mtr_trace_frame* frames;
+    u32 depth;
+    u32 frame_capacity;
+};
+
+void mtr_init_tracer(struct mtr_tracer* tracer);
+void mtr_delete_tracer(struct mtr_tracer* tracer);
+
+// done by the engine around every call. For closures key is their code
+void mtr_trace_enter(struct mtr_tracer* tracer, const void* key, u8 type);
+void mtr_trace_exit(struct mtr_tracer* tracer);
+
+// NULL if key wasn't called
+const struct mtr_trace_entry* mtr_trace_get(const struct mtr_tracer* tracer, const void* key);
+
+// A table of the functions, most exclusive time first, and the time in natives and in the script.
+// Functions are named by the symbols of the package and its modules
+bool mtr_write_trace_table(const struct mtr_tracer* tracer, const struct mtr_package* package, const char* path);
+
+// the same as a json array of { "name", "kind", "calls", "inclusive_ns", "exclusive_ns" }
+bool mtr_write_trace_json(const struct mtr_tracer* tracer, const struct mtr_package* package, const char* path);
+
+#endif
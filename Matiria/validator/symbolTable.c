@@ -107,6 +107,18 @@ void mtr_symbol_table_remove(const struct mtr_symbol_table* table, const char* k
     entry->length = strlen(tombstone);
 }
 
+struct mtr_symbol* mtr_symbol_table_next(const struct mtr_symbol_table* table, size_t* index) {
+    for (size_t i = *index; i < table->capacity; ++i) {
+        struct symbol_entry* entry = table->entries + i;
+        if (entry->key != NULL && entry->key != tombstone) {
+            *index = i + 1;
+            return &entry->symbol;
+        }
+    }
+    *index = table->capacity;
+    return NULL;
+}
+
 // void mtr_init_scope(struct mtr_scope* scope, struct mtr_scope* parent) {
 //     scope->parent = parent;
 //     mtr_init_symbol_table(&scope->symbols);
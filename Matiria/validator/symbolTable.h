@@ -16,4 +16,7 @@ void mtr_symbol_table_insert(struct mtr_symbol_table* table, const char* key, si
 struct mtr_symbol* mtr_symbol_table_get(const struct mtr_symbol_table* table, const char* key, size_t length);
 void mtr_symbol_table_remove(const struct mtr_symbol_table* table, const char* key, size_t length);
 
+// returns the first symbol at or after *index and moves *index past it. NULL when there are none left
+struct mtr_symbol* mtr_symbol_table_next(const struct mtr_symbol_table* table, size_t* index);
+
 #endif
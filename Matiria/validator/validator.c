@@ -2,7 +2,6 @@
 
 #include "AST/AST.h"
 #include "AST/symbol.h"
-#include "symbolTable.h"
 
 #include "core/report.h"
 #include "core/log.h"
@@ -11,37 +10,175 @@
 #include <stdlib.h>
 #include <string.h>
 
+#ifdef _OPENMP
+#   include <omp.h>
+#endif
+
+// Specializing a function more times than this is most likely a recursion that keeps creating new types
+#define MAX_SPECIALIZATIONS 16
+
+#define NOT_PLACED ((size_t) -1)
+
+struct specialization {
+    struct mtr_function_decl* generic;
+    struct mtr_type* type; // the interned function type with the concrete arguments
+    size_t index; // in the block, NOT_PLACED until the copy is appended and checked
+};
+
+// A call to a generic function found while the declared globals are checked in parallel
+struct pending_call {
+    struct mtr_primary* callee;
+    size_t specialization;
+};
+
+struct pending_calls {
+    struct pending_call* calls;
+    size_t count;
+    size_t capacity;
+};
+
+#define UNBOUND ((u32) -1)
+
+struct binding {
+    struct mtr_symbol symbol;
+    const struct validator* owner;
+    u32 shadowed; // the binding of the same name further out, UNBOUND if there is none
+};
+
+// Names in scope, innermost last. Scopes come and go in order so one flat stack holds all of
+// them, and innermost maps an interned name straight to the binding it resolves to.
+struct scopes {
+    u32* innermost; // indexed by name id
+    u32 names; // bodies parsed while streaming intern names after the scopes are made
+    struct binding* bindings;
+    u32 count;
+    u32 capacity;
+};
+
+static void init_scopes(struct scopes* scopes, u32 names) {
+    scopes->innermost = malloc(sizeof(u32) * names);
+    memset(scopes->innermost, 0xFF, sizeof(u32) * names);
+    scopes->names = names;
+    scopes->capacity = 64;
+    scopes->count = 0;
+    scopes->bindings = malloc(sizeof(struct binding) * scopes->capacity);
+}
+
+static void delete_scopes(struct scopes* scopes) {
+    free(scopes->innermost);
+    free(scopes->bindings);
+}
+
+static u32 innermost(const struct scopes* scopes, u32 name) {
+    return name < scopes->names ? scopes->innermost[name] : UNBOUND;
+}
+
+static void grow_names(struct scopes* scopes, u32 name) {
+    u32 names = scopes->names * 2 > name ? scopes->names * 2 : name + 1;
+    scopes->innermost = realloc(scopes->innermost, sizeof(u32) * names);
+    memset(scopes->innermost + scopes->names, 0xFF, sizeof(u32) * (names - scopes->names));
+    scopes->names = names;
+}
+
+// shared by every validator of an ast. Function bodies are checked on several threads, which only
+// register the specializations they call. Appending them to the block and checking them happens
+// on one thread afterwards
+struct globals {
+    struct mtr_block* block;
+    struct validator* root; // specializations are checked by it, so they land in the ast arena
+    struct mtr_function_decl** generics; // per declared global, NULL if it isn't a generic function
+    size_t declared;
+    struct specialization* specializations;
+    size_t count;
+    size_t capacity;
+    struct scopes global_scope; // read only once the globals are loaded
+    struct scopes* locals; // one stack per thread, shared by every body checked on it
+    u32 names;
+};
+
 struct validator {
-    struct mtr_symbol_table symbols;
+    struct scopes* scopes;
+    u32 mark; // bindings from here on are this validator's
+    u32 base; // and from here on belong to the global being checked
     size_t count;
     struct validator* enclosing;
     struct mtr_closure_decl* closure;
     struct mtr_type_list* type_list;
+    struct mtr_arena* arena;
+    struct globals* globals;
+    struct pending_calls* pending; // of the declared global being checked, NULL specializes right away
     const char* source;
 };
 
+static struct scopes* thread_scopes(struct globals* globals) {
+#ifdef _OPENMP
+    struct scopes* scopes = globals->locals + omp_get_thread_num();
+#else
+    struct scopes* scopes = globals->locals;
+#endif
+    if (scopes->innermost == NULL) {
+        init_scopes(scopes, globals->names);
+    }
+    return scopes;
+}
+
 static void init_validator(struct validator* validator, struct validator* enclosing) {
     validator->enclosing = enclosing;
     validator->closure = enclosing->closure;
-    mtr_init_symbol_table(&validator->symbols);
+    if (enclosing->enclosing == NULL) {
+        validator->scopes = thread_scopes(enclosing->globals);
+        validator->base = validator->scopes->count;
+    } else {
+        validator->scopes = enclosing->scopes;
+        validator->base = enclosing->base;
+    }
+    validator->mark = validator->scopes->count;
     validator->source = enclosing->source;
     validator->type_list = enclosing->type_list;
+    validator->arena = enclosing->arena;
+    validator->globals = enclosing->globals;
+    validator->pending = enclosing->pending;
 
     bool should_be_zero = enclosing == NULL || enclosing->enclosing == NULL;
     validator->count = should_be_zero ? 0 : enclosing->count;
 }
 
+// nodes made while validating go to the ast arena, which every thread shares
+static void* allocate(struct validator* validator, size_t size) {
+    void* memory;
+    #pragma omp critical (mtr_arena)
+    memory = mtr_arena_alloc(validator->arena, size);
+    return memory;
+}
+
+// drops the bindings of the validator, names go back to what they were bound to before
 static void delete_validator(struct validator* validator) {
-    mtr_delete_symbol_table(&validator->symbols);
+    struct scopes* scopes = validator->scopes;
+    while (scopes->count > validator->mark) {
+        const struct binding* b = scopes->bindings + --scopes->count;
+        scopes->innermost[b->symbol.token.id] = b->shadowed;
+    }
 }
 
-static struct mtr_symbol* find_symbol(const struct validator* validator, struct mtr_token token) {
-    struct mtr_symbol* s = mtr_symbol_table_get(&validator->symbols, token.start, token.length);
-    while (NULL == s && NULL != validator->enclosing) {
-        validator = validator->enclosing;
-        s = mtr_symbol_table_get(&validator->symbols, token.start, token.length);
+static struct binding* find_binding(const struct validator* validator, u32 name) {
+    const struct scopes* scopes = validator->scopes;
+    u32 b = innermost(scopes, name);
+    // below base are the locals of a global that is specializing a generic on this thread
+    if (b != UNBOUND && b >= validator->base) {
+        return scopes->bindings + b;
     }
-    return s;
+
+    const struct scopes* global = &validator->globals->global_scope;
+    if (scopes != global && (b = innermost(global, name)) != UNBOUND) {
+        return global->bindings + b;
+    }
+    return NULL;
+}
+
+static struct mtr_symbol* find_symbol(const struct validator* validator, struct mtr_token token) {
+    MTR_ASSERT(token.id != MTR_NO_NAME, "Name was not interned.");
+    struct binding* b = find_binding(validator, token.id);
+    return b ? &b->symbol : NULL;
 }
 
 static size_t add_symbol(struct validator* validator, struct mtr_symbol symbol) {
@@ -53,14 +190,30 @@ static size_t add_symbol(struct validator* validator, struct mtr_symbol symbol)
     symbol.index = validator->count++;
     symbol.is_global = validator->enclosing == NULL;
     symbol.upvalue = false;
-    mtr_symbol_table_insert(&validator->symbols, symbol.token.start, symbol.token.length, symbol);
+
+    struct scopes* scopes = validator->scopes;
+    if (scopes->count == scopes->capacity) {
+        scopes->capacity *= 2;
+        scopes->bindings = realloc(scopes->bindings, sizeof(struct binding) * scopes->capacity);
+    }
+
+    const u32 name = symbol.token.id;
+    if (name >= scopes->names) {
+        grow_names(scopes, name);
+    }
+
+    scopes->bindings[scopes->count] = (struct binding) {
+        .symbol = symbol,
+        .owner = validator,
+        .shadowed = scopes->innermost[name]
+    };
+    scopes->innermost[name] = scopes->count++;
     return symbol.index;
 }
 
 static size_t resolve_local(struct validator* validator, struct mtr_symbol symbol) {
-    struct mtr_token token = symbol.token;
-    struct mtr_symbol* s = mtr_symbol_table_get(&validator->symbols, token.start, token.length);
-    return s ? s->index : -1;
+    const struct binding* b = find_binding(validator, symbol.token.id);
+    return b && b->owner == validator ? b->symbol.index : (size_t) -1;
 }
 
 static size_t add_upvalue(struct validator* validator, struct mtr_symbol symbol, bool local) {
@@ -71,20 +224,22 @@ static size_t add_upvalue(struct validator* validator, struct mtr_symbol symbol,
     }
 
     if (closure->upvalues == NULL) {
-        closure->upvalues = malloc(sizeof(struct mtr_upvalue_symbol) * 8);
+        closure->upvalues = allocate(validator, sizeof(struct mtr_upvalue_symbol) * 8);
         closure->capacity = 8;
         closure->count = 0;
     }
 
     for (u8 i = 0; i < closure->count; ++i) {
-        if (mtr_token_compare(symbol.token, closure->upvalues[i].token)) {
+        if (symbol.token.id == closure->upvalues[i].token.id) {
             return i;
         }
     }
 
     if (closure->count == closure->capacity) {
+        struct mtr_upvalue_symbol* old = closure->upvalues;
+        closure->upvalues = allocate(validator, sizeof(struct mtr_upvalue_symbol) * closure->capacity * 2);
+        memcpy(closure->upvalues, old, sizeof(struct mtr_upvalue_symbol) * closure->capacity);
         closure->capacity *= 2;
-        closure->upvalues = realloc(closure->upvalues, sizeof(struct mtr_upvalue_symbol) * closure->capacity);
     }
 
     u16 index = closure->count++;
@@ -138,12 +293,7 @@ static bool check_assignemnt(const struct mtr_type* assign_to, const struct mtr_
 
     if (!mtr_type_match(assign_to, what)) {
         if (assign_to && assign_to->type == MTR_DATA_UNION) {
-            struct mtr_union_type* u = (struct mtr_union_type*) assign_to;
-            for (u8 i = 0; i < u->argc; ++i) {
-                if (mtr_type_match(u->types[i], what)) {
-                    return true;
-                }
-            }
+            return mtr_union_has_member((const struct mtr_union_type*) assign_to, what);
         }
 
         return false;
@@ -151,6 +301,39 @@ static bool check_assignemnt(const struct mtr_type* assign_to, const struct mtr_
     return true;
 }
 
+// returns the member index of 'type' in the union or -1
+static i32 variant_index(const struct mtr_union_type* u, const struct mtr_type* type) {
+    for (u16 i = 0; i < u->argc; ++i) {
+        if (u->types[i] == type) {
+            return i;
+        }
+    }
+
+    for (u16 i = 0; i < u->argc; ++i) {
+        if (mtr_type_match(u->types[i], type)) {
+            return i;
+        }
+    }
+    return -1;
+}
+
+// Values stored into a union remember which member they are so match can dispatch on it.
+// Call this after check_assignemnt succeeded.
+static struct mtr_expr* tag_variant(struct mtr_expr* expr, const struct mtr_type* to, const struct mtr_type* from, struct validator* validator) {
+    if (to->type != MTR_DATA_UNION || mtr_type_match(to, from)) {
+        return expr;
+    }
+
+    i32 index = variant_index((const struct mtr_union_type*) to, from);
+    MTR_ASSERT(index >= 0, "Value is not a member of the union.");
+
+    struct mtr_variant* variant = allocate(validator, sizeof(struct mtr_variant));
+    variant->expr_.type = MTR_EXPR_VARIANT;
+    variant->value = expr;
+    variant->tag = (u16) index;
+    return (struct mtr_expr*) variant;
+}
+
 static void expr_error(struct mtr_expr* expr, const char* message, const char* source) {
     switch (expr->type)
     {
@@ -199,7 +382,7 @@ static void expr_error(struct mtr_expr* expr, const char* message, const char* s
 }
 
 static struct mtr_type* get_operator_type(struct mtr_type_list* list, struct mtr_token op, const struct mtr_type* lhs, const struct mtr_type* rhs) {
-    struct mtr_type t;
+    struct mtr_type t = { .type = MTR_DATA_INVALID, .id = MTR_NO_TYPE_ID, .exact = false };
 
     switch (op.type)
     {
@@ -255,6 +438,17 @@ static struct mtr_type* analyze_binary(struct mtr_binary* expr, struct validator
     return  expr->operator.type;
 }
 
+// the declaration if the symbol names a generic script function
+static struct mtr_function_decl* get_generic(const struct validator* validator, const struct mtr_symbol* symbol) {
+    // specializations come after the declared globals and are never generic
+    if (!symbol->is_global || symbol->index >= validator->globals->declared) {
+        return NULL;
+    }
+
+    // other globals may be freed by other threads while this runs, generics are left alone
+    return validator->globals->generics[symbol->index];
+}
+
 static struct mtr_type* analyze_primary(struct mtr_primary* expr, struct validator* validator) {
     struct mtr_symbol* symbol = find_symbol(validator, expr->symbol.token);
 
@@ -263,6 +457,11 @@ static struct mtr_type* analyze_primary(struct mtr_primary* expr, struct validat
         return NULL;
     }
 
+    if (get_generic(validator, symbol)) {
+        mtr_report_error(expr->symbol.token, "Generic functions can only be called directly.", validator->source);
+        return NULL;
+    }
+
     expr->symbol.type = symbol->type;
     expr->symbol.index = symbol->index;
     expr->symbol.flags = symbol->flags;
@@ -339,6 +538,7 @@ static bool check_params(struct mtr_function_type* f, struct mtr_call* call, str
             expr_error(a, "Wrong type of argument.", validator->source);
             return false;
         }
+        call->argv[i] = tag_variant(a, to, from, validator);
     }
     return true;
 }
@@ -366,12 +566,168 @@ static struct mtr_type* function_call(struct mtr_call* call, struct mtr_type* ty
     return NULL;
 }
 
+// the slot of the specialization of generic for type, registered if there is none yet
+static size_t find_specialization(struct globals* globals, struct mtr_function_decl* generic, struct mtr_type* type) {
+    size_t slot = NOT_PLACED;
+    #pragma omp critical (mtr_specializations)
+    {
+        for (size_t i = 0; i < globals->count && slot == NOT_PLACED; ++i) {
+            const struct specialization* s = globals->specializations + i;
+            if (s->generic == generic && s->type == type) {
+                slot = i;
+            }
+        }
+
+        if (slot == NOT_PLACED) {
+            if (globals->count == globals->capacity) {
+                globals->capacity = globals->capacity == 0 ? 8 : globals->capacity * 2;
+                globals->specializations = realloc(globals->specializations, sizeof(struct specialization) * globals->capacity);
+            }
+            slot = globals->count++;
+            globals->specializations[slot] = (struct specialization) {
+                .generic = generic,
+                .type = type,
+                .index = NOT_PLACED
+            };
+        }
+    }
+    return slot;
+}
+
+static struct mtr_stmt* analyze_fn(struct mtr_function_decl* stmt, struct validator* validator);
+
+// Copies the generic function with the concrete parameter types, appends it to the globals and checks it.
+// Only ever runs on one thread. Returns the global index of the copy or -1.
+static size_t specialize(size_t slot, struct validator* validator) {
+    struct globals* globals = validator->globals;
+    if (globals->specializations[slot].index != NOT_PLACED) {
+        return globals->specializations[slot].index;
+    }
+
+    struct mtr_function_decl* generic = globals->specializations[slot].generic;
+    struct mtr_function_type* type = (struct mtr_function_type*) globals->specializations[slot].type;
+
+    size_t count = 0;
+    for (size_t i = 0; i < globals->count; ++i) {
+        count += globals->specializations[i].generic == generic && globals->specializations[i].index != NOT_PLACED;
+    }
+
+    if (count == MAX_SPECIALIZATIONS) {
+        mtr_report_error(generic->symbol.token, "Too many specializations of generic function.", validator->source);
+        return -1;
+    }
+
+    struct validator* global = globals->root;
+
+    struct mtr_function_decl* copy;
+    #pragma omp critical (mtr_arena)
+    copy = (struct mtr_function_decl*) mtr_copy_stmt(global->arena, (struct mtr_stmt*) generic);
+    copy->generic = false;
+    copy->symbol.type = (struct mtr_type*) type;
+    for (u8 i = 0; i < copy->argc; ++i) {
+        copy->argv[i].symbol.type = type->argv[i];
+    }
+
+    // globals are indexed by their position in the block
+    const size_t index = globals->block->size;
+    global->count = index + 1;
+    copy->symbol.index = index;
+    #pragma omp critical (mtr_arena)
+    mtr_block_append(global->arena, globals->block, (struct mtr_stmt*) copy);
+
+    // placed before the body is checked so recursive calls find it
+    globals->specializations[slot].index = index;
+
+    struct mtr_stmt* checked = analyze_fn(copy, global);
+    globals->block->statements[index] = checked;
+    if (checked == NULL) {
+        mtr_report_message(generic->symbol.token, "While specializing this function.", validator->source);
+        return -1;
+    }
+    return index;
+}
+
+// Calls to generic functions are redirected to a copy specialized for the argument types.
+static struct mtr_type* generic_call(struct mtr_call* call, struct mtr_function_decl* generic, struct validator* validator) {
+    struct mtr_function_type* g = (struct mtr_function_type*) generic->symbol.type;
+    if (g->argc > call->argc) {
+        expr_error(call->callable, "Expected more arguments.", validator->source);
+        return NULL;
+    } else if (g->argc < call->argc) {
+        expr_error(call->callable, "Too many arguments.", validator->source);
+        return NULL;
+    }
+
+    struct mtr_type* argv[UINT8_MAX];
+    for (u8 i = 0; i < call->argc; ++i) {
+        struct mtr_expr* a = call->argv[i];
+        struct mtr_type* from = analyze_expr(a, validator);
+        TYPE_CHECK(from);
+
+        struct mtr_type* to = g->argv[i];
+        if (to->type == MTR_DATA_ANY) {
+            argv[i] = from;
+            continue;
+        }
+
+        if (!check_assignemnt(to, from)) {
+            expr_error(a, "Wrong type of argument.", validator->source);
+            return NULL;
+        }
+        call->argv[i] = tag_variant(a, to, from, validator);
+        argv[i] = to;
+    }
+
+    struct mtr_type* type = mtr_type_list_register_function(validator->type_list, g->return_, argv, call->argc);
+    const size_t slot = find_specialization(validator->globals, generic, type);
+
+    struct mtr_primary* callee = (struct mtr_primary*) call->callable;
+    callee->symbol.type = type;
+    callee->symbol.is_global = true;
+    callee->symbol.upvalue = false;
+
+    struct pending_calls* pending = validator->pending;
+    if (pending) {
+        // the index is filled in when the specialization is placed
+        if (pending->count == pending->capacity) {
+            pending->capacity = pending->capacity == 0 ? 8 : pending->capacity * 2;
+            pending->calls = realloc(pending->calls, sizeof(struct pending_call) * pending->capacity);
+        }
+        pending->calls[pending->count++] = (struct pending_call) { .callee = callee, .specialization = slot };
+        return g->return_;
+    }
+
+    const size_t index = specialize(slot, validator);
+    if (index == (size_t) -1) {
+        return NULL;
+    }
+    callee->symbol.index = index;
+    return g->return_;
+}
+
+// Natives return whatever tag is in their value, so calls that return a union tag the result again from its type at run time
+static struct mtr_type* tag_result(struct mtr_call* call, struct mtr_type* type) {
+    if (type && type->type == MTR_DATA_UNION) {
+        call->returns = (const struct mtr_union_type*) type;
+    }
+    return type;
+}
+
 static struct mtr_type* analyze_call(struct mtr_call* call, struct validator* validator) {
+    if (call->callable->type == MTR_EXPR_PRIMARY) {
+        struct mtr_primary* p = (struct mtr_primary*) call->callable;
+        struct mtr_symbol* s = find_symbol(validator, p->symbol.token);
+        struct mtr_function_decl* generic = s ? get_generic(validator, s) : NULL;
+        if (generic) {
+            return tag_result(call, generic_call(call, generic, validator));
+        }
+    }
+
     struct mtr_type* type = analyze_expr(call->callable, validator);
     TYPE_CHECK(type);
 
     if (type->type == MTR_DATA_FN) {
-        return function_call(call, type, validator);
+        return tag_result(call, function_call(call, type, validator));
     }
 
     expr_error(call->callable, "Expression is not callable.", validator->source);
@@ -460,6 +816,7 @@ static struct mtr_type* analyze_expr(struct mtr_expr* expr, struct validator* va
     case MTR_EXPR_SUBSCRIPT: return analyze_subscript((struct mtr_access*) expr, validator);
     case MTR_EXPR_ACCESS: return analyze_access((struct mtr_access*) expr, validator);
     case MTR_EXPR_CAST:     IMPLEMENT return NULL;
+    case MTR_EXPR_VARIANT:  return analyze_expr(((struct mtr_variant*) expr)->value, validator);
     }
     MTR_ASSERT(false, "Invalid stmt type.");
     return NULL;
@@ -476,6 +833,16 @@ static bool load_fn(struct mtr_function_decl* stmt, struct validator* validator)
     }
 
     stmt->symbol.index = i;
+
+    struct mtr_function_type* type = (struct mtr_function_type*) stmt->symbol.type;
+    for (u8 a = 0; a < type->argc; ++a) {
+        stmt->generic = stmt->generic || type->argv[a]->type == MTR_DATA_ANY;
+    }
+
+    if (stmt->generic && type->return_->type == MTR_DATA_ANY) {
+        mtr_report_error(stmt->symbol.token, "Generic functions need a concrete return type.", validator->source);
+        return false;
+    }
     return true;
 }
 
@@ -503,12 +870,9 @@ static struct mtr_stmt* analyze(struct mtr_stmt* stmt, struct validator* validat
 #undef INVALID_RETURN_VALUE
 #define INVALID_RETURN_VALUE sanitize_stmt(stmt, false)
 
+// failed statements are dropped. They stay in the arena until the ast is deleted
 static struct mtr_stmt* sanitize_stmt(void* stmt, bool condition) {
-    if (!condition) {
-        mtr_free_stmt(stmt);
-        return NULL;
-    }
-    return stmt;
+    return condition ? stmt : NULL;
 }
 
 static struct mtr_stmt* analyze_block(struct mtr_block* block, struct validator* validator) {
@@ -541,6 +905,9 @@ static struct mtr_stmt* analyze_scope(struct mtr_block* block, struct validator*
 static struct mtr_stmt* analyze_variable(struct mtr_variable* decl, struct validator* validator) {
     bool expr = true;
     struct mtr_type* value_type = decl->value == NULL ? NULL : analyze_expr(decl->value, validator);
+    if (decl->value && value_type == NULL) {
+        return sanitize_stmt(decl, false);
+    }
 
     if (!decl->symbol.type) {
         decl->symbol.type = value_type;
@@ -552,14 +919,15 @@ static struct mtr_stmt* analyze_variable(struct mtr_variable* decl, struct valid
         MTR_ASSERT(name != NULL, "Type not loaded");
 
         // Create an expression for the constructor
-        struct mtr_primary* primary = malloc(sizeof(struct mtr_primary));
+        struct mtr_primary* primary = allocate(validator, sizeof(struct mtr_primary));
         primary->expr_.type = MTR_EXPR_PRIMARY;
         primary->symbol = *name;
 
-        struct mtr_call* call = malloc(sizeof (struct mtr_call));
+        struct mtr_call* call = allocate(validator, sizeof(struct mtr_call));
         call->expr_.type = MTR_EXPR_CALL;
         call->callable = (struct mtr_expr*) primary;
         call->argv = NULL;
+        call->returns = NULL;
         call->argc = 0;
 
         decl->value = (struct mtr_expr*)call;
@@ -570,6 +938,8 @@ static struct mtr_stmt* analyze_variable(struct mtr_variable* decl, struct valid
         if (!check_assignemnt(decl->symbol.type, value_type)) {
             mtr_report_error(decl->symbol.token, "Invalid assignement to variable of different type", validator->source);
             expr = false;
+        } else {
+            decl->value = tag_variant(decl->value, decl->symbol.type, value_type, validator);
         }
     }
 
@@ -594,7 +964,9 @@ static struct mtr_stmt* analyze_function_no_validator(struct mtr_function_decl*
     struct mtr_stmt* checked = analyze(stmt->body, validator);
     stmt->body = checked;
 
-    all_ok = checked != NULL && all_ok;
+    if (checked == NULL) {
+        return sanitize_stmt(stmt, false);
+    }
 
     struct mtr_function_type* type =  (struct mtr_function_type*) stmt->symbol.type;
     struct mtr_stmt* last = NULL;
@@ -634,14 +1006,11 @@ static struct mtr_stmt* analyze_assignment(struct mtr_assignment* stmt, struct v
         struct mtr_primary* p = (struct mtr_primary*) stmt->right;
         struct mtr_symbol* s = find_symbol(validator, p->symbol.token);
         if (NULL == s) {
-            struct mtr_variable* v = malloc(sizeof(struct mtr_variable));
+            struct mtr_variable* v = allocate(validator, sizeof(struct mtr_variable));
             v->stmt.type = MTR_STMT_VAR;
             v->symbol.token = p->symbol.token;
             v->symbol.type = NULL;
             v->value = stmt->expression;
-
-            mtr_free_expr((struct mtr_expr*) p);
-            free(stmt);
             return analyze_variable(v, validator);
         }
     }
@@ -661,6 +1030,8 @@ static struct mtr_stmt* analyze_assignment(struct mtr_assignment* stmt, struct v
     if (!check_assignemnt(right_t, expr_t)) {
         expr_error(stmt->right, "Invalid assignement to variable of different type", validator->source);
         expr_ok = false;
+    } else {
+        stmt->expression = tag_variant(stmt->expression, right_t, expr_t, validator);
     }
 
     return sanitize_stmt(stmt, expr_ok);
@@ -690,7 +1061,7 @@ static struct mtr_stmt* analyze_if(struct mtr_if* stmt, struct validator* valida
         struct validator otherwise;
         init_validator(&otherwise, validator);
         struct mtr_stmt* e_checked = analyze(stmt->otherwise, &otherwise);
-        stmt->then = e_checked;
+        stmt->otherwise = e_checked;
         e_ok = e_checked != NULL;
         delete_validator(&otherwise);
     }
@@ -717,6 +1088,155 @@ static struct mtr_stmt* analyze_while(struct mtr_while* stmt, struct validator*
     return sanitize_stmt(stmt, condition_ok && body_ok);
 }
 
+static bool load_binding(struct mtr_symbol* symbol, struct mtr_type* type, struct validator* validator) {
+    symbol->type = type;
+    symbol->assignable = true;
+    size_t i = add_symbol(validator, *symbol);
+    if (i == (size_t) -1) {
+        mtr_report_error(symbol->token, "Redefinition of name.", validator->source);
+
+        struct mtr_symbol* s = find_symbol(validator, symbol->token);
+        mtr_report_message(s->token, "Previuosly defined here.", validator->source);
+        return false;
+    }
+    symbol->index = i;
+    return true;
+}
+
+static struct mtr_stmt* analyze_for(struct mtr_for* stmt, struct validator* validator) {
+    struct mtr_type* iterable_t = analyze_expr(stmt->iterable, validator);
+    TYPE_CHECK(iterable_t);
+
+    bool has_second = stmt->second.token.type != MTR_TOKEN_INVALID;
+    struct mtr_type* first_t = NULL;
+    struct mtr_type* second_t = NULL;
+    bool iterable_ok = true;
+
+    if (stmt->end) {
+        struct mtr_type* end_t = analyze_expr(stmt->end, validator);
+        TYPE_CHECK(end_t);
+        if (iterable_t->type != MTR_DATA_INT || end_t->type != MTR_DATA_INT) {
+            expr_error(stmt->iterable, "Range bounds have to be Int.", validator->source);
+            iterable_ok = false;
+        }
+        stmt->kind = MTR_FOR_RANGE;
+        first_t = iterable_t;
+    } else if (iterable_t->type == MTR_DATA_ARRAY) {
+        stmt->kind = MTR_FOR_ARRAY;
+        first_t = ((struct mtr_array_type*) iterable_t)->element;
+    } else if (iterable_t->type == MTR_DATA_MAP) {
+        struct mtr_map_type* m = (struct mtr_map_type*) iterable_t;
+        stmt->kind = MTR_FOR_MAP;
+        first_t = m->key;
+        second_t = m->value;
+    } else {
+        expr_error(stmt->iterable, "Expression is not iterable.", validator->source);
+        iterable_ok = false;
+    }
+
+    if (iterable_ok && has_second && stmt->kind != MTR_FOR_MAP) {
+        mtr_report_error(stmt->second.token, "Only map loops bind a second variable.", validator->source);
+        iterable_ok = false;
+    }
+
+    struct validator loop;
+    init_validator(&loop, validator);
+
+    // the hidden iteration state lives right below the loop variables
+    stmt->slot = (u16) loop.count;
+    loop.count += 2;
+
+    bool vars_ok = iterable_ok;
+    if (iterable_ok) {
+        vars_ok = load_binding(&stmt->first, first_t, &loop);
+        if (stmt->kind == MTR_FOR_MAP) {
+            if (has_second) {
+                vars_ok = load_binding(&stmt->second, second_t, &loop) && vars_ok;
+            } else {
+                loop.count++; // the value slot is written anyway
+            }
+        }
+    }
+
+    bool body_ok = false;
+    if (vars_ok) {
+        struct mtr_stmt* body_checked = analyze(stmt->body, &loop);
+        stmt->body = body_checked;
+        body_ok = body_checked != NULL;
+    }
+    delete_validator(&loop);
+
+    return sanitize_stmt(stmt, vars_ok && body_ok);
+}
+
+static struct mtr_stmt* analyze_match(struct mtr_match* stmt, struct validator* validator) {
+    struct mtr_type* type = analyze_expr(stmt->expr, validator);
+    TYPE_CHECK(type);
+
+    if (type->type != MTR_DATA_UNION) {
+        expr_error(stmt->expr, "Only union values can be matched.", validator->source);
+        return sanitize_stmt(stmt, false);
+    }
+
+    const struct mtr_union_type* u = (const struct mtr_union_type*) type;
+    stmt->variants = u->argc;
+
+    struct validator match;
+    init_validator(&match, validator);
+
+    // the matched value stays on the stack and each case binds its name to it
+    const size_t slot = match.count++;
+
+    bool all_ok = true;
+    u16 covered = 0;
+    for (u16 i = 0; i < stmt->count; ++i) {
+        struct mtr_match_case* c = stmt->cases + i;
+        i32 index = variant_index(u, c->symbol.type);
+        if (index < 0) {
+            c->variant = UINT16_MAX;
+            mtr_report_error(c->symbol.token, "Type is not a member of the union.", validator->source);
+            all_ok = false;
+            continue;
+        }
+        c->variant = (u16) index;
+
+        bool duplicate = false;
+        for (u16 j = 0; j < i && !duplicate; ++j) {
+            duplicate = stmt->cases[j].variant == c->variant;
+        }
+        if (duplicate) {
+            mtr_report_error(c->symbol.token, "Duplicate match case.", validator->source);
+            all_ok = false;
+            continue;
+        }
+        covered++;
+
+        struct validator case_validator;
+        init_validator(&case_validator, &match);
+        case_validator.count = slot;
+        bool bound = load_binding(&c->symbol, c->symbol.type, &case_validator);
+        if (bound) {
+            c->body = analyze(c->body, &case_validator);
+        }
+        all_ok = bound && c->body != NULL && all_ok;
+        delete_validator(&case_validator);
+    }
+
+    if (stmt->otherwise) {
+        struct validator case_validator;
+        init_validator(&case_validator, &match);
+        stmt->otherwise = analyze(stmt->otherwise, &case_validator);
+        all_ok = stmt->otherwise != NULL && all_ok;
+        delete_validator(&case_validator);
+    } else if (covered != u->argc && all_ok) {
+        mtr_report_error(stmt->token, "Match doesn't handle every member of the union.", validator->source);
+        all_ok = false;
+    }
+
+    delete_validator(&match);
+    return sanitize_stmt(stmt, all_ok);
+}
+
 static struct mtr_stmt* analyze_return(struct mtr_return* stmt, struct validator* validator) {
     struct mtr_function_type* t = (struct mtr_function_type*) stmt->from->symbol.type;
     struct mtr_type* type = t->return_;;
@@ -792,6 +1312,8 @@ static struct mtr_stmt* analyze(struct mtr_stmt* stmt, struct validator* validat
     case MTR_STMT_VAR:        return analyze_variable((struct mtr_variable*) stmt, validator);
     case MTR_STMT_IF:         return analyze_if((struct mtr_if*) stmt, validator);
     case MTR_STMT_WHILE:      return analyze_while((struct mtr_while*) stmt, validator);
+    case MTR_STMT_FOR:        return analyze_for((struct mtr_for*) stmt, validator);
+    case MTR_STMT_MATCH:      return analyze_match((struct mtr_match*) stmt, validator);
     case MTR_STMT_RETURN:     return analyze_return((struct mtr_return*) stmt, validator);
     case MTR_STMT_CALL:       return analyze_call_stmt((struct mtr_call_stmt*) stmt, validator);
     case MTR_STMT_STRUCT:     return analyze_struct((struct mtr_struct_decl*) stmt, validator);
@@ -809,7 +1331,11 @@ static struct mtr_stmt* global_analysis(struct mtr_stmt* stmt, struct validator*
     switch (stmt->type)
     {
     case MTR_STMT_NATIVE_FN: return stmt;
-    case MTR_STMT_FN: return analyze_fn((struct mtr_function_decl*) stmt, validator);
+    case MTR_STMT_FN: {
+        struct mtr_function_decl* fn = (struct mtr_function_decl*) stmt;
+        // generic functions are checked when they get specialized
+        return fn->generic ? stmt : analyze_fn(fn, validator);
+    }
     case MTR_STMT_UNION: return stmt;
     case MTR_STMT_STRUCT: return analyze_struct((struct mtr_struct_decl*) stmt, validator);
     default:
@@ -879,31 +1405,140 @@ static bool load_global(struct mtr_stmt* stmt, struct validator* validator) {
     return false;
 }
 
-bool mtr_validate(struct mtr_ast* ast) {
+struct mtr_validator {
     struct validator validator;
-    validator.closure = NULL;
-    mtr_init_symbol_table(&validator.symbols);
-    validator.count = 0;
-    validator.enclosing = NULL;
-    validator.source = ast->source;
-    validator.type_list = &ast->type_list;
+    struct globals globals;
+    bool all_ok;
+};
 
-    bool all_ok = true;
+static void begin(struct mtr_validator* state, struct mtr_ast* ast, int threads) {
+    struct globals* globals = &state->globals;
+    globals->names = ast->names.count + 1;
+    init_scopes(&globals->global_scope, globals->names);
+    globals->locals = calloc(threads > 1 ? threads : 1, sizeof(struct scopes));
+
+    struct validator* validator = &state->validator;
+    validator->closure = NULL;
+    validator->scopes = &globals->global_scope;
+    validator->mark = 0;
+    validator->base = 0;
+    validator->count = 0;
+    validator->enclosing = NULL;
+    validator->source = ast->source;
+    validator->type_list = &ast->type_list;
+    validator->arena = &ast->arena;
 
     struct mtr_block* block = (struct mtr_block*) ast->head;
 
+    globals->block = block;
+    globals->root = validator;
+    globals->specializations = NULL;
+    globals->count = 0;
+    globals->capacity = 0;
+    validator->globals = globals;
+    validator->pending = NULL;
+
+    state->all_ok = true;
     for (size_t i = 0; i < block->size; ++i) {
         struct mtr_stmt* s = block->statements[i];
-        all_ok = load_global(s, &validator);
+        state->all_ok = load_global(s, validator) && state->all_ok;
     }
 
-    for (size_t i = 0; i < block->size; ++i) {
-        struct mtr_stmt* s = block->statements[i];
-        struct mtr_stmt* checked = global_analysis(s, &validator);
-        block->statements[i] = checked;
-        all_ok =  checked != NULL && all_ok;
+    // specializations are appended to the block after the declared globals
+    const size_t declared = block->size;
+    globals->generics = malloc(sizeof(struct mtr_function_decl*) * declared);
+    globals->declared = declared;
+    for (size_t i = 0; i < declared; ++i) {
+        struct mtr_function_decl* fn = (struct mtr_function_decl*) block->statements[i];
+        globals->generics[i] = block->statements[i]->type == MTR_STMT_FN && fn->generic ? fn : NULL;
+    }
+}
+
+static bool end(struct mtr_validator* state, int threads) {
+    for (int i = 0; i < (threads > 1 ? threads : 1); ++i) {
+        delete_scopes(state->globals.locals + i);
     }
+    free(state->globals.locals);
+    delete_scopes(&state->globals.global_scope);
+    free(state->globals.generics);
+    free(state->globals.specializations);
+    return state->all_ok;
+}
+
+bool mtr_validate(struct mtr_ast* ast, int threads) {
+    struct mtr_validator state;
+    begin(&state, ast, threads);
+
+    struct validator* validator = &state.validator;
+    struct mtr_block* block = state.globals.block;
+
+    // Appending specializations can move the statements so the declared ones are read from a copy
+    const size_t declared = state.globals.declared;
+    struct mtr_stmt** statements = malloc(sizeof(struct mtr_stmt*) * declared);
+    memcpy(statements, block->statements, sizeof(struct mtr_stmt*) * declared);
+
+    // Once the globals are loaded every body can be checked on its own. Results and reports
+    // are kept per global and applied in order afterwards, so errors read the same on any number of threads
+    struct mtr_stmt** checked = malloc(sizeof(struct mtr_stmt*) * declared);
+    struct mtr_report_buffer* reports = calloc(declared, sizeof(struct mtr_report_buffer));
+    struct pending_calls* pending = calloc(declared, sizeof(struct pending_calls));
+
+    #pragma omp parallel for schedule(dynamic, 8) num_threads(threads) if(threads > 1 && declared > 32)
+    for (size_t i = 0; i < declared; ++i) {
+        struct validator global = *validator;
+        global.pending = pending + i;
+        mtr_report_buffer_begin(reports + i);
+        checked[i] = global_analysis(statements[i], &global);
+        mtr_report_buffer_end();
+    }
+
+    // Specializations are checked here in the order of their first call, so they get the same
+    // index and report after the same global whichever thread asked for them first
+    for (size_t i = 0; i < declared; ++i) {
+        block->statements[i] = checked[i];
+        state.all_ok = checked[i] != NULL && state.all_ok;
+        mtr_report_buffer_flush(reports + i);
+
+        for (size_t c = 0; c < pending[i].count; ++c) {
+            const struct pending_call call = pending[i].calls[c];
+            const size_t index = specialize(call.specialization, validator);
+            call.callee->symbol.index = index;
+            state.all_ok = index != (size_t) -1 && state.all_ok;
+        }
+        free(pending[i].calls);
+    }
+
+    free(pending);
+    free(reports);
+    free(checked);
+    free(statements);
+    return end(&state, threads);
+}
+
+struct mtr_validator* mtr_validate_begin(struct mtr_ast* ast) {
+    struct mtr_validator* state = malloc(sizeof(struct mtr_validator));
+    begin(state, ast, 1);
+    return state;
+}
+
+size_t mtr_validate_declared(const struct mtr_validator* state) {
+    return state->globals.declared;
+}
+
+bool mtr_validate_global(struct mtr_validator* state, size_t index, struct mtr_arena* arena) {
+    // the body only lives in arena, so the nodes made while checking it go there too
+    struct validator validator = state->validator;
+    validator.arena = arena;
+
+    struct mtr_block* block = state->globals.block;
+    struct mtr_stmt* checked = global_analysis(block->statements[index], &validator);
+    block->statements[index] = checked;
+    state->all_ok = checked != NULL && state->all_ok;
+    return state->all_ok;
+}
 
-    delete_validator(&validator);
+bool mtr_validate_end(struct mtr_validator* state) {
+    bool all_ok = end(state, 1);
+    free(state);
     return all_ok;
 }
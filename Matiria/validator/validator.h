@@ -4,6 +4,18 @@
 #include "AST/AST.h"
 #include "core/types.h"
 
-bool mtr_validate(struct mtr_ast* ast);
+// function bodies are checked on up to 'threads' threads
+bool mtr_validate(struct mtr_ast* ast, int threads);
+
+// Streaming: the globals are loaded once, then each of the declared globals is checked
+// on its own, so a function body only has to exist while it is checked and compiled.
+// Nodes made for a global go to arena, specializations always go to the ast arena.
+struct mtr_validator;
+
+struct mtr_validator* mtr_validate_begin(struct mtr_ast* ast);
+size_t mtr_validate_declared(const struct mtr_validator* validator);
+// false once anything failed, so far
+bool mtr_validate_global(struct mtr_validator* validator, size_t index, struct mtr_arena* arena);
+bool mtr_validate_end(struct mtr_validator* validator);
 
 #endif
@@ -1,8 +1,19 @@
 #include "AST/type.h"
 #include "core/exitCode.h"
+#include "core/lines.h"
 #include "core/log.h"
+#include "core/report.h"
 #include "debug/dump.h"
 #include "launch.h"
+#include "cache.h"
+#include "compiler.h"
+#include "image.h"
+#include "profile.h"
+#include "sampler.h"
+#include "timeline.h"
+#include "tracer.h"
+#include "runtime/engine.h"
+#include "scanner/scanner.h"
 
 #include "AST/typeList.h"
 
@@ -22,6 +33,36 @@
 #   define MTR_PATH(path) "../../../Tests/"path
 #endif
 
+static i64 expected = 0;
+
+static mtr_value expect(u8 argc, mtr_value* argv) {
+    expected = argv->integer;
+    return MTR_NIL;
+}
+
+// compiles and runs a source built by the test. It can report values back through 'fn expect(Int x) ...'
+static enum mtr_exit_code run_source_with(const char* source, const struct mtr_compile_options* options) {
+    struct mtr_package package;
+    mtr_init_package(&package);
+
+    enum mtr_exit_code ec = mtr_compile_with_options(source, &package, options);
+    if (ec == MTR_OK) {
+        mtr_add_io(&package);
+        mtr_package_insert_native_function(&package, (struct mtr_object*) mtr_new_native_function(expect), "expect");
+        struct mtr_engine* engine = malloc(sizeof(*engine));
+        mtr_execute(engine, &package);
+        free(engine);
+    }
+
+    mtr_delete_package(&package);
+    return ec;
+}
+
+static enum mtr_exit_code run_source(const char* source) {
+    const struct mtr_compile_options options = { .cache = NULL };
+    return run_source_with(source, &options);
+}
+
 TEST_CASE(no_file) {
     CHECK(mtr_launch("nofile.mtr") == MTR_FILE_ERROR);
 }
@@ -50,6 +91,1242 @@ TEST_CASE(scope) {
     CHECK(mtr_launch(MTR_PATH("scope.mtr")) == MTR_OK);
 }
 
+TEST_CASE(big_function) {
+    // every statement is 16 bytes of bytecode so the bodies are way past what an i16 jump can reach
+    const char* head = "fn main() {\n Int i := 0;\n Int sum := 0;\n while i < 3: {\n  if i < 10 && i >= 0: {\n";
+    const char* statement = "   sum := sum + 1;\n";
+    const char* tail = "  }\n  i := i + 1;\n }\n expect(sum);\n}\nfn expect(Int x) ...\nfn print(Any x) ...\n";
+    const size_t count = 2500;
+
+    char* source = malloc(strlen(head) + strlen(statement) * count + strlen(tail) + 1);
+    char* c = source;
+    c += sprintf(c, "%s", head);
+    for (size_t i = 0; i < count; ++i) {
+        c += sprintf(c, "%s", statement);
+    }
+    sprintf(c, "%s", tail);
+
+    expected = 0;
+    CHECK(run_source(source) == MTR_OK);
+    CHECK(expected == (i64) (3 * count));
+    free(source);
+}
+
+TEST_CASE(for_loops) {
+    const char* source =
+        "fn main() {\n"
+        "    Int sum := 0;\n"
+        "    for i in 0..10: sum := sum + i;\n"
+        "    for i in 5..5: sum := sum + 1000000;\n"
+        "    [Int] a := [1, 2, 3];\n"
+        "    for x in a: {\n"
+        "        Int twice := x * 2;\n"
+        "        sum := sum + twice * 100;\n"
+        "    }\n"
+        "    [Int, Int] m := {1: 10, 2: 20};\n"
+        "    for k, v in m: sum := sum + k * 10000 + v * 10000;\n"
+        "    for k in m: sum := sum + k;\n"
+        "    expect(sum);\n"
+        "}\n"
+        "fn expect(Int x) ...\n"
+        "fn print(Any x) ...\n";
+
+    expected = 0;
+    CHECK(run_source(source) == MTR_OK);
+    CHECK(expected == 45 + 1200 + 330000 + 3);
+}
+
+TEST_CASE(for_errors) {
+    CHECK(run_source("fn main() { for x in 3: {} }") != MTR_OK);
+    CHECK(run_source("fn main() { for x in 0..1.5: {} }") != MTR_OK);
+    CHECK(run_source("fn main() { [Int] a := [1]; for x, y in a: {} }") != MTR_OK);
+}
+
+TEST_CASE(match) {
+    const char* source =
+        "type Value := [ Int | Float | String | [Int] ]\n"
+        "fn main() {\n"
+        "    Int sum := 0;\n"
+        "    Value v := 4;\n"
+        "    sum := sum + score(v);\n"
+        "    v := 2.5;\n"
+        "    sum := sum + score(v);\n"
+        "    v := 'four';\n"
+        "    sum := sum + score(v);\n"
+        "    sum := sum + score([1, 2, 3]);\n"
+        "    sum := sum + rest(1.5) + rest(7);\n"
+        "    expect(sum);\n"
+        "}\n"
+        "fn score(Value v) -> Int {\n"
+        "    Int r := 0;\n"
+        "    match v: {\n"
+        "        Float f: r := 20;\n"
+        "        Int i: r := i;\n"
+        "        [Int] a: r := 3000;\n"
+        "        String s: { Int x := 400; r := x; }\n"
+        "    }\n"
+        "    return r;\n"
+        "}\n"
+        "fn rest(Value v) -> Int {\n"
+        "    Int r := 0;\n"
+        "    match v: {\n"
+        "        Int i: r := 10000;\n"
+        "        else: r := 100000;\n"
+        "    }\n"
+        "    return r;\n"
+        "}\n"
+        "fn expect(Int x) ...\n"
+        "fn print(Any x) ...\n";
+
+    expected = 0;
+    CHECK(run_source(source) == MTR_OK);
+    CHECK(expected == 4 + 20 + 400 + 3000 + 100000 + 10000);
+}
+
+TEST_CASE(match_errors) {
+    const char* type = "type U := [ Int | Float ]\n";
+    char source[256];
+
+    sprintf(source, "%sfn main() { U u := 1; match u: { Int i: {} } }", type);
+    CHECK(run_source(source) != MTR_OK);
+    sprintf(source, "%sfn main() { U u := 1; match u: { Int i: {} Int j: {} Float f: {} } }", type);
+    CHECK(run_source(source) != MTR_OK);
+    sprintf(source, "%sfn main() { U u := 1; match u: { String s: {} else: {} } }", type);
+    CHECK(run_source(source) != MTR_OK);
+    CHECK(run_source("fn main() { Int x := 1; match x: { Int i: {} } }") != MTR_OK);
+}
+
+static mtr_value seven(u8 argc, mtr_value* argv) {
+    return MTR_INT(7);
+}
+
+static mtr_value half(u8 argc, mtr_value* argv) {
+    mtr_value value = MTR_FLOAT(0.5);
+    value.tag = 1;
+    return value;
+}
+
+TEST_CASE(native_union) {
+    const char* source =
+        "type U := [ String | Int | Float ]\n"
+        "fn seven() -> U ...\n"
+        "fn half() -> U ...\n"
+        "fn expect(Int x) ...\n"
+        "fn score(U u) -> Int {\n"
+        "    Int r := 0;\n"
+        "    match u: {\n"
+        "        String s: r := 1000;\n"
+        "        Int i: r := i;\n"
+        "        Float f: r := 20;\n"
+        "    }\n"
+        "    return r;\n"
+        "}\n"
+        "fn main() { expect(score(seven()) + score(half())); }\n";
+
+    // the natives return an Int tagged 0 and a Float tagged as the Int member
+    struct mtr_package package;
+    mtr_init_package(&package);
+    CHECK(mtr_compile(source, &package) == MTR_OK);
+    mtr_package_insert_native_function(&package, (struct mtr_object*) mtr_new_native_function(seven), "seven");
+    mtr_package_insert_native_function(&package, (struct mtr_object*) mtr_new_native_function(half), "half");
+    mtr_package_insert_native_function(&package, (struct mtr_object*) mtr_new_native_function(expect), "expect");
+    expected = 0;
+    struct mtr_engine* engine = malloc(sizeof(*engine));
+    mtr_execute(engine, &package);
+    free(engine);
+    mtr_delete_package(&package);
+    CHECK(expected == 7 + 20);
+}
+
+TEST_CASE(generics) {
+    const char* source =
+        "fn count(Any items) -> Int {\n"
+        "    Int n := 0;\n"
+        "    for x in items: n := n + 1;\n"
+        "    return n;\n"
+        "}\n"
+        "fn depth(Any x, Int n) -> Int {\n"
+        "    if n < 1: return 0;\n"
+        "    return 1 + depth(x, n - 1);\n"
+        "}\n"
+        "fn main() {\n"
+        "    Int total := count([1, 2, 3]) + count(['a', 'b']) * 10 + count({1: 2}) * 100 + count([4]) * 1000;\n"
+        "    total := total + depth(1.5, 4) * 10000;\n"
+        "    expect(total);\n"
+        "}\n"
+        "fn expect(Int x) ...\n"
+        "fn print(Any x) ...\n";
+
+    expected = 0;
+    CHECK(run_source(source) == MTR_OK);
+    CHECK(expected == 3 + 20 + 100 + 1000 + 40000);
+}
+
+TEST_CASE(generic_errors) {
+    // every level of recursion asks for a new type
+    CHECK(run_source("fn grow(Any x, Int n) -> Int { if n < 1: return 0; return grow([x], n - 1); }\n"
+                     "fn main() { grow(1, 100); }") != MTR_OK);
+    CHECK(run_source("fn id(Any x) -> Any { return x; }\nfn main() { id(1); }") != MTR_OK);
+    CHECK(run_source("fn f(Any x) {}\nfn main() { g := f; }") != MTR_OK);
+}
+
+TEST_CASE(image) {
+    const char* source =
+        "fn expect(Int x) ...\n"
+        "fn print(Any x) ...\n"
+        "type Pair := {\n"
+        "    Int a := 3;\n"
+        "}\n"
+        "fn id(Any x) -> Int { return 7; }\n"
+        "fn make(Int n) -> () -> Int {\n"
+        "    fn twice() -> Int { return n * 2; }\n"
+        "    return twice;\n"
+        "}\n"
+        "fn main() {\n"
+        "    Pair p;\n"
+        "    print('image');\n"
+        "    expect(p.a + make(20)() + id(1.0));\n"
+        "}\n";
+
+    const char* path = "image_test.mtrc";
+    struct mtr_package compiled;
+    mtr_init_package(&compiled);
+    CHECK(mtr_compile_and_save(source, &compiled, path) == MTR_OK);
+    mtr_delete_package(&compiled);
+
+    expected = 0;
+    struct mtr_package package;
+    mtr_init_package(&package);
+    CHECK(mtr_load_image(&package, path) == MTR_OK);
+    CHECK(package.main != NULL);
+    if (package.main) {
+        mtr_add_io(&package);
+        mtr_package_insert_native_function(&package, (struct mtr_object*) mtr_new_native_function(expect), "expect");
+        struct mtr_engine* engine = malloc(sizeof(*engine));
+        mtr_execute(engine, &package);
+        free(engine);
+    }
+    mtr_delete_package(&package);
+    CHECK(expected == 50);
+
+    // a truncated image is rejected
+    FILE* file = fopen(path, "wb");
+    fputs("MTRC", file);
+    fclose(file);
+    mtr_init_package(&package);
+    CHECK(mtr_load_image(&package, path) == MTR_FILE_ERROR);
+    mtr_delete_package(&package);
+    remove(path);
+}
+
+TEST_CASE(parallel_compile) {
+    // enough functions for validation and code generation to be split between threads.
+    // Every function specializes the same generic so threads race for it
+    const size_t count = 200;
+    char* source = malloc(128 * count + 512);
+    char* c = source;
+    c += sprintf(c, "fn twice(Any x) -> Int { return 2; }\n");
+    for (size_t i = 0; i < count; ++i) {
+        c += sprintf(c, "fn f%zu(Int n) -> Int { return n + %zu + twice(%s); }\n", i, i, i % 3 ? (i % 3 == 1 ? "1" : "1.5") : "[1]");
+    }
+    c += sprintf(c, "fn main() {\n    Int sum := 0;\n");
+    for (size_t i = 0; i < count; i += 50) {
+        c += sprintf(c, "    sum := sum + f%zu(1);\n", i);
+    }
+    sprintf(c, "    expect(sum);\n}\nfn expect(Int x) ...\nfn print(Any x) ...\n");
+
+    const struct mtr_compile_options options = { .cache = NULL, .threads = 4 };
+    expected = 0;
+    CHECK(run_source_with(source, &options) == MTR_OK);
+    CHECK(expected == 4 + 0 + 50 + 100 + 150 + 4 * 2);
+
+    // specializations are placed in the order of their first call, whichever thread found it
+    const struct mtr_compile_options serial = { .cache = NULL, .threads = 1 };
+    struct mtr_package packages[2];
+    mtr_init_package(packages + 0);
+    mtr_init_package(packages + 1);
+    CHECK(mtr_compile_with_options(source, packages + 0, &serial) == MTR_OK);
+    CHECK(mtr_compile_with_options(source, packages + 1, &options) == MTR_OK);
+    CHECK(packages[0].count == packages[1].count);
+    for (size_t i = 0; i < packages[0].count && i < packages[1].count; ++i) {
+        struct mtr_function* a = (struct mtr_function*) packages[0].objects[i];
+        struct mtr_function* b = (struct mtr_function*) packages[1].objects[i];
+        CHECK((a == NULL) == (b == NULL));
+        if (a == NULL || b == NULL || a->obj.type != MTR_OBJ_FUNCTION || b->obj.type != MTR_OBJ_FUNCTION) {
+            continue;
+        }
+        CHECK(a->chunk.size == b->chunk.size && memcmp(a->chunk.bytecode, b->chunk.bytecode, a->chunk.size) == 0);
+    }
+    mtr_delete_package(packages + 0);
+    mtr_delete_package(packages + 1);
+
+    // errors in bodies checked on other threads still fail the compilation
+    char* error = strstr(source, "fn f150(Int n) -> Int { return n");
+    error[sizeof("fn f150(Int n) -> Int { return ") - 1] = '\'';
+    error[sizeof("fn f150(Int n) -> Int { return ")] = '\'';
+    CHECK(run_source_with(source, &options) == MTR_TYPE_ERROR);
+    free(source);
+}
+
+static bool exists(const char* path) {
+    FILE* file = fopen(path, "rb");
+    if (file) {
+        fclose(file);
+    }
+    return file != NULL;
+}
+
+TEST_CASE(cache) {
+    const char* sources[] = {
+        "fn expect(Int x) ...\nfn print(Any x) ...\nfn main() { expect(1); }\n",
+        "fn expect(Int x) ...\nfn print(Any x) ...\nfn main() { expect(2); }\n",
+        "fn expect(Int x) ...\nfn print(Any x) ...\nfn main() { expect(3); }\n",
+    };
+    const struct mtr_compile_options options = { .cache = "cache_test", .cache_entries = 2 };
+
+    char* paths[3];
+    for (int i = 0; i < 3; ++i) {
+        paths[i] = mtr_cache_path(options.cache, mtr_cache_key(sources[i], mtr_compile_flags(&options)));
+    }
+
+    // cold, then warm
+    expected = 0;
+    CHECK(run_source_with(sources[0], &options) == MTR_OK);
+    CHECK(expected == 1);
+    CHECK(exists(paths[0]));
+    expected = 0;
+    CHECK(run_source_with(sources[0], &options) == MTR_OK);
+    CHECK(expected == 1);
+
+    // a broken entry is replaced
+    FILE* file = fopen(paths[0], "wb");
+    fputs("garbage", file);
+    fclose(file);
+    expected = 0;
+    CHECK(run_source_with(sources[0], &options) == MTR_OK);
+    CHECK(expected == 1);
+
+    // the cache keeps at most two entries
+    CHECK(run_source_with(sources[1], &options) == MTR_OK);
+    CHECK(run_source_with(sources[2], &options) == MTR_OK);
+    CHECK(expected == 3);
+    CHECK(exists(paths[0]) + exists(paths[1]) + exists(paths[2]) == 2);
+
+    // an entry that can't be written still runs, the next run compiles again
+    char blocker[256];
+    remove(paths[2]);
+    CHECK(mtr_cache_prepare(paths[2]));
+    snprintf(blocker, sizeof(blocker), "%s/blocker", paths[2]);
+    file = fopen(blocker, "wb");
+    fclose(file);
+    expected = 0;
+    CHECK(run_source_with(sources[2], &options) == MTR_OK);
+    CHECK(expected == 3);
+    remove(blocker);
+
+    for (int i = 0; i < 3; ++i) {
+        remove(paths[i]);
+        free(paths[i]);
+    }
+    remove(options.cache);
+}
+
+TEST_CASE(scanner) {
+    // runs longer than a vector, so the wide paths and the scalar tails both get used
+    const char* source =
+        "an_identifier_that_is_longer_than_32_bytes_1\n"
+        "                                        \n\n\t\t"
+        "1234567890123456789012345678901234567 3.14159265358979323846264338327950288 "
+        "'a string literal that is longer than thirty two bytes' "
+        "# a comment that goes on for more than thirty two bytes\n"
+        "x 'unterminated";
+
+    const struct mtr_token expected_tokens[] = {
+        { .type = MTR_TOKEN_IDENTIFIER, .length = 44 },
+        { .type = MTR_TOKEN_INT_LITERAL, .length = 37 },
+        { .type = MTR_TOKEN_FLOAT_LITERAL, .length = 37 },
+        { .type = MTR_TOKEN_STRING_LITERAL, .length = 55 },
+        { .type = MTR_TOKEN_COMMENT, .length = 55 },
+        { .type = MTR_TOKEN_IDENTIFIER, .length = 1 },
+        { .type = MTR_TOKEN_INVALID, .length = 13 }, // unterminated string
+        { .type = MTR_TOKEN_EOF, .length = 0 },
+        { .type = MTR_TOKEN_EOF, .length = 0 }, // and stays there
+    };
+
+    struct mtr_scanner scanner;
+    mtr_scanner_init(&scanner, source);
+    for (size_t i = 0; i < sizeof(expected_tokens) / sizeof(expected_tokens[0]); ++i) {
+        struct mtr_token token = mtr_next_token(&scanner);
+        CHECK(token.type == expected_tokens[i].type && token.length == expected_tokens[i].length);
+    }
+}
+
+TEST_CASE(keywords) {
+    const char* source =
+        "Any type if else true false fn return while for in match import Int Float Bool String "
+        "An types iff els True fals f returns whil fo i matches imports Integer Floa Bo Strings _if";
+
+    const enum mtr_token_type expected_types[] = {
+        MTR_TOKEN_ANY, MTR_TOKEN_TYPE, MTR_TOKEN_IF, MTR_TOKEN_ELSE,
+        MTR_TOKEN_TRUE, MTR_TOKEN_FALSE, MTR_TOKEN_FN, MTR_TOKEN_RETURN,
+        MTR_TOKEN_WHILE, MTR_TOKEN_FOR, MTR_TOKEN_IN, MTR_TOKEN_MATCH, MTR_TOKEN_IMPORT,
+        MTR_TOKEN_INT, MTR_TOKEN_FLOAT, MTR_TOKEN_BOOL, MTR_TOKEN_STRING
+    };
+
+    struct mtr_scanner scanner;
+    mtr_scanner_init(&scanner, source);
+    for (size_t i = 0; i < sizeof(expected_types) / sizeof(expected_types[0]); ++i) {
+        CHECK(mtr_next_token(&scanner).type == expected_types[i]);
+    }
+
+    // near misses are plain identifiers
+    for (int i = 0; i < 18; ++i) {
+        CHECK(mtr_next_token(&scanner).type == MTR_TOKEN_IDENTIFIER);
+    }
+    CHECK(mtr_next_token(&scanner).type == MTR_TOKEN_EOF);
+}
+
+TEST_CASE(stream) {
+    const struct mtr_compile_options options = { .cache = NULL, .stream = true };
+    const char* source =
+        "fn expect(Int x) ...\n"
+        "fn print(Any x) ...\n"
+        "type Pair := {\n"
+        "    Int a := 3;\n"
+        "}\n"
+        "fn main() {\n"
+        "    Pair p;\n"
+        "    expect(p.a + later(2) + count([1, 2]) + count(['}']) + make(20)()); # {\n"
+        "}\n"
+        "fn count(Any items) -> Int {\n"
+        "    Int n := 0;\n"
+        "    for x in items: n := n + 1;\n"
+        "    return n;\n"
+        "}\n"
+        "fn make(Int n) -> () -> Int {\n"
+        "    fn twice() -> Int { return n * 2; }\n"
+        "    return twice;\n"
+        "}\n"
+        "fn later(Int x) -> Int := x * 100;\n";
+
+    expected = 0;
+    CHECK(run_source_with(source, &options) == MTR_OK);
+    CHECK(expected == 3 + 200 + 2 + 1 + 40);
+
+    CHECK(run_source_with("fn main() { Int x := 1.0; }\nfn other() {}", &options) == MTR_TYPE_ERROR);
+    CHECK(run_source_with("fn main() { Int x := ; }\nfn other() { Int y := 'a'; }", &options) == MTR_PARSER_ERROR);
+    CHECK(run_source_with("fn main() { { }\n", &options) == MTR_PARSER_ERROR);
+
+    // a source that fills its pages exactly is still terminated when mapped
+    const char* path = "stream_test.mtr";
+    FILE* file = fopen(path, "wb");
+    const char* main = "fn print(Any x) ...\nfn main() {}\n";
+    fputs(main, file);
+    for (size_t i = strlen(main); i < 4096; ++i) {
+        fputc(i % 64 == 63 ? '\n' : ' ', file);
+    }
+    fclose(file);
+    CHECK(mtr_launch(path) == MTR_OK);
+    remove(path);
+}
+
+TEST_CASE(names) {
+    // the generic reuses names that are in scope where it gets specialized
+    const char* source =
+        "fn expect(Int x) ...\n"
+        "fn print(Any x) ...\n"
+        "fn count(Any items) -> Int {\n"
+        "    Int total := 0;\n"
+        "    for x in items: total := total + 1;\n"
+        "    return total;\n"
+        "}\n"
+        "fn main() {\n"
+        "    Int total := 100;\n"
+        "    { Int a := 1; total := total + a; }\n"
+        "    { Int a := 2; total := total + a; }\n"
+        "    fn outer() -> Int {\n"
+        "        Int b := 10;\n"
+        "        fn inner() -> Int { return b + total; }\n"
+        "        return inner();\n"
+        "    }\n"
+        "    expect(total + count([1, 2, 3]) + outer());\n"
+        "}\n";
+
+    expected = 0;
+    CHECK(run_source(source) == MTR_OK);
+    CHECK(expected == 103 + 3 + 113);
+
+    CHECK(run_source("fn main() { { Int a := 1; } Int b := a; }") == MTR_TYPE_ERROR);
+    CHECK(run_source("fn main() { Int a := 1; { Int a := 2; } }") == MTR_TYPE_ERROR);
+    CHECK(run_source("fn f() {}\nfn main() { Int f := 1; }") == MTR_TYPE_ERROR);
+}
+
+TEST_CASE(incremental) {
+    struct mtr_incremental incremental;
+    mtr_init_incremental(&incremental);
+    const struct mtr_compile_options options = { .cache = NULL, .incremental = &incremental };
+
+    const char* header =
+        "fn expect(Int x) ...\n"
+        "fn print(Any x) ...\n"
+        "type Point := {\n    Int x := 1;,\n    Int y := 2;\n}\n";
+    const char* versions[] = {
+        "fn f() -> Int { return 10; }\n"
+        "fn g() -> Int { Point p; return p.y; }\n"
+        "fn main() { expect(f() + g()); }\n",
+        // only g changed
+        "fn f() -> Int { return 10; }\n"
+        "fn g() -> Int { Point p; return p.x; }\n"
+        "fn main() { expect(f() + g()); }\n",
+        // f and g moved, so main uses different globals
+        "fn h() -> Int { return 1000; }\n"
+        "fn f() -> Int { return 10; }\n"
+        "fn g() -> Int { Point p; return p.x; }\n"
+        "fn main() { expect(f() + g() + h()); }\n",
+    };
+    const i64 results[] = { 12, 11, 1011 };
+    const size_t reused[] = { 0, 2, 2 };
+
+    char source[512];
+    for (int i = 0; i < 3; ++i) {
+        snprintf(source, sizeof(source), "%s%s", header, versions[i]);
+        expected = 0;
+        CHECK(run_source_with(source, &options) == MTR_OK);
+        CHECK(expected == results[i]);
+        CHECK(incremental.reused == reused[i]);
+    }
+
+    // swapping the members of the struct changes what p.x means
+    snprintf(source, sizeof(source), "%s%s", "fn expect(Int x) ...\nfn print(Any x) ...\ntype Point := {\n    Int y := 2;,\n    Int x := 1;\n}\n", versions[2]);
+    expected = 0;
+    CHECK(run_source_with(source, &options) == MTR_OK);
+    CHECK(expected == 1011);
+    CHECK(incremental.reused == 0);
+
+    // a failed compile keeps what the last good one had
+    CHECK(run_source_with("fn main() { Int x := 1.0; }", &options) == MTR_TYPE_ERROR);
+    expected = 0;
+    CHECK(run_source_with(source, &options) == MTR_OK);
+    CHECK(expected == 1011);
+    CHECK(incremental.reused == 4);
+
+    // a new global named like a local of an unchanged function is a redefinition there
+    const char* local = "fn expect(Int x) ...\nfn print(Any x) ...\nfn f() -> Int { Int x := 1; return x; }\nfn main() { expect(f()); }\n";
+    const char* clash = "fn expect(Int x) ...\nfn print(Any x) ...\nfn f() -> Int { Int x := 1; return x; }\nfn main() { expect(f()); }\nfn x() {}\n";
+    CHECK(run_source_with(local, &options) == MTR_OK);
+    CHECK(run_source_with(clash, &options) == MTR_TYPE_ERROR);
+    CHECK(run_source_with(local, &options) == MTR_OK);
+    CHECK(incremental.reused == 2);
+
+    // lazy compiles leave the incremental state alone
+    const size_t kept = incremental.count;
+    const struct mtr_compile_options lazy = { .cache = NULL, .incremental = &incremental, .lazy = true };
+    CHECK(run_source_with(local, &lazy) == MTR_OK);
+    CHECK(incremental.count == kept);
+    CHECK(incremental.reused == 2);
+
+    mtr_delete_incremental(&incremental);
+}
+
+TEST_CASE(lazy) {
+    const struct mtr_compile_options options = { .cache = NULL, .lazy = true };
+    const char* source =
+        "fn expect(Int x) ...\n"
+        "fn print(Any x) ...\n"
+        "fn count(Any items) -> Int {\n"
+        "    Int n := 0;\n"
+        "    for x in items: n := n + 1;\n"
+        "    return n;\n"
+        "}\n"
+        "fn apply(() -> Int f) -> Int {\n"
+        "    return f() + f();\n"
+        "}\n"
+        "fn fib(Int n) -> Int {\n"
+        "    if n < 2: return n;\n"
+        "    return fib(n - 1) + fib(n - 2);\n"
+        "}\n"
+        "fn ten() -> Int { return count([1.0, 2.0]) * 5; }\n"
+        "fn never() { Int x := 'not checked until called'; }\n"
+        "fn main() {\n"
+        "    expect(apply(ten) + fib(10) + count(['a']));\n"
+        "}\n";
+
+    // 'never' is never called, so its body is never checked
+    expected = 0;
+    CHECK(run_source_with(source, &options) == MTR_OK);
+    CHECK(expected == 20 + 55 + 1);
+    CHECK(run_source(source) == MTR_TYPE_ERROR);
+
+    // signatures and main are still checked up front
+    CHECK(run_source_with("fn f(Int x) -> Int { return x; }\nfn main() { Int y := f(1.0); }", &options) == MTR_TYPE_ERROR);
+    CHECK(run_source_with("fn main() { Int x := 1.0; }", &options) == MTR_TYPE_ERROR);
+    CHECK(run_source_with("fn main() { Int x := ; }", &options) == MTR_PARSER_ERROR);
+}
+
+TEST_CASE(type_ids) {
+    struct mtr_type_list list;
+    mtr_type_list_init(&list);
+
+    struct mtr_token int_token = { .type = MTR_TOKEN_INT };
+    struct mtr_token float_token = { .type = MTR_TOKEN_FLOAT };
+    struct mtr_token any_token = { .type = MTR_TOKEN_ANY };
+    struct mtr_type* int_type = mtr_type_list_register_from_token(&list, int_token);
+    struct mtr_type* float_type = mtr_type_list_register_from_token(&list, float_token);
+    struct mtr_type* any_type = mtr_type_list_register_from_token(&list, any_token);
+
+    struct mtr_type* ints = mtr_type_list_register_array(&list, int_type);
+    struct mtr_type* floats = mtr_type_list_register_array(&list, float_type);
+    struct mtr_type* anys = mtr_type_list_register_array(&list, any_type);
+    CHECK(ints == mtr_type_list_register_array(&list, int_type));
+    CHECK(ints->id != floats->id);
+    CHECK(ints->exact && !anys->exact);
+    CHECK(!mtr_type_match(ints, floats));
+    CHECK(mtr_type_match(ints, anys));
+
+    struct mtr_type* argv[] = { ints, float_type };
+    struct mtr_type* fn = mtr_type_list_register_function(&list, int_type, argv, 2);
+    CHECK(fn == mtr_type_list_register_function(&list, int_type, argv, 2));
+    CHECK(fn->exact && mtr_type_match(fn, fn));
+
+    struct mtr_token name = { .type = MTR_TOKEN_IDENTIFIER, .start = "Number", .length = 6 };
+    struct mtr_type* members[] = { int_type, float_type };
+    struct mtr_union_type* number = (struct mtr_union_type*) mtr_type_list_register_union_type(&list, name, members, 2);
+    CHECK(number->members != NULL);
+    CHECK(mtr_union_has_member(number, int_type));
+    CHECK(mtr_union_has_member(number, any_type));
+    CHECK(!mtr_union_has_member(number, ints));
+
+    mtr_type_list_delete(&list);
+}
+
+TEST_CASE(modules) {
+    const char* path = "module_test.mtr";
+    const char* module =
+        "fn expect(Int x) ...\n"
+        "type Point := {\n"
+        "    Int x := 1;,\n"
+        "    Int y := 2;\n"
+        "}\n"
+        "fn factor() -> Int { return 3; }\n"
+        "fn scale(Int x) -> Int { return x * factor(); }\n"
+        "fn report(Int x) { expect(x + 1); }\n"
+        "fn sum(Point p) -> Int { return p.x + p.y; }\n";
+    FILE* file = fopen(path, "wb");
+    fputs(module, file);
+    fclose(file);
+
+    const struct mtr_compile_options options = { .cache = "module_cache" };
+    const struct mtr_compile_options module_options = { .cache = NULL };
+    char* image = mtr_cache_path(options.cache, mtr_cache_key(module, mtr_compile_flags(&module_options)));
+
+    // 'sum' takes a type of the module so it isn't exported and the name is still free
+    const char* source =
+        "import 'module_test.mtr';\n"
+        "fn expect(Int x) ...\n"
+        "fn print(Any x) ...\n"
+        "fn sum(Int a) -> Int { return a; }\n"
+        "fn main() { report(scale(2) + sum(4)); }\n";
+
+    // the first import compiles the module, the second one maps its image
+    for (int i = 0; i < 2; ++i) {
+        expected = 0;
+        CHECK(run_source_with(source, &options) == MTR_OK);
+        CHECK(expected == 2 * 3 + 4 + 1);
+        CHECK(exists(image));
+    }
+
+    CHECK(run_source_with("import 'module_test.mtr';\nfn scale(Int x) -> Int { return x; }\nfn main() {}", &options) == MTR_SCOPE_ERROR);
+    CHECK(run_source_with("import 'module_test.mtr';\nfn main() { Int x := scale(1.0); }", &options) == MTR_TYPE_ERROR);
+    CHECK(run_source_with("import 'no_module.mtr';\nfn main() {}", &options) == MTR_FILE_ERROR);
+
+    remove(image);
+    free(image);
+    remove(options.cache);
+    remove(path);
+}
+
+static int spy_calls = 0;
+
+static mtr_value spy(u8 argc, mtr_value* argv) {
+    spy_calls++;
+    return MTR_INT(0);
+}
+
+static void replace_with_spy(struct mtr_package* package, const char* name) {
+    mtr_delete_object(mtr_package_get_function_by_name(package, name));
+    mtr_package_insert_native_function(package, (struct mtr_object*) mtr_new_native_function(spy), name);
+}
+
+TEST_CASE(fold) {
+    const char* source =
+        "fn expect(Int x) ...\n"
+        "fn print(Any x) ...\n"
+        "fn square(Int x) -> Int { return x * x; }\n"
+        "fn table(Int n) -> [Int, Int] {\n"
+        "    [Int, Int] m;\n"
+        "    for i in 0..n: m[i] := square(i);\n"
+        "    return m;\n"
+        "}\n"
+        "fn names() -> [String] { return ['a', 'bc']; }\n"
+        "fn noisy() -> Int { expect(1000); return 1; }\n"
+        "fn main() {\n"
+        "    [Int, Int] t := table(10);\n"
+        "    Int x := 3;\n"
+        "    expect(t[9] + square(x) + square(4) + noisy());\n"
+        "}\n";
+
+    struct mtr_package package;
+    mtr_init_package(&package);
+    CHECK(mtr_compile(source, &package) == MTR_OK);
+
+    // folded calls never reach the functions, square(x) and noisy() still do
+    replace_with_spy(&package, "square");
+    replace_with_spy(&package, "table");
+    replace_with_spy(&package, "noisy");
+    mtr_package_insert_native_function(&package, (struct mtr_object*) mtr_new_native_function(expect), "expect");
+    mtr_add_io(&package);
+    spy_calls = 0;
+    expected = 0;
+    struct mtr_engine* engine = malloc(sizeof(*engine));
+    mtr_execute(engine, &package);
+    free(engine);
+    mtr_delete_package(&package);
+    CHECK(spy_calls == 2);
+    CHECK(expected == 81 + 0 + 16 + 0);
+
+    // calls that fail or don't end are left for the run
+    const char* failing =
+        "fn at(Int i) -> Int { [Int] a := [1]; return a[i]; }\n"
+        "fn spin() -> Int { while true: {} return 0; }\n"
+        "fn deep(Int n) -> Int { return deep(n + 1); }\n"
+        "fn half(Int n) -> Int { return n / 0; }\n"
+        "fn main() { Int a := at(5) + spin() + deep(0) + half(1); }\n";
+    mtr_init_package(&package);
+    CHECK(mtr_compile(failing, &package) == MTR_OK);
+    mtr_delete_package(&package);
+}
+
+TEST_CASE(profile) {
+    const char* path = "profile_test.txt";
+    const char* source =
+        "fn expect(Int x) ...\n"
+        "fn print(Any x) ...\n"
+        "fn twice(Int x) -> Int := x * 2;\n"
+        "fn add(Int a, Int b) -> Int { return a + twice(b); }\n"
+        "fn main() {\n"
+        "    Int sum := 0;\n"
+        "    for i in 0..100: sum := add(sum, i);\n"
+        "    f := add;\n"
+        "    for i in 0..100: sum := f(sum, i);\n"
+        "    expect(sum);\n"
+        "}\n";
+
+    struct mtr_package package;
+    mtr_init_package(&package);
+    CHECK(mtr_compile(source, &package) == MTR_OK);
+    mtr_package_insert_native_function(&package, (struct mtr_object*) mtr_new_native_function(expect), "expect");
+    mtr_add_io(&package);
+
+    struct mtr_profile counted;
+    mtr_init_profile(&counted);
+    struct mtr_engine* engine = malloc(sizeof(*engine));
+    mtr_execute_with_profile(engine, &package, &counted);
+    CHECK(mtr_write_profile(&counted, &package, path));
+    const u32 main = (u32) mtr_symbol_table_get(&package.symbols, "main", 4)->index;
+    const u32 add = (u32) mtr_symbol_table_get(&package.symbols, "add", 3)->index;
+    mtr_delete_profile(&counted);
+    mtr_delete_package(&package);
+
+    struct mtr_profile profile;
+    mtr_init_profile(&profile);
+    CHECK(mtr_load_profile(&profile, path) == MTR_OK);
+    CHECK(mtr_profile_get(&profile, mtr_profile_site(main, 0)) == 100);
+    CHECK(mtr_profile_get(&profile, mtr_profile_site(main, 1)) == 100);
+    CHECK(mtr_profile_get(&profile, mtr_profile_site(main, 2)) == 1);
+    CHECK(mtr_profile_get(&profile, mtr_profile_site(add, 0)) == 200);
+
+    // Hot calls of globals are inlined, add into main and twice into add. Calls through f still
+    // reach add. The copy of add in main keeps its call of twice, inlined code isn't inlined into
+    const struct mtr_compile_options options = { .cache = NULL, .profile = &profile };
+    const char* spied[] = { "add", "twice", NULL };
+    // spies return 0 instead of the sum or the double
+    const i64 results[] = { 0, 9900, 2 * 9900 };
+    for (int i = 0; i < 3; ++i) {
+        mtr_init_package(&package);
+        CHECK(mtr_compile_with_options(source, &package, &options) == MTR_OK);
+        if (spied[i]) {
+            replace_with_spy(&package, spied[i]);
+        }
+        mtr_package_insert_native_function(&package, (struct mtr_object*) mtr_new_native_function(expect), "expect");
+        mtr_add_io(&package);
+        spy_calls = 0;
+        expected = 0;
+        mtr_execute(engine, &package);
+        CHECK(spy_calls == (spied[i] ? 100 : 0));
+        CHECK(expected == results[i]);
+        mtr_delete_package(&package);
+    }
+    free(engine);
+
+    const struct mtr_compile_options plain = { .cache = NULL };
+    CHECK(mtr_compile_flags(&options) != mtr_compile_flags(&plain));
+    mtr_delete_profile(&profile);
+
+    FILE* file = fopen(path, "wb");
+    fputs("not a profile", file);
+    fclose(file);
+    mtr_init_profile(&profile);
+    CHECK(mtr_load_profile(&profile, path) == MTR_FILE_ERROR);
+    remove(path);
+}
+
+// offset of the first op in the chunk, -1 if there is none
+static i64 find_op(const struct mtr_chunk* chunk, enum mtr_op_code op) {
+    for (const u8* ip = chunk->bytecode; ip < chunk->bytecode + chunk->size; ip = mtr_next_instruction(ip)) {
+        if (*ip == op) {
+            return ip - chunk->bytecode;
+        }
+    }
+    return -1;
+}
+
+TEST_CASE(lines) {
+    const char* source =
+        "fn expect(Int x) ...\n"
+        "fn check(Int a, Int b) -> Int {\n"
+        "    Int n := 0;\n"
+        "    if a <= b: {\n"
+        "        Int m := 1;\n"
+        "        n := m;\n"
+        "    }\n"
+        "    if a != b: n := n + 10;\n"
+        "    return n;\n"
+        "}\n"
+        "fn main() {\n"
+        "    expect(check(1, 2) + check(2, 2) * 100 + check(3, 2) * 1000);\n"
+        "}\n"
+        "fn print(Any x) ...\n";
+
+    struct mtr_line_index index;
+    mtr_init_line_index(&index, source);
+    CHECK(mtr_line_of(&index, source) == 1);
+    CHECK(mtr_line_of(&index, strstr(source, "return")) == 9);
+    CHECK(mtr_line_of(&index, source + strlen(source)) == 15);
+    CHECK(mtr_line_of(&index, "elsewhere") == 0);
+    mtr_delete_line_index(&index);
+
+    const struct mtr_compile_options debug = { .cache = NULL, .debug = true };
+    struct mtr_package package;
+    mtr_init_package(&package);
+    CHECK(mtr_compile_with_options(source, &package, &debug) == MTR_OK);
+    const size_t check = mtr_symbol_table_get(&package.symbols, "check", 5)->index;
+    const struct mtr_chunk* chunk = &((const struct mtr_function*) package.objects[check])->chunk;
+    CHECK(chunk->lines != NULL);
+    CHECK(mtr_chunk_line(chunk, 0) == 3);
+    CHECK(mtr_chunk_line(chunk, (size_t) find_op(chunk, MTR_OP_GREATER_I)) == 4);
+    CHECK(mtr_chunk_line(chunk, (size_t) find_op(chunk, MTR_OP_EQUAL_I)) == 8);
+    CHECK(mtr_chunk_line(chunk, (size_t) find_op(chunk, MTR_OP_RETURN)) == 9);
+    const size_t debug_size = chunk->size;
+    mtr_delete_package(&package);
+
+    // release code fuses the comparisons with their NOT and drops the POP_V after the return
+    const struct mtr_compile_options release = { .cache = NULL };
+    mtr_init_package(&package);
+    CHECK(mtr_compile_with_options(source, &package, &release) == MTR_OK);
+    chunk = &((const struct mtr_function*) package.objects[check])->chunk;
+    CHECK(chunk->lines == NULL);
+    CHECK(mtr_chunk_line(chunk, 0) == 0);
+    CHECK(find_op(chunk, MTR_OP_LESS_EQUAL_I) >= 0);
+    CHECK(find_op(chunk, MTR_OP_NOT_EQUAL_I) >= 0);
+    CHECK(find_op(chunk, MTR_OP_NOT) == -1);
+    CHECK(chunk->bytecode[chunk->size - 1] == MTR_OP_RETURN);
+    CHECK(chunk->size < debug_size);
+    mtr_delete_package(&package);
+
+    expected = 0;
+    CHECK(run_source_with(source, &debug) == MTR_OK);
+    CHECK(expected == 10111);
+    expected = 0;
+    CHECK(run_source_with(source, &release) == MTR_OK);
+    CHECK(expected == 10111);
+    const struct mtr_compile_options debug_stream = { .cache = NULL, .debug = true, .stream = true };
+    const struct mtr_compile_options debug_lazy = { .cache = NULL, .debug = true, .lazy = true };
+    expected = 0;
+    CHECK(run_source_with(source, &debug_stream) == MTR_OK);
+    CHECK(expected == 10111);
+    expected = 0;
+    CHECK(run_source_with(source, &debug_lazy) == MTR_OK);
+    CHECK(expected == 10111);
+    CHECK(mtr_compile_flags(&debug) != mtr_compile_flags(&release));
+}
+
+// offset of the first INT with value in the chunk, -1 if there is none
+static i64 find_int(const struct mtr_chunk* chunk, i64 value) {
+    for (const u8* ip = chunk->bytecode; ip < chunk->bytecode + chunk->size; ip = mtr_next_instruction(ip)) {
+        i64 constant;
+        memcpy(&constant, ip + 1, sizeof(i64));
+        if (*ip == MTR_OP_INT && constant == value) {
+            return ip - chunk->bytecode;
+        }
+    }
+    return -1;
+}
+
+TEST_CASE(profile_layout) {
+    const char* path = "profile_layout_test.txt";
+    const char* source =
+        "type V := [ Int | Float | String ]\n"
+        "fn expect(Int x) ...\n"
+        "fn print(Any x) ...\n"
+        "fn pick(Int i) -> Int {\n"
+        "    Int r := 0;\n"
+        "    if i < 90: r := 1; else r := 100;\n"
+        "    return r;\n"
+        "}\n"
+        "fn kind(V v) -> Int {\n"
+        "    Int r := 0;\n"
+        "    match v: {\n"
+        "        Int i: r := 1;\n"
+        "        Float f: r := 10;\n"
+        "        String s: r := 1000;\n"
+        "    }\n"
+        "    return r;\n"
+        "}\n"
+        "fn main() {\n"
+        "    Int sum := 0;\n"
+        "    for i in 0..100: {\n"
+        "        V v := 1.5;\n"
+        "        if i < 5: v := i;\n"
+        "        sum := sum + pick(i) + kind(v);\n"
+        "    }\n"
+        "    expect(sum);\n"
+        "}\n";
+
+    struct mtr_package package;
+    mtr_init_package(&package);
+    CHECK(mtr_compile(source, &package) == MTR_OK);
+    mtr_package_insert_native_function(&package, (struct mtr_object*) mtr_new_native_function(expect), "expect");
+    mtr_add_io(&package);
+
+    struct mtr_profile counted;
+    mtr_init_profile(&counted);
+    struct mtr_engine* engine = malloc(sizeof(*engine));
+    expected = 0;
+    mtr_execute_with_profile(engine, &package, &counted);
+    CHECK(expected == 90 + 1000 + 5 + 950);
+    CHECK(mtr_write_profile(&counted, &package, path));
+    const u32 pick = (u32) mtr_symbol_table_get(&package.symbols, "pick", 4)->index;
+    const u32 kind = (u32) mtr_symbol_table_get(&package.symbols, "kind", 4)->index;
+    mtr_delete_profile(&counted);
+    mtr_delete_package(&package);
+
+    struct mtr_profile profile;
+    mtr_init_profile(&profile);
+    CHECK(mtr_load_profile(&profile, path) == MTR_OK);
+    CHECK(mtr_profile_get(&profile, mtr_profile_branch(pick, 0, true)) == 10);
+    CHECK(mtr_profile_get(&profile, mtr_profile_branch(pick, 0, false)) == 90);
+    CHECK(mtr_profile_get(&profile, mtr_profile_variant(kind, 0, 0)) == 5);
+    CHECK(mtr_profile_get(&profile, mtr_profile_variant(kind, 0, 1)) == 95);
+    CHECK(mtr_profile_get(&profile, mtr_profile_variant(kind, 0, 2)) == 0);
+
+    // The condition of pick is mostly true, so it is negated and the then arm goes where the jump lands.
+    // Floats are matched most, their case goes last where it needs no jump to the end
+    const struct mtr_compile_options options = { .cache = NULL, .profile = &profile };
+    mtr_init_package(&package);
+    CHECK(mtr_compile_with_options(source, &package, &options) == MTR_OK);
+    const struct mtr_chunk* chunk = &((const struct mtr_function*) package.objects[pick])->chunk;
+    CHECK(find_op(chunk, MTR_OP_GREATER_EQUAL_I) >= 0);
+    CHECK(find_op(chunk, MTR_OP_LESS_I) == -1);
+    CHECK(find_int(chunk, 100) < find_int(chunk, 1));
+    chunk = &((const struct mtr_function*) package.objects[kind])->chunk;
+    CHECK(find_int(chunk, 1) < find_int(chunk, 1000));
+    CHECK(find_int(chunk, 1000) < find_int(chunk, 10));
+
+    mtr_package_insert_native_function(&package, (struct mtr_object*) mtr_new_native_function(expect), "expect");
+    mtr_add_io(&package);
+    expected = 0;
+    mtr_execute(engine, &package);
+    CHECK(expected == 90 + 1000 + 5 + 950);
+    mtr_delete_package(&package);
+    mtr_delete_profile(&profile);
+    free(engine);
+    remove(path);
+}
+
+static u32 inspected_lines[2];
+static int inspected_count;
+
+// the line a runtime error in the division of the closure would report
+static mtr_value inspect(u8 argc, mtr_value* argv) {
+    const struct mtr_closure* c = (const struct mtr_closure*) MTR_AS_OBJ(argv[0]);
+    inspected_lines[inspected_count++] = mtr_chunk_line(&c->chunk, (size_t) find_op(&c->chunk, MTR_OP_DIV_I));
+    return MTR_NIL;
+}
+
+TEST_CASE(closure_lines) {
+    const char* source =
+        "fn print(Any x) ...\n"
+        "fn inspect((Int) -> Int f) ...\n"
+        "fn main() {\n"
+        "    Int zero := 0;\n"
+        "    fn divide(Int x) -> Int {\n"
+        "        return x / zero;\n"
+        "    }\n"
+        "    inspect(divide);\n"
+        "    fn outer() -> (Int) -> Int {\n"
+        "        fn inner(Int x) -> Int {\n"
+        "            return x / zero;\n"
+        "        }\n"
+        "        return inner;\n"
+        "    }\n"
+        "    inspect(outer());\n"
+        "}\n";
+
+    // closures borrow the lines of the function they are in, nested ones too
+    const struct mtr_compile_options debug = { .cache = NULL, .debug = true };
+    struct mtr_package package;
+    mtr_init_package(&package);
+    CHECK(mtr_compile_with_options(source, &package, &debug) == MTR_OK);
+    mtr_package_insert_native_function(&package, (struct mtr_object*) mtr_new_native_function(inspect), "inspect");
+    mtr_add_io(&package);
+    struct mtr_engine* engine = malloc(sizeof(*engine));
+    inspected_count = 0;
+    mtr_execute(engine, &package);
+    CHECK(inspected_count == 2);
+    CHECK(inspected_lines[0] == 6);
+    CHECK(inspected_lines[1] == 11);
+    free(engine);
+    mtr_delete_package(&package);
+}
+
+// what reporting an error on the length characters at prints
+static char* report_at(const char* source, const char* at, u32 length) {
+    struct mtr_token token = { .type = MTR_TOKEN_IDENTIFIER, .start = at, .length = length };
+    struct mtr_report_buffer buffer = { NULL, 0, 0 };
+    mtr_report_buffer_begin(&buffer);
+    mtr_report_error(token, "Test.", source);
+    mtr_report_buffer_end();
+    return buffer.data;
+}
+
+TEST_CASE(reports) {
+    const char* source = "fn main() {\n    Int x := y;\n}\n";
+
+    const char* y = strchr(source, 'y');
+    char* alone = report_at(source, y, 1);
+    CHECK(strstr(alone, "[2:13]") != NULL);
+
+    // reports of a session share the line index and read the same
+    mtr_report_begin_source(source);
+    char* shared = report_at(source, y, 1);
+    char* end = report_at(source, source + strlen(source), 0);
+    mtr_report_begin_source(source);
+    mtr_report_end_source(source);
+    char* again = report_at(source, y, 1);
+    mtr_report_end_source(source);
+    CHECK(strcmp(alone, shared) == 0);
+    CHECK(strcmp(alone, again) == 0);
+    CHECK(strstr(end, "[3:0]") != NULL);
+    free(alone);
+    free(shared);
+    free(end);
+    free(again);
+
+    // the end of an empty source
+    const char* nothing = "";
+    char* empty = report_at(nothing, nothing, 0);
+    CHECK(strstr(empty, "[1:0]") != NULL);
+    free(empty);
+}
+
+TEST_CASE(sampler) {
+    const char* path = "samples_test.txt";
+    const char* source =
+        "fn print(Any x) ...\n"
+        "fn hot(Int x) -> Int {\n"
+        "    Int sum := 0;\n"
+        "    for i in 0..x: sum := sum + i;\n"
+        "    return sum;\n"
+        "}\n"
+        "fn main() {\n"
+        "    Int sum := 0;\n"
+        "    for i in 0..200: sum := sum + hot(i);\n"
+        "}\n";
+
+    struct mtr_package package;
+    mtr_init_package(&package);
+    CHECK(mtr_compile(source, &package) == MTR_OK);
+    mtr_add_io(&package);
+
+    // without a timer every MTR_SAMPLE_PERIOD-th call or jump is a sample
+    struct mtr_sampler sampler;
+    mtr_init_sampler(&sampler, 0);
+    struct mtr_engine* engine = malloc(sizeof(*engine));
+    mtr_execute_with_sampler(engine, &package, &sampler);
+    // the loop in hot jumps back at least 0 + 1 + ... + 199 times, main 200 times and calls hot 200 times
+    const u64 samples = sampler.samples;
+    CHECK(samples >= (199 * 200 / 2 + 200 + 200) / MTR_SAMPLE_PERIOD);
+    CHECK(mtr_write_samples(&sampler, &package, path));
+    mtr_delete_sampler(&sampler);
+
+    // a plain run afterwards doesn't sample
+    mtr_execute(engine, &package);
+    CHECK(engine->sampler == NULL);
+    mtr_delete_package(&package);
+    free(engine);
+
+    FILE* file = fopen(path, "rb");
+    char line[256];
+    u64 total = 0;
+    bool hot = false;
+    while (fgets(line, sizeof(line), file)) {
+        char* count = strrchr(line, ' ');
+        CHECK(count != NULL);
+        CHECK(strncmp(line, "main", 4) == 0);
+        hot = hot || strncmp(line, "main;hot ", 9) == 0;
+        total += strtoull(count + 1, NULL, 10);
+    }
+    fclose(file);
+    remove(path);
+    CHECK(hot);
+    CHECK(total == samples);
+}
+
+// whether the file at path has text in it
+static bool file_contains(const char* path, const char* text) {
+    FILE* file = fopen(path, "rb");
+    if (file == NULL) {
+        return false;
+    }
+
+    char content[16384];
+    const size_t size = fread(content, 1, sizeof(content) - 1, file);
+    content[size] = '\0';
+    fclose(file);
+    return strstr(content, text) != NULL;
+}
+
+TEST_CASE(tracer) {
+    const char* table = "trace_test.txt";
+    const char* json = "trace_test.json";
+    const char* source =
+        "fn expect(Int x) ...\n"
+        "fn print(Any x) ...\n"
+        "fn sum(Int n) -> Int {\n"
+        "    if n < 1: return 0;\n"
+        "    return n + sum(n - 1);\n"
+        "}\n"
+        "fn adder(Int n) -> (Int) -> Int {\n"
+        "    fn add(Int x) -> Int { return x + n; }\n"
+        "    return add;\n"
+        "}\n"
+        "fn size(Any items) -> Int {\n"
+        "    Int n := 0;\n"
+        "    for x in items: n := n + 1;\n"
+        "    return n;\n"
+        "}\n"
+        "fn main() {\n"
+        "    Int total := 0;\n"
+        "    Int sizes := 0;\n"
+        "    for i in 0..10: {\n"
+        "        f := adder(i);\n"
+        "        total := f(total) + sum(i);\n"
+        "        sizes := sizes + size([i]);\n"
+        "    }\n"
+        "    expect(total + sizes * 1000);\n"
+        "}\n";
+
+    struct mtr_package package;
+    mtr_init_package(&package);
+    CHECK(mtr_compile(source, &package) == MTR_OK);
+    mtr_package_insert_native_function(&package, (struct mtr_object*) mtr_new_native_function(expect), "expect");
+    mtr_add_io(&package);
+
+    struct mtr_tracer tracer;
+    mtr_init_tracer(&tracer);
+    struct mtr_engine* engine = malloc(sizeof(*engine));
+    expected = 0;
+    mtr_execute_with_tracer(engine, &package, &tracer);
+    CHECK(expected == 45 + 165 + 10000);
+    CHECK(tracer.depth == 0);
+
+    const struct mtr_trace_entry* main = mtr_trace_get(&tracer, package.main);
+    const struct mtr_trace_entry* sum = mtr_trace_get(&tracer, mtr_package_get_function_by_name(&package, "sum"));
+    const struct mtr_trace_entry* adder = mtr_trace_get(&tracer, mtr_package_get_function_by_name(&package, "adder"));
+    const struct mtr_trace_entry* native = mtr_trace_get(&tracer, mtr_package_get_function_by_name(&package, "expect"));
+    CHECK(main != NULL && main->calls == 1);
+    // sum(i) recurses i + 1 times
+    CHECK(sum != NULL && sum->calls == 10 + 45);
+    CHECK(adder != NULL && adder->calls == 10);
+    CHECK(native != NULL && native->calls == 1);
+
+    // the ten closures share their code
+    u64 closures = 0;
+    u64 exclusive = 0;
+    for (u32 i = 0; i < tracer.count; ++i) {
+        if (tracer.entries[i].type == MTR_OBJ_CLOSURE) {
+            closures += tracer.entries[i].calls;
+        }
+        CHECK(tracer.entries[i].inclusive >= tracer.entries[i].exclusive);
+        exclusive += tracer.entries[i].exclusive;
+    }
+    CHECK(tracer.count == 6);
+    CHECK(closures == 10);
+    CHECK(exclusive == main->inclusive);
+    CHECK(sum->inclusive <= main->inclusive);
+
+    CHECK(mtr_write_trace_table(&tracer, &package, table));
+    CHECK(mtr_write_trace_json(&tracer, &package, json));
+    CHECK(file_contains(table, "function sum"));
+    CHECK(file_contains(table, "native   expect"));
+    CHECK(file_contains(table, "closure  <closure>"));
+    // size([i]) runs a specialization, which goes by the name of the generic function
+    CHECK(file_contains(table, "function size\n"));
+    CHECK(file_contains(json, "{ \"name\": \"adder\", \"kind\": \"function\", \"calls\": 10,"));
+    remove(table);
+    remove(json);
+
+    mtr_delete_tracer(&tracer);
+    mtr_delete_package(&package);
+    free(engine);
+}
+
+TEST_CASE(timeline) {
+    const char* path = "timeline_test.json";
+    CHECK(mtr_launch_with_timeline(MTR_PATH("closure.mtr"), path) == MTR_OK);
+    CHECK(file_contains(path, "{\"displayTimeUnit\": \"ms\", \"traceEvents\": [\n"));
+    CHECK(file_contains(path, "{\"name\": \"read file\", \"cat\": \"launch\", \"ph\": \"X\""));
+    CHECK(file_contains(path, "{\"name\": \"scan and parse\", \"cat\": \"compile\""));
+    CHECK(file_contains(path, "{\"name\": \"validate\", \"cat\": \"compile\""));
+    CHECK(file_contains(path, "{\"name\": \"load package\", \"cat\": \"compile\""));
+    CHECK(file_contains(path, "{\"name\": \"closure_inside_closure\", \"cat\": \"codegen\""));
+    CHECK(file_contains(path, "{\"name\": \"closure_inside_closure\", \"cat\": \"run\""));
+    CHECK(file_contains(path, "{\"name\": \"<closure>\", \"cat\": \"run\""));
+    CHECK(file_contains(path, "{\"name\": \"print\", \"cat\": \"run\""));
+    CHECK(file_contains(path, "{\"name\": \"main\", \"cat\": \"run\""));
+    CHECK(file_contains(path, "{\"name\": \"collect\", \"cat\": \"gc\""));
+    CHECK(file_contains(path, "}\n]}\n"));
+    remove(path);
+
+    // without a timeline nothing is recorded
+    struct mtr_package package;
+    mtr_init_package(&package);
+    struct mtr_timeline timeline;
+    mtr_init_timeline(&timeline);
+    const struct mtr_compile_options options = { .cache = NULL, .timeline = &timeline };
+    CHECK(mtr_compile_with_options("fn main() {}\n", &package, &options) == MTR_OK);
+    CHECK(timeline.count > 0);
+    const size_t compiled = timeline.count;
+    struct mtr_engine* engine = malloc(sizeof(*engine));
+    mtr_execute(engine, &package);
+    CHECK(timeline.count == compiled);
+    mtr_execute_with_timeline(engine, &package, &timeline);
+    CHECK(timeline.count == compiled + 2);
+    free(engine);
+    mtr_delete_package(&package);
+    mtr_delete_timeline(&timeline);
+}
+
 static void all_tests() {
     no_file();
     parser();
@@ -59,6 +1336,34 @@ static void all_tests() {
     closure();
     user_types();
     scope();
+    big_function();
+    for_loops();
+    for_errors();
+    match();
+    match_errors();
+    native_union();
+    generics();
+    generic_errors();
+    image();
+    cache();
+    parallel_compile();
+    scanner();
+    keywords();
+    stream();
+    names();
+    type_ids();
+    incremental();
+    lazy();
+    modules();
+    fold();
+    profile();
+    lines();
+    profile_layout();
+    closure_lines();
+    reports();
+    sampler();
+    tracer();
+    timeline();
     REPORT();
 }
 
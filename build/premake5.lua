@@ -1,3 +1,8 @@
+newoption {
+	trigger				= 'opstats',
+	description			= 'Count what the engine runs, see runtime/opstats.h'
+}
+
 output_dir = '%{cfg.buildcfg}_%{cfg.architecture}_%{cfg.system}'
 
 workspace 'Matiria'
@@ -11,6 +16,7 @@ workspace 'Matiria'
 	exceptionhandling	'Off'
 	warnings			'Extra'
 	floatingpoint		'Fast'
+	openmp				'On'
 	staticruntime		'On'
 	files				{
 							'%{prj.name}/**.c',
@@ -36,6 +42,9 @@ workspace 'Matiria'
 		flags			'LinkTimeOptimization'
 		defines			'NDEBUG'
 
+	filter 'options:opstats'
+		defines			'MTR_OPCODE_STATS'
+
 	filter "system:windows"
 		systemversion "latest"
 
@@ -52,3 +61,9 @@ project 'Tests'
 	kind				'ConsoleApp'
 	includedirs			{ '', '%{prj.name}', 'Matiria' }
 	links				'Matiria'
+
+project 'Bench'
+	location			'%{prj.name}'
+	kind				'ConsoleApp'
+	includedirs			{ '', '%{prj.name}', 'Matiria' }
+	links				'Matiria'